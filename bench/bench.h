@@ -0,0 +1,92 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+
+/* Timing shared by the micro benchmarks. Every case prints one line of tab
+ * separated fields:
+ *   name ops ns_per_op ops_per_s p50_ns p99_ns p999_ns
+ * Lines starting with # are comments, so runs of two commits can be
+ * compared with diff or awk. ns/op and ops/s come from a run of all ops
+ * timed as a whole, the percentiles from a second run timing every op on
+ * its own, less the cost of reading the clock. */
+
+typedef void (*bench_op_fn)(void *arg);
+
+static uint64_t bench_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static int bench_compare(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+/* Median cost of reading the clock twice in a row */
+static uint64_t bench_clock_overhead_ns(void) {
+    static uint64_t overhead;
+    uint64_t samples[1001];
+    uint32_t i;
+
+    if (overhead) return overhead;
+    for (i = 0; i < 1001; i++) {
+        uint64_t start = bench_now_ns();
+        samples[i] = bench_now_ns() - start;
+    }
+    qsort(samples, 1001, sizeof(uint64_t), bench_compare);
+    overhead = samples[500] ? samples[500] : 1;
+    return overhead;
+}
+
+static void bench_header(const char *title) {
+    printf("# %s\n", title);
+    printf("# name\tops\tns_per_op\tops_per_s\tp50_ns\tp99_ns\tp999_ns\n");
+    fflush(stdout);
+}
+
+static void bench_run(const char *name, bench_op_fn op, void *arg, uint32_t ops) {
+    uint64_t *samples;
+    uint64_t overhead = bench_clock_overhead_ns();
+    uint64_t start, elapsed;
+    double ns_per_op;
+    uint32_t i;
+
+    if (ops == 0) return;
+    samples = malloc(ops * sizeof(uint64_t));
+    if (!samples) {
+        fprintf(stderr, "%s: out of memory\n", name);
+        return;
+    }
+
+    /* Warm caches, branch predictors and lazily opened files */
+    for (i = 0; i < ops / 10 + 1; i++) op(arg);
+
+    start = bench_now_ns();
+    for (i = 0; i < ops; i++) op(arg);
+    elapsed = bench_now_ns() - start;
+    ns_per_op = (double)elapsed / ops;
+
+    for (i = 0; i < ops; i++) {
+        uint64_t t = bench_now_ns();
+        op(arg);
+        t = bench_now_ns() - t;
+        samples[i] = t > overhead ? t - overhead : 0;
+    }
+    qsort(samples, ops, sizeof(uint64_t), bench_compare);
+
+    printf("%s\t%u\t%.1f\t%.0f\t%llu\t%llu\t%llu\n", name, ops, ns_per_op,
+           ns_per_op > 0.0 ? 1e9 / ns_per_op : 0.0,
+           (unsigned long long)samples[(uint64_t)ops * 50 / 100],
+           (unsigned long long)samples[(uint64_t)ops * 99 / 100],
+           (unsigned long long)samples[(uint64_t)ops * 999 / 1000]);
+    fflush(stdout);
+    free(samples);
+}
+
+#endif
@@ -0,0 +1,121 @@
+#define _GNU_SOURCE
+#include "../compat.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../platform.h"
+#include "../datasource.h"
+#include "../ini_parser.h"
+#include "bench.h"
+
+/* One collect of every local datasource, what a sampling thread pays per
+ * sample, and parsing the config of a 1000 plot dashboard. The handlers
+ * are linked on their own rather than through datasource.c, which would
+ * pull in SNMP, ping and remote. */
+#define BENCH_INI_PLOTS 1000
+
+#ifdef __linux__
+#define BENCH_INTERFACE "lo"
+#else
+#define BENCH_INTERFACE "lo0"
+#endif
+
+extern datasource_handler_t cpu_handler;
+extern datasource_handler_t memory_handler;
+extern datasource_handler_t loadavg_handler;
+extern datasource_handler_t if_thr_handler;
+
+typedef struct {
+    datasource_t ds;
+    double value;
+} bench_collect_t;
+
+static void bench_collect(void *arg) {
+    bench_collect_t *b = (bench_collect_t *)arg;
+    b->ds.handler->collect(b->ds.context, &b->value);
+}
+
+static void bench_ini(void *arg) {
+    ini_free(ini_parse_file((const char *)arg));
+}
+
+static void bench_handler(datasource_handler_t *handler, const char *target, uint32_t ops) {
+    bench_collect_t b;
+    char name[64];
+
+    memset(&b, 0, sizeof(b));
+    b.ds.handler = handler;
+    b.ds.target = (char *)target;
+    snprintf(name, sizeof(name), "datasource_collect/%s", handler->name);
+
+    if (!handler->init(target, &b.ds.context) || !b.ds.context) {
+        fprintf(stderr, "%s: cannot open %s\n", name, target);
+        return;
+    }
+    bench_run(name, bench_collect, &b, ops);
+    handler->cleanup(b.ds.context);
+}
+
+static int bench_write_ini(char *path) {
+    uint32_t i;
+    int fd = mkstemp(path);
+    if (fd < 0) return 0;
+
+    FILE *f = fdopen(fd, "w");
+    if (!f) {
+        close(fd);
+        return 0;
+    }
+
+    fprintf(f, "[global]\n"
+               "default_width=300\n"
+               "default_height=60\n"
+               "columns=10\n"
+               "interval_ms=1000\n"
+               "history_dir=/var/lib/plottool\n"
+               "\n[targets]\n");
+    for (i = 0; i < BENCH_INI_PLOTS; i++) {
+        switch (i % 4) {
+            case 0: fprintf(f, "ping=host%u.example.com\n", i); break;
+            case 1: fprintf(f, "snmp=public@10.0.%u.%u:ifHCInOctets.%u\n", i / 256, i % 256, i % 48); break;
+            case 2: fprintf(f, "if_thr=local,eth%u\n", i % 8); break;
+            default: fprintf(f, "synthetic=random:walk:seed=%u\n", i); break;
+        }
+    }
+    fclose(f);
+    return 1;
+}
+
+int main(int argc, char *argv[]) {
+    const char *interface = argc > 2 ? argv[2] : BENCH_INTERFACE;
+    char if_target[64];
+    char ini_path[32];
+    uint32_t ops = 10000;
+
+    if (argc > 1) {
+        ops = (uint32_t)atoi(argv[1]);
+        if (ops == 0) ops = 1;
+    }
+
+    platform_init();
+
+    bench_header("local datasources and ini parser");
+    bench_handler(&cpu_handler, "local", ops);
+    bench_handler(&memory_handler, "local", ops);
+    bench_handler(&loadavg_handler, "local", ops);
+    snprintf(if_target, sizeof(if_target), "local,%s", interface);
+    bench_handler(&if_thr_handler, if_target, ops);
+
+    strcpy(ini_path, "/tmp/plottool-bench-XXXXXX");
+    if (bench_write_ini(ini_path)) {
+        bench_run("ini_parse_file/1000", bench_ini, ini_path, ops / 50 + 1);
+        unlink(ini_path);
+    } else {
+        fprintf(stderr, "ini_parse_file: cannot write %s\n", ini_path);
+    }
+
+    platform_cleanup();
+    return 0;
+}
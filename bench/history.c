@@ -0,0 +1,130 @@
+#define _GNU_SOURCE
+#include "../compat.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include "../platform.h"
+#include "../ringbuf.h"
+#include "../history.h"
+#include "../decimate.h"
+
+/* Size and speed of the compressed history: bytes per sample against the
+ * 8 of a ring buffer slot, worst error, decode throughput and what a
+ * zoomed out plot costs to build from scratch and to keep up to date. */
+#define BENCH_CHUNK 4096
+#define BENCH_WIDTH 1000
+
+typedef double (*bench_signal_t)(uint32_t n);
+
+static double bench_now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+static uint32_t bench_noise(uint32_t n) {
+    n ^= n >> 16;
+    n *= 0x7feb352d;
+    n ^= n >> 15;
+    n *= 0x846ca68b;
+    n ^= n >> 16;
+    return n;
+}
+
+/* CPU %, slow waves with jitter */
+static double bench_cpu(uint32_t n) {
+    return 30.0 + 25.0 * sin(n * 0.001) + (bench_noise(n) % 1000) / 100.0;
+}
+
+/* Ping RTT in ms, rare spikes and timeouts */
+static double bench_ping(uint32_t n) {
+    uint32_t r = bench_noise(n);
+    if (r % 1000 == 0) return -1.0;
+    if (r % 97 == 0) return 150.0 + (r >> 20) % 200;
+    return 12.0 + (r % 4000) / 1000.0;
+}
+
+/* Interface bytes/s, bursty and wide ranging */
+static double bench_bandwidth(uint32_t n) {
+    uint32_t r = bench_noise(n);
+    return (r % 8 == 0 ? 1e8 : 1e5) * (1.0 + (r >> 8) % 1000 / 100.0);
+}
+
+static void bench_signal(const char *name, bench_signal_t signal, uint32_t samples) {
+    static double values[BENCH_CHUNK];
+    double columns[BENCH_WIDTH], min[BENCH_WIDTH], max[BENCH_WIDTH];
+    history_t *history = history_create(samples);
+    decimate_t *decimate;
+    uint64_t from, first, written;
+    uint32_t n, count, i;
+    double start, push_ms, decode_ms, build_ms, update_ms, worst = 0.0;
+
+    if (!history) {
+        fprintf(stderr, "Failed to create history of %u samples\n", samples);
+        return;
+    }
+
+    start = bench_now_ms();
+    for (n = 0; n < samples; n++) {
+        history_push(history, signal(n));
+    }
+    push_ms = bench_now_ms() - start;
+
+    start = bench_now_ms();
+    for (from = 0; (count = history_read_range(history, from, values, BENCH_CHUNK, &first, &written)) > 0; ) {
+        from = first + count;
+    }
+    decode_ms = bench_now_ms() - start;
+
+    /* Errors decode exactly, values within half a code of their block */
+    for (from = 0; (count = history_read_range(history, from, values, BENCH_CHUNK, &first, &written)) > 0; ) {
+        for (i = 0; i < count; i++) {
+            double error = fabs(values[i] - signal((uint32_t)(first + i)));
+            if (error > worst) worst = error;
+        }
+        from = first + count;
+    }
+
+    decimate = decimate_create(DECIMATE_MINMAX);
+    start = bench_now_ms();
+    decimate_update_history(decimate, history, BENCH_WIDTH, columns, min, max);
+    build_ms = bench_now_ms() - start;
+
+    start = bench_now_ms();
+    for (i = 0; i < 1000; i++) {
+        history_push(history, signal(samples + i));
+        decimate_update_history(decimate, history, BENCH_WIDTH, columns, min, max);
+    }
+    update_ms = (bench_now_ms() - start) / 1000;
+
+    printf("%-9s  %10u  %9.3f  %9.3g  %8.1f  %9.1f  %8.3f  %9.4f\n",
+           name, samples, (double)history_bytes(history) / samples, worst,
+           samples / push_ms / 1000.0, samples / decode_ms / 1000.0, build_ms, update_ms);
+
+    decimate_destroy(decimate);
+    history_destroy(history);
+}
+
+int main(int argc, char *argv[]) {
+    uint32_t samples = 10000000;
+
+    if (argc > 1) {
+        samples = (uint32_t)atoi(argv[1]);
+        if (samples == 0) samples = 1;
+    }
+
+    platform_init();
+
+    printf("%u samples per plot, ring buffer %u bytes per sample, %u wide plot\n\n",
+           samples, (uint32_t)sizeof(double), BENCH_WIDTH);
+    printf("signal        samples  bytes/smp  max error  push M/s  decode M/s  build ms  update ms\n");
+    bench_signal("cpu", bench_cpu, samples);
+    bench_signal("ping", bench_ping, samples);
+    bench_signal("bandwidth", bench_bandwidth, samples);
+
+    platform_cleanup();
+    return 0;
+}
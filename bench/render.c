@@ -0,0 +1,194 @@
+#define _GNU_SOURCE
+#include "../compat.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../platform.h"
+#include "../graphics.h"
+#include "../config.h"
+#include "../plot.h"
+#include "../ringbuf.h"
+
+/* Per-frame cost of a 4K dashboard drawn by the software backend: 5 columns
+ * by 20 rows of 768x96 plots filling 3840x2130, once for every render
+ * thread count from 1 up to the number of CPUs. */
+#define BENCH_COLUMNS 5
+#define BENCH_ROWS 20
+#define BENCH_PLOTS (BENCH_COLUMNS * BENCH_ROWS)
+
+static double bench_now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+static double bench_sample(uint32_t plot, uint32_t n) {
+    if ((n + plot * 31) % 97 == 0) return -1.0;
+    return 50.0 + 40.0 * sin((n + plot * 17) * 0.05) + (double)((n * 7919 + plot) % 10);
+}
+
+static char *bench_write_config(uint32_t threads) {
+    static char path[32];
+    uint32_t i;
+
+    strcpy(path, "/tmp/plottool-bench-XXXXXX");
+    int fd = mkstemp(path);
+    if (fd < 0) return NULL;
+
+    FILE *f = fdopen(fd, "w");
+    if (!f) {
+        close(fd);
+        return NULL;
+    }
+
+    fprintf(f, "[global]\n"
+               "default_width=768\n"
+               "default_height=96\n"
+               "window_margin=5\n"
+               "columns=%d\n"
+               "max_window_height=2160\n"
+               "max_fps=1000000\n"
+               "render_threads=%u\n"
+               "\n[targets]\n", BENCH_COLUMNS, threads);
+    for (i = 0; i < BENCH_PLOTS; i++) {
+        fprintf(f, "shell=bench %u\n", i);
+    }
+    fclose(f);
+    return path;
+}
+
+/* Average cost of one plot_system_update; prepare() sets up what changed */
+static double bench_run(plot_system_t *system, uint32_t frames,
+                        void (*prepare)(plot_system_t *system, uint32_t frame)) {
+    uint32_t frame;
+    double total = 0.0;
+
+    for (frame = 0; frame < frames; frame++) {
+        if (prepare) prepare(system, frame);
+        double start = bench_now_ms();
+        plot_system_update(system);
+        total += bench_now_ms() - start;
+    }
+
+    return total / frames;
+}
+
+static uint32_t sample_counter = 0;
+
+static void prepare_full(plot_system_t *system, uint32_t frame) {
+    (void)frame;
+    system->needs_redraw = 1;
+}
+
+static void prepare_all_plots(plot_system_t *system, uint32_t frame) {
+    uint32_t i;
+    (void)frame;
+    sample_counter++;
+    for (i = 0; i < system->plot_count; i++) {
+        ringbuf_push(system->plots[i].data_buffer, bench_sample(i, sample_counter));
+    }
+}
+
+static void prepare_one_plot(plot_system_t *system, uint32_t frame) {
+    uint32_t i = frame % system->plot_count;
+    sample_counter++;
+    ringbuf_push(system->plots[i].data_buffer, bench_sample(i, sample_counter));
+}
+
+static int bench_dashboard(uint32_t threads, uint32_t frames, int print_size) {
+    uint32_t i, n;
+    int32_t width, height;
+
+    char *config_path = bench_write_config(threads);
+    if (!config_path) {
+        fprintf(stderr, "Failed to write benchmark configuration\n");
+        return 0;
+    }
+
+    config_t *config = config_load(config_path);
+    unlink(config_path);
+    if (!config) {
+        fprintf(stderr, "Failed to load benchmark configuration\n");
+        return 0;
+    }
+
+    plot_system_t *system = plot_system_create(config);
+    if (!system) {
+        fprintf(stderr, "Failed to create plot system\n");
+        config_destroy(config);
+        return 0;
+    }
+
+    for (i = 0; i < system->plot_count; i++) {
+        system->plots[i].data_buffer = ringbuf_create(1);
+        system->plots[i].data_buffer_secondary = NULL;
+        system->plots[i].data_source = NULL;
+        system->plots[i].is_dual = 0;
+        system->plots[i].stats.max_value = 100.0;
+    }
+
+    /* The first update sizes the ring buffers to the plot width */
+    plot_system_update(system);
+    for (i = 0; i < system->plot_count; i++) {
+        ringbuf_t *ring = system->plots[i].data_buffer;
+        for (n = 0; n < ring->size; n++) {
+            ringbuf_push(ring, bench_sample(i, n));
+        }
+    }
+    sample_counter = system->plots[0].data_buffer->size;
+
+    if (print_size) {
+        window_get_size(system->window, &width, &height);
+        printf("dashboard %dx%d, %u plots, %u frames\n\n", width, height, system->plot_count, frames);
+        printf("threads  idle ms  full ms    fps  all plots ms  one plot ms\n");
+    }
+
+    double idle = bench_run(system, frames, NULL);
+    double full = bench_run(system, frames, prepare_full);
+    double all_plots = bench_run(system, frames, prepare_all_plots);
+    double one_plot = bench_run(system, frames, prepare_one_plot);
+
+    printf("%7u  %7.3f  %7.3f  %5.1f  %12.3f  %11.3f\n",
+           threads, idle, full, 1000.0 / full, all_plots, one_plot);
+
+    for (i = 0; i < system->plot_count; i++) {
+        ringbuf_destroy(system->plots[i].data_buffer);
+    }
+    plot_system_destroy(system);
+    config_destroy(config);
+    return 1;
+}
+
+int main(int argc, char *argv[]) {
+    uint32_t frames = 200;
+    uint32_t max_threads = 0;
+    uint32_t threads;
+
+    if (argc > 1) {
+        frames = (uint32_t)atoi(argv[1]);
+        if (frames == 0) frames = 1;
+    }
+    if (argc > 2) {
+        max_threads = (uint32_t)atoi(argv[2]);
+    }
+
+    platform_init();
+    graphics_init();
+
+    if (max_threads == 0) max_threads = platform_cpu_count();
+
+    for (threads = 1; threads <= max_threads; threads *= 2) {
+        if (!bench_dashboard(threads, frames, threads == 1)) return 1;
+        if (threads < max_threads && threads * 2 > max_threads) {
+            if (!bench_dashboard(max_threads, frames, 0)) return 1;
+        }
+    }
+
+    graphics_cleanup();
+    platform_cleanup();
+    return 0;
+}
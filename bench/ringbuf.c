@@ -0,0 +1,131 @@
+#define _GNU_SOURCE
+#include "../compat.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../platform.h"
+#include "../ringbuf.h"
+#include "bench.h"
+
+/* Ring buffer operations on their own and with a second thread pushing,
+ * reading or resizing the same buffer, the way the sampling thread and the
+ * renderer share it. Buffers are the width of a wide plot. */
+#define BENCH_SIZE 4096
+
+typedef struct {
+    ringbuf_t *ringbuf;
+    double *buffer;
+    uint32_t n;
+    uint32_t size;
+} bench_ringbuf_t;
+
+typedef struct {
+    bench_op_fn op;
+    bench_ringbuf_t state;
+    volatile int stop;
+    volatile int started;
+    plot_thread_t *thread;
+} bench_background_t;
+
+static void bench_push(void *arg) {
+    bench_ringbuf_t *b = (bench_ringbuf_t *)arg;
+    ringbuf_push(b->ringbuf, (double)(b->n++ & 1023));
+}
+
+static void bench_snapshot(void *arg) {
+    bench_ringbuf_t *b = (bench_ringbuf_t *)arg;
+    uint32_t count, head, tail;
+    ringbuf_read_snapshot(b->ringbuf, b->buffer, BENCH_SIZE, &count, &head, &tail);
+}
+
+/* Alternates between two sizes so every call moves the data */
+static void bench_resize(void *arg) {
+    bench_ringbuf_t *b = (bench_ringbuf_t *)arg;
+    b->size = b->size == BENCH_SIZE ? BENCH_SIZE * 2 : BENCH_SIZE;
+    ringbuf_resize(b->ringbuf, b->size);
+}
+
+static void bench_background_thread(void *arg) {
+    bench_background_t *bg = (bench_background_t *)arg;
+
+    bg->started = 1;
+    while (!bg->stop) {
+        bg->op(&bg->state);
+    }
+}
+
+static int bench_background_start(bench_background_t *bg, bench_op_fn op, ringbuf_t *ringbuf) {
+    memset(bg, 0, sizeof(*bg));
+    bg->op = op;
+    bg->state.ringbuf = ringbuf;
+    bg->state.size = BENCH_SIZE;
+    bg->state.buffer = malloc(BENCH_SIZE * sizeof(double));
+    if (!bg->state.buffer) return 0;
+
+    bg->thread = plot_thread_create(bench_background_thread, bg);
+    if (!bg->thread) {
+        free(bg->state.buffer);
+        return 0;
+    }
+    while (!bg->started) platform_sleep(1);
+    return 1;
+}
+
+static void bench_background_stop(bench_background_t *bg) {
+    bg->stop = 1;
+    plot_thread_join(bg->thread);
+    plot_thread_destroy(bg->thread);
+    free(bg->state.buffer);
+}
+
+/* op on a fresh full buffer, with background running on it unless NULL */
+static void bench_case(const char *name, bench_op_fn op, bench_op_fn background, uint32_t ops) {
+    bench_ringbuf_t b;
+    bench_background_t bg;
+    uint32_t i;
+
+    memset(&b, 0, sizeof(b));
+    b.ringbuf = ringbuf_create(BENCH_SIZE);
+    b.buffer = malloc(BENCH_SIZE * sizeof(double));
+    b.size = BENCH_SIZE;
+    if (!b.ringbuf || !b.buffer) {
+        fprintf(stderr, "%s: out of memory\n", name);
+        goto cleanup;
+    }
+    for (i = 0; i < BENCH_SIZE; i++) ringbuf_push(b.ringbuf, (double)i);
+
+    if (background && !bench_background_start(&bg, background, b.ringbuf)) {
+        fprintf(stderr, "%s: cannot start thread\n", name);
+        goto cleanup;
+    }
+    bench_run(name, op, &b, ops);
+    if (background) bench_background_stop(&bg);
+
+cleanup:
+    free(b.buffer);
+    if (b.ringbuf) ringbuf_destroy(b.ringbuf);
+}
+
+int main(int argc, char *argv[]) {
+    uint32_t ops = 1000000;
+
+    if (argc > 1) {
+        ops = (uint32_t)atoi(argv[1]);
+        if (ops == 0) ops = 1;
+    }
+
+    platform_init();
+
+    bench_header("ring buffer, name/contender");
+    bench_case("ringbuf_push", bench_push, NULL, ops);
+    bench_case("ringbuf_push/reader", bench_push, bench_snapshot, ops);
+    bench_case("ringbuf_push/resize", bench_push, bench_resize, ops);
+    bench_case("ringbuf_read_snapshot", bench_snapshot, NULL, ops / 100 + 1);
+    bench_case("ringbuf_read_snapshot/writer", bench_snapshot, bench_push, ops / 100 + 1);
+    bench_case("ringbuf_resize", bench_resize, NULL, ops / 100 + 1);
+    bench_case("ringbuf_resize/writer", bench_resize, bench_push, ops / 100 + 1);
+
+    platform_cleanup();
+    return 0;
+}
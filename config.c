@@ -4,6 +4,7 @@
 #include "ini_parser.h"
 #include "default_config.h"
 #include "platform.h"
+#include "heatmap.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -43,6 +44,31 @@ static color_t parse_color(const char *str) {
     return color;
 }
 
+/* Seconds, fractions allowed, rounded to whole milliseconds and never
+ * below one. Zero or less means not set. */
+static int32_t parse_interval(const char *str) {
+    double ms = atof(str) * 1000.0;
+
+    if (ms <= 0.0) return 0;
+    if (ms < 1.0) return 1;
+    if (ms > 2147483647.0) return 2147483647;
+    return (int32_t)(ms + 0.5);
+}
+
+/* The same in microseconds for sampling faster than once a millisecond,
+ * 0 at a millisecond or more */
+static int32_t parse_interval_us(const char *str) {
+    double us = atof(str) * 1000000.0;
+
+    if (us <= 0.0 || us >= 1000.0) return 0;
+    if (us < 1.0) return 1;
+    return (int32_t)(us + 0.5);
+}
+
+static decimate_mode_t parse_decimation(const char *str) {
+    return strcmp(str, "lttb") == 0 ? DECIMATE_LTTB : DECIMATE_MINMAX;
+}
+
 static int parse_type_target(const char *type, const char *target, plot_config_t *plot, config_t *config) {
     const char *actual_type;
     const char *actual_target;
@@ -116,8 +142,26 @@ static int parse_type_target(const char *type, const char *target, plot_config_t
     plot->line_color_secondary = config->line_color_secondary;
 
     plot->background_color = (color_t){100, 100, 100, 255};
-    plot->height = 100;
+    plot->height = config->default_height;
     plot->refresh_interval_ms = 0;
+    plot->refresh_interval_us = 0;
+    plot->column_interval_ms = 0;
+    plot->history = config->history;
+    plot->history_compress = config->history_compress;
+    plot->decimation = config->decimation;
+
+    /* One pixel row per target plus title and footer */
+    if (strcmp(actual_type, "heatmap") == 0) {
+        char row_type[64];
+        char **targets;
+        uint32_t target_count;
+
+        if (heatmap_expand_targets(heatmap_split_spec(actual_target, row_type, sizeof(row_type)),
+                                   &targets, &target_count)) {
+            plot->height = target_count + 44;
+            heatmap_free_targets(targets, target_count);
+        }
+    }
 
     return 1;
 }
@@ -142,7 +186,24 @@ static void parse_plot_config(ini_file_t *ini, plot_config_t *plot, const char *
     }
 
     if ((value = ini_get_value(ini, section_name, "refresh_interval_sec"))) {
-        plot->refresh_interval_ms = atoi(value) * 1000;
+        plot->refresh_interval_ms = parse_interval(value);
+        plot->refresh_interval_us = parse_interval_us(value);
+    }
+
+    if ((value = ini_get_value(ini, section_name, "column_interval_sec"))) {
+        plot->column_interval_ms = parse_interval(value);
+    }
+
+    if ((value = ini_get_value(ini, section_name, "history"))) {
+        plot->history = atoi(value) > 0 ? atoi(value) : 0;
+    }
+
+    if ((value = ini_get_value(ini, section_name, "history_compress"))) {
+        plot->history_compress = strcmp(value, "1") == 0;
+    }
+
+    if ((value = ini_get_value(ini, section_name, "decimation"))) {
+        plot->decimation = parse_decimation(value);
     }
 }
 
@@ -158,10 +219,8 @@ static int is_config_valid(ini_file_t *ini) {
     return 0;
 }
 
-config_t *config_load(const char *filename) {
-    ini_file_t *ini;
-    char *config_path;
-    int use_defaults;
+/* The config in ini, read from path */
+static config_t *config_from_ini(ini_file_t *ini, const char *path) {
     config_t *config;
     char *value;
     plot_config_t *plots;
@@ -171,47 +230,9 @@ config_t *config_load(const char *filename) {
     char *type, *target;
     char *section_name;
 
-    ini = ini_parse_file(filename);
-    config_path = NULL;
-    use_defaults = 0;
-
-    if (!ini) {
-        char *platform_config_path;
-        platform_config_path = get_platform_config_path(filename);
-        if (platform_config_path) {
-            ini = ini_parse_file(platform_config_path);
-        }
-
-        if (!ini) {
-            use_defaults = 1;
-        }
-    }
-
-    if (ini && !is_config_valid(ini)) {
-        ini_free(ini);
-        ini = NULL;
-        use_defaults = 1;
-    }
-
-    if (use_defaults) {
-        config_path = create_default_config_file(filename);
-        if (!config_path) {
-            fprintf(stderr, "Could not create config file %s\n", filename);
-            return NULL;
-        }
-        ini = ini_parse_file(config_path);
-        if (!ini) {
-            fprintf(stderr, "Could not parse config file %s\n", filename);
-            return NULL;
-        }
-    }
-    
     config = malloc(sizeof(config_t));
-    if (!config) {
-        ini_free(ini);
-        return NULL;
-    }
-    
+    if (!config) return NULL;
+
     config->background_color = (color_t){100, 100, 100, 255};
     config->text_color = (color_t){255, 255, 255, 255};
     config->border_color = (color_t){255, 255, 255, 255};
@@ -221,12 +242,38 @@ config_t *config_load(const char *filename) {
     config->default_height = 100;
     config->default_width = 400;
     config->refresh_interval_ms = 10000;
+    config->refresh_interval_us = 0;
+    config->column_interval_ms = 0;
+    config->history = 0;
+    config->history_compress = 0;
+    config->decimation = DECIMATE_MINMAX;
+    config->history_dir = NULL;
+    config->shm_name = NULL;
+    config->history_sync_ms = 60000;
     config->window_margin = 5;
+    config->columns = 1;
+    config->max_window_height = 1080;
     config->max_fps = 30;
+    config->render_threads = 1;
     config->fullscreen = FULLSCREEN_OFF;
     config->fps_counter = 0;
     config->font_size = 1.0f;
     config->font_name = NULL;
+    config->http_port = 0;
+    config->http_bind = NULL;
+    config->vnc_port = 0;
+    config->vnc_bind = NULL;
+    config->agent_port = 0;
+    config->agent_bind = NULL;
+    config->export_format = EXPORT_OFF;
+    config->export_to = NULL;
+    config->export_batch = 1000;
+    config->export_flush_ms = 1000;
+    config->query_socket = NULL;
+    config->path = malloc(strlen(path) + 1);
+    if (config->path) {
+        strcpy(config->path, path);
+    }
     config->plots = NULL;
     config->plot_count = 0;
     
@@ -254,15 +301,55 @@ config_t *config_load(const char *filename) {
     if ((value = ini_get_value(ini, "global", "default_width"))) {
         config->default_width = atoi(value);
     }
-    if ((value = ini_get_value(ini, "global", "refresh_interval_sec"))) {
-        config->refresh_interval_ms = atoi(value) * 1000;
+    if ((value = ini_get_value(ini, "global", "refresh_interval_sec")) && parse_interval(value) > 0) {
+        config->refresh_interval_ms = parse_interval(value);
+        config->refresh_interval_us = parse_interval_us(value);
+    }
+    if ((value = ini_get_value(ini, "global", "column_interval_sec"))) {
+        config->column_interval_ms = parse_interval(value);
+    }
+    if ((value = ini_get_value(ini, "global", "history"))) {
+        config->history = atoi(value) > 0 ? atoi(value) : 0;
+    }
+    if ((value = ini_get_value(ini, "global", "history_compress"))) {
+        config->history_compress = strcmp(value, "1") == 0;
+    }
+    if ((value = ini_get_value(ini, "global", "decimation"))) {
+        config->decimation = parse_decimation(value);
+    }
+    if ((value = ini_get_value(ini, "global", "history_dir")) && *value) {
+        config->history_dir = malloc(strlen(value) + 1);
+        if (config->history_dir) {
+            strcpy(config->history_dir, value);
+        }
+    }
+    /* shm_open wants a single leading slash */
+    if ((value = ini_get_value(ini, "global", "shm_name")) && *value) {
+        config->shm_name = malloc(strlen(value) + 2);
+        if (config->shm_name) {
+            snprintf(config->shm_name, strlen(value) + 2, "%s%s", value[0] == '/' ? "" : "/", value);
+        }
+    }
+    if ((value = ini_get_value(ini, "global", "history_sync_sec"))) {
+        config->history_sync_ms = parse_interval(value);
     }
     if ((value = ini_get_value(ini, "global", "window_margin"))) {
         config->window_margin = atoi(value);
     }
+    if ((value = ini_get_value(ini, "global", "columns"))) {
+        config->columns = atoi(value);
+        if (config->columns < 1) config->columns = 1;
+    }
+    if ((value = ini_get_value(ini, "global", "max_window_height"))) {
+        config->max_window_height = atoi(value);
+    }
     if ((value = ini_get_value(ini, "global", "max_fps"))) {
         config->max_fps = atoi(value);
     }
+    if ((value = ini_get_value(ini, "global", "render_threads"))) {
+        config->render_threads = atoi(value);
+        if (config->render_threads < 0) config->render_threads = 1;
+    }
     if ((value = ini_get_value(ini, "global", "fullscreen"))) {
         if (strcmp(value, "force") == 0) {
             config->fullscreen = FULLSCREEN_FORCE;
@@ -294,6 +381,59 @@ config_t *config_load(const char *filename) {
             strcpy(config->font_name, value);
         }
     }
+    if ((value = ini_get_value(ini, "global", "http_port"))) {
+        config->http_port = atoi(value);
+        if (config->http_port < 0 || config->http_port > 65535) config->http_port = 0;
+    }
+    if ((value = ini_get_value(ini, "global", "http_bind"))) {
+        config->http_bind = malloc(strlen(value) + 1);
+        if (config->http_bind) {
+            strcpy(config->http_bind, value);
+        }
+    }
+    if ((value = ini_get_value(ini, "global", "vnc_port"))) {
+        config->vnc_port = atoi(value);
+        if (config->vnc_port < 0 || config->vnc_port > 65535) config->vnc_port = 0;
+    }
+    if ((value = ini_get_value(ini, "global", "vnc_bind"))) {
+        config->vnc_bind = malloc(strlen(value) + 1);
+        if (config->vnc_bind) {
+            strcpy(config->vnc_bind, value);
+        }
+    }
+    if ((value = ini_get_value(ini, "global", "agent_port"))) {
+        config->agent_port = atoi(value);
+        if (config->agent_port < 0 || config->agent_port > 65535) config->agent_port = 0;
+    }
+    if ((value = ini_get_value(ini, "global", "agent_bind"))) {
+        config->agent_bind = malloc(strlen(value) + 1);
+        if (config->agent_bind) {
+            strcpy(config->agent_bind, value);
+        }
+    }
+    if ((value = ini_get_value(ini, "global", "export"))) {
+        config->export_format = strcmp(value, "influx") == 0 ? EXPORT_INFLUX :
+                                strcmp(value, "csv") == 0 ? EXPORT_CSV : EXPORT_OFF;
+    }
+    if ((value = ini_get_value(ini, "global", "export_to")) && *value) {
+        config->export_to = malloc(strlen(value) + 1);
+        if (config->export_to) {
+            strcpy(config->export_to, value);
+        }
+    }
+    if ((value = ini_get_value(ini, "global", "export_batch"))) {
+        config->export_batch = atoi(value);
+        if (config->export_batch < 1) config->export_batch = 1;
+    }
+    if ((value = ini_get_value(ini, "global", "export_flush_sec"))) {
+        config->export_flush_ms = parse_interval(value);
+    }
+    if ((value = ini_get_value(ini, "global", "query_socket")) && *value) {
+        config->query_socket = malloc(strlen(value) + 1);
+        if (config->query_socket) {
+            strcpy(config->query_socket, value);
+        }
+    }
 
     plots = NULL;
     plot_count = 0;
@@ -306,7 +446,7 @@ config_t *config_load(const char *filename) {
                     plot_capacity = plot_capacity ? plot_capacity * 2 : 4;
                     plots = realloc(plots, sizeof(plot_config_t) * plot_capacity);
                     if (!plots) {
-                        ini_free(ini);
+                        free(config->path);
                         free(config);
                         return NULL;
                     }
@@ -341,12 +481,87 @@ config_t *config_load(const char *filename) {
     config->plots = plots;
     config->plot_count = plot_count;
 
-    global_config = config;
+    return config;
+}
+
+config_t *config_load(const char *filename) {
+    ini_file_t *ini;
+    const char *config_path = filename;
+    int use_defaults = 0;
+    config_t *config;
+
+    ini = ini_parse_file(filename);
+
+    if (!ini) {
+        char *platform_config_path;
+        platform_config_path = get_platform_config_path(filename);
+        if (platform_config_path) {
+            ini = ini_parse_file(platform_config_path);
+            if (ini) config_path = platform_config_path;
+        }
+
+        if (!ini) {
+            use_defaults = 1;
+        }
+    }
+
+    if (ini && !is_config_valid(ini)) {
+        ini_free(ini);
+        ini = NULL;
+        use_defaults = 1;
+    }
+
+    if (use_defaults) {
+        config_path = create_default_config_file(filename);
+        if (!config_path) {
+            fprintf(stderr, "Could not create config file %s\n", filename);
+            return NULL;
+        }
+        ini = ini_parse_file(config_path);
+        if (!ini) {
+            fprintf(stderr, "Could not parse config file %s\n", filename);
+            return NULL;
+        }
+    }
 
+    config = config_from_ini(ini, config_path);
+    if (config) {
+        global_config = config;
+    }
+
+    ini_free(ini);
+    return config;
+}
+
+/* The file a running config came from, read again. Unlike config_load it
+ * never falls back to the default config: a file half written or broken
+ * gives NULL and the running config stays. */
+config_t *config_reload(const char *path) {
+    ini_file_t *ini;
+    config_t *config;
+
+    if (!path) return NULL;
+
+    ini = ini_parse_file(path);
+    if (!ini || !is_config_valid(ini)) {
+        if (ini) ini_free(ini);
+        return NULL;
+    }
+
+    config = config_from_ini(ini, path);
     ini_free(ini);
+    if (config && config->plot_count == 0) {
+        config_destroy(config);
+        return NULL;
+    }
     return config;
 }
 
+/* The config config_get_max_fps answers from, after a reload */
+void config_make_current(config_t *config) {
+    global_config = config;
+}
+
 void config_destroy(config_t *config) {
     uint32_t i;
     
@@ -366,6 +581,14 @@ void config_destroy(config_t *config) {
     if (config->font_name) {
         free(config->font_name);
     }
+    free(config->http_bind);
+    free(config->vnc_bind);
+    free(config->agent_bind);
+    free(config->export_to);
+    free(config->query_socket);
+    free(config->path);
+    free(config->history_dir);
+    free(config->shm_name);
     free(config);
 }
 
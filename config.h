@@ -3,6 +3,7 @@
 
 #include "compat.h"
 #include "graphics.h"
+#include "decimate.h"
 
 typedef struct {
     char *name;
@@ -13,6 +14,11 @@ typedef struct {
     color_t background_color;
     int32_t height;
     int32_t refresh_interval_ms;
+    int32_t refresh_interval_us;    /* set below a millisecond, which the ms round up to */
+    int32_t column_interval_ms;
+    uint32_t history;
+    int history_compress;
+    decimate_mode_t decimation;
 } plot_config_t;
 
 typedef enum {
@@ -21,6 +27,12 @@ typedef enum {
     FULLSCREEN_FORCE = 2
 } fullscreen_mode_t;
 
+typedef enum {
+    EXPORT_OFF = 0,
+    EXPORT_INFLUX = 1,
+    EXPORT_CSV = 2
+} export_format_t;
+
 typedef struct {
     color_t background_color;
     color_t text_color;
@@ -31,18 +43,43 @@ typedef struct {
     int32_t default_height;
     int32_t default_width;
     int32_t refresh_interval_ms;
+    int32_t refresh_interval_us; /* set below a millisecond, which the ms round up to */
+    int32_t column_interval_ms;  /* 0 is one column per frame at most */
+    uint32_t history;   /* samples kept per plot, 0 is one per pixel column */
+    int history_compress;   /* keep history in a compressed store, not the ring */
+    decimate_mode_t decimation;
+    char *history_dir;  /* NULL keeps history in memory only */
+    char *shm_name;     /* shared memory of --daemon and --attach, NULL is /plottool */
+    int32_t history_sync_ms;
     int32_t window_margin;
+    int32_t columns;
+    int32_t max_window_height;
     int32_t max_fps;
+    int32_t render_threads;  /* 0 is one per CPU */
     fullscreen_mode_t fullscreen;
     int fps_counter;
     float font_size;
     char *font_name;
+    int32_t http_port;  /* 0 disables the built-in HTTP server */
+    char *http_bind;
+    int32_t vnc_port;   /* 0 disables the built-in VNC server */
+    char *vnc_bind;
+    int32_t agent_port; /* 0 serves no plots to remote= plots elsewhere */
+    char *agent_bind;
+    export_format_t export_format;
+    char *export_to;    /* NULL or "-" is stdout, unix:/path a socket, else a file */
+    int32_t export_batch;   /* lines per write */
+    int32_t export_flush_ms;
+    char *query_socket; /* NULL serves no local queries */
+    char *path;         /* the file read, watched for changes */
 
     plot_config_t *plots;
     uint32_t plot_count;
 } config_t;
 
 config_t *config_load(const char *filename);
+config_t *config_reload(const char *path);
+void config_make_current(config_t *config);
 void config_destroy(config_t *config);
 int config_get_max_fps(void);
 
@@ -1,6 +1,7 @@
 #define _GNU_SOURCE
 #include "compat.h"
 #include "datasource.h"
+#include "platform.h"
 #include <stdlib.h>
 #include <string.h>
 
@@ -11,6 +12,8 @@ extern datasource_handler_t snmp_handler;
 extern datasource_handler_t if_thr_handler;
 extern datasource_handler_t loadavg_handler;
 extern datasource_handler_t shell_handler;
+extern datasource_handler_t remote_handler;
+extern datasource_handler_t synthetic_handler;
 
 static datasource_handler_t *handlers[] = {
     &ping_handler,
@@ -20,48 +23,89 @@ static datasource_handler_t *handlers[] = {
     &if_thr_handler,
     &loadavg_handler,
     &shell_handler,
+    &remote_handler,
+    &synthetic_handler,
     NULL
 };
 
+/* Every plot opens its datasource on its own thread, handlers whose init
+ * is not reentrant take turns */
+static mutex_t *serial_mutex;
+
+/* Library setup of the handlers, from main before any sampler starts */
+void datasource_setup(void) {
+    int i;
+
+    for (i = 0; handlers[i]; i++) {
+        if (handlers[i]->setup) handlers[i]->setup();
+    }
+    if (!serial_mutex) serial_mutex = mutex_create();
+}
+
 datasource_t *datasource_create(const char *type, const char *target) {
+    datasource_t *ds = datasource_describe(type, target);
+
+    if (ds && !datasource_init(ds)) {
+        datasource_destroy(ds);
+        return NULL;
+    }
+    return ds;
+}
+
+/* Unit, scale and formatting of a type without sampling anything, for
+ * viewers of a daemon. There is no context to collect or get stats from. */
+datasource_t *datasource_describe(const char *type, const char *target) {
     int i;
     if (!type) return NULL;
 
-    datasource_handler_t *handler = NULL;
     for (i = 0; handlers[i]; i++) {
-        if (strcmp(handlers[i]->name, type) == 0) {
-            handler = handlers[i];
-            break;
-        }
+        if (strcmp(handlers[i]->name, type) == 0) break;
     }
-
-    if (!handler) return NULL;
+    if (!handlers[i]) return NULL;
 
     datasource_t *ds = malloc(sizeof(datasource_t));
     if (!ds) return NULL;
 
-    ds->handler = handler;
+    ds->handler = handlers[i];
+    ds->context = NULL;
     ds->target = target ? strdup(target) : NULL;
+    return ds;
+}
 
-    if (!handler->init(target, &ds->context)) {
-        free(ds->target);
-        free(ds);
-        return NULL;
-    }
+/* Opens what a described datasource samples, which may block on DNS, an
+ * SNMP session or a command. Other threads may already read the datasource,
+ * the context only shows once it is complete. Returns 0 when it failed. */
+int datasource_init(datasource_t *ds) {
+    void *context = NULL;
+    int serial, ok;
 
-    return ds;
+    if (!ds || !ds->handler || ds->context) return 0;
+
+    serial = ds->handler->serial_init && serial_mutex;
+    if (serial) mutex_lock(serial_mutex);
+    ok = ds->handler->init(ds->target, &context);
+    if (serial) mutex_unlock(serial_mutex);
+    if (!ok) return 0;
+
+    __sync_synchronize();
+    ds->context = context;
+    return 1;
 }
 
 int datasource_collect(datasource_t *ds, double *value) {
-    if (!ds || !ds->handler) return 0;
+    if (!ds || !ds->handler || !ds->context) return 0;
     return ds->handler->collect(ds->context, value);
 }
 
 void datasource_destroy(datasource_t *ds) {
     if (!ds) return;
 
-    if (ds->handler && ds->handler->cleanup) {
+    if (ds->handler && ds->handler->cleanup && ds->context) {
+        int serial = ds->handler->serial_init && serial_mutex;
+
+        if (serial) mutex_lock(serial_mutex);
         ds->handler->cleanup(ds->context);
+        if (serial) mutex_unlock(serial_mutex);
     }
 
     free(ds->target);
@@ -79,7 +123,7 @@ double datasource_get_max_scale(datasource_t *ds) {
 }
 
 void datasource_set_refresh_interval(datasource_t *ds, int32_t refresh_interval_ms) {
-    if (!ds || !ds->handler) return;
+    if (!ds || !ds->handler || !ds->context) return;
     if (ds->handler == &shell_handler) {
         extern void shell_set_refresh_interval(void *context, int32_t refresh_interval_ms);
         shell_set_refresh_interval(ds->context, refresh_interval_ms);
@@ -26,6 +26,8 @@ typedef struct {
     const char *unit;
     int is_dual;
     double max_scale;
+    void (*setup)(void);    /* once, before any thread, may be NULL */
+    int serial_init;        /* init and cleanup are not reentrant */
 } datasource_handler_t;
 
 typedef struct {
@@ -34,7 +36,10 @@ typedef struct {
     char *target;
 } datasource_t;
 
+void datasource_setup(void);
 datasource_t *datasource_create(const char *type, const char *target);
+datasource_t *datasource_describe(const char *type, const char *target);
+int datasource_init(datasource_t *ds);
 int datasource_collect(datasource_t *ds, double *value);
 void datasource_destroy(datasource_t *ds);
 const char *datasource_get_unit(datasource_t *ds);
@@ -0,0 +1,362 @@
+#include "compat.h"
+#include "decimate.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+#define DECIMATE_EMPTY UINT64_MAX
+
+typedef struct {
+    uint64_t id;        /* column number, samples id * per_column onwards */
+    uint32_t count;
+    double min;
+    double max;
+    double sum;
+    uint64_t pick_at;   /* LTTB: which sample was picked */
+    double pick;
+} decimate_column_t;
+
+/* Samples are read from the source this many at a time, so a deep
+ * history is folded without a copy of all of it */
+#define DECIMATE_CHUNK 4096
+
+typedef uint32_t (*decimate_read_t)(void *source, uint64_t from, double *values, double *min, double *max,
+                                    uint32_t count, uint64_t *first_out, uint64_t *written_out,
+                                    uint32_t *generation_out);
+
+struct decimate {
+    decimate_mode_t mode;
+    int valid;
+    void *source;
+    uint32_t generation;
+    uint32_t size;
+    uint32_t width;
+    uint32_t per_column;
+    uint64_t written;   /* samples folded into columns so far */
+    uint64_t picked;    /* first column whose LTTB pick can still change */
+    double last;        /* newest sample folded */
+
+    /* Ring of columns indexed by column number, width + 2 so LTTB still
+     * has the column left of the oldest one it revisits */
+    decimate_column_t *columns;
+    uint32_t slots;
+
+    /* Samples copied out of the source */
+    double values[DECIMATE_CHUNK];
+    double min[DECIMATE_CHUNK];
+    double max[DECIMATE_CHUNK];
+};
+
+decimate_t *decimate_create(decimate_mode_t mode) {
+    decimate_t *decimate = calloc(1, sizeof(decimate_t));
+    if (!decimate) return NULL;
+
+    decimate->mode = mode;
+    return decimate;
+}
+
+void decimate_destroy(decimate_t *decimate) {
+    if (!decimate) return;
+
+    free(decimate->columns);
+    free(decimate);
+}
+
+static int decimate_reset(decimate_t *decimate, void *source, uint32_t width, uint32_t per_column,
+                          uint32_t size, uint32_t generation) {
+    uint32_t i;
+
+    if (decimate->slots != width + 2) {
+        decimate_column_t *columns = realloc(decimate->columns, sizeof(decimate_column_t) * (width + 2));
+        if (!columns) return 0;
+        decimate->columns = columns;
+        decimate->slots = width + 2;
+    }
+
+    for (i = 0; i < decimate->slots; i++) {
+        decimate->columns[i].id = DECIMATE_EMPTY;
+    }
+    decimate->source = source;
+    decimate->size = size;
+    decimate->width = width;
+    decimate->per_column = per_column;
+    decimate->generation = generation;
+    decimate->written = 0;
+    decimate->picked = 0;
+    decimate->valid = 1;
+    return 1;
+}
+
+/* Lowest min, highest max and sum of a run of samples */
+static void decimate_reduce(const double *values, const double *min, const double *max, uint32_t count,
+                            double *lo_out, double *hi_out, double *sum_out) {
+    double lo = min[0], hi = max[0], sum = 0.0;
+    uint32_t i = 0;
+
+#if defined(__SSE2__)
+    if (count >= 4) {
+        __m128d vlo = _mm_loadu_pd(min), vhi = _mm_loadu_pd(max);
+        __m128d vsum0 = _mm_setzero_pd(), vsum1 = _mm_setzero_pd();
+        double lanes[2];
+
+        for (; i + 4 <= count; i += 4) {
+            vlo = _mm_min_pd(vlo, _mm_min_pd(_mm_loadu_pd(min + i), _mm_loadu_pd(min + i + 2)));
+            vhi = _mm_max_pd(vhi, _mm_max_pd(_mm_loadu_pd(max + i), _mm_loadu_pd(max + i + 2)));
+            vsum0 = _mm_add_pd(vsum0, _mm_loadu_pd(values + i));
+            vsum1 = _mm_add_pd(vsum1, _mm_loadu_pd(values + i + 2));
+        }
+        _mm_storeu_pd(lanes, vlo);
+        lo = lanes[0] < lanes[1] ? lanes[0] : lanes[1];
+        _mm_storeu_pd(lanes, vhi);
+        hi = lanes[0] > lanes[1] ? lanes[0] : lanes[1];
+        _mm_storeu_pd(lanes, _mm_add_pd(vsum0, vsum1));
+        sum = lanes[0] + lanes[1];
+    }
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+    if (count >= 4) {
+        float64x2_t vlo = vld1q_f64(min), vhi = vld1q_f64(max);
+        float64x2_t vsum0 = vdupq_n_f64(0.0), vsum1 = vdupq_n_f64(0.0);
+
+        for (; i + 4 <= count; i += 4) {
+            vlo = vminq_f64(vlo, vminq_f64(vld1q_f64(min + i), vld1q_f64(min + i + 2)));
+            vhi = vmaxq_f64(vhi, vmaxq_f64(vld1q_f64(max + i), vld1q_f64(max + i + 2)));
+            vsum0 = vaddq_f64(vsum0, vld1q_f64(values + i));
+            vsum1 = vaddq_f64(vsum1, vld1q_f64(values + i + 2));
+        }
+        lo = vminvq_f64(vlo);
+        hi = vmaxvq_f64(vhi);
+        sum = vaddvq_f64(vaddq_f64(vsum0, vsum1));
+    }
+#endif
+    for (; i < count; i++) {
+        if (min[i] < lo) lo = min[i];
+        if (max[i] > hi) hi = max[i];
+        sum += values[i];
+    }
+
+    *lo_out = lo;
+    *hi_out = hi;
+    *sum_out = sum;
+}
+
+/* Add the samples not seen yet to their columns */
+static void decimate_fold(decimate_t *decimate, uint64_t first, uint32_t count) {
+    uint64_t per_column = decimate->per_column;
+    uint32_t i = decimate->written > first ? (uint32_t)(decimate->written - first) : 0;
+
+    while (i < count) {
+        uint64_t id = (first + i) / per_column;
+        uint32_t end = (uint32_t)((id + 1) * per_column - first);
+        decimate_column_t *column = &decimate->columns[id % decimate->slots];
+        double lo, hi, sum;
+
+        if (end > count) end = count;
+        if (column->id != id) {
+            column->id = id;
+            column->count = 0;
+            column->sum = 0.0;
+            column->pick_at = first + i;
+            column->pick = RINGBUF_MISSING;
+        }
+
+        /* Gaps from when plottool was not running only come in runs, and
+         * count for nothing */
+        while (i < end) {
+            uint32_t run = i;
+
+            if (decimate->values[i] == RINGBUF_MISSING) {
+                i++;
+                continue;
+            }
+            while (run < end && decimate->values[run] != RINGBUF_MISSING) run++;
+
+            decimate_reduce(decimate->values + i, decimate->min + i, decimate->max + i, run - i, &lo, &hi, &sum);
+            if (column->count == 0 || lo < column->min) column->min = lo;
+            if (column->count == 0 || hi > column->max) column->max = hi;
+            column->sum += sum;
+            column->count += run - i;
+            i = run;
+        }
+    }
+
+    decimate->written = first + count;
+    if (count > 0) decimate->last = decimate->values[count - 1];
+}
+
+/* Largest-Triangle-Three-Buckets: each column keeps the sample forming the
+ * largest triangle with the previous pick and the mean of the next column.
+ * That is settled once the next column is complete, so only the last two
+ * columns are read again. The newest column shows its newest sample. */
+static void decimate_pick(decimate_t *decimate, decimate_read_t read, void *source, uint64_t written) {
+    uint64_t per_column = decimate->per_column;
+    uint64_t newest = (written - 1) / per_column;
+    uint64_t id;
+
+    for (id = decimate->picked; id <= newest; id++) {
+        decimate_column_t *column = &decimate->columns[id % decimate->slots];
+        decimate_column_t *prev = &decimate->columns[(id + decimate->slots - 1) % decimate->slots];
+        decimate_column_t *next = &decimate->columns[(id + 1) % decimate->slots];
+        uint64_t base = id * per_column;
+        uint64_t end = base + per_column < written ? base + per_column : written;
+        double px, py, nx, ny, best = -1.0;
+        uint64_t s, first, latest;
+        uint32_t generation, count, i;
+
+        if (column->id != id || column->count == 0) continue;
+
+        if (id == newest) {
+            column->pick = decimate->last;
+            column->pick_at = written - 1;
+            continue;
+        }
+
+        if (id > 0 && prev->id == id - 1 && prev->pick >= 0.0) {
+            px = (double)prev->pick_at - (double)base;
+            py = prev->pick;
+        } else {
+            px = 0.0;
+            py = column->sum / column->count;
+        }
+        if (next->id == id + 1 && next->count > 0) {
+            nx = (double)per_column + next->count / 2.0;
+            ny = next->sum / next->count;
+        } else {
+            nx = (double)per_column;
+            ny = column->sum / column->count;
+        }
+
+        column->pick = -1.0;
+        for (s = base; s < end; s = first + count) {
+            count = read(source, s, decimate->values, decimate->min, decimate->max,
+                         end - s < DECIMATE_CHUNK ? (uint32_t)(end - s) : DECIMATE_CHUNK,
+                         &first, &latest, &generation);
+            if (count == 0 || generation != decimate->generation) break;
+            if (first + count > end) count = (uint32_t)(end - first);
+
+            for (i = 0; i < count; i++) {
+                double x = (double)(first + i - base);
+                double y = decimate->values[i];
+                double area;
+
+                if (y < 0.0) continue;
+                area = fabs((px - nx) * (y - py) - (px - x) * (ny - py));
+                if (area > best) {
+                    best = area;
+                    column->pick = y;
+                    column->pick_at = first + i;
+                }
+            }
+        }
+    }
+
+    id = written / per_column;
+    if (id > 0 && id - 1 > decimate->picked) decimate->picked = id - 1;
+}
+
+/* Fill values, min and max with up to width columns, oldest first, and
+ * return how many. Error columns, where any sample failed, are -1. */
+static uint32_t decimate_run(decimate_t *decimate, decimate_read_t read, void *source,
+                             uint32_t size, uint32_t generation, uint32_t width,
+                             double *values, double *min, double *max) {
+    uint32_t per_column = (size + width - 1) / width;
+    uint64_t from, first = 0, written = 0, target = 0, newest, id;
+    uint32_t count, read_generation, out = 0;
+
+    if (!decimate->valid || decimate->source != source || decimate->generation != generation ||
+        decimate->width != width || decimate->per_column != per_column) {
+        if (!decimate_reset(decimate, source, width, per_column, size, generation)) return 0;
+    }
+
+    /* Fold in what was pushed since the last frame, a chunk at a time up
+     * to what was there at the start */
+    from = decimate->written;
+    do {
+        count = read(source, from, decimate->values, decimate->min, decimate->max, DECIMATE_CHUNK,
+                     &first, &written, &read_generation);
+        if (read_generation != decimate->generation) {
+            decimate->valid = 0;
+            return 0;
+        }
+        if (target == 0) target = written;
+        decimate_fold(decimate, first, count);
+        from = first + count;
+    } while (count > 0 && from < target);
+    if (decimate->written == 0) return 0;
+    written = decimate->written;
+
+    if (decimate->mode == DECIMATE_LTTB) {
+        decimate_pick(decimate, read, source, written);
+    }
+
+    /* Columns older than what the source still holds are not shown, so
+     * the plot spans the same time however the columns fall */
+    newest = (written - 1) / decimate->per_column;
+    id = written > decimate->size ? (written - decimate->size) / decimate->per_column : 0;
+    if (newest + 1 > width && id < newest + 1 - width) id = newest + 1 - width;
+    for (; id <= newest; id++) {
+        decimate_column_t *column = &decimate->columns[id % decimate->slots];
+
+        if (column->id != id) continue;
+        if (column->count == 0) {
+            values[out] = min[out] = max[out] = RINGBUF_MISSING;
+        } else if (column->min < 0.0) {
+            values[out] = min[out] = max[out] = -1.0;
+        } else if (decimate->mode == DECIMATE_LTTB) {
+            values[out] = min[out] = max[out] = column->pick;
+        } else {
+            values[out] = column->sum / column->count;
+            min[out] = column->min;
+            max[out] = column->max;
+        }
+        out++;
+    }
+
+    return out;
+}
+
+static uint32_t decimate_read_ringbuf(void *source, uint64_t from, double *values, double *min, double *max,
+                                      uint32_t count, uint64_t *first_out, uint64_t *written_out,
+                                      uint32_t *generation_out) {
+    return ringbuf_read_range((ringbuf_t*)source, from, values, min, max, NULL, count,
+                              first_out, written_out, generation_out);
+}
+
+/* The compressed history keeps no envelope and is never resized */
+static uint32_t decimate_read_history(void *source, uint64_t from, double *values, double *min, double *max,
+                                      uint32_t count, uint64_t *first_out, uint64_t *written_out,
+                                      uint32_t *generation_out) {
+    count = history_read_range((history_t*)source, from, values, count, first_out, written_out);
+    memcpy(min, values, sizeof(double) * count);
+    memcpy(max, values, sizeof(double) * count);
+    *generation_out = 0;
+    return count;
+}
+
+uint32_t decimate_update(decimate_t *decimate, ringbuf_t *ringbuf, uint32_t width,
+                         double *values, double *min, double *max) {
+    uint32_t attempts, out = 0;
+
+    if (!decimate || !ringbuf || width == 0) return 0;
+
+    /* A resize between reading the size and copying starts over once */
+    for (attempts = 0; attempts < 2; attempts++) {
+        out = decimate_run(decimate, decimate_read_ringbuf, ringbuf, ringbuf->size, ringbuf->generation,
+                           width, values, min, max);
+        if (decimate->valid) break;
+    }
+    return out;
+}
+
+uint32_t decimate_update_history(decimate_t *decimate, history_t *history, uint32_t width,
+                                 double *values, double *min, double *max) {
+    if (!decimate || !history || width == 0) return 0;
+
+    return decimate_run(decimate, decimate_read_history, history, history_size(history), 0,
+                        width, values, min, max);
+}
@@ -0,0 +1,28 @@
+#ifndef DECIMATE_H
+#define DECIMATE_H
+
+#include "compat.h"
+#include "ringbuf.h"
+#include "history.h"
+
+/* Folds a ring buffer or compressed history holding more samples than the
+ * plot has columns into one value per column. Columns cover fixed runs of
+ * samples counted from the first push, so older columns never change as
+ * the plot scrolls and only those that received new samples are
+ * recomputed on the next frame. */
+
+typedef enum {
+    DECIMATE_MINMAX = 0,  /* mean with min/max envelope of each column */
+    DECIMATE_LTTB = 1     /* Largest-Triangle-Three-Buckets pick per column */
+} decimate_mode_t;
+
+typedef struct decimate decimate_t;
+
+decimate_t *decimate_create(decimate_mode_t mode);
+void decimate_destroy(decimate_t *decimate);
+uint32_t decimate_update(decimate_t *decimate, ringbuf_t *ringbuf, uint32_t width,
+                         double *values, double *min, double *max);
+uint32_t decimate_update_history(decimate_t *decimate, history_t *history, uint32_t width,
+                                 double *values, double *min, double *max);
+
+#endif
@@ -4,6 +4,7 @@
 #include <string.h>
 #include <stdio.h>
 #include <time.h>
+#include <sys/time.h>
 #include <stdint.h>
 
 #if defined(__APPLE__) || defined(__FreeBSD__) || defined(__NetBSD__) || defined(__OpenBSD__)
@@ -20,7 +21,7 @@ typedef struct {
     char *interface_name;
     uint32_t prev_in_bytes;
     uint32_t prev_out_bytes;
-    time_t prev_time;
+    uint64_t prev_time_us;
     int first_sample;
     uint32_t last_in_rate;
     uint32_t last_out_rate;
@@ -180,7 +181,7 @@ static int if_thr_init(const char *target, void **context) {
 
     ctx->prev_in_bytes = 0;
     ctx->prev_out_bytes = 0;
-    ctx->prev_time = 0;
+    ctx->prev_time_us = 0;
     ctx->first_sample = 1;
     ctx->last_in_rate = 0;
     ctx->last_out_rate = 0;
@@ -207,7 +208,11 @@ static int if_thr_collect_internal(if_thr_context_t *ctx) {
 #endif
 
     uint32_t in_bytes, out_bytes;
-    time_t current_time = time(NULL);
+    struct timeval tv;
+    uint64_t current_time_us;
+
+    gettimeofday(&tv, NULL);
+    current_time_us = (uint64_t)tv.tv_sec * 1000000 + tv.tv_usec;
 
     if (!get_interface_stats(ctx->interface_name, &in_bytes, &out_bytes)) {
         return 0;
@@ -216,7 +221,7 @@ static int if_thr_collect_internal(if_thr_context_t *ctx) {
     if (ctx->first_sample) {
         ctx->prev_in_bytes = in_bytes;
         ctx->prev_out_bytes = out_bytes;
-        ctx->prev_time = current_time;
+        ctx->prev_time_us = current_time_us;
         ctx->first_sample = 0;
         ctx->last_in_rate = 0;
         ctx->last_out_rate = 0;
@@ -224,16 +229,17 @@ static int if_thr_collect_internal(if_thr_context_t *ctx) {
         return 1;
     }
 
-    time_t time_diff = current_time - ctx->prev_time;
-    if (time_diff <= 0) {
+    if (current_time_us <= ctx->prev_time_us) {
         return 1;
     }
+    /* Sub-second sampling needs the fraction, or every rate reads zero */
+    double time_diff = (current_time_us - ctx->prev_time_us) / 1000000.0;
 
     uint32_t in_diff = in_bytes - ctx->prev_in_bytes;
     uint32_t out_diff = out_bytes - ctx->prev_out_bytes;
 
-    uint32_t in_rate_bps = in_diff / time_diff;
-    uint32_t out_rate_bps = out_diff / time_diff;
+    uint32_t in_rate_bps = (uint32_t)(in_diff / time_diff);
+    uint32_t out_rate_bps = (uint32_t)(out_diff / time_diff);
     uint32_t combined_rate_bps = in_rate_bps + out_rate_bps;
 
     // Update statistics with uint32_t values
@@ -251,7 +257,7 @@ static int if_thr_collect_internal(if_thr_context_t *ctx) {
 
     ctx->prev_in_bytes = in_bytes;
     ctx->prev_out_bytes = out_bytes;
-    ctx->prev_time = current_time;
+    ctx->prev_time_us = current_time_us;
     ctx->last_in_rate = in_rate_bps;
     ctx->last_out_rate = out_rate_bps;
     ctx->last_rate = combined_rate_bps;
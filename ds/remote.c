@@ -0,0 +1,35 @@
+#include "../datasource.h"
+#include <stdio.h>
+
+/* remote=host:plot plots are fed by the remote client in remote.c, there
+ * is nothing to sample here. This only describes a plot named by its
+ * title on the agent, whose type is not known up front. */
+
+static int remote_init(const char *target, void **context) {
+    (void)target;
+    (void)context;
+    return 0;
+}
+
+static int remote_collect(void *context, double *value) {
+    (void)context;
+    (void)value;
+    return 0;
+}
+
+static void remote_format_value(double value, char *buffer, size_t buffer_size) {
+    snprintf(buffer, buffer_size, "%.2f", value);
+}
+
+datasource_handler_t remote_handler = {
+    .init = remote_init,
+    .collect = remote_collect,
+    .collect_dual = NULL,
+    .get_stats = NULL,
+    .format_value = remote_format_value,
+    .cleanup = NULL,
+    .name = "remote",
+    .unit = "",
+    .is_dual = 0,
+    .max_scale = 0.0
+};
@@ -107,6 +107,12 @@ static int parse_snmp_target(const char* target, char** hostname, char** communi
     return (*hostname && *community);
 }
 
+static void snmp_setup(void) {
+    init_snmp("plottool");
+}
+
+/* Not reentrant, snmp_open and snmp_close share the library's session
+ * list, serial_init has them take turns */
 static int snmp_init(const char *target, void **context) {
     snmp_context_t *ctx;
     struct snmp_session init_ses;
@@ -121,7 +127,6 @@ static int snmp_init(const char *target, void **context) {
         return 0;
     }
 
-    init_snmp("plottool");
     snmp_sess_init(&init_ses);
     init_ses.version = SNMP_VERSION_1;
     init_ses.peername = ctx->hostname;
@@ -302,5 +307,7 @@ datasource_handler_t snmp_handler = {
     .name = "snmp",
     .unit = "B/s",
     .is_dual = 1,
-    .max_scale = 0.0
+    .max_scale = 0.0,
+    .setup = snmp_setup,
+    .serial_init = 1
 };
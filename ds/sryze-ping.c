@@ -258,7 +258,7 @@ sryze_ping_context_t *sryze_ping_create(const char *hostname, uint32_t timeout_m
 
     ctx->timeout_us = timeout_ms * 1000;
     static uint16_t next_id = 0;
-    ctx->id = (uint16_t)getpid() + (++next_id);
+    ctx->id = (uint16_t)getpid() + __sync_add_and_fetch(&next_id, 1);
     ctx->seq = 0;
     strcpy(ctx->addr_str, "<unknown>");
 
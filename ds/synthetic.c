@@ -0,0 +1,288 @@
+#include "../datasource.h"
+#include "../platform.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <math.h>
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+/* Generated samples for load and soak tests without any real host. The
+ * target is a kind followed by options, all separated by colons so it also
+ * fits in a heatmap row list:
+ *   sine:period=5s         0..max over period, phase from the seed
+ *   random                 uniform 0..max
+ *   random:walk:step=0.02  steps of up to step * max, kept within 0..max
+ *   burst:p=0.01:len=1     low noise, spikes of len samples with chance p
+ *   counter:rate=1e6       grows by rate per second, wraps at wrap=
+ * Every kind takes max= (default 100), seed= and fail= (chance of a failed
+ * sample). Without seed= it comes from the target, so equal targets give
+ * equal samples. Collecting is a few arithmetic operations, fine for rates
+ * of tens of kHz. */
+
+typedef enum {
+    SYNTHETIC_SINE,
+    SYNTHETIC_RANDOM,
+    SYNTHETIC_WALK,
+    SYNTHETIC_BURST,
+    SYNTHETIC_COUNTER
+} synthetic_kind_t;
+
+typedef struct {
+    synthetic_kind_t kind;
+    double max;
+    double period_us;
+    double phase;
+    double step;
+    double p;
+    uint32_t burst_len;
+    double rate;
+    double wrap;
+    double fail;
+    uint64_t state;     /* xorshift64* */
+    uint64_t start_us;
+
+    double value;       /* walk position */
+    uint32_t burst_left;
+
+    mutex_t *stats_mutex;   /* collect runs on the sampler, get_stats elsewhere */
+    double min_seen;
+    double max_seen;
+    double sum;
+    uint32_t sample_count;
+    double last;
+} synthetic_context_t;
+
+static uint64_t synthetic_next(synthetic_context_t *ctx) {
+    ctx->state ^= ctx->state >> 12;
+    ctx->state ^= ctx->state << 25;
+    ctx->state ^= ctx->state >> 27;
+    return ctx->state * 0x2545F4914F6CDD1DULL;
+}
+
+/* 0 <= x < 1 */
+static double synthetic_uniform(synthetic_context_t *ctx) {
+    return (synthetic_next(ctx) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+/* 5s, 500ms, 2m or 1h, plain numbers are seconds */
+static double synthetic_parse_duration_us(const char *str) {
+    char *end;
+    double value = strtod(str, &end);
+
+    if (strcmp(end, "ms") == 0) return value * 1000.0;
+    if (strcmp(end, "m") == 0) return value * 60000000.0;
+    if (strcmp(end, "h") == 0) return value * 3600000000.0;
+    return value * 1000000.0;
+}
+
+static int synthetic_init(const char *target, void **context) {
+    synthetic_context_t *ctx;
+    char *copy, *item, *save;
+    uint64_t hash = 1469598103934665603ULL;
+    const char *c;
+    int ok = 1;
+
+    if (!target) return 0;
+
+    ctx = calloc(1, sizeof(synthetic_context_t));
+    copy = strdup(target);
+    if (!ctx || !copy) {
+        free(ctx);
+        free(copy);
+        return 0;
+    }
+
+    /* FNV-1a of the target, the seed unless one is given */
+    for (c = target; *c; c++) {
+        hash = (hash ^ (unsigned char)*c) * 1099511628211ULL;
+    }
+
+    ctx->max = 100.0;
+    ctx->period_us = 10000000.0;
+    ctx->step = 0.02;
+    ctx->p = 0.01;
+    ctx->burst_len = 1;
+    ctx->rate = 1000.0;
+    ctx->wrap = 4294967296.0;
+
+    item = strtok_r(copy, ":", &save);
+    if (!item) {
+        ok = 0;
+    } else if (strcmp(item, "sine") == 0) {
+        ctx->kind = SYNTHETIC_SINE;
+    } else if (strcmp(item, "random") == 0) {
+        ctx->kind = SYNTHETIC_RANDOM;
+    } else if (strcmp(item, "burst") == 0) {
+        ctx->kind = SYNTHETIC_BURST;
+    } else if (strcmp(item, "counter") == 0) {
+        ctx->kind = SYNTHETIC_COUNTER;
+    } else {
+        ok = 0;
+    }
+
+    while (ok && (item = strtok_r(NULL, ":", &save))) {
+        char *value = strchr(item, '=');
+
+        if (!value) {
+            if (strcmp(item, "walk") == 0 && ctx->kind == SYNTHETIC_RANDOM) {
+                ctx->kind = SYNTHETIC_WALK;
+            } else {
+                ok = 0;
+            }
+            continue;
+        }
+        *value++ = '\0';
+
+        if (strcmp(item, "max") == 0) {
+            ctx->max = atof(value);
+        } else if (strcmp(item, "seed") == 0) {
+            hash = strtoull(value, NULL, 0) * 0x9E3779B97F4A7C15ULL;
+        } else if (strcmp(item, "fail") == 0) {
+            ctx->fail = atof(value);
+        } else if (strcmp(item, "period") == 0) {
+            ctx->period_us = synthetic_parse_duration_us(value);
+        } else if (strcmp(item, "step") == 0) {
+            ctx->step = atof(value);
+        } else if (strcmp(item, "p") == 0) {
+            ctx->p = atof(value);
+        } else if (strcmp(item, "len") == 0) {
+            ctx->burst_len = (uint32_t)atoi(value);
+        } else if (strcmp(item, "rate") == 0) {
+            ctx->rate = atof(value);
+        } else if (strcmp(item, "wrap") == 0) {
+            ctx->wrap = atof(value);
+        } else {
+            ok = 0;
+        }
+    }
+
+    if (ok && (ctx->max <= 0.0 || ctx->period_us <= 0.0 || ctx->wrap <= 0.0 || ctx->burst_len < 1)) {
+        ok = 0;
+    }
+    if (!ok) {
+        fprintf(stderr, "Invalid synthetic target %s\n", target);
+        free(copy);
+        free(ctx);
+        return 0;
+    }
+    free(copy);
+
+    ctx->stats_mutex = mutex_create();
+    if (!ctx->stats_mutex) {
+        free(ctx);
+        return 0;
+    }
+    ctx->state = hash ? hash : 1;
+    ctx->phase = synthetic_uniform(ctx);
+    ctx->value = ctx->max / 2.0;
+    ctx->start_us = platform_get_monotonic_us();
+    ctx->min_seen = 0.0;
+    ctx->max_seen = 0.0;
+
+    *context = ctx;
+    return 1;
+}
+
+static int synthetic_collect(void *context, double *value) {
+    synthetic_context_t *ctx = (synthetic_context_t *)context;
+    double elapsed_us, v;
+
+    if (!ctx || !value) return 0;
+
+    if (ctx->fail > 0.0 && synthetic_uniform(ctx) < ctx->fail) return 0;
+
+    switch (ctx->kind) {
+        case SYNTHETIC_SINE:
+            elapsed_us = (double)(platform_get_monotonic_us() - ctx->start_us);
+            v = ctx->max * (0.5 + 0.5 * sin(2.0 * M_PI * (elapsed_us / ctx->period_us + ctx->phase)));
+            break;
+        case SYNTHETIC_RANDOM:
+            v = ctx->max * synthetic_uniform(ctx);
+            break;
+        case SYNTHETIC_WALK:
+            ctx->value += ctx->max * ctx->step * (2.0 * synthetic_uniform(ctx) - 1.0);
+            if (ctx->value < 0.0) ctx->value = -ctx->value;
+            if (ctx->value > ctx->max) ctx->value = 2.0 * ctx->max - ctx->value;
+            v = ctx->value;
+            break;
+        case SYNTHETIC_BURST:
+            if (ctx->burst_left == 0 && synthetic_uniform(ctx) < ctx->p) {
+                ctx->burst_left = ctx->burst_len;
+            }
+            if (ctx->burst_left > 0) {
+                ctx->burst_left--;
+                v = ctx->max * (0.5 + 0.5 * synthetic_uniform(ctx));
+            } else {
+                v = ctx->max * 0.05 * synthetic_uniform(ctx);
+            }
+            break;
+        case SYNTHETIC_COUNTER:
+        default:
+            elapsed_us = (double)(platform_get_monotonic_us() - ctx->start_us);
+            v = fmod(ctx->rate * elapsed_us / 1000000.0, ctx->wrap);
+            break;
+    }
+
+    *value = v;
+    mutex_lock(ctx->stats_mutex);
+    if (ctx->sample_count == 0 || v < ctx->min_seen) ctx->min_seen = v;
+    if (ctx->sample_count == 0 || v > ctx->max_seen) ctx->max_seen = v;
+    ctx->sum += v;
+    ctx->last = v;
+    ctx->sample_count++;
+    mutex_unlock(ctx->stats_mutex);
+    return 1;
+}
+
+static int synthetic_get_stats(void *context, datasource_stats_t *stats) {
+    synthetic_context_t *ctx = (synthetic_context_t *)context;
+    if (!ctx || !stats) return 0;
+
+    memset(stats, 0, sizeof(*stats));
+    mutex_lock(ctx->stats_mutex);
+    if (ctx->sample_count > 0) {
+        stats->min = ctx->min_seen;
+        stats->max = ctx->max_seen;
+        stats->avg = ctx->sum / ctx->sample_count;
+        stats->last = ctx->last;
+    }
+    mutex_unlock(ctx->stats_mutex);
+    return 1;
+}
+
+static void synthetic_cleanup(void *context) {
+    synthetic_context_t *ctx = (synthetic_context_t *)context;
+    if (!ctx) return;
+
+    mutex_destroy(ctx->stats_mutex);
+    free(ctx);
+}
+
+static void synthetic_format_value(double value, char *buffer, size_t buffer_size) {
+    if (value >= 1e9) {
+        snprintf(buffer, buffer_size, "%.1fG", value / 1e9);
+    } else if (value >= 1e6) {
+        snprintf(buffer, buffer_size, "%.1fM", value / 1e6);
+    } else if (value >= 1e3) {
+        snprintf(buffer, buffer_size, "%.1fk", value / 1e3);
+    } else {
+        snprintf(buffer, buffer_size, "%.1f", value);
+    }
+}
+
+datasource_handler_t synthetic_handler = {
+    .init = synthetic_init,
+    .collect = synthetic_collect,
+    .collect_dual = NULL,
+    .get_stats = synthetic_get_stats,
+    .format_value = synthetic_format_value,
+    .cleanup = synthetic_cleanup,
+    .name = "synthetic",
+    .unit = "",
+    .is_dual = 0,
+    .max_scale = 0.0
+};
@@ -83,21 +83,25 @@ sryze_ping_context_t *sryze_ping_create(const char *hostname, uint32_t timeout_m
     if (!ctx) return NULL;
 
     ctx->timeout_us = timeout_ms * 1000;
+    /* Pings are created on several threads at once */
     static uint16_t next_id = 0;
-    ctx->id = (uint16_t)getpid() + (++next_id);
+    ctx->id = (uint16_t)getpid() + __sync_add_and_fetch(&next_id, 1);
     ctx->seq = 0;
     strcpy(ctx->addr_str, "<unknown>");
 
     ctx->target_addr.sin_family = AF_INET;
     ctx->target_addr.sin_addr.s_addr = inet_addr(hostname);
     if (ctx->target_addr.sin_addr.s_addr == -1 && strcmp(hostname, "255.255.255.255") != 0) {
-        struct hostent *hp = gethostbyname(hostname);
-        if (hp && hp->h_length == 4) {
-            memcpy(&ctx->target_addr.sin_addr, hp->h_addr, hp->h_length);
-        } else {
+        struct addrinfo hints, *addrinfo = NULL;
+
+        memset(&hints, 0, sizeof(hints));
+        hints.ai_family = AF_INET;
+        if (getaddrinfo(hostname, NULL, &hints, &addrinfo) != 0 || !addrinfo) {
             free(ctx);
             return NULL;
         }
+        ctx->target_addr.sin_addr = ((struct sockaddr_in *)addrinfo->ai_addr)->sin_addr;
+        freeaddrinfo(addrinfo);
     }
 
     ctx->recvfd = socket(AF_INET, SOCK_RAW, IPPROTO_ICMP);
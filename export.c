@@ -0,0 +1,436 @@
+#include "compat.h"
+#include "export.h"
+#include "net.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#define EXPORT_QUEUE_SIZE 65536     /* samples, a power of two */
+#define EXPORT_POLL_MS 20
+#define EXPORT_RETRY_MS 1000
+#define EXPORT_REPORT_MS 10000
+#define EXPORT_LINE_MAX 1024
+
+/* The sequence of a cell publishes its sample, acquire and release make
+ * the sample visible with it */
+#define export_load(ptr) __atomic_load_n(ptr, __ATOMIC_ACQUIRE)
+#define export_store(ptr, value) __atomic_store_n(ptr, value, __ATOMIC_RELEASE)
+
+/* One slot of the queue. Its sequence says whose turn it is: equal to the
+ * position a producer may fill it, one more once the sample is in. */
+typedef struct {
+    volatile uint32_t sequence;
+    uint32_t stream;
+    uint64_t time;
+    double value;
+    double min;
+    double max;
+} export_cell_t;
+
+struct exporter {
+    export_cell_t *cells;
+    volatile uint32_t enqueue_pos;
+    uint32_t dequeue_pos;           /* writer thread only */
+    volatile uint32_t dropped;      /* queue full */
+
+    export_format_t format;
+    char *to;
+    int fd;
+    int socket;                     /* fd is a UNIX socket, reconnected when lost */
+    uint32_t retry_ms;
+    uint32_t batch;
+    uint32_t flush_ms;
+    int64_t wall_offset_us;         /* monotonic push times to Unix time */
+
+    /* Per stream, plot << 1 | series: the line up to the value */
+    char **prefix;
+    uint32_t stream_count;
+    data_collector_t *collector;
+
+    char *out;
+    size_t out_size;
+    size_t out_capacity;
+    uint32_t out_lines;
+    uint32_t lost;                  /* formatted but not written */
+
+    plot_thread_t *thread;
+    volatile int running;
+};
+
+static void export_tap(void *arg, uint32_t stream, uint64_t time, double value, double min, double max) {
+    exporter_t *exporter = (exporter_t *)arg;
+    export_cell_t *cell;
+    uint32_t pos = export_load(&exporter->enqueue_pos);
+    int32_t diff;
+
+    for (;;) {
+        cell = &exporter->cells[pos & (EXPORT_QUEUE_SIZE - 1)];
+        diff = (int32_t)(export_load(&cell->sequence) - pos);
+        if (diff == 0) {
+            if (__sync_bool_compare_and_swap(&exporter->enqueue_pos, pos, pos + 1)) break;
+        } else if (diff < 0) {
+            /* Full, the writer is behind: drop rather than wait */
+            __sync_fetch_and_add(&exporter->dropped, 1);
+            return;
+        }
+        pos = export_load(&exporter->enqueue_pos);
+    }
+
+    cell->stream = stream;
+    cell->time = time;
+    cell->value = value;
+    cell->min = min;
+    cell->max = max;
+    export_store(&cell->sequence, pos + 1);
+}
+
+static int export_dequeue(exporter_t *exporter, export_cell_t *out) {
+    export_cell_t *cell = &exporter->cells[exporter->dequeue_pos & (EXPORT_QUEUE_SIZE - 1)];
+
+    if ((int32_t)(export_load(&cell->sequence) - (exporter->dequeue_pos + 1)) < 0) return 0;
+    out->stream = cell->stream;
+    out->time = cell->time;
+    out->value = cell->value;
+    out->min = cell->min;
+    out->max = cell->max;
+    export_store(&cell->sequence, exporter->dequeue_pos + EXPORT_QUEUE_SIZE);
+    exporter->dequeue_pos++;
+    return 1;
+}
+
+/* Influx escapes commas, spaces and equal signs in tags with a backslash */
+static size_t export_influx_escape(char *out, size_t size, const char *text) {
+    size_t n = 0;
+
+    for (; *text && n + 2 < size; text++) {
+        if (*text == ',' || *text == ' ' || *text == '=') out[n++] = '\\';
+        out[n++] = *text;
+    }
+    out[n] = '\0';
+    return n;
+}
+
+/* CSV quotes fields holding commas or quotes, doubling the quotes */
+static size_t export_csv_quote(char *out, size_t size, const char *text) {
+    size_t n = 0;
+
+    if (!strpbrk(text, ",\"\n")) {
+        snprintf(out, size, "%s", text);
+        return strlen(out);
+    }
+    out[n++] = '"';
+    for (; *text && n + 3 < size; text++) {
+        if (*text == '"') out[n++] = '"';
+        out[n++] = *text;
+    }
+    out[n++] = '"';
+    out[n] = '\0';
+    return n;
+}
+
+static char *export_prefix(exporter_t *exporter, const plot_config_t *plot, int dual, int series) {
+    char line[EXPORT_LINE_MAX];
+    const char *series_name = series ? "secondary" : "primary";
+    size_t n;
+
+    if (exporter->format == EXPORT_INFLUX) {
+        n = export_influx_escape(line, sizeof(line), plot->type);
+        n += snprintf(line + n, sizeof(line) - n, ",plot=");
+        n += export_influx_escape(line + n, sizeof(line) - n, plot->name ? plot->name : plot->type);
+        n += snprintf(line + n, sizeof(line) - n, ",target=");
+        n += export_influx_escape(line + n, sizeof(line) - n, plot->target);
+        if (dual && n < sizeof(line)) snprintf(line + n, sizeof(line) - n, ",series=%s", series_name);
+    } else {
+        n = export_csv_quote(line, sizeof(line), plot->name ? plot->name : plot->type);
+        line[n++] = ',';
+        n += export_csv_quote(line + n, sizeof(line) - n, plot->type);
+        line[n++] = ',';
+        n += export_csv_quote(line + n, sizeof(line) - n, plot->target);
+        snprintf(line + n, sizeof(line) - n, ",%s", dual ? series_name : "");
+    }
+    return strdup(line);
+}
+
+static int export_reserve(exporter_t *exporter, size_t more) {
+    char *grown;
+    size_t capacity;
+
+    if (exporter->out_size + more <= exporter->out_capacity) return 1;
+    capacity = exporter->out_capacity ? exporter->out_capacity * 2 : 65536;
+    while (capacity < exporter->out_size + more) capacity *= 2;
+    grown = realloc(exporter->out, capacity);
+    if (!grown) return 0;
+    exporter->out = grown;
+    exporter->out_capacity = capacity;
+    return 1;
+}
+
+static void export_line(exporter_t *exporter, const export_cell_t *cell) {
+    const char *prefix = cell->stream < exporter->stream_count ? exporter->prefix[cell->stream] : NULL;
+    int64_t wall_us = (int64_t)cell->time + exporter->wall_offset_us;
+    int envelope = cell->min != cell->value || cell->max != cell->value;
+    int n;
+
+    if (!prefix || !export_reserve(exporter, EXPORT_LINE_MAX + 128)) return;
+
+    if (exporter->format == EXPORT_INFLUX) {
+        /* A line needs a field, failed samples are simply absent */
+        if (!(cell->value >= 0.0)) return;
+        if (envelope) {
+            n = sprintf(exporter->out + exporter->out_size, "%s value=%.10g,min=%.10g,max=%.10g %lld000\n",
+                        prefix, cell->value, cell->min, cell->max, (long long)wall_us);
+        } else {
+            n = sprintf(exporter->out + exporter->out_size, "%s value=%.10g %lld000\n",
+                        prefix, cell->value, (long long)wall_us);
+        }
+    } else if (cell->value == RINGBUF_MISSING) {
+        return;
+    } else if (!(cell->value >= 0.0)) {
+        n = sprintf(exporter->out + exporter->out_size, "%lld.%06lld,%s,,,,error\n",
+                    (long long)(wall_us / 1000000), (long long)(wall_us % 1000000), prefix);
+    } else {
+        n = sprintf(exporter->out + exporter->out_size, "%lld.%06lld,%s,%.10g,%.10g,%.10g,\n",
+                    (long long)(wall_us / 1000000), (long long)(wall_us % 1000000), prefix,
+                    cell->value, cell->min, cell->max);
+    }
+    if (n > 0) {
+        exporter->out_size += (size_t)n;
+        exporter->out_lines++;
+    }
+}
+
+static int export_connect(exporter_t *exporter) {
+    struct sockaddr_un address;
+    const char *path = exporter->to + 5;
+    int fd;
+
+    if (strlen(path) >= sizeof(address.sun_path)) return -1;
+
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, path);
+    if (connect(fd, (struct sockaddr *)&address, sizeof(address)) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static void export_header(exporter_t *exporter) {
+    static const char header[] = "time,plot,type,target,series,value,min,max,error\n";
+    ssize_t n;
+
+    if (exporter->format != EXPORT_CSV) return;
+    n = write(exporter->fd, header, sizeof(header) - 1);
+    (void)n;
+}
+
+static void export_write(exporter_t *exporter) {
+    size_t done = 0;
+    ssize_t n;
+    uint32_t now;
+
+    if (exporter->out_size == 0) return;
+
+    if (exporter->fd < 0 && exporter->socket) {
+        now = platform_get_time_ms();
+        if (now - exporter->retry_ms >= EXPORT_RETRY_MS) {
+            exporter->retry_ms = now;
+            exporter->fd = export_connect(exporter);
+            if (exporter->fd >= 0) export_header(exporter);
+        }
+    }
+
+    while (exporter->fd >= 0 && done < exporter->out_size) {
+        n = exporter->socket ? send(exporter->fd, exporter->out + done, exporter->out_size - done, MSG_NOSIGNAL) :
+                               write(exporter->fd, exporter->out + done, exporter->out_size - done);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) {
+            if (exporter->socket) {
+                close(exporter->fd);
+                exporter->fd = -1;
+            }
+            break;
+        }
+        done += (size_t)n;
+    }
+
+    /* Lines cut off in the middle cannot be taken back, count them lost */
+    if (done < exporter->out_size) exporter->lost += exporter->out_lines;
+
+    exporter->out_size = 0;
+    exporter->out_lines = 0;
+}
+
+static void export_thread(void *arg) {
+    exporter_t *exporter = (exporter_t *)arg;
+    export_cell_t cell;
+    uint32_t now, flushed_ms, reported_ms, dropped, reported_dropped = 0, reported_lost = 0;
+    uint32_t drained;
+
+    flushed_ms = reported_ms = platform_get_time_ms();
+
+    while (exporter->running) {
+        drained = 0;
+        while (exporter->out_lines < exporter->batch && drained < exporter->batch &&
+               export_dequeue(exporter, &cell)) {
+            export_line(exporter, &cell);
+            drained++;
+        }
+
+        now = platform_get_time_ms();
+        if (exporter->out_lines >= exporter->batch ||
+            (exporter->out_lines > 0 && now - flushed_ms >= exporter->flush_ms)) {
+            export_write(exporter);
+            flushed_ms = now;
+        }
+
+        dropped = export_load(&exporter->dropped);
+        if ((dropped != reported_dropped || exporter->lost != reported_lost) &&
+            now - reported_ms >= EXPORT_REPORT_MS) {
+            fprintf(stderr, "Export: %u samples dropped, queue full, %u lost writing to %s\n",
+                    dropped - reported_dropped, exporter->lost - reported_lost,
+                    exporter->to ? exporter->to : "stdout");
+            reported_dropped = dropped;
+            reported_lost = exporter->lost;
+            reported_ms = now;
+        }
+
+        if (drained == 0) platform_sleep(EXPORT_POLL_MS);
+    }
+
+    while (export_dequeue(exporter, &cell)) {
+        export_line(exporter, &cell);
+    }
+    export_write(exporter);
+}
+
+static void exporter_free(exporter_t *exporter) {
+    uint32_t i;
+
+    if (exporter->fd > 2) close(exporter->fd);
+    if (exporter->prefix) {
+        for (i = 0; i < exporter->stream_count; i++) {
+            free(exporter->prefix[i]);
+        }
+        free(exporter->prefix);
+    }
+    free(exporter->cells);
+    free(exporter->to);
+    free(exporter->out);
+    free(exporter);
+}
+
+static int export_open(exporter_t *exporter) {
+    if (!exporter->to || strcmp(exporter->to, "-") == 0) {
+        exporter->fd = STDOUT_FILENO;
+    } else if (strncmp(exporter->to, "unix:", 5) == 0) {
+        /* Not there yet is fine, the writer keeps trying */
+        exporter->socket = 1;
+        exporter->fd = export_connect(exporter);
+        if (exporter->fd < 0) {
+            fprintf(stderr, "Export: cannot connect to %s: %s, retrying\n", exporter->to + 5, strerror(errno));
+            return 1;
+        }
+    } else {
+        exporter->fd = open(exporter->to, O_WRONLY | O_CREAT | O_APPEND, 0644);
+        if (exporter->fd < 0) {
+            fprintf(stderr, "Export: cannot open %s: %s\n", exporter->to, strerror(errno));
+            return 0;
+        }
+        if (lseek(exporter->fd, 0, SEEK_END) > 0) return 1;
+    }
+    export_header(exporter);
+    return 1;
+}
+
+/* Taps the rings, which may already be sampling after a reload. Once
+ * exporter_destroy has removed the taps no push can reach the exporter. */
+exporter_t *exporter_create(data_collector_t *collector, config_t *config) {
+    exporter_t *exporter;
+    data_source_t *source;
+    uint32_t i, series;
+
+    if (!collector || !config || config->export_format == EXPORT_OFF) return NULL;
+
+    exporter = calloc(1, sizeof(exporter_t));
+    if (!exporter) return NULL;
+
+    exporter->format = config->export_format;
+    exporter->batch = (uint32_t)config->export_batch;
+    exporter->flush_ms = (uint32_t)config->export_flush_ms;
+    exporter->fd = -1;
+    exporter->collector = collector;
+    exporter->wall_offset_us = (int64_t)platform_get_time_us() - (int64_t)platform_get_monotonic_us();
+    exporter->stream_count = collector->source_count * 2;
+
+    exporter->to = config->export_to ? strdup(config->export_to) : NULL;
+    exporter->cells = calloc(EXPORT_QUEUE_SIZE, sizeof(export_cell_t));
+    exporter->prefix = calloc(exporter->stream_count + 1, sizeof(char *));
+    if ((config->export_to && !exporter->to) || !exporter->cells || !exporter->prefix) {
+        exporter_free(exporter);
+        return NULL;
+    }
+    for (i = 0; i < EXPORT_QUEUE_SIZE; i++) {
+        exporter->cells[i].sequence = i;
+    }
+
+    if (!export_open(exporter)) {
+        exporter_free(exporter);
+        return NULL;
+    }
+    net_ignore_sigpipe();
+
+    /* Heatmap rings hold row colors, not values */
+    for (i = 0; i < collector->source_count && i < config->plot_count; i++) {
+        source = collector->sources[i];
+        if (!source->data_buffer || source->heatmap || strcmp(source->type, "heatmap") == 0) continue;
+        for (series = 0; series < (source->data_buffer_secondary ? 2u : 1u); series++) {
+            exporter->prefix[i * 2 + series] = export_prefix(exporter, &config->plots[i],
+                                                             source->data_buffer_secondary != NULL, series);
+        }
+    }
+
+    exporter->running = 1;
+    exporter->thread = plot_thread_create(export_thread, exporter);
+    if (!exporter->thread) {
+        exporter_free(exporter);
+        return NULL;
+    }
+
+    for (i = 0; i < collector->source_count && i < config->plot_count; i++) {
+        source = collector->sources[i];
+        if (exporter->prefix[i * 2]) {
+            ringbuf_add_tap(source->data_buffer, export_tap, exporter, i * 2);
+        }
+        if (exporter->prefix[i * 2 + 1]) {
+            ringbuf_add_tap(source->data_buffer_secondary, export_tap, exporter, i * 2 + 1);
+        }
+    }
+
+    return exporter;
+}
+
+void exporter_destroy(exporter_t *exporter) {
+    uint32_t i;
+
+    if (!exporter) return;
+
+    for (i = 0; i < exporter->collector->source_count; i++) {
+        ringbuf_remove_tap(exporter->collector->sources[i]->data_buffer, export_tap, exporter);
+        ringbuf_remove_tap(exporter->collector->sources[i]->data_buffer_secondary, export_tap, exporter);
+    }
+    exporter->running = 0;
+    plot_thread_join(exporter->thread);
+    plot_thread_destroy(exporter->thread);
+    exporter_free(exporter);
+}
@@ -0,0 +1,20 @@
+#ifndef EXPORT_H
+#define EXPORT_H
+
+#include "compat.h"
+#include "config.h"
+#include "threading.h"
+
+/* Every sample pushed into a plot, written as InfluxDB line protocol or
+ * CSV to stdout, a file or a UNIX socket (export= and export_to= in
+ * [global]). Sampler threads only put samples into a bounded lock-free
+ * queue, one writer thread formats and writes them in batches of
+ * export_batch lines or every export_flush_sec. Samples that do not fit
+ * in the queue, or cannot be written, are dropped and counted. */
+
+typedef struct exporter exporter_t;
+
+exporter_t *exporter_create(data_collector_t *collector, config_t *config);
+void exporter_destroy(exporter_t *exporter);
+
+#endif
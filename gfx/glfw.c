@@ -1,6 +1,13 @@
 #include "../graphics.h"
+#ifdef __APPLE__
+#define GLFW_INCLUDE_GLCOREARB
+#else
+#define GL_GLEXT_PROTOTYPES
+#define GLFW_INCLUDE_GLEXT
+#endif
 #include <GLFW/glfw3.h>
 #include <stdio.h>
+#include <stddef.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
@@ -9,11 +16,12 @@
 
 static int glfw_initialized = 0;
 static int window_resized = 0;
+static int window_visible = 1;
 static double last_frame_time = 0.0;
 static int target_fps = 60;
 static int vsync_enabled = 1;
 
-static graphics_event_t pending_event = {GRAPHICS_EVENT_NONE, 0};
+static graphics_event_t pending_event = {GRAPHICS_EVENT_NONE, 0, 0};
 static int fullscreen_state = 0;
 
 static uint32_t frame_count = 0;
@@ -23,6 +31,119 @@ static float current_fps = 0.0f;
 static FT_Library ft_library;
 static int ft_initialized = 0;
 
+/*
+ * Rendering goes through a small shader pipeline instead of immediate mode.
+ * Every primitive is appended to a CPU side vertex batch carrying its own
+ * color, lines and triangles in separate streams, so a whole plot (its
+ * fill, text and hundreds of column lines) takes two glDrawArrays calls:
+ * triangles first, then lines over them. Text and lines of a plot never
+ * overlap, so that order is the order they were drawn in. The batch is
+ * flushed at the end of every plot, when the glyph atlas changes and at
+ * present time.
+ *
+ * The same shader source is compiled for GL 3.3 core, GLES 2.0 and legacy
+ * GL 2.1 contexts, picked at window creation. Set PLOTTOOL_GL=core|es2|legacy
+ * to force one, e.g. for headless runs on Mesa llvmpipe under Xvfb.
+ */
+typedef enum {
+    GL_DIALECT_CORE,
+    GL_DIALECT_ES2,
+    GL_DIALECT_LEGACY
+} gl_dialect_t;
+
+static gl_dialect_t gl_dialect = GL_DIALECT_CORE;
+
+#define GLFW_GLYPH_FIRST 32
+#define GLFW_GLYPH_COUNT 95
+#define GLFW_ATLAS_WIDTH 256
+#define GLFW_BATCH_INITIAL 4096
+
+typedef struct {
+    float x, y;
+    float u, v;
+    uint8_t r, g, b, a;
+} glfw_vertex_t;
+
+typedef struct {
+    glfw_vertex_t *vertices;
+    uint32_t count;
+    uint32_t capacity;
+} glfw_batch_t;
+
+typedef struct {
+    GLFWwindow *window;
+    GLuint program;
+    GLuint vbo;
+    GLuint vao;
+    GLint u_viewport;
+    GLint u_texture;
+    GLint u_image;
+    GLuint image_texture;
+    uint8_t *image_rgba;
+    size_t image_rgba_capacity;
+    GLuint batch_texture;
+    glfw_batch_t triangles;
+    glfw_batch_t lines;
+    uint32_t vbo_capacity;
+    color_t current_color;
+    int32_t width, height;
+} glfw_renderer_context_t;
+
+typedef struct {
+    int32_t advance;
+    int32_t left, top;
+    int32_t width, rows;
+    float u0, v0, u1, v1;
+} glfw_glyph_t;
+
+typedef struct {
+    FT_Face face;
+    GLuint texture;
+    int32_t line_height;
+    glfw_glyph_t glyphs[GLFW_GLYPH_COUNT];
+} glfw_font_context_t;
+
+static const char *glfw_vertex_shader_body =
+    "ATTRIBUTE vec2 a_position;\n"
+    "ATTRIBUTE vec2 a_uv;\n"
+    "ATTRIBUTE vec4 a_color;\n"
+    "VARYING_OUT vec2 v_uv;\n"
+    "VARYING_OUT vec4 v_color;\n"
+    "uniform vec2 u_viewport;\n"
+    "void main() {\n"
+    "    v_uv = a_uv;\n"
+    "    v_color = a_color;\n"
+    "    gl_Position = vec4(a_position.x * 2.0 / u_viewport.x - 1.0,\n"
+    "                       1.0 - a_position.y * 2.0 / u_viewport.y, 0.0, 1.0);\n"
+    "}\n";
+
+static const char *glfw_fragment_shader_body =
+    "VARYING_IN vec2 v_uv;\n"
+    "VARYING_IN vec4 v_color;\n"
+    "uniform sampler2D u_texture;\n"
+    "uniform float u_image;\n"
+    "FRAG_OUTPUT_DECL\n"
+    "void main() {\n"
+    "    vec4 texel = TEXTURE(u_texture, v_uv);\n"
+    "    float coverage = v_uv.x < 0.0 ? 1.0 : texel.r;\n"
+    "    FRAG_COLOR = mix(vec4(v_color.rgb, v_color.a * coverage), vec4(texel.rgb, v_color.a), u_image);\n"
+    "}\n";
+
+static const char *glfw_vertex_prefix[] = {
+    "#version 330 core\n#define ATTRIBUTE in\n#define VARYING_OUT out\n",
+    "#version 100\n#define ATTRIBUTE attribute\n#define VARYING_OUT varying\n",
+    "#version 120\n#define ATTRIBUTE attribute\n#define VARYING_OUT varying\n"
+};
+
+static const char *glfw_fragment_prefix[] = {
+    "#version 330 core\n#define VARYING_IN in\n#define TEXTURE texture\n"
+    "#define FRAG_OUTPUT_DECL out vec4 frag_color;\n#define FRAG_COLOR frag_color\n",
+    "#version 100\nprecision mediump float;\n#define VARYING_IN varying\n#define TEXTURE texture2D\n"
+    "#define FRAG_OUTPUT_DECL\n#define FRAG_COLOR gl_FragColor\n",
+    "#version 120\n#define VARYING_IN varying\n#define TEXTURE texture2D\n"
+    "#define FRAG_OUTPUT_DECL\n#define FRAG_COLOR gl_FragColor\n"
+};
+
 static void error_callback(int error, const char* description) {
     fprintf(stderr, "GLFW Error %d: %s\n", error, description);
 }
@@ -34,6 +155,26 @@ static void window_size_callback(GLFWwindow* window, int width, int height) {
     window_resized = 1;
 }
 
+static void window_iconify_callback(GLFWwindow* window, int iconified) {
+    (void)window;
+    window_visible = !iconified;
+}
+
+static void glfw_queue_scroll(key_code_t key, int32_t rows) {
+    pending_event.type = GRAPHICS_EVENT_SCROLL;
+    pending_event.key = key;
+    pending_event.scroll = rows;
+}
+
+static void scroll_callback(GLFWwindow* window, double xoffset, double yoffset) {
+    (void)window;
+    (void)xoffset;
+
+    if (yoffset != 0.0) {
+        glfw_queue_scroll(KEY_NONE, yoffset > 0.0 ? -1 : 1);
+    }
+}
+
 static void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods) {
     (void)window;
     (void)scancode;
@@ -53,6 +194,24 @@ static void key_callback(GLFWwindow* window, int key, int scancode, int action,
                 pending_event.type = GRAPHICS_EVENT_FULLSCREEN_TOGGLE;
                 pending_event.key = KEY_F;
                 break;
+            case GLFW_KEY_UP:
+                glfw_queue_scroll(KEY_UP, -1);
+                break;
+            case GLFW_KEY_DOWN:
+                glfw_queue_scroll(KEY_DOWN, 1);
+                break;
+            case GLFW_KEY_PAGE_UP:
+                glfw_queue_scroll(KEY_PAGE_UP, 0);
+                break;
+            case GLFW_KEY_PAGE_DOWN:
+                glfw_queue_scroll(KEY_PAGE_DOWN, 0);
+                break;
+            case GLFW_KEY_HOME:
+                glfw_queue_scroll(KEY_HOME, 0);
+                break;
+            case GLFW_KEY_END:
+                glfw_queue_scroll(KEY_END, 0);
+                break;
         }
     }
 }
@@ -78,10 +237,6 @@ int graphics_init(void) {
         ft_initialized = 1;
     }
 
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 2);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 1);
-    glfwWindowHint(GLFW_DOUBLEBUFFER, GLFW_TRUE);
-
     fps_last_time = glfwGetTime();
     frame_count = 0;
     current_fps = 0.0f;
@@ -101,11 +256,57 @@ void graphics_cleanup(void) {
     glfw_initialized = 0;
 }
 
+static void glfw_set_context_hints(gl_dialect_t dialect) {
+    glfwDefaultWindowHints();
+    glfwWindowHint(GLFW_DOUBLEBUFFER, GLFW_TRUE);
+
+    switch (dialect) {
+        case GL_DIALECT_CORE:
+            glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+            glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+            glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+            glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GLFW_TRUE);
+            break;
+        case GL_DIALECT_ES2:
+            glfwWindowHint(GLFW_CLIENT_API, GLFW_OPENGL_ES_API);
+            glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 2);
+            glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 0);
+            break;
+        case GL_DIALECT_LEGACY:
+            glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 2);
+            glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 1);
+            break;
+    }
+}
+
 window_t *window_create(const char *title, int32_t width, int32_t height) {
     window_t *window = malloc(sizeof(window_t));
     if (!window) return NULL;
 
-    GLFWwindow* glfw_window = glfwCreateWindow(width, height, title, NULL, NULL);
+    gl_dialect_t order[] = {GL_DIALECT_CORE, GL_DIALECT_ES2, GL_DIALECT_LEGACY};
+    int order_count = 3;
+    const char *forced = getenv("PLOTTOOL_GL");
+    if (forced) {
+        if (strcmp(forced, "core") == 0) {
+            order_count = 1;
+        } else if (strcmp(forced, "es2") == 0) {
+            order[0] = GL_DIALECT_ES2;
+            order_count = 1;
+        } else if (strcmp(forced, "legacy") == 0) {
+            order[0] = GL_DIALECT_LEGACY;
+            order_count = 1;
+        }
+    }
+
+    GLFWwindow* glfw_window = NULL;
+    int i;
+    for (i = 0; i < order_count && !glfw_window; i++) {
+        glfw_set_context_hints(order[i]);
+        glfw_window = glfwCreateWindow(width, height, title, NULL, NULL);
+        if (glfw_window) {
+            gl_dialect = order[i];
+        }
+    }
     if (!glfw_window) {
         free(window);
         return NULL;
@@ -113,6 +314,8 @@ window_t *window_create(const char *title, int32_t width, int32_t height) {
 
     glfwSetWindowSizeCallback(glfw_window, window_size_callback);
     glfwSetKeyCallback(glfw_window, key_callback);
+    glfwSetWindowIconifyCallback(glfw_window, window_iconify_callback);
+    glfwSetScrollCallback(glfw_window, scroll_callback);
     glfwMakeContextCurrent(glfw_window);
 
     glfwSetWindowSize(glfw_window, width, height);
@@ -168,32 +371,276 @@ void window_get_size(window_t *window, int32_t *width, int32_t *height) {
     glfwGetWindowSize((GLFWwindow*)window->handle, width, height);
 }
 
+static GLuint glfw_compile_shader(GLenum type, const char *prefix, const char *body) {
+    GLuint shader = glCreateShader(type);
+    const char *sources[2];
+    GLint status;
+
+    sources[0] = prefix;
+    sources[1] = body;
+    glShaderSource(shader, 2, sources, NULL);
+    glCompileShader(shader);
+
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
+    if (!status) {
+        char log[512];
+        glGetShaderInfoLog(shader, sizeof(log), NULL, log);
+        fprintf(stderr, "GL shader compile failed: %s\n", log);
+        glDeleteShader(shader);
+        return 0;
+    }
+
+    return shader;
+}
+
+static GLuint glfw_create_program(void) {
+    GLuint vs = glfw_compile_shader(GL_VERTEX_SHADER, glfw_vertex_prefix[gl_dialect], glfw_vertex_shader_body);
+    GLuint fs = glfw_compile_shader(GL_FRAGMENT_SHADER, glfw_fragment_prefix[gl_dialect], glfw_fragment_shader_body);
+    GLuint program;
+    GLint status;
+
+    if (!vs || !fs) {
+        if (vs) glDeleteShader(vs);
+        if (fs) glDeleteShader(fs);
+        return 0;
+    }
+
+    program = glCreateProgram();
+    glAttachShader(program, vs);
+    glAttachShader(program, fs);
+    glBindAttribLocation(program, 0, "a_position");
+    glBindAttribLocation(program, 1, "a_uv");
+    glBindAttribLocation(program, 2, "a_color");
+    glLinkProgram(program);
+
+    glDeleteShader(vs);
+    glDeleteShader(fs);
+
+    glGetProgramiv(program, GL_LINK_STATUS, &status);
+    if (!status) {
+        char log[512];
+        glGetProgramInfoLog(program, sizeof(log), NULL, log);
+        fprintf(stderr, "GL program link failed: %s\n", log);
+        glDeleteProgram(program);
+        return 0;
+    }
+
+    return program;
+}
+
+static void glfw_flush(glfw_renderer_context_t *ctx) {
+    uint32_t triangle_bytes, line_bytes;
+
+    if (ctx->triangles.count == 0 && ctx->lines.count == 0) return;
+
+    triangle_bytes = ctx->triangles.count * sizeof(glfw_vertex_t);
+    line_bytes = ctx->lines.count * sizeof(glfw_vertex_t);
+
+    glUseProgram(ctx->program);
+    if (ctx->vao) {
+        glBindVertexArray(ctx->vao);
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, ctx->vbo);
+
+    /* Orphan the previous storage so the driver never stalls on a buffer
+     * that is still being read by the last draw. */
+    if (triangle_bytes + line_bytes > ctx->vbo_capacity) {
+        ctx->vbo_capacity = (ctx->triangles.capacity + ctx->lines.capacity) * sizeof(glfw_vertex_t);
+    }
+    glBufferData(GL_ARRAY_BUFFER, ctx->vbo_capacity, NULL, GL_STREAM_DRAW);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, triangle_bytes, ctx->triangles.vertices);
+    glBufferSubData(GL_ARRAY_BUFFER, triangle_bytes, line_bytes, ctx->lines.vertices);
+
+    glEnableVertexAttribArray(0);
+    glEnableVertexAttribArray(1);
+    glEnableVertexAttribArray(2);
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(glfw_vertex_t),
+                          (const void *)offsetof(glfw_vertex_t, x));
+    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(glfw_vertex_t),
+                          (const void *)offsetof(glfw_vertex_t, u));
+    glVertexAttribPointer(2, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(glfw_vertex_t),
+                          (const void *)offsetof(glfw_vertex_t, r));
+
+    glUniform2f(ctx->u_viewport, (float)ctx->width, (float)ctx->height);
+    if (ctx->batch_texture) {
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, ctx->batch_texture);
+    }
+
+    if (ctx->triangles.count) glDrawArrays(GL_TRIANGLES, 0, ctx->triangles.count);
+    if (ctx->lines.count) glDrawArrays(GL_LINES, ctx->triangles.count, ctx->lines.count);
+
+    ctx->triangles.count = 0;
+    ctx->lines.count = 0;
+    ctx->batch_texture = 0;
+}
+
+static int glfw_batch_init(glfw_batch_t *batch) {
+    batch->count = 0;
+    batch->capacity = GLFW_BATCH_INITIAL;
+    batch->vertices = malloc(batch->capacity * sizeof(glfw_vertex_t));
+    return batch->vertices != NULL;
+}
+
+static glfw_vertex_t *glfw_reserve(glfw_renderer_context_t *ctx, glfw_batch_t *batch, GLuint texture,
+                                   uint32_t count) {
+    if (texture && ctx->batch_texture && ctx->batch_texture != texture) {
+        glfw_flush(ctx);
+    }
+
+    if (batch->count + count > batch->capacity) {
+        uint32_t new_capacity = batch->capacity * 2;
+        while (new_capacity < batch->count + count) new_capacity *= 2;
+
+        glfw_vertex_t *grown = realloc(batch->vertices, new_capacity * sizeof(glfw_vertex_t));
+        if (!grown) {
+            glfw_flush(ctx);
+            if (count > batch->capacity) return NULL;
+        } else {
+            batch->vertices = grown;
+            batch->capacity = new_capacity;
+        }
+    }
+
+    if (texture) ctx->batch_texture = texture;
+
+    glfw_vertex_t *out = &batch->vertices[batch->count];
+    batch->count += count;
+    return out;
+}
+
+static void glfw_set_vertex(glfw_vertex_t *v, float x, float y, float u, float t, color_t color) {
+    v->x = x;
+    v->y = y;
+    v->u = u;
+    v->v = t;
+    v->r = color.r;
+    v->g = color.g;
+    v->b = color.b;
+    v->a = color.a;
+}
+
+static void glfw_push_line(glfw_renderer_context_t *ctx, float x1, float y1, float x2, float y2) {
+    glfw_vertex_t *v = glfw_reserve(ctx, &ctx->lines, 0, 2);
+    if (!v) return;
+
+    glfw_set_vertex(&v[0], x1 + 0.5f, y1 + 0.5f, -1.0f, -1.0f, ctx->current_color);
+    glfw_set_vertex(&v[1], x2 + 0.5f, y2 + 0.5f, -1.0f, -1.0f, ctx->current_color);
+}
+
+static void glfw_push_quad(glfw_renderer_context_t *ctx, GLuint texture, color_t color,
+                           float x0, float y0, float x1, float y1,
+                           float u0, float v0, float u1, float v1) {
+    glfw_vertex_t *v = glfw_reserve(ctx, &ctx->triangles, texture, 6);
+    if (!v) return;
+
+    glfw_set_vertex(&v[0], x0, y0, u0, v0, color);
+    glfw_set_vertex(&v[1], x1, y0, u1, v0, color);
+    glfw_set_vertex(&v[2], x1, y1, u1, v1, color);
+    glfw_set_vertex(&v[3], x0, y0, u0, v0, color);
+    glfw_set_vertex(&v[4], x1, y1, u1, v1, color);
+    glfw_set_vertex(&v[5], x0, y1, u0, v1, color);
+}
+
 renderer_t *renderer_create(window_t *window) {
     renderer_t *renderer = malloc(sizeof(renderer_t));
     if (!renderer) return NULL;
 
+    glfw_renderer_context_t *ctx = malloc(sizeof(glfw_renderer_context_t));
+    if (!ctx) {
+        free(renderer);
+        return NULL;
+    }
+
     GLFWwindow* glfw_window = (GLFWwindow*)window->handle;
     glfwMakeContextCurrent(glfw_window);
 
-    int32_t width, height;
-    glfwGetFramebufferSize(glfw_window, &width, &height);
-    glViewport(0, 0, width, height);
+    ctx->window = glfw_window;
+    ctx->program = glfw_create_program();
+    if (!ctx->program) {
+        free(ctx);
+        free(renderer);
+        return NULL;
+    }
+
+    ctx->lines.vertices = NULL;
+    if (!glfw_batch_init(&ctx->triangles) || !glfw_batch_init(&ctx->lines)) {
+        glDeleteProgram(ctx->program);
+        free(ctx->triangles.vertices);
+        free(ctx->lines.vertices);
+        free(ctx);
+        free(renderer);
+        return NULL;
+    }
+    ctx->vbo_capacity = 2 * GLFW_BATCH_INITIAL * sizeof(glfw_vertex_t);
+    ctx->batch_texture = 0;
+    ctx->current_color = (color_t){255, 255, 255, 255};
+
+    ctx->vao = 0;
+    if (gl_dialect == GL_DIALECT_CORE) {
+        glGenVertexArrays(1, &ctx->vao);
+        glBindVertexArray(ctx->vao);
+    }
+    glGenBuffers(1, &ctx->vbo);
+
+    ctx->u_viewport = glGetUniformLocation(ctx->program, "u_viewport");
+    ctx->u_texture = glGetUniformLocation(ctx->program, "u_texture");
+    ctx->u_image = glGetUniformLocation(ctx->program, "u_image");
+    glUseProgram(ctx->program);
+    glUniform1i(ctx->u_texture, 0);
+    glUniform1f(ctx->u_image, 0.0f);
+
+    ctx->image_texture = 0;
+    ctx->image_rgba = NULL;
+    ctx->image_rgba_capacity = 0;
+
+    glfwGetWindowSize(glfw_window, &ctx->width, &ctx->height);
+
+    int32_t fb_width, fb_height;
+    glfwGetFramebufferSize(glfw_window, &fb_width, &fb_height);
+    glViewport(0, 0, fb_width, fb_height);
 
     glEnable(GL_BLEND);
     glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
-    renderer->handle = glfw_window;
+    renderer->handle = ctx;
     return renderer;
 }
 
 void renderer_destroy(renderer_t *renderer) {
     if (!renderer) return;
+
+    glfw_renderer_context_t *ctx = (glfw_renderer_context_t*)renderer->handle;
+    if (ctx) {
+        glDeleteBuffers(1, &ctx->vbo);
+        if (ctx->vao) {
+            glDeleteVertexArrays(1, &ctx->vao);
+        }
+        if (ctx->image_texture) {
+            glDeleteTextures(1, &ctx->image_texture);
+        }
+        glDeleteProgram(ctx->program);
+        free(ctx->triangles.vertices);
+        free(ctx->lines.vertices);
+        free(ctx->image_rgba);
+        free(ctx);
+    }
     free(renderer);
 }
 
 void renderer_clear(renderer_t *renderer, color_t color) {
     if (!renderer) return;
 
+    glfw_renderer_context_t *ctx = (glfw_renderer_context_t*)renderer->handle;
+    ctx->triangles.count = 0;
+    ctx->lines.count = 0;
+    ctx->batch_texture = 0;
+
+    int32_t fb_width, fb_height;
+    glfwGetWindowSize(ctx->window, &ctx->width, &ctx->height);
+    glfwGetFramebufferSize(ctx->window, &fb_width, &fb_height);
+    glViewport(0, 0, fb_width, fb_height);
+
     glClearColor(color.r / 255.0f, color.g / 255.0f, color.b / 255.0f, color.a / 255.0f);
     glClear(GL_COLOR_BUFFER_BIT);
 }
@@ -201,77 +648,217 @@ void renderer_clear(renderer_t *renderer, color_t color) {
 void renderer_present(renderer_t *renderer) {
     if (!renderer) return;
 
-    GLFWwindow* glfw_window = (GLFWwindow*)renderer->handle;
-    glfwSwapBuffers(glfw_window);
+    glfw_renderer_context_t *ctx = (glfw_renderer_context_t*)renderer->handle;
+    glfw_flush(ctx);
+    glfwSwapBuffers(ctx->window);
 }
 
-void renderer_set_color(renderer_t *renderer, color_t color) {
+int renderer_read_pixels(renderer_t *renderer, const uint32_t **pixels,
+                         int32_t *width, int32_t *height, int32_t *stride) {
+    (void)renderer;
+    (void)pixels;
+    (void)width;
+    (void)height;
+    (void)stride;
+    return 0;
+}
+
+int renderer_has_backing_store(renderer_t *renderer) {
+    (void)renderer;
+    return 0;
+}
+
+int renderer_begin_plot(renderer_t *renderer, uint32_t index, rect_t rect, int dirty) {
+    (void)renderer;
+    (void)index;
+    (void)rect;
+    (void)dirty;
+    return 1;
+}
+
+/* Two draws per plot, see the batch above */
+void renderer_end_plot(renderer_t *renderer, uint32_t index, rect_t rect) {
+    (void)index;
+    (void)rect;
     if (!renderer) return;
-    glColor4f(color.r / 255.0f, color.g / 255.0f, color.b / 255.0f, color.a / 255.0f);
+
+    glfw_flush((glfw_renderer_context_t*)renderer->handle);
 }
 
-void renderer_draw_line(renderer_t *renderer, int32_t x1, int32_t y1, int32_t x2, int32_t y2) {
+renderer_t *renderer_create_worker(renderer_t *renderer) {
+    (void)renderer;
+    return NULL;
+}
+
+void renderer_set_color(renderer_t *renderer, color_t color) {
     if (!renderer) return;
 
-    GLFWwindow* glfw_window = (GLFWwindow*)renderer->handle;
-    int32_t win_width, win_height;
-    glfwGetWindowSize(glfw_window, &win_width, &win_height);
-    glViewport(0, 0, win_width, win_height);
+    glfw_renderer_context_t *ctx = (glfw_renderer_context_t*)renderer->handle;
+    ctx->current_color = color;
+}
 
-    glMatrixMode(GL_PROJECTION);
-    glLoadIdentity();
-    glOrtho(0, win_width, win_height, 0, -1, 1);
-    glMatrixMode(GL_MODELVIEW);
-    glLoadIdentity();
+void renderer_draw_line(renderer_t *renderer, int32_t x1, int32_t y1, int32_t x2, int32_t y2) {
+    if (!renderer) return;
 
-    glBegin(GL_LINES);
-    glVertex2i(x1, y1);
-    glVertex2i(x2, y2);
-    glEnd();
+    glfw_renderer_context_t *ctx = (glfw_renderer_context_t*)renderer->handle;
+    glfw_push_line(ctx, (float)x1, (float)y1, (float)x2, (float)y2);
 }
 
 void renderer_draw_rect(renderer_t *renderer, rect_t rect) {
     if (!renderer) return;
 
-    GLFWwindow* glfw_window = (GLFWwindow*)renderer->handle;
-    int32_t win_width, win_height;
-    glfwGetWindowSize(glfw_window, &win_width, &win_height);
-    glViewport(0, 0, win_width, win_height);
-
-    glMatrixMode(GL_PROJECTION);
-    glLoadIdentity();
-    glOrtho(0, win_width, win_height, 0, -1, 1);
-    glMatrixMode(GL_MODELVIEW);
-    glLoadIdentity();
+    glfw_renderer_context_t *ctx = (glfw_renderer_context_t*)renderer->handle;
+    float x0 = (float)rect.x;
+    float y0 = (float)rect.y;
+    float x1 = (float)(rect.x + rect.w);
+    float y1 = (float)(rect.y + rect.h);
 
-    glBegin(GL_LINE_LOOP);
-    glVertex2i(rect.x, rect.y);
-    glVertex2i(rect.x + rect.w, rect.y);
-    glVertex2i(rect.x + rect.w, rect.y + rect.h);
-    glVertex2i(rect.x, rect.y + rect.h);
-    glEnd();
+    glfw_push_line(ctx, x0, y0, x1, y0);
+    glfw_push_line(ctx, x1, y0, x1, y1);
+    glfw_push_line(ctx, x1, y1, x0, y1);
+    glfw_push_line(ctx, x0, y1, x0, y0);
 }
 
 void renderer_fill_rect(renderer_t *renderer, rect_t rect) {
     if (!renderer) return;
 
-    GLFWwindow* glfw_window = (GLFWwindow*)renderer->handle;
-    int32_t win_width, win_height;
-    glfwGetWindowSize(glfw_window, &win_width, &win_height);
-    glViewport(0, 0, win_width, win_height);
+    glfw_renderer_context_t *ctx = (glfw_renderer_context_t*)renderer->handle;
+    glfw_push_quad(ctx, 0, ctx->current_color,
+                   (float)rect.x, (float)rect.y,
+                   (float)(rect.x + rect.w), (float)(rect.y + rect.h),
+                   -1.0f, -1.0f, -1.0f, -1.0f);
+}
+
+/* Images go through their own texture and draw call; GLES 2.0 has no BGRA
+ * upload so the scanlines are swizzled to RGBA first. */
+void renderer_draw_image(renderer_t *renderer, rect_t rect, const uint32_t *pixels, int32_t stride) {
+    if (!renderer || !pixels || rect.w <= 0 || rect.h <= 0) return;
+
+    glfw_renderer_context_t *ctx = (glfw_renderer_context_t*)renderer->handle;
+    size_t needed = (size_t)rect.w * rect.h * 4;
+    int32_t x, y;
+
+    if (needed > ctx->image_rgba_capacity) {
+        uint8_t *grown = realloc(ctx->image_rgba, needed);
+        if (!grown) return;
+        ctx->image_rgba = grown;
+        ctx->image_rgba_capacity = needed;
+    }
+
+    for (y = 0; y < rect.h; y++) {
+        const uint32_t *src = pixels + (size_t)y * stride;
+        uint8_t *dst = ctx->image_rgba + (size_t)y * rect.w * 4;
+        for (x = 0; x < rect.w; x++) {
+            dst[0] = (uint8_t)(src[x] >> 16);
+            dst[1] = (uint8_t)(src[x] >> 8);
+            dst[2] = (uint8_t)src[x];
+            dst[3] = 255;
+            dst += 4;
+        }
+    }
 
-    glMatrixMode(GL_PROJECTION);
-    glLoadIdentity();
-    glOrtho(0, win_width, win_height, 0, -1, 1);
-    glMatrixMode(GL_MODELVIEW);
-    glLoadIdentity();
+    glfw_flush(ctx);
 
-    glBegin(GL_QUADS);
-    glVertex2i(rect.x, rect.y);
-    glVertex2i(rect.x + rect.w, rect.y);
-    glVertex2i(rect.x + rect.w, rect.y + rect.h);
-    glVertex2i(rect.x, rect.y + rect.h);
-    glEnd();
+    if (!ctx->image_texture) {
+        glGenTextures(1, &ctx->image_texture);
+        glBindTexture(GL_TEXTURE_2D, ctx->image_texture);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    }
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, ctx->image_texture);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, rect.w, rect.h, 0, GL_RGBA, GL_UNSIGNED_BYTE, ctx->image_rgba);
+
+    glfw_push_quad(ctx, ctx->image_texture, (color_t){255, 255, 255, 255},
+                   (float)rect.x, (float)rect.y,
+                   (float)(rect.x + rect.w), (float)(rect.y + rect.h),
+                   0.0f, 0.0f, 1.0f, 1.0f);
+    glUniform1f(ctx->u_image, 1.0f);
+    glfw_flush(ctx);
+    glUniform1f(ctx->u_image, 0.0f);
+}
+
+static int glfw_build_atlas(glfw_font_context_t *ctx) {
+    FT_Face face = ctx->face;
+    int32_t pen_x = 0, pen_y = 0, row_height = 0;
+    int32_t atlas_height;
+    uint8_t *pixels;
+    int i;
+
+    /* First pass: measure and place every glyph into shelf rows. */
+    for (i = 0; i < GLFW_GLYPH_COUNT; i++) {
+        glfw_glyph_t *g = &ctx->glyphs[i];
+        memset(g, 0, sizeof(*g));
+        if (FT_Load_Char(face, GLFW_GLYPH_FIRST + i, FT_LOAD_RENDER)) {
+            continue;
+        }
+
+        g->advance = face->glyph->advance.x >> 6;
+        g->left = face->glyph->bitmap_left;
+        g->top = face->glyph->bitmap_top;
+        g->width = face->glyph->bitmap.width;
+        g->rows = face->glyph->bitmap.rows;
+
+        if (pen_x + g->width + 1 > GLFW_ATLAS_WIDTH) {
+            pen_x = 0;
+            pen_y += row_height + 1;
+            row_height = 0;
+        }
+        g->u0 = (float)pen_x;
+        g->v0 = (float)pen_y;
+        pen_x += g->width + 1;
+        if (g->rows > row_height) row_height = g->rows;
+    }
+
+    atlas_height = 1;
+    while (atlas_height < pen_y + row_height + 1) atlas_height *= 2;
+
+    pixels = calloc(GLFW_ATLAS_WIDTH, atlas_height);
+    if (!pixels) return 0;
+
+    /* Second pass: copy bitmaps and normalize texture coordinates. */
+    for (i = 0; i < GLFW_GLYPH_COUNT; i++) {
+        glfw_glyph_t *g = &ctx->glyphs[i];
+        int32_t row;
+        int32_t gx = (int32_t)g->u0;
+        int32_t gy = (int32_t)g->v0;
+
+        if (g->width > 0 && g->rows > 0 &&
+            !FT_Load_Char(face, GLFW_GLYPH_FIRST + i, FT_LOAD_RENDER)) {
+            FT_Bitmap *bitmap = &face->glyph->bitmap;
+            for (row = 0; row < g->rows; row++) {
+                memcpy(pixels + (gy + row) * GLFW_ATLAS_WIDTH + gx,
+                       bitmap->buffer + row * bitmap->pitch, g->width);
+            }
+        }
+
+        g->u0 = (float)gx / GLFW_ATLAS_WIDTH;
+        g->v0 = (float)gy / atlas_height;
+        g->u1 = (float)(gx + g->width) / GLFW_ATLAS_WIDTH;
+        g->v1 = (float)(gy + g->rows) / atlas_height;
+    }
+
+    glGenTextures(1, &ctx->texture);
+    glBindTexture(GL_TEXTURE_2D, ctx->texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+    if (gl_dialect == GL_DIALECT_CORE) {
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, GLFW_ATLAS_WIDTH, atlas_height, 0,
+                     GL_RED, GL_UNSIGNED_BYTE, pixels);
+    } else {
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_LUMINANCE, GLFW_ATLAS_WIDTH, atlas_height, 0,
+                     GL_LUMINANCE, GL_UNSIGNED_BYTE, pixels);
+    }
+
+    free(pixels);
+    return 1;
 }
 
 font_t *font_create(const char *path, int32_t size) {
@@ -280,6 +867,12 @@ font_t *font_create(const char *path, int32_t size) {
     font_t *font = malloc(sizeof(font_t));
     if (!font) return NULL;
 
+    glfw_font_context_t *ctx = malloc(sizeof(glfw_font_context_t));
+    if (!ctx) {
+        free(font);
+        return NULL;
+    }
+
     FT_Face face;
     FT_Error error;
 
@@ -290,6 +883,7 @@ font_t *font_create(const char *path, int32_t size) {
             "/System/Library/Fonts/Arial.ttf",
             "/System/Library/Fonts/Helvetica.ttc",
             "/usr/share/fonts/1type/dejavu/DejaVuSans.ttf",
+            "/usr/share/fonts/truetype/dejavu/DejaVuSans.ttf",
             NULL
         };
 
@@ -301,6 +895,7 @@ font_t *font_create(const char *path, int32_t size) {
     }
 
     if (error) {
+        free(ctx);
         free(font);
         return NULL;
     }
@@ -308,18 +903,36 @@ font_t *font_create(const char *path, int32_t size) {
     error = FT_Set_Pixel_Sizes(face, 0, size);
     if (error) {
         FT_Done_Face(face);
+        free(ctx);
         free(font);
         return NULL;
     }
 
-    font->handle = face;
+    ctx->face = face;
+    ctx->texture = 0;
+    ctx->line_height = face->size->metrics.height >> 6;
+
+    if (!glfw_build_atlas(ctx)) {
+        FT_Done_Face(face);
+        free(ctx);
+        free(font);
+        return NULL;
+    }
+
+    font->handle = ctx;
     return font;
 }
 
 void font_destroy(font_t *font) {
     if (!font) return;
-    if (font->handle) {
-        FT_Done_Face((FT_Face)font->handle);
+
+    glfw_font_context_t *ctx = (glfw_font_context_t*)font->handle;
+    if (ctx) {
+        if (ctx->texture) {
+            glDeleteTextures(1, &ctx->texture);
+        }
+        FT_Done_Face(ctx->face);
+        free(ctx);
     }
     free(font);
 }
@@ -328,70 +941,26 @@ void font_draw_text(renderer_t *renderer, font_t *font, color_t color,
                     int32_t x, int32_t y, const char *text) {
     if (!renderer || !font || !text || !font->handle) return;
 
-    GLFWwindow* glfw_window = (GLFWwindow*)renderer->handle;
-    int32_t win_width, win_height;
-    glfwGetWindowSize(glfw_window, &win_width, &win_height);
-    glViewport(0, 0, win_width, win_height);
-
-    glMatrixMode(GL_PROJECTION);
-    glLoadIdentity();
-    glOrtho(0, win_width, 0, win_height, -1, 1);
-    glMatrixMode(GL_MODELVIEW);
-    glLoadIdentity();
+    glfw_renderer_context_t *rctx = (glfw_renderer_context_t*)renderer->handle;
+    glfw_font_context_t *fctx = (glfw_font_context_t*)font->handle;
 
-    glEnable(GL_BLEND);
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-    glEnable(GL_TEXTURE_2D);
-
-    FT_Face face = (FT_Face)font->handle;
     float pen_x = (float)x;
-    float pen_y = (float)(win_height - y - 8);
+    float baseline = (float)(y + 8);
 
     for (const char* c = text; *c; c++) {
-        if (FT_Load_Char(face, *c, FT_LOAD_RENDER)) {
-            continue;
-        }
-
-        FT_GlyphSlot slot = face->glyph;
-        FT_Bitmap bitmap = slot->bitmap;
-
-        if (bitmap.width == 0 || bitmap.rows == 0) {
-            pen_x += slot->advance.x >> 6;
-            continue;
+        int index = (unsigned char)*c - GLFW_GLYPH_FIRST;
+        if (index < 0 || index >= GLFW_GLYPH_COUNT) continue;
+
+        glfw_glyph_t *g = &fctx->glyphs[index];
+        if (g->width > 0 && g->rows > 0) {
+            float gx = pen_x + g->left;
+            float gy = baseline - g->top;
+            glfw_push_quad(rctx, fctx->texture, color,
+                           gx, gy, gx + g->width, gy + g->rows,
+                           g->u0, g->v0, g->u1, g->v1);
         }
-
-        GLuint texture;
-        glGenTextures(1, &texture);
-        glBindTexture(GL_TEXTURE_2D, texture);
-
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_ALPHA, bitmap.width, bitmap.rows, 0,
-                     GL_ALPHA, GL_UNSIGNED_BYTE, bitmap.buffer);
-
-        float xpos = pen_x + slot->bitmap_left;
-        float ypos = pen_y - (bitmap.rows - slot->bitmap_top);
-        float w = (float)bitmap.width;
-        float h = (float)bitmap.rows;
-
-        glColor4f(color.r / 255.0f, color.g / 255.0f, color.b / 255.0f, color.a / 255.0f);
-
-        glBegin(GL_QUADS);
-        glTexCoord2f(0.0f, 0.0f); glVertex2f(xpos, ypos + h);
-        glTexCoord2f(1.0f, 0.0f); glVertex2f(xpos + w, ypos + h);
-        glTexCoord2f(1.0f, 1.0f); glVertex2f(xpos + w, ypos);
-        glTexCoord2f(0.0f, 1.0f); glVertex2f(xpos, ypos);
-        glEnd();
-
-        glDeleteTextures(1, &texture);
-        pen_x += slot->advance.x >> 6;
+        pen_x += g->advance;
     }
-
-    glDisable(GL_TEXTURE_2D);
 }
 
 void font_get_text_size(font_t *font, const char *text, int32_t *width, int32_t *height) {
@@ -401,26 +970,17 @@ void font_get_text_size(font_t *font, const char *text, int32_t *width, int32_t
         return;
     }
 
-    FT_Face face = (FT_Face)font->handle;
+    glfw_font_context_t *ctx = (glfw_font_context_t*)font->handle;
     int total_width = 0;
-    int max_height = 0;
 
     for (const char* c = text; *c; c++) {
-        if (FT_Load_Char(face, *c, FT_LOAD_DEFAULT)) {
-            continue;
-        }
-
-        FT_GlyphSlot slot = face->glyph;
-        total_width += slot->advance.x >> 6;
-
-        int char_height = slot->bitmap_top + (slot->bitmap.rows - slot->bitmap_top);
-        if (char_height > max_height) {
-            max_height = char_height;
-        }
+        int index = (unsigned char)*c - GLFW_GLYPH_FIRST;
+        if (index < 0 || index >= GLFW_GLYPH_COUNT) continue;
+        total_width += ctx->glyphs[index].advance;
     }
 
     if (width) *width = total_width;
-    if (height) *height = max_height > 0 ? max_height : face->size->metrics.height >> 6;
+    if (height) *height = ctx->line_height;
 }
 
 int graphics_poll_events(void) {
@@ -487,6 +1047,13 @@ void graphics_start_render_timer(int fps) {
 void graphics_stop_render_timer(void) {
 }
 
+int window_is_visible(window_t *window) {
+    if (!window) return 0;
+
+    GLFWwindow* glfw_window = (GLFWwindow*)window->handle;
+    return window_visible && glfwGetWindowAttrib(glfw_window, GLFW_VISIBLE);
+}
+
 int window_was_resized(void) {
     int result = window_resized;
     window_resized = 0;
@@ -2,6 +2,7 @@
 #include <gtk/gtk.h>
 #include <cairo.h>
 #include <pango/pangocairo.h>
+#include <string.h>
 #include <sys/time.h>
 #include <unistd.h>
 
@@ -12,13 +13,26 @@ typedef struct {
     cairo_t *cr;
     int width, height;
     gboolean should_quit;
+    gboolean visible;
     GMainLoop *main_loop;
 } gtk_window_context_t;
 
+typedef struct {
+    cairo_surface_t *surface;
+    int width, height;
+    uint32_t last_frame;
+} gtk_plot_cache_t;
+
 typedef struct {
     cairo_t *cr;
     gtk_window_context_t *window_context;
     color_t current_color;
+
+    /* One offscreen surface per plot; cr points at the one being redrawn */
+    gtk_plot_cache_t *plot_cache;
+    uint32_t plot_cache_count;
+    uint32_t frame;
+    int full_damage;
 } gtk_renderer_context_t;
 
 typedef struct {
@@ -29,9 +43,8 @@ typedef struct {
 static int gtk_initialized = 0;
 static gtk_window_context_t *gtk_active_window = NULL;
 
-static graphics_event_t pending_event = {GRAPHICS_EVENT_NONE, 0};
+static graphics_event_t pending_event = {GRAPHICS_EVENT_NONE, 0, 0};
 static int fullscreen_state = 0;
-static guint gtk_render_timer_id = 0;
 static int window_resized = 0;
 
 static uint32_t frame_count = 0;
@@ -41,19 +54,20 @@ static float current_fps = 0.0f;
 static gboolean gtk_draw_callback(GtkWidget *widget, cairo_t *cr, gpointer data);
 static gboolean gtk_delete_event(GtkWidget *widget, GdkEvent *event, gpointer data);
 static void gtk_size_allocate(GtkWidget *widget, GtkAllocation *allocation, gpointer data);
+static gboolean gtk_window_state_event(GtkWidget *widget, GdkEventWindowState *event, gpointer data);
+
+static void gtk_queue_scroll(key_code_t key, int32_t rows) {
+    pending_event.type = GRAPHICS_EVENT_SCROLL;
+    pending_event.key = key;
+    pending_event.scroll = rows;
+}
 
 static uint64_t gtk_get_time_ms(void) {
     return g_get_monotonic_time() / 1000;
 }
 
-static gboolean gtk_render_timer_callback(gpointer user_data) {
-    (void)user_data;
-
-    if (gtk_active_window && gtk_active_window->drawing_area) {
-        gtk_widget_queue_draw(gtk_active_window->drawing_area);
-    }
-
-    return G_SOURCE_CONTINUE;
+static cairo_t *gtk_target(gtk_renderer_context_t *ctx) {
+    return ctx->cr ? ctx->cr : ctx->window_context->cr;
 }
 
 static gboolean gtk_key_press_callback(GtkWidget *widget, GdkEventKey *event, gpointer user_data) {
@@ -75,6 +89,47 @@ static gboolean gtk_key_press_callback(GtkWidget *widget, GdkEventKey *event, gp
             pending_event.type = GRAPHICS_EVENT_FULLSCREEN_TOGGLE;
             pending_event.key = KEY_F;
             break;
+        case GDK_KEY_Up:
+            gtk_queue_scroll(KEY_UP, -1);
+            break;
+        case GDK_KEY_Down:
+            gtk_queue_scroll(KEY_DOWN, 1);
+            break;
+        case GDK_KEY_Page_Up:
+            gtk_queue_scroll(KEY_PAGE_UP, 0);
+            break;
+        case GDK_KEY_Page_Down:
+            gtk_queue_scroll(KEY_PAGE_DOWN, 0);
+            break;
+        case GDK_KEY_Home:
+            gtk_queue_scroll(KEY_HOME, 0);
+            break;
+        case GDK_KEY_End:
+            gtk_queue_scroll(KEY_END, 0);
+            break;
+    }
+
+    return TRUE;
+}
+
+static gboolean gtk_scroll_callback(GtkWidget *widget, GdkEventScroll *event, gpointer user_data) {
+    (void)widget;
+    (void)user_data;
+
+    switch (event->direction) {
+        case GDK_SCROLL_UP:
+            gtk_queue_scroll(KEY_NONE, -1);
+            break;
+        case GDK_SCROLL_DOWN:
+            gtk_queue_scroll(KEY_NONE, 1);
+            break;
+        case GDK_SCROLL_SMOOTH:
+            if (event->delta_y != 0.0) {
+                gtk_queue_scroll(KEY_NONE, event->delta_y < 0.0 ? -1 : 1);
+            }
+            break;
+        default:
+            break;
     }
 
     return TRUE;
@@ -117,6 +172,7 @@ window_t *window_create(const char *title, int32_t width, int32_t height) {
     ctx->width = width;
     ctx->height = height;
     ctx->should_quit = FALSE;
+    ctx->visible = TRUE;
     ctx->main_loop = g_main_loop_new(NULL, FALSE);
 
     gtk_window_set_title(GTK_WINDOW(ctx->window), title);
@@ -135,6 +191,10 @@ window_t *window_create(const char *title, int32_t width, int32_t height) {
     g_signal_connect(ctx->window, "delete-event", G_CALLBACK(gtk_delete_event), ctx);
     g_signal_connect(ctx->drawing_area, "size-allocate", G_CALLBACK(gtk_size_allocate), ctx);
     g_signal_connect(ctx->window, "key-press-event", G_CALLBACK(gtk_key_press_callback), ctx);
+    g_signal_connect(ctx->window, "window-state-event", G_CALLBACK(gtk_window_state_event), ctx);
+    g_signal_connect(ctx->drawing_area, "scroll-event", G_CALLBACK(gtk_scroll_callback), ctx);
+
+    gtk_widget_add_events(ctx->drawing_area, GDK_SCROLL_MASK | GDK_SMOOTH_SCROLL_MASK);
 
     gtk_widget_set_can_focus(ctx->window, TRUE);
     gtk_widget_grab_focus(ctx->window);
@@ -225,6 +285,10 @@ renderer_t *renderer_create(window_t *window) {
     ctx->cr = NULL;
     ctx->window_context = (gtk_window_context_t*)window->handle;
     ctx->current_color = (color_t){255, 255, 255, 255};
+    ctx->plot_cache = NULL;
+    ctx->plot_cache_count = 0;
+    ctx->frame = 0;
+    ctx->full_damage = 1;
 
     renderer->handle = ctx;
     return renderer;
@@ -235,6 +299,16 @@ void renderer_destroy(renderer_t *renderer) {
 
     gtk_renderer_context_t *ctx = (gtk_renderer_context_t*)renderer->handle;
     if (ctx) {
+        uint32_t i;
+        if (ctx->cr) {
+            cairo_destroy(ctx->cr);
+        }
+        for (i = 0; i < ctx->plot_cache_count; i++) {
+            if (ctx->plot_cache[i].surface) {
+                cairo_surface_destroy(ctx->plot_cache[i].surface);
+            }
+        }
+        free(ctx->plot_cache);
         free(ctx);
     }
     free(renderer);
@@ -249,10 +323,123 @@ void renderer_clear(renderer_t *renderer, color_t color) {
                              color.r / 255.0, color.g / 255.0, color.b / 255.0, color.a / 255.0);
         cairo_paint(ctx->window_context->cr);
     }
+    ctx->full_damage = 1;
 }
 
 void renderer_present(renderer_t *renderer) {
     if (!renderer) return;
+
+    gtk_renderer_context_t *ctx = (gtk_renderer_context_t*)renderer->handle;
+    if (ctx->full_damage) {
+        /* A full frame touches every visible plot, so anything left over
+         * has been scrolled away and its surface can go. */
+        uint32_t i;
+        for (i = 0; i < ctx->plot_cache_count; i++) {
+            gtk_plot_cache_t *cache = &ctx->plot_cache[i];
+            if (cache->surface && cache->last_frame != ctx->frame) {
+                cairo_surface_destroy(cache->surface);
+                cache->surface = NULL;
+            }
+        }
+        if (ctx->window_context->drawing_area) {
+            gtk_widget_queue_draw(ctx->window_context->drawing_area);
+        }
+    }
+    ctx->full_damage = 0;
+    ctx->frame++;
+}
+
+int renderer_read_pixels(renderer_t *renderer, const uint32_t **pixels,
+                         int32_t *width, int32_t *height, int32_t *stride) {
+    (void)renderer;
+    (void)pixels;
+    (void)width;
+    (void)height;
+    (void)stride;
+    return 0;
+}
+
+int renderer_has_backing_store(renderer_t *renderer) {
+    return renderer != NULL;
+}
+
+static void gtk_blit_plot(gtk_renderer_context_t *ctx, gtk_plot_cache_t *cache, rect_t rect) {
+    gtk_window_context_t *wctx = ctx->window_context;
+
+    if (!wctx->cr || !cache->surface) return;
+
+    cairo_save(wctx->cr);
+    cairo_rectangle(wctx->cr, rect.x, rect.y, rect.w, rect.h);
+    cairo_clip(wctx->cr);
+    cairo_set_source_surface(wctx->cr, cache->surface, rect.x, rect.y);
+    cairo_set_operator(wctx->cr, CAIRO_OPERATOR_SOURCE);
+    cairo_paint(wctx->cr);
+    cairo_restore(wctx->cr);
+
+    if (!ctx->full_damage && wctx->drawing_area) {
+        gtk_widget_queue_draw_area(wctx->drawing_area, rect.x, rect.y, rect.w, rect.h);
+    }
+}
+
+int renderer_begin_plot(renderer_t *renderer, uint32_t index, rect_t rect, int dirty) {
+    if (!renderer) return 1;
+
+    gtk_renderer_context_t *ctx = (gtk_renderer_context_t*)renderer->handle;
+
+    if (index >= ctx->plot_cache_count) {
+        uint32_t new_count = index + 1;
+        gtk_plot_cache_t *grown = realloc(ctx->plot_cache, sizeof(gtk_plot_cache_t) * new_count);
+        if (!grown) return 1;
+        memset(&grown[ctx->plot_cache_count], 0,
+               sizeof(gtk_plot_cache_t) * (new_count - ctx->plot_cache_count));
+        ctx->plot_cache = grown;
+        ctx->plot_cache_count = new_count;
+    }
+
+    gtk_plot_cache_t *cache = &ctx->plot_cache[index];
+    cache->last_frame = ctx->frame;
+
+    if (cache->surface && cache->width == rect.w && cache->height == rect.h && !dirty) {
+        gtk_blit_plot(ctx, cache, rect);
+        return 0;
+    }
+
+    if (!cache->surface || cache->width != rect.w || cache->height != rect.h) {
+        if (cache->surface) {
+            cairo_surface_destroy(cache->surface);
+        }
+        cache->surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, rect.w, rect.h);
+        cache->width = rect.w;
+        cache->height = rect.h;
+    }
+
+    if (ctx->cr) {
+        cairo_destroy(ctx->cr);
+    }
+    ctx->cr = cairo_create(cache->surface);
+    cairo_translate(ctx->cr, -rect.x, -rect.y);
+    return 1;
+}
+
+void renderer_end_plot(renderer_t *renderer, uint32_t index, rect_t rect) {
+    if (!renderer) return;
+
+    gtk_renderer_context_t *ctx = (gtk_renderer_context_t*)renderer->handle;
+
+    if (!ctx->cr) return;
+
+    cairo_destroy(ctx->cr);
+    ctx->cr = NULL;
+
+    if (index < ctx->plot_cache_count) {
+        cairo_surface_flush(ctx->plot_cache[index].surface);
+        gtk_blit_plot(ctx, &ctx->plot_cache[index], rect);
+    }
+}
+
+renderer_t *renderer_create_worker(renderer_t *renderer) {
+    (void)renderer;
+    return NULL;
 }
 
 void renderer_set_color(renderer_t *renderer, color_t color) {
@@ -266,15 +453,16 @@ void renderer_draw_line(renderer_t *renderer, int32_t x1, int32_t y1, int32_t x2
     if (!renderer) return;
 
     gtk_renderer_context_t *ctx = (gtk_renderer_context_t*)renderer->handle;
-    if (ctx->window_context->cr) {
-        cairo_set_source_rgba(ctx->window_context->cr,
+    cairo_t *cr = gtk_target(ctx);
+    if (cr) {
+        cairo_set_source_rgba(cr,
                              ctx->current_color.r / 255.0, ctx->current_color.g / 255.0,
                              ctx->current_color.b / 255.0, ctx->current_color.a / 255.0);
-        cairo_set_line_width(ctx->window_context->cr, 1.0);
-        cairo_set_antialias(ctx->window_context->cr, CAIRO_ANTIALIAS_NONE);
-        cairo_move_to(ctx->window_context->cr, x1 + 0.5, y1 + 0.5);
-        cairo_line_to(ctx->window_context->cr, x2 + 0.5, y2 + 0.5);
-        cairo_stroke(ctx->window_context->cr);
+        cairo_set_line_width(cr, 1.0);
+        cairo_set_antialias(cr, CAIRO_ANTIALIAS_NONE);
+        cairo_move_to(cr, x1 + 0.5, y1 + 0.5);
+        cairo_line_to(cr, x2 + 0.5, y2 + 0.5);
+        cairo_stroke(cr);
     }
 }
 
@@ -282,14 +470,15 @@ void renderer_draw_rect(renderer_t *renderer, rect_t rect) {
     if (!renderer) return;
 
     gtk_renderer_context_t *ctx = (gtk_renderer_context_t*)renderer->handle;
-    if (ctx->window_context->cr) {
-        cairo_set_source_rgba(ctx->window_context->cr,
+    cairo_t *cr = gtk_target(ctx);
+    if (cr) {
+        cairo_set_source_rgba(cr,
                              ctx->current_color.r / 255.0, ctx->current_color.g / 255.0,
                              ctx->current_color.b / 255.0, ctx->current_color.a / 255.0);
-        cairo_set_line_width(ctx->window_context->cr, 1.0);
-        cairo_set_antialias(ctx->window_context->cr, CAIRO_ANTIALIAS_NONE);
-        cairo_rectangle(ctx->window_context->cr, rect.x + 0.5, rect.y + 0.5, rect.w - 1, rect.h - 1);
-        cairo_stroke(ctx->window_context->cr);
+        cairo_set_line_width(cr, 1.0);
+        cairo_set_antialias(cr, CAIRO_ANTIALIAS_NONE);
+        cairo_rectangle(cr, rect.x + 0.5, rect.y + 0.5, rect.w - 1, rect.h - 1);
+        cairo_stroke(cr);
     }
 }
 
@@ -297,15 +486,34 @@ void renderer_fill_rect(renderer_t *renderer, rect_t rect) {
     if (!renderer) return;
 
     gtk_renderer_context_t *ctx = (gtk_renderer_context_t*)renderer->handle;
-    if (ctx->window_context->cr) {
-        cairo_set_source_rgba(ctx->window_context->cr,
+    cairo_t *cr = gtk_target(ctx);
+    if (cr) {
+        cairo_set_source_rgba(cr,
                              ctx->current_color.r / 255.0, ctx->current_color.g / 255.0,
                              ctx->current_color.b / 255.0, ctx->current_color.a / 255.0);
-        cairo_rectangle(ctx->window_context->cr, rect.x, rect.y, rect.w, rect.h);
-        cairo_fill(ctx->window_context->cr);
+        cairo_rectangle(cr, rect.x, rect.y, rect.w, rect.h);
+        cairo_fill(cr);
     }
 }
 
+void renderer_draw_image(renderer_t *renderer, rect_t rect, const uint32_t *pixels, int32_t stride) {
+    if (!renderer || !pixels || rect.w <= 0 || rect.h <= 0) return;
+
+    gtk_renderer_context_t *ctx = (gtk_renderer_context_t*)renderer->handle;
+    cairo_t *cr = gtk_target(ctx);
+    if (!cr) return;
+
+    /* CAIRO_FORMAT_RGB24 is the same native endian 0x00RRGGBB layout */
+    cairo_surface_t *image = cairo_image_surface_create_for_data((unsigned char*)pixels,
+                                                                 CAIRO_FORMAT_RGB24,
+                                                                 rect.w, rect.h, stride * 4);
+    if (cairo_surface_status(image) == CAIRO_STATUS_SUCCESS) {
+        cairo_set_source_surface(cr, image, rect.x, rect.y);
+        cairo_paint(cr);
+    }
+    cairo_surface_destroy(image);
+}
+
 font_t *font_create(const char *path, int32_t size) {
     font_t *font = malloc(sizeof(font_t));
     if (!font) return NULL;
@@ -352,17 +560,20 @@ void font_draw_text(renderer_t *renderer, font_t *font, color_t color,
     gtk_renderer_context_t *rctx = (gtk_renderer_context_t*)renderer->handle;
     gtk_font_context_t *fctx = (gtk_font_context_t*)font->handle;
 
-    if (rctx->window_context->cr) {
+    cairo_t *cr = gtk_target(rctx);
+    if (cr) {
         if (!fctx->layout) {
-            fctx->layout = pango_cairo_create_layout(rctx->window_context->cr);
+            fctx->layout = pango_cairo_create_layout(cr);
             pango_layout_set_font_description(fctx->layout, fctx->font_desc);
+        } else {
+            pango_cairo_update_layout(cr, fctx->layout);
         }
 
         pango_layout_set_text(fctx->layout, text, -1);
-        cairo_set_source_rgba(rctx->window_context->cr,
+        cairo_set_source_rgba(cr,
                              color.r / 255.0, color.g / 255.0, color.b / 255.0, color.a / 255.0);
-        cairo_move_to(rctx->window_context->cr, x, y);
-        pango_cairo_show_layout(rctx->window_context->cr, fctx->layout);
+        cairo_move_to(cr, x, y);
+        pango_cairo_show_layout(cr, fctx->layout);
     }
 }
 
@@ -441,19 +652,10 @@ int graphics_get_event(graphics_event_t *event) {
 }
 
 void graphics_start_render_timer(int fps) {
-    if (gtk_render_timer_id != 0) {
-        g_source_remove(gtk_render_timer_id);
-    }
-
-    guint interval = 1000 / fps;
-    gtk_render_timer_id = g_timeout_add(interval, gtk_render_timer_callback, NULL);
+    (void)fps;
 }
 
 void graphics_stop_render_timer(void) {
-    if (gtk_render_timer_id != 0) {
-        g_source_remove(gtk_render_timer_id);
-        gtk_render_timer_id = 0;
-    }
 }
 
 static gboolean gtk_draw_callback(GtkWidget *widget, cairo_t *cr, gpointer data) {
@@ -503,6 +705,23 @@ static void gtk_size_allocate(GtkWidget *widget, GtkAllocation *allocation, gpoi
     }
 }
 
+static gboolean gtk_window_state_event(GtkWidget *widget, GdkEventWindowState *event, gpointer data) {
+    gtk_window_context_t *ctx = (gtk_window_context_t*)data;
+    (void)widget;
+
+    ctx->visible = (event->new_window_state &
+                    (GDK_WINDOW_STATE_ICONIFIED | GDK_WINDOW_STATE_WITHDRAWN)) == 0;
+
+    return FALSE;
+}
+
+int window_is_visible(window_t *window) {
+    if (!window) return 0;
+
+    gtk_window_context_t *ctx = (gtk_window_context_t*)window->handle;
+    return ctx->visible;
+}
+
 int window_was_resized(void) {
     int result = window_resized;
     window_resized = 0;
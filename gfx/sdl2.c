@@ -5,14 +5,21 @@
 
 static int sdl_initialized = 0;
 static int window_resized = 0;
+static int window_visible = 1;
 
 static uint32_t frame_count = 0;
 static uint32_t fps_last_time = 0;
 static float current_fps = 0.0f;
 
-static graphics_event_t pending_event = {GRAPHICS_EVENT_NONE, 0};
+static graphics_event_t pending_event = {GRAPHICS_EVENT_NONE, 0, 0};
 static int fullscreen_state = 0;
 
+static void sdl_queue_scroll(key_code_t key, int32_t rows) {
+    pending_event.type = GRAPHICS_EVENT_SCROLL;
+    pending_event.key = key;
+    pending_event.scroll = rows;
+}
+
 int graphics_init(void) {
     if (sdl_initialized) {
         return 1;
@@ -133,6 +140,40 @@ void renderer_present(renderer_t *renderer) {
     SDL_RenderPresent((SDL_Renderer*)renderer->handle);
 }
 
+int renderer_read_pixels(renderer_t *renderer, const uint32_t **pixels,
+                         int32_t *width, int32_t *height, int32_t *stride) {
+    (void)renderer;
+    (void)pixels;
+    (void)width;
+    (void)height;
+    (void)stride;
+    return 0;
+}
+
+int renderer_has_backing_store(renderer_t *renderer) {
+    (void)renderer;
+    return 0;
+}
+
+int renderer_begin_plot(renderer_t *renderer, uint32_t index, rect_t rect, int dirty) {
+    (void)renderer;
+    (void)index;
+    (void)rect;
+    (void)dirty;
+    return 1;
+}
+
+void renderer_end_plot(renderer_t *renderer, uint32_t index, rect_t rect) {
+    (void)renderer;
+    (void)index;
+    (void)rect;
+}
+
+renderer_t *renderer_create_worker(renderer_t *renderer) {
+    (void)renderer;
+    return NULL;
+}
+
 void renderer_set_color(renderer_t *renderer, color_t color) {
     if (!renderer) return;
     SDL_SetRenderDrawColor((SDL_Renderer*)renderer->handle,
@@ -156,6 +197,22 @@ void renderer_fill_rect(renderer_t *renderer, rect_t rect) {
     SDL_RenderFillRect((SDL_Renderer*)renderer->handle, &sdl_rect);
 }
 
+void renderer_draw_image(renderer_t *renderer, rect_t rect, const uint32_t *pixels, int32_t stride) {
+    if (!renderer || !pixels || rect.w <= 0 || rect.h <= 0) return;
+
+    SDL_Surface *surface = SDL_CreateRGBSurfaceWithFormatFrom((void*)pixels, rect.w, rect.h, 32,
+                                                              stride * 4, SDL_PIXELFORMAT_RGB888);
+    if (!surface) return;
+
+    SDL_Texture *texture = SDL_CreateTextureFromSurface((SDL_Renderer*)renderer->handle, surface);
+    SDL_FreeSurface(surface);
+    if (!texture) return;
+
+    SDL_Rect sdl_rect = {rect.x, rect.y, rect.w, rect.h};
+    SDL_RenderCopy((SDL_Renderer*)renderer->handle, texture, NULL, &sdl_rect);
+    SDL_DestroyTexture(texture);
+}
+
 font_t *font_create(const char *path, int32_t size) {
     font_t *font = malloc(sizeof(font_t));
     if (!font) return NULL;
@@ -254,8 +311,20 @@ int graphics_wait_events(void) {
                 case SDL_QUIT:
                     return 0;
                 case SDL_WINDOWEVENT:
-                    if (event.window.event == SDL_WINDOWEVENT_RESIZED) {
-                        window_resized = 1;
+                    switch (event.window.event) {
+                        case SDL_WINDOWEVENT_RESIZED:
+                            window_resized = 1;
+                            break;
+                        case SDL_WINDOWEVENT_HIDDEN:
+                        case SDL_WINDOWEVENT_MINIMIZED:
+                            window_visible = 0;
+                            break;
+                        case SDL_WINDOWEVENT_SHOWN:
+                        case SDL_WINDOWEVENT_RESTORED:
+                        case SDL_WINDOWEVENT_MAXIMIZED:
+                        case SDL_WINDOWEVENT_EXPOSED:
+                            window_visible = 1;
+                            break;
                     }
                     break;
                 case SDL_KEYDOWN:
@@ -272,8 +341,34 @@ int graphics_wait_events(void) {
                             pending_event.type = GRAPHICS_EVENT_FULLSCREEN_TOGGLE;
                             pending_event.key = KEY_F;
                             break;
+                        case SDLK_UP:
+                            sdl_queue_scroll(KEY_UP, -1);
+                            break;
+                        case SDLK_DOWN:
+                            sdl_queue_scroll(KEY_DOWN, 1);
+                            break;
+                        case SDLK_PAGEUP:
+                            sdl_queue_scroll(KEY_PAGE_UP, 0);
+                            break;
+                        case SDLK_PAGEDOWN:
+                            sdl_queue_scroll(KEY_PAGE_DOWN, 0);
+                            break;
+                        case SDLK_HOME:
+                            sdl_queue_scroll(KEY_HOME, 0);
+                            break;
+                        case SDLK_END:
+                            sdl_queue_scroll(KEY_END, 0);
+                            break;
                     }
                     break;
+                case SDL_MOUSEWHEEL: {
+                    Sint32 wheel_y = event.wheel.y;
+                    if (event.wheel.direction == SDL_MOUSEWHEEL_FLIPPED) wheel_y = -wheel_y;
+                    if (wheel_y != 0) {
+                        sdl_queue_scroll(KEY_NONE, wheel_y > 0 ? -1 : 1);
+                    }
+                    break;
+                }
                 case SDL_MOUSEBUTTONDOWN:
                 case SDL_MOUSEMOTION:
                 case SDL_USEREVENT:
@@ -305,6 +400,11 @@ void graphics_start_render_timer(int fps) {
 void graphics_stop_render_timer(void) {
 }
 
+int window_is_visible(window_t *window) {
+    if (!window) return 0;
+    return window_visible;
+}
+
 int window_was_resized(void) {
     int result = window_resized;
     window_resized = 0;
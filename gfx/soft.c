@@ -0,0 +1,693 @@
+#define _GNU_SOURCE
+#include "../graphics.h"
+#include "soft_font.h"
+#include <sys/time.h>
+#include <unistd.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+/* Headless renderer drawing into a 0x00RRGGBB framebuffer in memory. There
+ * is no display, so input comes only from signals. */
+
+typedef struct {
+    uint32_t *pixels;
+    int32_t width, height;
+    int32_t stride;     /* in pixels */
+    int fullscreen;
+} soft_window_context_t;
+
+/* Opaque vertical lines, one slot per x. Bars are queued and written
+ * scanline by scanline since filling them one at a time down a 4K
+ * framebuffer misses the cache on every pixel. */
+typedef struct {
+    int32_t *top;       /* top > bottom marks an empty slot */
+    int32_t *bottom;
+    uint32_t *pixel;
+    int32_t min_x, max_x;
+    int32_t min_y, max_y;
+} soft_columns_t;
+
+/* Worker renderers share the window but keep their own colour, queue and
+ * clip, so plots can be drawn on several threads at once. */
+typedef struct {
+    soft_window_context_t *window_context;
+    uint32_t current_color;
+    uint8_t current_alpha;
+    soft_columns_t columns;
+    rect_t clip;        /* the whole framebuffer outside begin/end_plot */
+} soft_renderer_context_t;
+
+typedef struct {
+    int32_t scale;
+} soft_font_context_t;
+
+static int soft_initialized = 0;
+static soft_window_context_t *soft_active_window = NULL;
+
+static uint32_t frame_count = 0;
+static uint64_t fps_last_time = 0;
+static float current_fps = 0.0f;
+
+static uint64_t soft_get_time_ms(void) {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (uint64_t)(tv.tv_sec * 1000 + tv.tv_usec / 1000);
+}
+
+static uint32_t soft_pack(color_t color) {
+    return ((uint32_t)color.r << 16) | ((uint32_t)color.g << 8) | color.b;
+}
+
+/* Red and blue share one multiply, green gets the other */
+static uint32_t soft_blend(uint32_t dst, uint32_t src, uint32_t alpha) {
+    uint32_t inv = 255 - alpha;
+    uint32_t rb = ((src & 0xff00ff) * alpha + (dst & 0xff00ff) * inv) >> 8;
+    uint32_t g = ((src & 0x00ff00) * alpha + (dst & 0x00ff00) * inv) >> 8;
+    return (rb & 0xff00ff) | (g & 0x00ff00);
+}
+
+static void soft_fill_span(uint32_t *dst, int32_t count, uint32_t pixel) {
+#if defined(__SSE2__)
+    __m128i v = _mm_set1_epi32((int)pixel);
+    while (count >= 16) {
+        _mm_storeu_si128((__m128i*)dst, v);
+        _mm_storeu_si128((__m128i*)(dst + 4), v);
+        _mm_storeu_si128((__m128i*)(dst + 8), v);
+        _mm_storeu_si128((__m128i*)(dst + 12), v);
+        dst += 16;
+        count -= 16;
+    }
+    while (count >= 4) {
+        _mm_storeu_si128((__m128i*)dst, v);
+        dst += 4;
+        count -= 4;
+    }
+#elif defined(__ARM_NEON)
+    uint32x4_t v = vdupq_n_u32(pixel);
+    while (count >= 16) {
+        vst1q_u32(dst, v);
+        vst1q_u32(dst + 4, v);
+        vst1q_u32(dst + 8, v);
+        vst1q_u32(dst + 12, v);
+        dst += 16;
+        count -= 16;
+    }
+    while (count >= 4) {
+        vst1q_u32(dst, v);
+        dst += 4;
+        count -= 4;
+    }
+#endif
+    while (count-- > 0) {
+        *dst++ = pixel;
+    }
+}
+
+/* Columns are strided so there is nothing to vectorize, unroll instead */
+static void soft_fill_column(uint32_t *dst, int32_t count, int32_t stride, uint32_t pixel) {
+    while (count >= 4) {
+        dst[0] = pixel;
+        dst[stride] = pixel;
+        dst[stride * 2] = pixel;
+        dst[stride * 3] = pixel;
+        dst += stride * 4;
+        count -= 4;
+    }
+    while (count-- > 0) {
+        *dst = pixel;
+        dst += stride;
+    }
+}
+
+static void soft_blend_span(uint32_t *dst, int32_t count, uint32_t pixel, uint32_t alpha) {
+    while (count-- > 0) {
+        *dst = soft_blend(*dst, pixel, alpha);
+        dst++;
+    }
+}
+
+/* Clip rect against the renderer clip, returns 0 if nothing is left */
+static int soft_clip(soft_renderer_context_t *ctx, rect_t *rect) {
+    int32_t x2 = rect->x + rect->w;
+    int32_t y2 = rect->y + rect->h;
+
+    if (rect->x < ctx->clip.x) rect->x = ctx->clip.x;
+    if (rect->y < ctx->clip.y) rect->y = ctx->clip.y;
+    if (x2 > ctx->clip.x + ctx->clip.w) x2 = ctx->clip.x + ctx->clip.w;
+    if (y2 > ctx->clip.y + ctx->clip.h) y2 = ctx->clip.y + ctx->clip.h;
+
+    rect->w = x2 - rect->x;
+    rect->h = y2 - rect->y;
+    return rect->w > 0 && rect->h > 0;
+}
+
+static void soft_fill(soft_renderer_context_t *ctx, rect_t rect, uint32_t pixel, uint8_t alpha) {
+    soft_window_context_t *wctx = ctx->window_context;
+    int32_t y;
+    if (alpha == 0 || !soft_clip(ctx, &rect)) return;
+
+    uint32_t *row = wctx->pixels + (size_t)rect.y * wctx->stride + rect.x;
+
+    if (alpha != 255) {
+        for (y = 0; y < rect.h; y++, row += wctx->stride) {
+            soft_blend_span(row, rect.w, pixel, alpha);
+        }
+    } else if (rect.w == 1) {
+        soft_fill_column(row, rect.h, wctx->stride, pixel);
+    } else {
+        for (y = 0; y < rect.h; y++, row += wctx->stride) {
+            soft_fill_span(row, rect.w, pixel);
+        }
+    }
+}
+
+static void soft_reset_columns(soft_columns_t *columns, int32_t from, int32_t to) {
+    int32_t x;
+    for (x = from; x <= to; x++) {
+        columns->top[x] = INT32_MAX;
+        columns->bottom[x] = -1;
+    }
+    columns->min_x = INT32_MAX;
+    columns->max_x = -1;
+    columns->min_y = INT32_MAX;
+    columns->max_y = -1;
+}
+
+static void soft_flush_columns(soft_renderer_context_t *ctx) {
+    soft_columns_t *columns = &ctx->columns;
+    soft_window_context_t *wctx = ctx->window_context;
+    int32_t y;
+
+    if (columns->max_x < columns->min_x) return;
+
+    for (y = columns->min_y; y <= columns->max_y; y++) {
+        uint32_t *row = wctx->pixels + (size_t)y * wctx->stride;
+        int32_t x = columns->min_x;
+
+#if defined(__SSE2__)
+        __m128i vy = _mm_set1_epi32(y);
+        for (; x + 4 <= columns->max_x + 1; x += 4) {
+            __m128i top = _mm_loadu_si128((const __m128i*)(columns->top + x));
+            __m128i bottom = _mm_loadu_si128((const __m128i*)(columns->bottom + x));
+            __m128i src = _mm_loadu_si128((const __m128i*)(columns->pixel + x));
+            __m128i dst = _mm_loadu_si128((const __m128i*)(row + x));
+            __m128i outside = _mm_or_si128(_mm_cmpgt_epi32(top, vy), _mm_cmpgt_epi32(vy, bottom));
+            dst = _mm_or_si128(_mm_and_si128(outside, dst), _mm_andnot_si128(outside, src));
+            _mm_storeu_si128((__m128i*)(row + x), dst);
+        }
+#elif defined(__ARM_NEON)
+        int32x4_t vy = vdupq_n_s32(y);
+        for (; x + 4 <= columns->max_x + 1; x += 4) {
+            uint32x4_t inside = vandq_u32(vcleq_s32(vld1q_s32(columns->top + x), vy),
+                                          vcgeq_s32(vld1q_s32(columns->bottom + x), vy));
+            vst1q_u32(row + x, vbslq_u32(inside, vld1q_u32(columns->pixel + x), vld1q_u32(row + x)));
+        }
+#endif
+        for (; x <= columns->max_x; x++) {
+            if (y >= columns->top[x] && y <= columns->bottom[x]) {
+                row[x] = columns->pixel[x];
+            }
+        }
+    }
+
+    soft_reset_columns(columns, columns->min_x, columns->max_x);
+}
+
+static void soft_queue_column(soft_renderer_context_t *ctx, int32_t x, int32_t y1, int32_t y2) {
+    soft_columns_t *columns = &ctx->columns;
+    rect_t *clip = &ctx->clip;
+
+    if (y1 < clip->y) y1 = clip->y;
+    if (y2 >= clip->y + clip->h) y2 = clip->y + clip->h - 1;
+    if (x < clip->x || x >= clip->x + clip->w || y1 > y2) return;
+
+    /* A second line on the same x has to land on top of the first */
+    if (columns->top[x] <= columns->bottom[x]) {
+        soft_flush_columns(ctx);
+    }
+
+    columns->top[x] = y1;
+    columns->bottom[x] = y2;
+    columns->pixel[x] = ctx->current_color;
+    if (x < columns->min_x) columns->min_x = x;
+    if (x > columns->max_x) columns->max_x = x;
+    if (y1 < columns->min_y) columns->min_y = y1;
+    if (y2 > columns->max_y) columns->max_y = y2;
+}
+
+static void soft_plot(soft_renderer_context_t *ctx, int32_t x, int32_t y, uint32_t pixel, uint8_t alpha) {
+    soft_window_context_t *wctx = ctx->window_context;
+    rect_t *clip = &ctx->clip;
+    if (x < clip->x || y < clip->y || x >= clip->x + clip->w || y >= clip->y + clip->h) return;
+
+    uint32_t *dst = wctx->pixels + (size_t)y * wctx->stride + x;
+    *dst = alpha == 255 ? pixel : soft_blend(*dst, pixel, alpha);
+}
+
+int graphics_init(void) {
+    if (soft_initialized) {
+        return 1;
+    }
+
+    fps_last_time = soft_get_time_ms();
+    frame_count = 0;
+    current_fps = 0.0f;
+
+    soft_initialized = 1;
+    return 1;
+}
+
+void graphics_cleanup(void) {
+    if (!soft_initialized) return;
+    soft_initialized = 0;
+}
+
+window_t *window_create(const char *title, int32_t width, int32_t height) {
+    (void)title;
+    if (width <= 0 || height <= 0) return NULL;
+
+    window_t *window = malloc(sizeof(window_t));
+    if (!window) return NULL;
+
+    soft_window_context_t *ctx = malloc(sizeof(soft_window_context_t));
+    if (!ctx) {
+        free(window);
+        return NULL;
+    }
+
+    ctx->pixels = calloc((size_t)width * height, sizeof(uint32_t));
+    if (!ctx->pixels) {
+        free(ctx);
+        free(window);
+        return NULL;
+    }
+
+    ctx->width = width;
+    ctx->height = height;
+    ctx->stride = width;
+    ctx->fullscreen = 0;
+
+    soft_active_window = ctx;
+
+    window->handle = ctx;
+    return window;
+}
+
+void window_destroy(window_t *window) {
+    if (!window) return;
+
+    soft_window_context_t *ctx = (soft_window_context_t*)window->handle;
+    if (ctx) {
+        if (soft_active_window == ctx) {
+            soft_active_window = NULL;
+        }
+        free(ctx->pixels);
+        free(ctx);
+    }
+    free(window);
+}
+
+void window_set_fullscreen(window_t *window, int fullscreen) {
+    if (!window) return;
+
+    soft_window_context_t *ctx = (soft_window_context_t*)window->handle;
+    ctx->fullscreen = fullscreen;
+}
+
+int window_is_fullscreen(window_t *window) {
+    if (!window) return 0;
+
+    soft_window_context_t *ctx = (soft_window_context_t*)window->handle;
+    return ctx->fullscreen;
+}
+
+void window_set_topmost(window_t *window, int topmost) {
+    (void)window;
+    (void)topmost;
+}
+
+void window_get_size(window_t *window, int32_t *width, int32_t *height) {
+    if (!window || !width || !height) return;
+
+    soft_window_context_t *ctx = (soft_window_context_t*)window->handle;
+    *width = ctx->width;
+    *height = ctx->height;
+}
+
+int window_was_resized(void) {
+    return 0;
+}
+
+int window_is_visible(window_t *window) {
+    return window != NULL;
+}
+
+renderer_t *renderer_create(window_t *window) {
+    if (!window) return NULL;
+
+    renderer_t *renderer = malloc(sizeof(renderer_t));
+    if (!renderer) return NULL;
+
+    soft_renderer_context_t *ctx = malloc(sizeof(soft_renderer_context_t));
+    if (!ctx) {
+        free(renderer);
+        return NULL;
+    }
+
+    ctx->window_context = (soft_window_context_t*)window->handle;
+    ctx->current_color = 0;
+    ctx->current_alpha = 255;
+    ctx->clip.x = 0;
+    ctx->clip.y = 0;
+    ctx->clip.w = ctx->window_context->width;
+    ctx->clip.h = ctx->window_context->height;
+
+    int32_t width = ctx->window_context->width;
+    ctx->columns.top = malloc(sizeof(int32_t) * width);
+    ctx->columns.bottom = malloc(sizeof(int32_t) * width);
+    ctx->columns.pixel = malloc(sizeof(uint32_t) * width);
+    if (!ctx->columns.top || !ctx->columns.bottom || !ctx->columns.pixel) {
+        free(ctx->columns.top);
+        free(ctx->columns.bottom);
+        free(ctx->columns.pixel);
+        free(ctx);
+        free(renderer);
+        return NULL;
+    }
+    soft_reset_columns(&ctx->columns, 0, width - 1);
+
+    renderer->handle = ctx;
+    return renderer;
+}
+
+void renderer_destroy(renderer_t *renderer) {
+    if (!renderer) return;
+
+    soft_renderer_context_t *ctx = (soft_renderer_context_t*)renderer->handle;
+    if (ctx) {
+        free(ctx->columns.top);
+        free(ctx->columns.bottom);
+        free(ctx->columns.pixel);
+        free(ctx);
+    }
+    free(renderer);
+}
+
+void renderer_clear(renderer_t *renderer, color_t color) {
+    if (!renderer) return;
+
+    soft_renderer_context_t *ctx = (soft_renderer_context_t*)renderer->handle;
+    soft_window_context_t *wctx = ctx->window_context;
+    rect_t all = {0, 0, wctx->width, wctx->height};
+
+    soft_reset_columns(&ctx->columns, 0, wctx->width - 1);
+    soft_fill(ctx, all, soft_pack(color), 255);
+}
+
+void renderer_present(renderer_t *renderer) {
+    if (!renderer) return;
+    soft_flush_columns((soft_renderer_context_t*)renderer->handle);
+}
+
+int renderer_read_pixels(renderer_t *renderer, const uint32_t **pixels,
+                         int32_t *width, int32_t *height, int32_t *stride) {
+    if (!renderer || !pixels || !width || !height || !stride) return 0;
+
+    soft_renderer_context_t *ctx = (soft_renderer_context_t*)renderer->handle;
+    soft_flush_columns(ctx);
+    *pixels = ctx->window_context->pixels;
+    *width = ctx->window_context->width;
+    *height = ctx->window_context->height;
+    *stride = ctx->window_context->stride;
+    return 1;
+}
+
+/* The framebuffer is never thrown away, plots without new samples keep
+ * their pixels from the previous frame. */
+int renderer_has_backing_store(renderer_t *renderer) {
+    return renderer != NULL;
+}
+
+int renderer_begin_plot(renderer_t *renderer, uint32_t index, rect_t rect, int dirty) {
+    if (!renderer) return 0;
+    (void)index;
+    (void)dirty;
+
+    soft_renderer_context_t *ctx = (soft_renderer_context_t*)renderer->handle;
+    soft_flush_columns(ctx);
+    if (!soft_clip(ctx, &rect)) return 0;
+    ctx->clip = rect;
+    return 1;
+}
+
+void renderer_end_plot(renderer_t *renderer, uint32_t index, rect_t rect) {
+    if (!renderer) return;
+    (void)index;
+    (void)rect;
+
+    soft_renderer_context_t *ctx = (soft_renderer_context_t*)renderer->handle;
+    soft_flush_columns(ctx);
+    ctx->clip.x = 0;
+    ctx->clip.y = 0;
+    ctx->clip.w = ctx->window_context->width;
+    ctx->clip.h = ctx->window_context->height;
+}
+
+renderer_t *renderer_create_worker(renderer_t *renderer) {
+    if (!renderer) return NULL;
+
+    soft_renderer_context_t *ctx = (soft_renderer_context_t*)renderer->handle;
+    window_t window;
+    window.handle = ctx->window_context;
+    return renderer_create(&window);
+}
+
+void renderer_set_color(renderer_t *renderer, color_t color) {
+    if (!renderer) return;
+
+    soft_renderer_context_t *ctx = (soft_renderer_context_t*)renderer->handle;
+    ctx->current_color = soft_pack(color);
+    ctx->current_alpha = color.a;
+}
+
+void renderer_draw_line(renderer_t *renderer, int32_t x1, int32_t y1, int32_t x2, int32_t y2) {
+    if (!renderer) return;
+
+    soft_renderer_context_t *ctx = (soft_renderer_context_t*)renderer->handle;
+
+    /* Plots are almost entirely vertical bars */
+    if (x1 == x2 && ctx->current_alpha == 255) {
+        soft_queue_column(ctx, x1, y1 < y2 ? y1 : y2, y1 < y2 ? y2 : y1);
+        return;
+    }
+
+    soft_flush_columns(ctx);
+    if (x1 == x2 || y1 == y2) {
+        rect_t rect;
+        rect.x = x1 < x2 ? x1 : x2;
+        rect.y = y1 < y2 ? y1 : y2;
+        rect.w = (x1 < x2 ? x2 - x1 : x1 - x2) + 1;
+        rect.h = (y1 < y2 ? y2 - y1 : y1 - y2) + 1;
+        soft_fill(ctx, rect, ctx->current_color, ctx->current_alpha);
+        return;
+    }
+
+    int32_t dx = x2 > x1 ? x2 - x1 : x1 - x2;
+    int32_t dy = y2 > y1 ? y1 - y2 : y2 - y1;
+    int32_t sx = x1 < x2 ? 1 : -1;
+    int32_t sy = y1 < y2 ? 1 : -1;
+    int32_t err = dx + dy;
+
+    for (;;) {
+        soft_plot(ctx, x1, y1, ctx->current_color, ctx->current_alpha);
+        if (x1 == x2 && y1 == y2) break;
+        int32_t e2 = err * 2;
+        if (e2 >= dy) {
+            err += dy;
+            x1 += sx;
+        }
+        if (e2 <= dx) {
+            err += dx;
+            y1 += sy;
+        }
+    }
+}
+
+void renderer_draw_rect(renderer_t *renderer, rect_t rect) {
+    if (!renderer || rect.w <= 0 || rect.h <= 0) return;
+
+    soft_renderer_context_t *ctx = (soft_renderer_context_t*)renderer->handle;
+    rect_t top = {rect.x, rect.y, rect.w, 1};
+
+    soft_flush_columns(ctx);
+    rect_t bottom = {rect.x, rect.y + rect.h - 1, rect.w, 1};
+    rect_t left = {rect.x, rect.y + 1, 1, rect.h - 2};
+    rect_t right = {rect.x + rect.w - 1, rect.y + 1, 1, rect.h - 2};
+
+    soft_fill(ctx, top, ctx->current_color, ctx->current_alpha);
+    if (rect.h > 1) {
+        soft_fill(ctx, bottom, ctx->current_color, ctx->current_alpha);
+    }
+    soft_fill(ctx, left, ctx->current_color, ctx->current_alpha);
+    if (rect.w > 1) {
+        soft_fill(ctx, right, ctx->current_color, ctx->current_alpha);
+    }
+}
+
+void renderer_fill_rect(renderer_t *renderer, rect_t rect) {
+    if (!renderer) return;
+
+    soft_renderer_context_t *ctx = (soft_renderer_context_t*)renderer->handle;
+    soft_flush_columns(ctx);
+    soft_fill(ctx, rect, ctx->current_color, ctx->current_alpha);
+}
+
+void renderer_draw_image(renderer_t *renderer, rect_t rect, const uint32_t *pixels, int32_t stride) {
+    if (!renderer || !pixels || rect.w <= 0 || rect.h <= 0) return;
+
+    soft_renderer_context_t *ctx = (soft_renderer_context_t*)renderer->handle;
+    soft_window_context_t *wctx = ctx->window_context;
+    rect_t clipped = rect;
+    int32_t y;
+
+    if (!soft_clip(ctx, &clipped)) return;
+
+    soft_flush_columns(ctx);
+    pixels += (size_t)(clipped.y - rect.y) * stride + (clipped.x - rect.x);
+    uint32_t *dst = wctx->pixels + (size_t)clipped.y * wctx->stride + clipped.x;
+
+    for (y = 0; y < clipped.h; y++) {
+        memcpy(dst, pixels, sizeof(uint32_t) * clipped.w);
+        dst += wctx->stride;
+        pixels += stride;
+    }
+}
+
+/* The built-in font is integer scaled, size 11 is the native cell */
+font_t *font_create(const char *path, int32_t size) {
+    (void)path;
+
+    font_t *font = malloc(sizeof(font_t));
+    if (!font) return NULL;
+
+    soft_font_context_t *ctx = malloc(sizeof(soft_font_context_t));
+    if (!ctx) {
+        free(font);
+        return NULL;
+    }
+
+    ctx->scale = (size + 5) / 11;
+    if (ctx->scale < 1) ctx->scale = 1;
+
+    font->handle = ctx;
+    return font;
+}
+
+void font_destroy(font_t *font) {
+    if (!font) return;
+
+    free(font->handle);
+    free(font);
+}
+
+void font_draw_text(renderer_t *renderer, font_t *font, color_t color,
+                    int32_t x, int32_t y, const char *text) {
+    if (!renderer || !font || !text) return;
+
+    soft_renderer_context_t *rctx = (soft_renderer_context_t*)renderer->handle;
+    soft_font_context_t *fctx = (soft_font_context_t*)font->handle;
+    soft_window_context_t *wctx = rctx->window_context;
+    uint32_t pixel = soft_pack(color);
+    int32_t scale = fctx->scale;
+
+    soft_flush_columns(rctx);
+    for (; *text; text++, x += SOFT_FONT_WIDTH * scale) {
+        unsigned char c = (unsigned char)*text;
+        int32_t row, col;
+
+        if (x >= wctx->width) break;
+        if (x + SOFT_FONT_WIDTH * scale <= 0) continue;
+        if (c < SOFT_FONT_FIRST || c > SOFT_FONT_LAST) c = '?';
+
+        const uint8_t *glyph = soft_font_glyphs[c - SOFT_FONT_FIRST];
+        for (row = 0; row < SOFT_FONT_HEIGHT; row++) {
+            uint8_t bits = glyph[row];
+            for (col = 0; bits; col++, bits <<= 1) {
+                if (!(bits & 0x80)) continue;
+                if (scale == 1) {
+                    soft_plot(rctx, x + col, y + row, pixel, color.a);
+                } else {
+                    rect_t dot = {x + col * scale, y + row * scale, scale, scale};
+                    soft_fill(rctx, dot, pixel, color.a);
+                }
+            }
+        }
+    }
+}
+
+void font_get_text_size(font_t *font, const char *text, int32_t *width, int32_t *height) {
+    if (!font || !text || !width || !height) return;
+
+    soft_font_context_t *ctx = (soft_font_context_t*)font->handle;
+    *width = (int32_t)strlen(text) * SOFT_FONT_WIDTH * ctx->scale;
+    *height = SOFT_FONT_HEIGHT * ctx->scale;
+}
+
+int graphics_poll_events(void) {
+    return 1;
+}
+
+int graphics_wait_events(void) {
+    extern int config_get_max_fps(void);
+    int fps = config_get_max_fps();
+    if (fps <= 0) fps = 1;
+    int sleep_us = 1000000 / fps;
+
+    usleep(sleep_us);
+
+    return graphics_poll_events();
+}
+
+int graphics_get_event(graphics_event_t *event) {
+    if (!event) return 0;
+
+    event->type = GRAPHICS_EVENT_NONE;
+    return 0;
+}
+
+void graphics_start_render_timer(int fps) {
+    (void)fps;
+}
+
+void graphics_stop_render_timer(void) {
+}
+
+void graphics_draw_fps_counter(renderer_t *renderer, font_t *font, int enabled) {
+    if (!enabled || !renderer || !font) return;
+
+    frame_count++;
+    uint64_t current_time = soft_get_time_ms();
+
+    if (current_time - fps_last_time >= 1000) {
+        current_fps = (float)frame_count * 1000.0f / (float)(current_time - fps_last_time);
+        frame_count = 0;
+        fps_last_time = current_time;
+    }
+
+    char fps_text[32];
+    snprintf(fps_text, sizeof(fps_text), "FPS: %.1f", current_fps);
+
+    color_t fps_bg_color = {0, 0, 0, 180};
+    color_t fps_text_color = {255, 255, 0, 255};
+    rect_t fps_bg_rect = {5, 5, 80, 20};
+
+    renderer_set_color(renderer, fps_bg_color);
+    renderer_fill_rect(renderer, fps_bg_rect);
+
+    font_draw_text(renderer, font, fps_text_color, 10, 8, fps_text);
+}
@@ -0,0 +1,814 @@
+#define _GNU_SOURCE
+#include "../graphics.h"
+#include <sys/time.h>
+#include <sys/ioctl.h>
+#include <termios.h>
+#include <signal.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <stdarg.h>
+#include <string.h>
+
+/* Terminal renderer for SSH sessions. Plots are drawn into a grid of
+ * character cells, each 2x16 pixels showing a 2x4 braille dot pattern or
+ * one character of text. renderer_present diffs the grid against what the
+ * terminal already shows and writes only the changed cells, with as few
+ * cursor moves and colour changes as it can, in a single write. */
+
+#define TTY_CELL_W 2
+#define TTY_CELL_H 16
+#define TTY_DOT_H (TTY_CELL_H / 4)
+
+typedef struct {
+    uint8_t ch;         /* printable ASCII, 0 when the cell shows dots */
+    uint8_t dots;       /* braille pattern, bit layout of U+2800 */
+    uint8_t color;      /* xterm 256 colour palette */
+    int32_t text_y;     /* pixel row the text was drawn at */
+} tty_cell_t;
+
+typedef struct {
+    int32_t cols, rows;
+    tty_cell_t *cells;  /* the frame being drawn */
+    tty_cell_t *shown;  /* what the terminal displays */
+    int repaint;        /* terminal contents unknown, clear and redraw */
+    uint32_t background;
+    int fullscreen;
+
+    char *out;
+    size_t out_size;
+    size_t out_capacity;
+} tty_window_context_t;
+
+typedef struct {
+    tty_window_context_t *window_context;
+    uint32_t current_color;
+    uint8_t current_alpha;
+} tty_renderer_context_t;
+
+static const uint8_t tty_dot_bits[4][2] = {
+    {0x01, 0x08},
+    {0x02, 0x10},
+    {0x04, 0x20},
+    {0x40, 0x80}
+};
+
+static int tty_initialized = 0;
+static tty_window_context_t *tty_active_window = NULL;
+static struct termios tty_saved_termios;
+static int tty_termios_saved = 0;
+static volatile sig_atomic_t tty_resized = 0;
+static int window_resized = 0;
+
+static graphics_event_t pending_event = {GRAPHICS_EVENT_NONE, 0, 0};
+
+static uint32_t frame_count = 0;
+static uint64_t fps_last_time = 0;
+static float current_fps = 0.0f;
+
+static uint64_t tty_get_time_ms(void) {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (uint64_t)(tv.tv_sec * 1000 + tv.tv_usec / 1000);
+}
+
+static uint32_t tty_pack(color_t color) {
+    return ((uint32_t)color.r << 16) | ((uint32_t)color.g << 8) | color.b;
+}
+
+static int tty_cube_level(int v) {
+    if (v < 48) return 0;
+    if (v < 115) return 1;
+    return (v - 35) / 40;
+}
+
+/* Nearest entry of the 6x6x6 cube or the grey ramp */
+static uint8_t tty_color_index(uint32_t rgb) {
+    static const int levels[6] = {0, 95, 135, 175, 215, 255};
+    int r = (rgb >> 16) & 0xff, g = (rgb >> 8) & 0xff, b = rgb & 0xff;
+    int cr = tty_cube_level(r), cg = tty_cube_level(g), cb = tty_cube_level(b);
+    int dr = levels[cr] - r, dg = levels[cg] - g, db = levels[cb] - b;
+    int cube_error = dr * dr + dg * dg + db * db;
+
+    int grey = (r + g + b) / 3;
+    int grey_step = grey < 8 ? 0 : grey > 238 ? 23 : (grey - 8) / 10;
+    int grey_value = 8 + grey_step * 10;
+    int gr = grey_value - r, gg = grey_value - g, gb = grey_value - b;
+    int grey_error = gr * gr + gg * gg + gb * gb;
+
+    if (grey_error < cube_error) return (uint8_t)(232 + grey_step);
+    return (uint8_t)(16 + 36 * cr + 6 * cg + cb);
+}
+
+static int32_t tty_floor_div(int32_t value, int32_t divisor) {
+    return value >= 0 ? value / divisor : -((-value + divisor - 1) / divisor);
+}
+
+static void tty_restore_terminal(void) {
+    static const char leave[] = "\033[0m\033[?25h\033[?1049l";
+
+    if (!tty_initialized) return;
+    if (write(STDOUT_FILENO, leave, sizeof(leave) - 1) < 0) {
+        /* nothing left to do about it */
+    }
+    if (tty_termios_saved) {
+        tcsetattr(STDIN_FILENO, TCSANOW, &tty_saved_termios);
+    }
+    tty_initialized = 0;
+}
+
+static void tty_sigwinch_handler(int sig) {
+    (void)sig;
+    tty_resized = 1;
+}
+
+static void tty_query_size(int32_t *cols, int32_t *rows) {
+    struct winsize ws;
+
+    if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) == 0 && ws.ws_col > 0 && ws.ws_row > 0) {
+        *cols = ws.ws_col;
+        *rows = ws.ws_row;
+        return;
+    }
+
+    const char *columns = getenv("COLUMNS");
+    const char *lines = getenv("LINES");
+    *cols = columns ? atoi(columns) : 0;
+    *rows = lines ? atoi(lines) : 0;
+    if (*cols <= 0) *cols = 80;
+    if (*rows <= 0) *rows = 24;
+}
+
+static int tty_resize_grid(tty_window_context_t *ctx, int32_t cols, int32_t rows) {
+    size_t count = (size_t)cols * rows;
+    tty_cell_t *cells = calloc(count, sizeof(tty_cell_t));
+    tty_cell_t *shown = calloc(count, sizeof(tty_cell_t));
+
+    if (!cells || !shown) {
+        free(cells);
+        free(shown);
+        return 0;
+    }
+
+    free(ctx->cells);
+    free(ctx->shown);
+    ctx->cells = cells;
+    ctx->shown = shown;
+    ctx->cols = cols;
+    ctx->rows = rows;
+    ctx->repaint = 1;
+    return 1;
+}
+
+static int tty_reserve(tty_window_context_t *ctx, size_t extra) {
+    if (ctx->out_size + extra <= ctx->out_capacity) return 1;
+
+    size_t capacity = ctx->out_capacity ? ctx->out_capacity : 4096;
+    while (capacity < ctx->out_size + extra) capacity *= 2;
+
+    char *grown = realloc(ctx->out, capacity);
+    if (!grown) return 0;
+    ctx->out = grown;
+    ctx->out_capacity = capacity;
+    return 1;
+}
+
+static void tty_emit(tty_window_context_t *ctx, const char *fmt, ...) {
+    va_list args;
+    int length;
+
+    if (!tty_reserve(ctx, 32)) return;
+    va_start(args, fmt);
+    length = vsnprintf(ctx->out + ctx->out_size, ctx->out_capacity - ctx->out_size, fmt, args);
+    va_end(args);
+    if (length > 0) ctx->out_size += (size_t)length;
+}
+
+static void tty_flush_output(tty_window_context_t *ctx) {
+    size_t done = 0;
+
+    while (done < ctx->out_size) {
+        ssize_t n = write(STDOUT_FILENO, ctx->out + done, ctx->out_size - done);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN) {
+                struct pollfd pfd = {STDOUT_FILENO, POLLOUT, 0};
+                poll(&pfd, 1, 100);
+                continue;
+            }
+            break;
+        }
+        done += (size_t)n;
+    }
+    ctx->out_size = 0;
+}
+
+/* Blank cells look the same whatever their colour */
+static int tty_cell_same(const tty_cell_t *a, const tty_cell_t *b) {
+    if (a->ch != b->ch || a->dots != b->dots) return 0;
+    return (!a->ch && !a->dots) || a->color == b->color;
+}
+
+static void tty_set_dot(tty_window_context_t *ctx, int32_t x, int32_t y, uint8_t color) {
+    if (x < 0 || y < 0 || x >= ctx->cols * TTY_CELL_W || y >= ctx->rows * TTY_CELL_H) return;
+
+    tty_cell_t *cell = &ctx->cells[(size_t)(y / TTY_CELL_H) * ctx->cols + x / TTY_CELL_W];
+    if (cell->ch) return;   /* text stays readable over the bars */
+    cell->dots |= tty_dot_bits[(y % TTY_CELL_H) / TTY_DOT_H][x % TTY_CELL_W];
+    cell->color = color;
+}
+
+static void tty_column(tty_window_context_t *ctx, int32_t x, int32_t y1, int32_t y2, uint8_t color) {
+    int32_t y;
+    if (y1 > y2) {
+        y = y1;
+        y1 = y2;
+        y2 = y;
+    }
+    if (y1 < 0) y1 = 0;
+    if (y2 >= ctx->rows * TTY_CELL_H) y2 = ctx->rows * TTY_CELL_H - 1;
+
+    /* One step per dot, not per pixel */
+    for (y = y1 - y1 % TTY_DOT_H; y <= y2; y += TTY_DOT_H) {
+        tty_set_dot(ctx, x, y, color);
+    }
+}
+
+/* Clear everything the rect covers: dots it overlaps and text drawn
+ * inside it */
+static void tty_clear(tty_window_context_t *ctx, rect_t rect) {
+    int32_t x1 = rect.x, y1 = rect.y;
+    int32_t x2 = rect.x + rect.w - 1, y2 = rect.y + rect.h - 1;
+    int32_t x, y;
+
+    if (x1 < 0) x1 = 0;
+    if (y1 < 0) y1 = 0;
+    if (x2 >= ctx->cols * TTY_CELL_W) x2 = ctx->cols * TTY_CELL_W - 1;
+    if (y2 >= ctx->rows * TTY_CELL_H) y2 = ctx->rows * TTY_CELL_H - 1;
+    if (x1 > x2 || y1 > y2) return;
+
+    for (y = y1 - y1 % TTY_DOT_H; y <= y2; y += TTY_DOT_H) {
+        for (x = x1; x <= x2; x++) {
+            tty_cell_t *cell = &ctx->cells[(size_t)(y / TTY_CELL_H) * ctx->cols + x / TTY_CELL_W];
+            if (cell->ch) {
+                if (cell->text_y >= rect.y && cell->text_y < rect.y + rect.h) {
+                    cell->ch = 0;
+                }
+                continue;
+            }
+            cell->dots &= (uint8_t)~tty_dot_bits[(y % TTY_CELL_H) / TTY_DOT_H][x % TTY_CELL_W];
+        }
+    }
+}
+
+int graphics_init(void) {
+    if (tty_initialized) {
+        return 1;
+    }
+
+    static const char enter[] = "\033[?1049h\033[?25l\033[2J";
+    struct termios raw;
+
+    if (tcgetattr(STDIN_FILENO, &tty_saved_termios) == 0) {
+        tty_termios_saved = 1;
+        raw = tty_saved_termios;
+        raw.c_lflag &= ~(ICANON | ECHO);
+        raw.c_cc[VMIN] = 0;
+        raw.c_cc[VTIME] = 0;
+        tcsetattr(STDIN_FILENO, TCSANOW, &raw);
+    }
+
+    if (write(STDOUT_FILENO, enter, sizeof(enter) - 1) < 0) {
+        return 0;
+    }
+
+    signal(SIGWINCH, tty_sigwinch_handler);
+
+    fps_last_time = tty_get_time_ms();
+    frame_count = 0;
+    current_fps = 0.0f;
+
+    /* main exits from its signal handlers, put the terminal back then too */
+    static int restore_registered = 0;
+    if (!restore_registered) {
+        atexit(tty_restore_terminal);
+        restore_registered = 1;
+    }
+
+    tty_initialized = 1;
+    return 1;
+}
+
+void graphics_cleanup(void) {
+    tty_restore_terminal();
+}
+
+/* The terminal decides the size, width and height are ignored */
+window_t *window_create(const char *title, int32_t width, int32_t height) {
+    int32_t cols, rows;
+    (void)title;
+    (void)width;
+    (void)height;
+
+    window_t *window = malloc(sizeof(window_t));
+    if (!window) return NULL;
+
+    tty_window_context_t *ctx = calloc(1, sizeof(tty_window_context_t));
+    if (!ctx) {
+        free(window);
+        return NULL;
+    }
+
+    tty_query_size(&cols, &rows);
+    if (!tty_resize_grid(ctx, cols, rows)) {
+        free(ctx);
+        free(window);
+        return NULL;
+    }
+
+    tty_active_window = ctx;
+
+    window->handle = ctx;
+    return window;
+}
+
+void window_destroy(window_t *window) {
+    if (!window) return;
+
+    tty_window_context_t *ctx = (tty_window_context_t*)window->handle;
+    if (ctx) {
+        if (tty_active_window == ctx) {
+            tty_active_window = NULL;
+        }
+        free(ctx->cells);
+        free(ctx->shown);
+        free(ctx->out);
+        free(ctx);
+    }
+    free(window);
+}
+
+void window_set_fullscreen(window_t *window, int fullscreen) {
+    if (!window) return;
+
+    tty_window_context_t *ctx = (tty_window_context_t*)window->handle;
+    ctx->fullscreen = fullscreen;
+}
+
+int window_is_fullscreen(window_t *window) {
+    if (!window) return 0;
+
+    tty_window_context_t *ctx = (tty_window_context_t*)window->handle;
+    return ctx->fullscreen;
+}
+
+void window_set_topmost(window_t *window, int topmost) {
+    (void)window;
+    (void)topmost;
+}
+
+void window_get_size(window_t *window, int32_t *width, int32_t *height) {
+    if (!window || !width || !height) return;
+
+    tty_window_context_t *ctx = (tty_window_context_t*)window->handle;
+
+    if (tty_resized) {
+        int32_t cols, rows;
+        tty_resized = 0;
+        tty_query_size(&cols, &rows);
+        if (cols != ctx->cols || rows != ctx->rows) {
+            tty_resize_grid(ctx, cols, rows);
+        }
+    }
+
+    *width = ctx->cols * TTY_CELL_W;
+    *height = ctx->rows * TTY_CELL_H;
+}
+
+int window_was_resized(void) {
+    if (tty_resized) {
+        window_resized = 1;
+    }
+    int result = window_resized;
+    window_resized = 0;
+    return result;
+}
+
+int window_is_visible(window_t *window) {
+    return window != NULL;
+}
+
+renderer_t *renderer_create(window_t *window) {
+    if (!window) return NULL;
+
+    renderer_t *renderer = malloc(sizeof(renderer_t));
+    if (!renderer) return NULL;
+
+    tty_renderer_context_t *ctx = malloc(sizeof(tty_renderer_context_t));
+    if (!ctx) {
+        free(renderer);
+        return NULL;
+    }
+
+    ctx->window_context = (tty_window_context_t*)window->handle;
+    ctx->current_color = 0xffffff;
+    ctx->current_alpha = 255;
+
+    renderer->handle = ctx;
+    return renderer;
+}
+
+void renderer_destroy(renderer_t *renderer) {
+    if (!renderer) return;
+
+    free(renderer->handle);
+    free(renderer);
+}
+
+/* The background colour is the terminal's own, fills in it erase */
+void renderer_clear(renderer_t *renderer, color_t color) {
+    if (!renderer) return;
+
+    tty_renderer_context_t *ctx = (tty_renderer_context_t*)renderer->handle;
+    tty_window_context_t *wctx = ctx->window_context;
+
+    wctx->background = tty_pack(color);
+    memset(wctx->cells, 0, sizeof(tty_cell_t) * (size_t)wctx->cols * wctx->rows);
+}
+
+void renderer_present(renderer_t *renderer) {
+    if (!renderer) return;
+
+    tty_renderer_context_t *ctx = (tty_renderer_context_t*)renderer->handle;
+    tty_window_context_t *wctx = ctx->window_context;
+    int32_t cursor_row = -1, cursor_col = -1;
+    int color = -1;
+    int32_t row, col;
+
+    if (wctx->repaint) {
+        tty_emit(wctx, "\033[0m\033[2J");
+        memset(wctx->shown, 0, sizeof(tty_cell_t) * (size_t)wctx->cols * wctx->rows);
+        wctx->repaint = 0;
+    }
+
+    for (row = 0; row < wctx->rows; row++) {
+        tty_cell_t *cells = wctx->cells + (size_t)row * wctx->cols;
+        tty_cell_t *shown = wctx->shown + (size_t)row * wctx->cols;
+
+        for (col = 0; col < wctx->cols; col++) {
+            tty_cell_t *cell = &cells[col];
+            if (tty_cell_same(cell, &shown[col])) continue;
+
+            if (!tty_reserve(wctx, 32)) return;
+
+            if (cursor_row == row && cursor_col == col) {
+                /* already there */
+            } else if (cursor_row == row && col > cursor_col) {
+                if (col - cursor_col == 1) {
+                    tty_emit(wctx, "\033[C");
+                } else {
+                    tty_emit(wctx, "\033[%dC", col - cursor_col);
+                }
+            } else if (cursor_row >= 0 && row == cursor_row + 1 && col == 0) {
+                tty_emit(wctx, "\r\n");
+            } else {
+                tty_emit(wctx, "\033[%d;%dH", row + 1, col + 1);
+            }
+
+            if ((cell->ch || cell->dots) && cell->color != color) {
+                tty_emit(wctx, "\033[38;5;%dm", cell->color);
+                color = cell->color;
+            }
+
+            if (cell->ch) {
+                wctx->out[wctx->out_size++] = (char)cell->ch;
+            } else if (cell->dots) {
+                /* U+2800 + pattern as UTF-8 */
+                wctx->out[wctx->out_size++] = (char)0xe2;
+                wctx->out[wctx->out_size++] = (char)(0xa0 | (cell->dots >> 6));
+                wctx->out[wctx->out_size++] = (char)(0x80 | (cell->dots & 0x3f));
+            } else {
+                wctx->out[wctx->out_size++] = ' ';
+            }
+
+            shown[col] = *cell;
+            cursor_row = row;
+            cursor_col = col + 1;
+            /* Past the last column the cursor position is up to the terminal */
+            if (cursor_col >= wctx->cols) cursor_row = -1;
+        }
+    }
+
+    tty_flush_output(wctx);
+}
+
+int renderer_read_pixels(renderer_t *renderer, const uint32_t **pixels,
+                         int32_t *width, int32_t *height, int32_t *stride) {
+    (void)renderer;
+    (void)pixels;
+    (void)width;
+    (void)height;
+    (void)stride;
+    return 0;
+}
+
+/* The cell grid is kept, plots without new samples are left as they are */
+int renderer_has_backing_store(renderer_t *renderer) {
+    return renderer != NULL;
+}
+
+int renderer_begin_plot(renderer_t *renderer, uint32_t index, rect_t rect, int dirty) {
+    (void)renderer;
+    (void)index;
+    (void)rect;
+    (void)dirty;
+    return 1;
+}
+
+void renderer_end_plot(renderer_t *renderer, uint32_t index, rect_t rect) {
+    (void)renderer;
+    (void)index;
+    (void)rect;
+}
+
+renderer_t *renderer_create_worker(renderer_t *renderer) {
+    (void)renderer;
+    return NULL;
+}
+
+void renderer_set_color(renderer_t *renderer, color_t color) {
+    if (!renderer) return;
+
+    tty_renderer_context_t *ctx = (tty_renderer_context_t*)renderer->handle;
+    ctx->current_color = tty_pack(color);
+    ctx->current_alpha = color.a;
+}
+
+void renderer_draw_line(renderer_t *renderer, int32_t x1, int32_t y1, int32_t x2, int32_t y2) {
+    if (!renderer) return;
+
+    tty_renderer_context_t *ctx = (tty_renderer_context_t*)renderer->handle;
+    tty_window_context_t *wctx = ctx->window_context;
+    uint8_t color = tty_color_index(ctx->current_color);
+
+    if (x1 == x2) {
+        tty_column(wctx, x1, y1, y2, color);
+        return;
+    }
+
+    int32_t dx = x2 > x1 ? x2 - x1 : x1 - x2;
+    int32_t dy = y2 > y1 ? y1 - y2 : y2 - y1;
+    int32_t sx = x1 < x2 ? 1 : -1;
+    int32_t sy = y1 < y2 ? 1 : -1;
+    int32_t err = dx + dy;
+
+    for (;;) {
+        tty_set_dot(wctx, x1, y1, color);
+        if (x1 == x2 && y1 == y2) break;
+        int32_t e2 = err * 2;
+        if (e2 >= dy) {
+            err += dy;
+            x1 += sx;
+        }
+        if (e2 <= dx) {
+            err += dx;
+            y1 += sy;
+        }
+    }
+}
+
+void renderer_draw_rect(renderer_t *renderer, rect_t rect) {
+    if (!renderer || rect.w <= 0 || rect.h <= 0) return;
+
+    renderer_draw_line(renderer, rect.x, rect.y, rect.x + rect.w - 1, rect.y);
+    renderer_draw_line(renderer, rect.x, rect.y + rect.h - 1, rect.x + rect.w - 1, rect.y + rect.h - 1);
+    renderer_draw_line(renderer, rect.x, rect.y, rect.x, rect.y + rect.h - 1);
+    renderer_draw_line(renderer, rect.x + rect.w - 1, rect.y, rect.x + rect.w - 1, rect.y + rect.h - 1);
+}
+
+/* Translucent overlays have no cell equivalent and are skipped */
+void renderer_fill_rect(renderer_t *renderer, rect_t rect) {
+    if (!renderer || rect.w <= 0 || rect.h <= 0) return;
+
+    tty_renderer_context_t *ctx = (tty_renderer_context_t*)renderer->handle;
+    tty_window_context_t *wctx = ctx->window_context;
+    int32_t x;
+
+    if (ctx->current_color == wctx->background) {
+        tty_clear(wctx, rect);
+        return;
+    }
+    if (ctx->current_alpha != 255) return;
+
+    uint8_t color = tty_color_index(ctx->current_color);
+    for (x = rect.x; x < rect.x + rect.w; x++) {
+        tty_column(wctx, x, rect.y, rect.y + rect.h - 1, color);
+    }
+}
+
+/* Each dot lights up if any pixel under it differs from the background.
+ * A cell has one colour, it takes the reddest of its pixels so failures
+ * in a heatmap stay visible. */
+void renderer_draw_image(renderer_t *renderer, rect_t rect, const uint32_t *pixels, int32_t stride) {
+    if (!renderer || !pixels || rect.w <= 0 || rect.h <= 0) return;
+
+    tty_renderer_context_t *ctx = (tty_renderer_context_t*)renderer->handle;
+    tty_window_context_t *wctx = ctx->window_context;
+    int32_t first_col = tty_floor_div(rect.x, TTY_CELL_W);
+    int32_t last_col = tty_floor_div(rect.x + rect.w - 1, TTY_CELL_W);
+    int32_t first_row = tty_floor_div(rect.y, TTY_CELL_H);
+    int32_t last_row = tty_floor_div(rect.y + rect.h - 1, TTY_CELL_H);
+    int32_t row, col, x, y;
+
+    tty_clear(wctx, rect);
+
+    if (first_col < 0) first_col = 0;
+    if (first_row < 0) first_row = 0;
+    if (last_col >= wctx->cols) last_col = wctx->cols - 1;
+    if (last_row >= wctx->rows) last_row = wctx->rows - 1;
+
+    for (row = first_row; row <= last_row; row++) {
+        for (col = first_col; col <= last_col; col++) {
+            tty_cell_t *cell = &wctx->cells[(size_t)row * wctx->cols + col];
+            uint32_t reddest = 0;
+            int found = 0;
+
+            if (cell->ch) continue;
+
+            for (y = row * TTY_CELL_H; y < (row + 1) * TTY_CELL_H; y++) {
+                if (y < rect.y || y >= rect.y + rect.h) continue;
+                for (x = col * TTY_CELL_W; x < (col + 1) * TTY_CELL_W; x++) {
+                    if (x < rect.x || x >= rect.x + rect.w) continue;
+
+                    uint32_t p = pixels[(size_t)(y - rect.y) * stride + (x - rect.x)] & 0xffffff;
+                    if (p == wctx->background) continue;
+
+                    cell->dots |= tty_dot_bits[(y % TTY_CELL_H) / TTY_DOT_H][x % TTY_CELL_W];
+                    if (!found || (p >> 16) > (reddest >> 16)) reddest = p;
+                    found = 1;
+                }
+            }
+            if (found) cell->color = tty_color_index(reddest);
+        }
+    }
+}
+
+font_t *font_create(const char *path, int32_t size) {
+    (void)path;
+    (void)size;
+
+    font_t *font = malloc(sizeof(font_t));
+    if (!font) return NULL;
+
+    font->handle = NULL;
+    return font;
+}
+
+void font_destroy(font_t *font) {
+    free(font);
+}
+
+/* One character per cell, on the row holding the top of the text */
+void font_draw_text(renderer_t *renderer, font_t *font, color_t color,
+                    int32_t x, int32_t y, const char *text) {
+    if (!renderer || !font || !text) return;
+
+    tty_renderer_context_t *ctx = (tty_renderer_context_t*)renderer->handle;
+    tty_window_context_t *wctx = ctx->window_context;
+    int32_t row = tty_floor_div(y, TTY_CELL_H);
+    int32_t col = tty_floor_div(x, TTY_CELL_W);
+    uint8_t index = tty_color_index(tty_pack(color));
+
+    if (row < 0 || row >= wctx->rows) return;
+
+    for (; *text; text++, col++) {
+        unsigned char c = (unsigned char)*text;
+        if (col < 0) continue;
+        if (col >= wctx->cols) break;
+        if (c < 0x20 || c > 0x7e) c = '?';
+
+        tty_cell_t *cell = &wctx->cells[(size_t)row * wctx->cols + col];
+        cell->ch = c;
+        cell->dots = 0;
+        cell->color = index;
+        cell->text_y = y;
+    }
+}
+
+void font_get_text_size(font_t *font, const char *text, int32_t *width, int32_t *height) {
+    if (!font || !text || !width || !height) return;
+
+    *width = (int32_t)strlen(text) * TTY_CELL_W;
+    *height = TTY_CELL_H;
+}
+
+/* Keys arrive as bytes, cursor keys as CSI sequences */
+int graphics_poll_events(void) {
+    unsigned char buf[64];
+    ssize_t n, i;
+
+    n = read(STDIN_FILENO, buf, sizeof(buf));
+    for (i = 0; i < n; i++) {
+        if (buf[i] == 0x1b) {
+            if (i + 2 >= n || buf[i + 1] != '[') return 0;
+
+            unsigned char final = buf[i + 2];
+            unsigned char code = 0;
+            i += 2;
+            if (final >= '0' && final <= '9' && i + 1 < n && buf[i + 1] == '~') {
+                code = final;
+                i++;
+            }
+
+            pending_event.type = GRAPHICS_EVENT_SCROLL;
+            pending_event.scroll = 0;
+            if (final == 'A') {
+                pending_event.key = KEY_UP;
+                pending_event.scroll = -1;
+            } else if (final == 'B') {
+                pending_event.key = KEY_DOWN;
+                pending_event.scroll = 1;
+            } else if (code == '5') {
+                pending_event.key = KEY_PAGE_UP;
+            } else if (code == '6') {
+                pending_event.key = KEY_PAGE_DOWN;
+            } else if (final == 'H' || code == '1') {
+                pending_event.key = KEY_HOME;
+            } else if (final == 'F' || code == '4') {
+                pending_event.key = KEY_END;
+            } else {
+                pending_event.type = GRAPHICS_EVENT_NONE;
+            }
+            continue;
+        }
+
+        switch (buf[i]) {
+            case 'q':
+                pending_event.type = GRAPHICS_EVENT_QUIT;
+                pending_event.key = KEY_Q;
+                break;
+            case 'r':
+                pending_event.type = GRAPHICS_EVENT_REFRESH;
+                pending_event.key = KEY_R;
+                if (tty_active_window) tty_active_window->repaint = 1;
+                break;
+            case 'f':
+                pending_event.type = GRAPHICS_EVENT_FULLSCREEN_TOGGLE;
+                pending_event.key = KEY_F;
+                break;
+        }
+    }
+
+    return 1;
+}
+
+/* Sleep in poll() so keys are handled straight away */
+int graphics_wait_events(void) {
+    extern int config_get_max_fps(void);
+    int fps = config_get_max_fps();
+    if (fps <= 0) fps = 1;
+
+    struct pollfd pfd = {STDIN_FILENO, POLLIN, 0};
+    poll(&pfd, 1, 1000 / fps);
+
+    return graphics_poll_events();
+}
+
+int graphics_get_event(graphics_event_t *event) {
+    if (!event) return 0;
+
+    if (pending_event.type != GRAPHICS_EVENT_NONE) {
+        *event = pending_event;
+        pending_event.type = GRAPHICS_EVENT_NONE;
+        return 1;
+    }
+
+    event->type = GRAPHICS_EVENT_NONE;
+    return 0;
+}
+
+void graphics_start_render_timer(int fps) {
+    (void)fps;
+}
+
+void graphics_stop_render_timer(void) {
+}
+
+void graphics_draw_fps_counter(renderer_t *renderer, font_t *font, int enabled) {
+    if (!enabled || !renderer || !font) return;
+
+    frame_count++;
+    uint64_t current_time = tty_get_time_ms();
+
+    if (current_time - fps_last_time >= 1000) {
+        current_fps = (float)frame_count * 1000.0f / (float)(current_time - fps_last_time);
+        frame_count = 0;
+        fps_last_time = current_time;
+    }
+
+    char fps_text[32];
+    snprintf(fps_text, sizeof(fps_text), "FPS: %.1f", current_fps);
+
+    color_t fps_text_color = {255, 255, 0, 255};
+    font_draw_text(renderer, font, fps_text_color, 0, 0, fps_text);
+}
@@ -4,6 +4,9 @@
 #include <X11/Xutil.h>
 #include <X11/Xatom.h>
 #include <X11/keysym.h>
+#include <X11/extensions/XShm.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
 #include <sys/time.h>
 #include <unistd.h>
 #include <string.h>
@@ -20,6 +23,26 @@ typedef struct {
     int should_quit;
     unsigned long bg_color;
     Atom wm_delete_window;
+    int mapped;
+    int obscured;
+
+    /* Pixmap regions touched since the last present */
+    XRectangle *damage;
+    int damage_count;
+    int damage_capacity;
+    int damage_full;
+
+    /* Pixmap copy handed out by renderer_read_pixels */
+    uint32_t *readback;
+    size_t readback_capacity;
+
+    /* Window sized MIT-SHM image for blits and readback. shm_failed is set
+     * when the server can't share memory with us, eg. a remote display. */
+    XImage *shm_image;
+    XShmSegmentInfo shm_info;
+    int shm_pending;    /* puts issued this frame */
+    int shm_sync;       /* puts from the last frame the server may not have read */
+    int shm_failed;
 } x11_window_context_t;
 
 typedef struct {
@@ -36,13 +59,28 @@ static int x11_initialized = 0;
 static x11_window_context_t *x11_active_window = NULL;
 static int window_resized = 0;
 
-static graphics_event_t pending_event = {GRAPHICS_EVENT_NONE, 0};
+static graphics_event_t pending_event = {GRAPHICS_EVENT_NONE, 0, 0};
 static int fullscreen_state = 0;
 
 static uint32_t frame_count = 0;
 static uint64_t fps_last_time = 0;
 static float current_fps = 0.0f;
 
+static void x11_queue_scroll(key_code_t key, int32_t rows) {
+    pending_event.type = GRAPHICS_EVENT_SCROLL;
+    pending_event.key = key;
+    pending_event.scroll = rows;
+}
+
+static int x11_shm_error = 0;
+
+static int x11_shm_error_handler(Display *display, XErrorEvent *event) {
+    (void)display;
+    (void)event;
+    x11_shm_error = 1;
+    return 0;
+}
+
 static uint64_t x11_get_time_ms(void) {
     struct timeval tv;
     gettimeofday(&tv, NULL);
@@ -109,6 +147,18 @@ window_t *window_create(const char *title, int32_t width, int32_t height) {
     ctx->width = width;
     ctx->height = height;
     ctx->should_quit = 0;
+    ctx->damage = NULL;
+    ctx->damage_count = 0;
+    ctx->damage_capacity = 0;
+    ctx->damage_full = 1;
+    ctx->mapped = 1;
+    ctx->obscured = 0;
+    ctx->readback = NULL;
+    ctx->readback_capacity = 0;
+    ctx->shm_image = NULL;
+    ctx->shm_pending = 0;
+    ctx->shm_sync = 0;
+    ctx->shm_failed = 0;
 
     Window root = RootWindow(ctx->display, ctx->screen);
     ctx->bg_color = WhitePixel(ctx->display, ctx->screen);
@@ -123,7 +173,7 @@ window_t *window_create(const char *title, int32_t width, int32_t height) {
 
     XSelectInput(ctx->display, ctx->window,
                  ExposureMask | KeyPressMask | ButtonPressMask |
-                 StructureNotifyMask | PointerMotionMask);
+                 StructureNotifyMask | PointerMotionMask | VisibilityChangeMask);
 
     ctx->pixmap = XCreatePixmap(ctx->display, ctx->window, width, height,
                                DefaultDepth(ctx->display, ctx->screen));
@@ -151,6 +201,90 @@ window_t *window_create(const char *title, int32_t width, int32_t height) {
     return window;
 }
 
+static void x11_shm_destroy(x11_window_context_t *ctx) {
+    if (!ctx->shm_image) return;
+
+    XShmDetach(ctx->display, &ctx->shm_info);
+    XSync(ctx->display, False);
+    ctx->shm_image->data = NULL;
+    XDestroyImage(ctx->shm_image);
+    shmdt(ctx->shm_info.shmaddr);
+    ctx->shm_image = NULL;
+    ctx->shm_pending = 0;
+    ctx->shm_sync = 0;
+}
+
+/* The shared image, created on first use and again after a resize. NULL
+ * means going through the protocol with XPutImage/XGetImage instead. */
+static XImage *x11_shm_image(x11_window_context_t *ctx) {
+    if (ctx->shm_failed) return NULL;
+
+    if (ctx->shm_image && ctx->shm_image->width == ctx->width &&
+        ctx->shm_image->height == ctx->height) {
+        /* Don't overwrite pixels the server has yet to copy out */
+        if (ctx->shm_sync) {
+            XSync(ctx->display, False);
+            ctx->shm_sync = 0;
+        }
+        return ctx->shm_image;
+    }
+    x11_shm_destroy(ctx);
+
+    const char *env = getenv("PLOTTOOL_X11_SHM");
+    if ((env && strcmp(env, "0") == 0) || !XShmQueryExtension(ctx->display)) {
+        ctx->shm_failed = 1;
+        return NULL;
+    }
+
+    XImage *image = XShmCreateImage(ctx->display, DefaultVisual(ctx->display, ctx->screen),
+                                    DefaultDepth(ctx->display, ctx->screen), ZPixmap, NULL,
+                                    &ctx->shm_info, ctx->width, ctx->height);
+    if (!image) {
+        ctx->shm_failed = 1;
+        return NULL;
+    }
+
+    ctx->shm_info.shmid = shmget(IPC_PRIVATE, (size_t)image->bytes_per_line * image->height,
+                                 IPC_CREAT | 0600);
+    if (ctx->shm_info.shmid < 0) {
+        XDestroyImage(image);
+        ctx->shm_failed = 1;
+        return NULL;
+    }
+
+    ctx->shm_info.shmaddr = shmat(ctx->shm_info.shmid, NULL, 0);
+    ctx->shm_info.readOnly = False;
+    if (ctx->shm_info.shmaddr == (char*)-1) {
+        shmctl(ctx->shm_info.shmid, IPC_RMID, NULL);
+        XDestroyImage(image);
+        ctx->shm_failed = 1;
+        return NULL;
+    }
+    image->data = ctx->shm_info.shmaddr;
+
+    /* A server on another host answers the attach with BadAccess */
+    XSync(ctx->display, False);
+    x11_shm_error = 0;
+    int (*previous_handler)(Display*, XErrorEvent*) = XSetErrorHandler(x11_shm_error_handler);
+    Status attached = XShmAttach(ctx->display, &ctx->shm_info);
+    XSync(ctx->display, False);
+    XSetErrorHandler(previous_handler);
+
+    /* The segment goes away once both sides have detached */
+    shmctl(ctx->shm_info.shmid, IPC_RMID, NULL);
+
+    if (!attached || x11_shm_error) {
+        image->data = NULL;
+        XDestroyImage(image);
+        shmdt(ctx->shm_info.shmaddr);
+        ctx->shm_failed = 1;
+        return NULL;
+    }
+
+    ctx->shm_image = image;
+    return image;
+}
+
 void window_destroy(window_t *window) {
     if (!window) return;
 
@@ -160,6 +294,7 @@ void window_destroy(window_t *window) {
             x11_active_window = NULL;
         }
 
+        x11_shm_destroy(ctx);
         if (ctx->font_info) {
             XFreeFont(ctx->display, ctx->font_info);
         }
@@ -175,6 +310,8 @@ void window_destroy(window_t *window) {
         if (ctx->display) {
             XCloseDisplay(ctx->display);
         }
+        free(ctx->damage);
+        free(ctx->readback);
         free(ctx);
     }
     free(window);
@@ -338,22 +475,159 @@ void renderer_clear(renderer_t *renderer, color_t color) {
     XFillRectangle(ctx->window_context->display, ctx->window_context->pixmap,
                    ctx->window_context->gc, 0, 0,
                    ctx->window_context->width, ctx->window_context->height);
+    ctx->window_context->damage_full = 1;
 }
 
 void renderer_present(renderer_t *renderer) {
     if (!renderer) return;
 
     x11_renderer_context_t *ctx = (x11_renderer_context_t*)renderer->handle;
+    x11_window_context_t *wctx = ctx->window_context;
+
+    if (wctx->damage_full) {
+        XCopyArea(wctx->display, wctx->pixmap, wctx->window, wctx->gc,
+                  0, 0, wctx->width, wctx->height, 0, 0);
+    } else {
+        int i;
+        for (i = 0; i < wctx->damage_count; i++) {
+            XRectangle *r = &wctx->damage[i];
+            XCopyArea(wctx->display, wctx->pixmap, wctx->window, wctx->gc,
+                      r->x, r->y, r->width, r->height, r->x, r->y);
+        }
+    }
+    wctx->damage_full = 0;
+    wctx->damage_count = 0;
+    wctx->shm_sync = wctx->shm_pending;
+    wctx->shm_pending = 0;
+
+    XFlush(wctx->display);
+}
+
+static int x11_mask_shift(unsigned long mask);
+
+/* 24 bit visuals in host byte order share our 0x00RRGGBB layout */
+static int x11_image_is_native(XImage *image) {
+    uint32_t byte_order_probe = 1;
+    return image->bits_per_pixel == 32 && image->red_mask == 0xff0000 &&
+           image->green_mask == 0x00ff00 && image->blue_mask == 0x0000ff &&
+           image->byte_order == (*(uint8_t*)&byte_order_probe ? LSBFirst : MSBFirst);
+}
+
+int renderer_read_pixels(renderer_t *renderer, const uint32_t **pixels,
+                         int32_t *width, int32_t *height, int32_t *stride) {
+    if (!renderer || !pixels || !width || !height || !stride) return 0;
+
+    x11_renderer_context_t *ctx = (x11_renderer_context_t*)renderer->handle;
+    x11_window_context_t *wctx = ctx->window_context;
+    size_t needed = (size_t)wctx->width * wctx->height;
+    XImage *shm = x11_shm_image(wctx);
+    XImage *image;
+    int32_t x, y;
+
+    if (shm && XShmGetImage(wctx->display, wctx->pixmap, shm, 0, 0, AllPlanes)) {
+        image = shm;
+        if (x11_image_is_native(image)) {
+            *pixels = (const uint32_t*)image->data;
+            *width = wctx->width;
+            *height = wctx->height;
+            *stride = image->bytes_per_line / 4;
+            return 1;
+        }
+    } else {
+        image = XGetImage(wctx->display, wctx->pixmap, 0, 0, wctx->width, wctx->height,
+                          AllPlanes, ZPixmap);
+        if (!image) return 0;
+    }
+
+    if (needed > wctx->readback_capacity) {
+        uint32_t *grown = realloc(wctx->readback, needed * sizeof(uint32_t));
+        if (!grown) {
+            if (image != shm) XDestroyImage(image);
+            return 0;
+        }
+        wctx->readback = grown;
+        wctx->readback_capacity = needed;
+    }
+
+    int red_shift = x11_mask_shift(image->red_mask);
+    int green_shift = x11_mask_shift(image->green_mask);
+    int blue_shift = x11_mask_shift(image->blue_mask);
+    unsigned long red_max = image->red_mask >> red_shift;
+    unsigned long green_max = image->green_mask >> green_shift;
+    unsigned long blue_max = image->blue_mask >> blue_shift;
+
+    if (!red_max || !green_max || !blue_max) {
+        if (image != shm) XDestroyImage(image);
+        return 0;
+    }
+
+    for (y = 0; y < wctx->height; y++) {
+        uint32_t *row = wctx->readback + (size_t)y * wctx->width;
+
+        if (x11_image_is_native(image)) {
+            memcpy(row, image->data + (size_t)y * image->bytes_per_line, wctx->width * 4);
+            continue;
+        }
+
+        for (x = 0; x < wctx->width; x++) {
+            unsigned long p = XGetPixel(image, x, y);
+            row[x] = (uint32_t)((((p & image->red_mask) >> red_shift) * 255 / red_max) << 16 |
+                                (((p & image->green_mask) >> green_shift) * 255 / green_max) << 8 |
+                                (((p & image->blue_mask) >> blue_shift) * 255 / blue_max));
+        }
+    }
+
+    if (image != shm) XDestroyImage(image);
+
+    *pixels = wctx->readback;
+    *width = wctx->width;
+    *height = wctx->height;
+    *stride = wctx->width;
+    return 1;
+}
+
+int renderer_has_backing_store(renderer_t *renderer) {
+    return renderer != NULL;
+}
+
+int renderer_begin_plot(renderer_t *renderer, uint32_t index, rect_t rect, int dirty) {
+    (void)renderer;
+    (void)index;
+    (void)rect;
+    (void)dirty;
+    return 1;
+}
+
+void renderer_end_plot(renderer_t *renderer, uint32_t index, rect_t rect) {
+    if (!renderer) return;
+    (void)index;
+
+    x11_renderer_context_t *ctx = (x11_renderer_context_t*)renderer->handle;
+    x11_window_context_t *wctx = ctx->window_context;
 
-    XCopyArea(ctx->window_context->display,
-              ctx->window_context->pixmap,
-              ctx->window_context->window,
-              ctx->window_context->gc,
-              0, 0,
-              ctx->window_context->width, ctx->window_context->height,
-              0, 0);
+    if (wctx->damage_full) return;
+
+    if (wctx->damage_count >= wctx->damage_capacity) {
+        int new_capacity = wctx->damage_capacity ? wctx->damage_capacity * 2 : 16;
+        XRectangle *grown = realloc(wctx->damage, sizeof(XRectangle) * new_capacity);
+        if (!grown) {
+            wctx->damage_full = 1;
+            return;
+        }
+        wctx->damage = grown;
+        wctx->damage_capacity = new_capacity;
+    }
+
+    wctx->damage[wctx->damage_count].x = rect.x;
+    wctx->damage[wctx->damage_count].y = rect.y;
+    wctx->damage[wctx->damage_count].width = rect.w;
+    wctx->damage[wctx->damage_count].height = rect.h;
+    wctx->damage_count++;
+}
 
-    XFlush(ctx->window_context->display);
+renderer_t *renderer_create_worker(renderer_t *renderer) {
+    (void)renderer;
+    return NULL;
 }
 
 void renderer_set_color(renderer_t *renderer, color_t color) {
@@ -391,6 +665,131 @@ void renderer_fill_rect(renderer_t *renderer, rect_t rect) {
                    ctx->window_context->gc, rect.x, rect.y, rect.w, rect.h);
 }
 
+static int x11_mask_shift(unsigned long mask) {
+    int shift = 0;
+    if (!mask) return 0;
+    while (!(mask & 1)) {
+        mask >>= 1;
+        shift++;
+    }
+    return shift;
+}
+
+static void x11_shm_put(x11_window_context_t *wctx, XImage *shm, rect_t rect,
+                        const uint32_t *pixels, int32_t stride) {
+    int32_t x2 = rect.x + rect.w;
+    int32_t y2 = rect.y + rect.h;
+    int32_t x, y;
+
+    if (rect.x < 0) {
+        pixels -= rect.x;
+        rect.x = 0;
+    }
+    if (rect.y < 0) {
+        pixels -= (size_t)rect.y * stride;
+        rect.y = 0;
+    }
+    if (x2 > shm->width) x2 = shm->width;
+    if (y2 > shm->height) y2 = shm->height;
+    rect.w = x2 - rect.x;
+    rect.h = y2 - rect.y;
+    if (rect.w <= 0 || rect.h <= 0) return;
+
+    if (x11_image_is_native(shm)) {
+        for (y = 0; y < rect.h; y++) {
+            memcpy(shm->data + (size_t)(rect.y + y) * shm->bytes_per_line + (size_t)rect.x * 4,
+                   pixels + (size_t)y * stride, (size_t)rect.w * 4);
+        }
+    } else {
+        int red_shift = x11_mask_shift(shm->red_mask);
+        int green_shift = x11_mask_shift(shm->green_mask);
+        int blue_shift = x11_mask_shift(shm->blue_mask);
+        unsigned long red_max = shm->red_mask >> red_shift;
+        unsigned long green_max = shm->green_mask >> green_shift;
+        unsigned long blue_max = shm->blue_mask >> blue_shift;
+
+        for (y = 0; y < rect.h; y++) {
+            const uint32_t *row = pixels + (size_t)y * stride;
+            for (x = 0; x < rect.w; x++) {
+                uint32_t p = row[x];
+                unsigned long value = ((((p >> 16) & 0xff) * red_max / 255) << red_shift) |
+                                      ((((p >> 8) & 0xff) * green_max / 255) << green_shift) |
+                                      (((p & 0xff) * blue_max / 255) << blue_shift);
+                XPutPixel(shm, rect.x + x, rect.y + y, value);
+            }
+        }
+    }
+
+    XShmPutImage(wctx->display, wctx->pixmap, wctx->gc, shm,
+                 rect.x, rect.y, rect.x, rect.y, rect.w, rect.h, False);
+    wctx->shm_pending = 1;
+}
+
+void renderer_draw_image(renderer_t *renderer, rect_t rect, const uint32_t *pixels, int32_t stride) {
+    if (!renderer || !pixels || rect.w <= 0 || rect.h <= 0) return;
+
+    x11_renderer_context_t *ctx = (x11_renderer_context_t*)renderer->handle;
+    x11_window_context_t *wctx = ctx->window_context;
+    Visual *visual = DefaultVisual(wctx->display, wctx->screen);
+    int depth = DefaultDepth(wctx->display, wctx->screen);
+    uint32_t byte_order_probe = 1;
+    XImage *image;
+
+    if (visual->class != TrueColor && visual->class != DirectColor) return;
+
+    /* Local servers read the pixels straight out of shared memory */
+    XImage *shm = x11_shm_image(wctx);
+    if (shm) {
+        x11_shm_put(wctx, shm, rect, pixels, stride);
+        return;
+    }
+
+    /* The common 24 bit visual takes our scanlines as they are, in host
+     * byte order; Xlib swaps if the server differs. */
+    if (depth >= 24 && visual->red_mask == 0xff0000 &&
+        visual->green_mask == 0x00ff00 && visual->blue_mask == 0x0000ff) {
+        image = XCreateImage(wctx->display, visual, depth, ZPixmap, 0, (char*)pixels,
+                             rect.w, rect.h, 32, stride * 4);
+        if (!image) return;
+        image->byte_order = *(uint8_t*)&byte_order_probe ? LSBFirst : MSBFirst;
+        XPutImage(wctx->display, wctx->pixmap, wctx->gc, image, 0, 0, rect.x, rect.y, rect.w, rect.h);
+        image->data = NULL;
+        XDestroyImage(image);
+        return;
+    }
+
+    /* Anything else, eg. 16 bit framebuffers, is converted pixel by pixel */
+    image = XCreateImage(wctx->display, visual, depth, ZPixmap, 0, NULL, rect.w, rect.h, 32, 0);
+    if (!image) return;
+    image->data = malloc((size_t)image->bytes_per_line * rect.h);
+    if (!image->data) {
+        XDestroyImage(image);
+        return;
+    }
+
+    int red_shift = x11_mask_shift(visual->red_mask);
+    int green_shift = x11_mask_shift(visual->green_mask);
+    int blue_shift = x11_mask_shift(visual->blue_mask);
+    unsigned long red_max = visual->red_mask >> red_shift;
+    unsigned long green_max = visual->green_mask >> green_shift;
+    unsigned long blue_max = visual->blue_mask >> blue_shift;
+    int32_t x, y;
+
+    for (y = 0; y < rect.h; y++) {
+        const uint32_t *row = pixels + (size_t)y * stride;
+        for (x = 0; x < rect.w; x++) {
+            uint32_t p = row[x];
+            unsigned long value = ((((p >> 16) & 0xff) * red_max / 255) << red_shift) |
+                                  ((((p >> 8) & 0xff) * green_max / 255) << green_shift) |
+                                  (((p & 0xff) * blue_max / 255) << blue_shift);
+            XPutPixel(image, x, y, value);
+        }
+    }
+
+    XPutImage(wctx->display, wctx->pixmap, wctx->gc, image, 0, 0, rect.x, rect.y, rect.w, rect.h);
+    XDestroyImage(image);
+}
+
 font_t *font_create(const char *path, int32_t size) {
     if (path && strlen(path) > 0) {
     }
@@ -538,6 +937,11 @@ int graphics_poll_events(void) {
 
         switch (event.type) {
             case Expose:
+                XCopyArea(x11_active_window->display, x11_active_window->pixmap,
+                          x11_active_window->window, x11_active_window->gc,
+                          event.xexpose.x, event.xexpose.y,
+                          event.xexpose.width, event.xexpose.height,
+                          event.xexpose.x, event.xexpose.y);
                 break;
             case ConfigureNotify:
                 if (event.xconfigure.width != x11_active_window->width ||
@@ -561,6 +965,15 @@ int graphics_poll_events(void) {
                                   x11_active_window->width, x11_active_window->height);
                 }
                 break;
+            case MapNotify:
+                x11_active_window->mapped = 1;
+                break;
+            case UnmapNotify:
+                x11_active_window->mapped = 0;
+                break;
+            case VisibilityNotify:
+                x11_active_window->obscured = event.xvisibility.state == VisibilityFullyObscured;
+                break;
             case KeyPress: {
                 KeySym key = XLookupKeysym(&event.xkey, 0);
                 switch (key) {
@@ -578,9 +991,34 @@ int graphics_poll_events(void) {
                         break;
                     case XK_Escape:
                         return 0;
+                    case XK_Up:
+                        x11_queue_scroll(KEY_UP, -1);
+                        break;
+                    case XK_Down:
+                        x11_queue_scroll(KEY_DOWN, 1);
+                        break;
+                    case XK_Prior:
+                        x11_queue_scroll(KEY_PAGE_UP, 0);
+                        break;
+                    case XK_Next:
+                        x11_queue_scroll(KEY_PAGE_DOWN, 0);
+                        break;
+                    case XK_Home:
+                        x11_queue_scroll(KEY_HOME, 0);
+                        break;
+                    case XK_End:
+                        x11_queue_scroll(KEY_END, 0);
+                        break;
                 }
                 break;
             }
+            case ButtonPress:
+                if (event.xbutton.button == Button4) {
+                    x11_queue_scroll(KEY_NONE, -1);
+                } else if (event.xbutton.button == Button5) {
+                    x11_queue_scroll(KEY_NONE, 1);
+                }
+                break;
             case ClientMessage:
                 if ((unsigned long)event.xclient.data.l[0] == x11_active_window->wm_delete_window) {
                     x11_active_window->should_quit = 1;
@@ -630,6 +1068,13 @@ void graphics_start_render_timer(int fps) {
 void graphics_stop_render_timer(void) {
 }
 
+int window_is_visible(window_t *window) {
+    if (!window) return 0;
+
+    x11_window_context_t *ctx = (x11_window_context_t*)window->handle;
+    return ctx->mapped && !ctx->obscured;
+}
+
 int window_was_resized(void) {
     int result = window_resized;
     window_resized = 0;
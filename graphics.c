@@ -14,6 +14,10 @@
     #include "gfx/x11.c"
 #elif defined(GFX_GLFW)
     #include "gfx/glfw.c"
+#elif defined(GFX_SOFT)
+    #include "gfx/soft.c"
+#elif defined(GFX_TTY)
+    #include "gfx/tty.c"
 #else
-    #error "No graphics driver selected. Use -DGFX_SDL3, -DGFX_SDL2, -DGFX_GTK3, -DGFX_X11, or -DGFX_GLFW"
+    #error "No graphics driver selected. Use -DGFX_SDL3, -DGFX_SDL2, -DGFX_GTK3, -DGFX_X11, -DGFX_GLFW, -DGFX_SOFT, or -DGFX_TTY"
 #endif
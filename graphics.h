@@ -33,6 +33,8 @@ int window_is_fullscreen(window_t *window);
 void window_set_topmost(window_t *window, int topmost);
 void window_get_size(window_t *window, int32_t *width, int32_t *height);
 int window_was_resized(void);
+/* 0 while the window is minimized, unmapped or fully covered */
+int window_is_visible(window_t *window);
 
 renderer_t *renderer_create(window_t *window);
 void renderer_destroy(renderer_t *renderer);
@@ -42,6 +44,26 @@ void renderer_set_color(renderer_t *renderer, color_t color);
 void renderer_draw_line(renderer_t *renderer, int32_t x1, int32_t y1, int32_t x2, int32_t y2);
 void renderer_draw_rect(renderer_t *renderer, rect_t rect);
 void renderer_fill_rect(renderer_t *renderer, rect_t rect);
+/* Blit rect.w x rect.h pixels of 0x00RRGGBB, stride counted in pixels */
+void renderer_draw_image(renderer_t *renderer, rect_t rect, const uint32_t *pixels, int32_t stride);
+/* Framebuffer readback as 0x00RRGGBB scanlines, valid until the next draw.
+ * Returns 0 on backends that render straight to the display. */
+int renderer_read_pixels(renderer_t *renderer, const uint32_t **pixels,
+                         int32_t *width, int32_t *height, int32_t *stride);
+
+/* Per-plot damage tracking. Backends with a retained back buffer only get
+ * asked to repaint plots whose data changed. renderer_begin_plot returns 0
+ * when the backend already holds an up to date copy of the plot (dirty is 0)
+ * and has put it on screen, so the caller skips drawing it. */
+int renderer_has_backing_store(renderer_t *renderer);
+int renderer_begin_plot(renderer_t *renderer, uint32_t index, rect_t rect, int dirty);
+void renderer_end_plot(renderer_t *renderer, uint32_t index, rect_t rect);
+
+/* A second renderer on the same target for drawing plots from another
+ * thread. It keeps its own colour and queues and between begin_plot and
+ * end_plot touches nothing outside the plot rect. NULL where the backend
+ * can only be driven from one thread. Free with renderer_destroy. */
+renderer_t *renderer_create_worker(renderer_t *renderer);
 
 font_t *font_create(const char *path, int32_t size);
 void font_destroy(font_t *font);
@@ -50,9 +72,16 @@ void font_draw_text(renderer_t *renderer, font_t *font, color_t color,
 void font_get_text_size(font_t *font, const char *text, int32_t *width, int32_t *height);
 
 typedef enum {
+    KEY_NONE = 0,
     KEY_Q = 'q',
     KEY_R = 'r',
-    KEY_F = 'f'
+    KEY_F = 'f',
+    KEY_UP = 0x100,
+    KEY_DOWN,
+    KEY_PAGE_UP,
+    KEY_PAGE_DOWN,
+    KEY_HOME,
+    KEY_END
 } key_code_t;
 
 typedef enum {
@@ -60,12 +89,14 @@ typedef enum {
     GRAPHICS_EVENT_QUIT,
     GRAPHICS_EVENT_KEY_PRESS,
     GRAPHICS_EVENT_REFRESH,
-    GRAPHICS_EVENT_FULLSCREEN_TOGGLE
+    GRAPHICS_EVENT_FULLSCREEN_TOGGLE,
+    GRAPHICS_EVENT_SCROLL
 } graphics_event_type_t;
 
 typedef struct {
     graphics_event_type_t type;
     key_code_t key;
+    int32_t scroll; /* rows, positive scrolls down */
 } graphics_event_t;
 
 int graphics_poll_events(void);
@@ -0,0 +1,281 @@
+#define _GNU_SOURCE
+#include "compat.h"
+#include "heatmap.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <math.h>
+
+#define HEATMAP_MAX_TARGETS 65536
+
+heatmap_t *heatmap_create(uint32_t rows, uint32_t columns, double max_value) {
+    if (rows == 0 || columns == 0) return NULL;
+
+    heatmap_t *heatmap = malloc(sizeof(heatmap_t));
+    if (!heatmap) return NULL;
+
+    heatmap->cells = calloc((size_t)rows * columns, 1);
+    heatmap->latest = calloc(rows, 1);
+    heatmap->mutex = mutex_create();
+    if (!heatmap->cells || !heatmap->latest || !heatmap->mutex) {
+        free(heatmap->cells);
+        free(heatmap->latest);
+        mutex_destroy(heatmap->mutex);
+        free(heatmap);
+        return NULL;
+    }
+
+    heatmap->rows = rows;
+    heatmap->columns = columns;
+    heatmap->max_value = max_value > 0.0 ? max_value : 1.0;
+    atomic_store(&heatmap->head, 0);
+    atomic_store(&heatmap->count, 0);
+    atomic_store(&heatmap->lost, 0);
+
+    return heatmap;
+}
+
+void heatmap_destroy(heatmap_t *heatmap) {
+    if (!heatmap) return;
+
+    mutex_destroy(heatmap->mutex);
+    free(heatmap->cells);
+    free(heatmap->latest);
+    free(heatmap);
+}
+
+int heatmap_resize(heatmap_t *heatmap, uint32_t columns) {
+    if (!heatmap || columns == 0) return 0;
+
+    mutex_lock(heatmap->mutex);
+
+    if (columns == heatmap->columns) {
+        mutex_unlock(heatmap->mutex);
+        return 1;
+    }
+
+    uint8_t *cells = calloc((size_t)heatmap->rows * columns, 1);
+    if (!cells) {
+        mutex_unlock(heatmap->mutex);
+        return 0;
+    }
+
+    uint32_t count = atomic_load(&heatmap->count);
+    uint32_t head = atomic_load(&heatmap->head);
+    uint32_t keep = count < columns ? count : columns;
+    uint32_t start = (head + heatmap->columns - keep) % heatmap->columns;
+    uint32_t row, i;
+
+    for (row = 0; row < heatmap->rows; row++) {
+        uint8_t *src = heatmap->cells + (size_t)row * heatmap->columns;
+        uint8_t *dst = cells + (size_t)row * columns;
+        for (i = 0; i < keep; i++) {
+            dst[i] = src[(start + i) % heatmap->columns];
+        }
+    }
+
+    free(heatmap->cells);
+    heatmap->cells = cells;
+    heatmap->columns = columns;
+    atomic_store(&heatmap->head, keep % columns);
+    atomic_store(&heatmap->count, keep);
+
+    mutex_unlock(heatmap->mutex);
+    return 1;
+}
+
+uint8_t heatmap_quantize(heatmap_t *heatmap, double value) {
+    if (value < 0.0) return HEATMAP_LOSS;
+    if (value >= heatmap->max_value) return HEATMAP_LEVELS;
+
+    return (uint8_t)(1 + (HEATMAP_LEVELS - 1) * log1p(value) / log1p(heatmap->max_value));
+}
+
+/* Called by the sampling threads, each row has a single writer */
+void heatmap_set(heatmap_t *heatmap, uint32_t row, double value) {
+    if (!heatmap || row >= heatmap->rows) return;
+    heatmap->latest[row] = heatmap_quantize(heatmap, value);
+}
+
+/* Append the latest sample of every row as a new column. Returns how many
+ * rows failed in it. */
+uint32_t heatmap_commit(heatmap_t *heatmap) {
+    uint32_t row, lost = 0;
+    if (!heatmap) return 0;
+
+    mutex_lock(heatmap->mutex);
+
+    uint32_t head = atomic_load(&heatmap->head);
+    for (row = 0; row < heatmap->rows; row++) {
+        uint8_t value = heatmap->latest[row];
+        heatmap->cells[(size_t)row * heatmap->columns + head] = value;
+        if (value == HEATMAP_LOSS) lost++;
+    }
+
+    atomic_store(&heatmap->head, (head + 1) % heatmap->columns);
+    atomic_store(&heatmap->lost, lost);
+    if (atomic_load(&heatmap->count) < heatmap->columns) {
+        atomic_store(&heatmap->count, atomic_load(&heatmap->count) + 1);
+    }
+
+    mutex_unlock(heatmap->mutex);
+    return lost;
+}
+
+/* Write the matrix as XRGB scanlines, newest sample in the right-most
+ * column. When there are more rows than pixel lines each line shows the
+ * worst of the rows folded into it so a failing target is never hidden. */
+int heatmap_render(heatmap_t *heatmap, const uint32_t *palette,
+                   uint32_t *pixels, int32_t width, int32_t height, int32_t stride) {
+    if (!heatmap || !palette || !pixels || width <= 0 || height <= 0) return 0;
+
+    uint8_t *line = malloc(width);
+    if (!line) return 0;
+
+    mutex_lock(heatmap->mutex);
+
+    uint32_t columns = heatmap->columns;
+    uint32_t count = atomic_load(&heatmap->count);
+    uint32_t head = atomic_load(&heatmap->head);
+    uint32_t visible = count < (uint32_t)width ? count : (uint32_t)width;
+    uint32_t start = (head + columns - visible) % columns;
+    uint32_t first_span = (start + visible <= columns) ? visible : columns - start;
+    uint32_t pad = width - visible;
+    uint32_t prev_r0 = 0, prev_r1 = 0;
+    int32_t y, x;
+
+    for (y = 0; y < height; y++) {
+        uint32_t *dst = pixels + (size_t)y * stride;
+        uint32_t r0 = (uint32_t)((uint64_t)y * heatmap->rows / height);
+        uint32_t r1 = (uint32_t)((uint64_t)(y + 1) * heatmap->rows / height);
+        uint32_t row, i;
+
+        if (r1 <= r0) r1 = r0 + 1;
+
+        if (y > 0 && r0 == prev_r0 && r1 == prev_r1) {
+            memcpy(dst, dst - stride, sizeof(uint32_t) * width);
+            continue;
+        }
+        prev_r0 = r0;
+        prev_r1 = r1;
+
+        memset(line, HEATMAP_NO_DATA, width);
+        for (row = r0; row < r1; row++) {
+            const uint8_t *src = heatmap->cells + (size_t)row * columns;
+            uint8_t *out = line + pad;
+            for (i = 0; i < first_span; i++) {
+                if (src[start + i] > out[i]) out[i] = src[start + i];
+            }
+            out += first_span;
+            for (i = 0; i < visible - first_span; i++) {
+                if (src[i] > out[i]) out[i] = src[i];
+            }
+        }
+
+        for (x = 0; x < width; x++) {
+            dst[x] = palette[line[x]];
+        }
+    }
+
+    mutex_unlock(heatmap->mutex);
+    free(line);
+    return 1;
+}
+
+static int heatmap_add_target(char ***targets, uint32_t *count, uint32_t *capacity, const char *target) {
+    if (*count >= HEATMAP_MAX_TARGETS) return 0;
+
+    if (*count >= *capacity) {
+        uint32_t new_capacity = *capacity ? *capacity * 2 : 16;
+        char **grown = realloc(*targets, sizeof(char*) * new_capacity);
+        if (!grown) return 0;
+        *targets = grown;
+        *capacity = new_capacity;
+    }
+
+    (*targets)[*count] = strdup(target);
+    if (!(*targets)[*count]) return 0;
+    (*count)++;
+    return 1;
+}
+
+/* "ping=10.1.0.1-254" names the datasource used for every row, a bare
+ * target list means ping. Returns the target list part. */
+const char *heatmap_split_spec(const char *spec, char *type, size_t type_size) {
+    const char *eq = strchr(spec, '=');
+
+    if (!eq) {
+        snprintf(type, type_size, "ping");
+        return spec;
+    }
+
+    snprintf(type, type_size, "%.*s", (int)(eq - spec), spec);
+    return eq + 1;
+}
+
+/* Expand a comma separated target list. An IPv4 style item whose last
+ * octet is a range ("10.1.0.1-254") turns into one target per address. */
+int heatmap_expand_targets(const char *spec, char ***targets, uint32_t *count) {
+    char *copy, *item, *save;
+    uint32_t capacity = 0;
+
+    if (!spec || !targets || !count) return 0;
+
+    *targets = NULL;
+    *count = 0;
+
+    copy = strdup(spec);
+    if (!copy) return 0;
+
+    for (item = strtok_r(copy, ",", &save); item; item = strtok_r(NULL, ",", &save)) {
+        char *end, *dash, *dot;
+        char expanded[256];
+        unsigned long first, last, n;
+        int ok = 1;
+
+        while (isspace((unsigned char)*item)) item++;
+        end = item + strlen(item);
+        while (end > item && isspace((unsigned char)end[-1])) *--end = '\0';
+        if (*item == '\0') continue;
+
+        dash = strrchr(item, '-');
+        dot = strrchr(item, '.');
+        if (dash && dot && dot < dash && strspn(item, "0123456789.-") == strlen(item)) {
+            *dash = '\0';
+            first = strtoul(dot + 1, NULL, 10);
+            last = strtoul(dash + 1, NULL, 10);
+            dot[1] = '\0';
+            if (dash[1] == '\0' || last < first || last > 255) {
+                ok = 0;
+            }
+            for (n = first; ok && n <= last; n++) {
+                snprintf(expanded, sizeof(expanded), "%s%lu", item, n);
+                ok = heatmap_add_target(targets, count, &capacity, expanded);
+            }
+        } else {
+            ok = heatmap_add_target(targets, count, &capacity, item);
+        }
+
+        if (!ok) {
+            free(copy);
+            heatmap_free_targets(*targets, *count);
+            *targets = NULL;
+            *count = 0;
+            return 0;
+        }
+    }
+
+    free(copy);
+    return *count > 0;
+}
+
+void heatmap_free_targets(char **targets, uint32_t count) {
+    uint32_t i;
+    if (!targets) return;
+
+    for (i = 0; i < count; i++) {
+        free(targets[i]);
+    }
+    free(targets);
+}
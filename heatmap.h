@@ -0,0 +1,39 @@
+#ifndef HEATMAP_H
+#define HEATMAP_H
+
+#include "compat.h"
+#include "platform.h"
+#include <stddef.h>
+
+/* Quantized cell values: 0 means no sample, 255 a failed one, 1..254 a
+ * value on a log scale between 0 and max_value. */
+#define HEATMAP_NO_DATA 0
+#define HEATMAP_LOSS 255
+#define HEATMAP_LEVELS 254
+
+typedef struct {
+    uint32_t rows;
+    uint32_t columns;
+    uint8_t *cells;     /* rows * columns, each row is a ring of samples */
+    uint8_t *latest;    /* newest quantized sample per row, not yet committed */
+    atomic_uint_fast32_t head;
+    atomic_uint_fast32_t count;
+    atomic_uint_fast32_t lost;  /* failed rows in the newest column */
+    double max_value;
+    mutex_t *mutex;
+} heatmap_t;
+
+heatmap_t *heatmap_create(uint32_t rows, uint32_t columns, double max_value);
+void heatmap_destroy(heatmap_t *heatmap);
+int heatmap_resize(heatmap_t *heatmap, uint32_t columns);
+uint8_t heatmap_quantize(heatmap_t *heatmap, double value);
+void heatmap_set(heatmap_t *heatmap, uint32_t row, double value);
+uint32_t heatmap_commit(heatmap_t *heatmap);
+int heatmap_render(heatmap_t *heatmap, const uint32_t *palette,
+                   uint32_t *pixels, int32_t width, int32_t height, int32_t stride);
+
+const char *heatmap_split_spec(const char *spec, char *type, size_t type_size);
+int heatmap_expand_targets(const char *spec, char ***targets, uint32_t *count);
+void heatmap_free_targets(char **targets, uint32_t count);
+
+#endif
@@ -0,0 +1,225 @@
+#include "compat.h"
+#include "history.h"
+#include "platform.h"
+#include "ringbuf.h"
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+#define HISTORY_CODES 65533     /* code of the highest value in a block */
+#define HISTORY_GAP 65534
+#define HISTORY_ERROR 65535
+
+typedef struct {
+    double offset;      /* value of code 0 */
+    double scale;       /* value step between codes */
+    uint32_t specials;  /* samples coded as error or gap */
+    uint16_t codes[HISTORY_BLOCK];
+} history_block_t;
+
+struct history {
+    mutex_t *mutex;
+    uint64_t written;           /* samples pushed since creation */
+
+    /* Ring of sealed blocks, block n in slot n % capacity, allocated as
+     * they fill so a new plot stays small */
+    history_block_t **blocks;
+    uint32_t capacity;
+    uint32_t allocated;
+
+    double open[HISTORY_BLOCK]; /* block being filled */
+};
+
+history_t *history_create(uint32_t samples) {
+    history_t *history = calloc(1, sizeof(history_t));
+    if (!history) return NULL;
+
+    history->capacity = (samples + HISTORY_BLOCK - 1) / HISTORY_BLOCK;
+    if (history->capacity == 0) history->capacity = 1;
+    history->blocks = calloc(history->capacity, sizeof(history_block_t*));
+    history->mutex = mutex_create();
+    if (!history->blocks || !history->mutex) {
+        history_destroy(history);
+        return NULL;
+    }
+
+    return history;
+}
+
+void history_destroy(history_t *history) {
+    uint32_t i;
+    if (!history) return;
+
+    if (history->blocks) {
+        for (i = 0; i < history->capacity; i++) {
+            free(history->blocks[i]);
+        }
+        free(history->blocks);
+    }
+    if (history->mutex) mutex_destroy(history->mutex);
+    free(history);
+}
+
+static void history_seal(history_block_t *block, const double *values) {
+    double lo = 0.0, hi = 0.0, step;
+    int any = 0;
+    uint32_t i;
+
+    for (i = 0; i < HISTORY_BLOCK; i++) {
+        if (values[i] < 0.0) continue;
+        if (!any || values[i] < lo) lo = values[i];
+        if (!any || values[i] > hi) hi = values[i];
+        any = 1;
+    }
+
+    block->offset = lo;
+    block->scale = (hi - lo) / HISTORY_CODES;
+    block->specials = 0;
+    step = block->scale > 0.0 ? 1.0 / block->scale : 0.0;
+
+    for (i = 0; i < HISTORY_BLOCK; i++) {
+        if (values[i] == RINGBUF_MISSING) {
+            block->codes[i] = HISTORY_GAP;
+            block->specials++;
+        } else if (values[i] < 0.0) {
+            block->codes[i] = HISTORY_ERROR;
+            block->specials++;
+        } else {
+            block->codes[i] = (uint16_t)((values[i] - lo) * step + 0.5);
+        }
+    }
+}
+
+/* Codes back to values, the hot loop when a zoomed out plot is rebuilt */
+static void history_decode(const history_block_t *block, uint32_t start, uint32_t count, double *out) {
+    const uint16_t *codes = block->codes + start;
+    double offset = block->offset, scale = block->scale;
+    uint32_t i = 0;
+
+    if (block->specials) {
+        for (i = 0; i < count; i++) {
+            if (codes[i] == HISTORY_GAP) out[i] = RINGBUF_MISSING;
+            else if (codes[i] == HISTORY_ERROR) out[i] = -1.0;
+            else out[i] = offset + codes[i] * scale;
+        }
+        return;
+    }
+
+#if defined(__SSE2__)
+    {
+        __m128d voffset = _mm_set1_pd(offset), vscale = _mm_set1_pd(scale);
+        __m128i zero = _mm_setzero_si128();
+
+        for (; i + 8 <= count; i += 8) {
+            __m128i c = _mm_loadu_si128((const __m128i*)(codes + i));
+            __m128i lo = _mm_unpacklo_epi16(c, zero);
+            __m128i hi = _mm_unpackhi_epi16(c, zero);
+
+            _mm_storeu_pd(out + i, _mm_add_pd(voffset, _mm_mul_pd(_mm_cvtepi32_pd(lo), vscale)));
+            _mm_storeu_pd(out + i + 2, _mm_add_pd(voffset, _mm_mul_pd(_mm_cvtepi32_pd(_mm_srli_si128(lo, 8)), vscale)));
+            _mm_storeu_pd(out + i + 4, _mm_add_pd(voffset, _mm_mul_pd(_mm_cvtepi32_pd(hi), vscale)));
+            _mm_storeu_pd(out + i + 6, _mm_add_pd(voffset, _mm_mul_pd(_mm_cvtepi32_pd(_mm_srli_si128(hi, 8)), vscale)));
+        }
+    }
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+    {
+        float64x2_t voffset = vdupq_n_f64(offset);
+
+        for (; i + 4 <= count; i += 4) {
+            uint32x4_t c = vmovl_u16(vld1_u16(codes + i));
+
+            vst1q_f64(out + i, vfmaq_n_f64(voffset, vcvtq_f64_u64(vmovl_u32(vget_low_u32(c))), scale));
+            vst1q_f64(out + i + 2, vfmaq_n_f64(voffset, vcvtq_f64_u64(vmovl_u32(vget_high_u32(c))), scale));
+        }
+    }
+#endif
+    for (; i < count; i++) {
+        out[i] = offset + codes[i] * scale;
+    }
+}
+
+void history_push(history_t *history, double value) {
+    uint32_t at;
+    if (!history) return;
+
+    mutex_lock(history->mutex);
+
+    at = (uint32_t)(history->written % HISTORY_BLOCK);
+    history->open[at] = value;
+    history->written++;
+
+    if (at == HISTORY_BLOCK - 1) {
+        uint32_t slot = (uint32_t)((history->written / HISTORY_BLOCK - 1) % history->capacity);
+
+        if (!history->blocks[slot]) {
+            history->blocks[slot] = malloc(sizeof(history_block_t));
+            if (history->blocks[slot]) history->allocated++;
+        }
+        if (history->blocks[slot]) {
+            history_seal(history->blocks[slot], history->open);
+        }
+    }
+
+    mutex_unlock(history->mutex);
+}
+
+/* Copy up to count samples, oldest first, starting at sample number from
+ * or the oldest one still kept. Like ringbuf_read_range. */
+uint32_t history_read_range(history_t *history, uint64_t from, double *values, uint32_t count,
+                            uint64_t *first_out, uint64_t *written_out) {
+    uint64_t sealed, oldest, first, at;
+    uint32_t i = 0;
+
+    if (!history || !values || !first_out || !written_out) return 0;
+
+    mutex_lock(history->mutex);
+
+    sealed = history->written / HISTORY_BLOCK;
+    oldest = sealed > history->capacity ? (sealed - history->capacity) * HISTORY_BLOCK : 0;
+    first = from > oldest ? from : oldest;
+    if (first > history->written) first = history->written;
+    if (history->written - first < count) count = (uint32_t)(history->written - first);
+
+    for (at = first; i < count; ) {
+        uint64_t block = at / HISTORY_BLOCK;
+        uint32_t offset = (uint32_t)(at % HISTORY_BLOCK);
+        uint32_t run = HISTORY_BLOCK - offset;
+        history_block_t *sealed_block;
+
+        if (run > count - i) run = count - i;
+        if (block == sealed) {
+            memcpy(values + i, history->open + offset, sizeof(double) * run);
+        } else if ((sealed_block = history->blocks[block % history->capacity])) {
+            history_decode(sealed_block, offset, run, values + i);
+        } else {
+            uint32_t j;
+            for (j = 0; j < run; j++) values[i + j] = RINGBUF_MISSING;
+        }
+        i += run;
+        at += run;
+    }
+
+    *first_out = first;
+    *written_out = history->written;
+
+    mutex_unlock(history->mutex);
+    return count;
+}
+
+/* Samples it holds once full, not counting the block being filled */
+uint32_t history_size(history_t *history) {
+    if (!history) return 0;
+    return history->capacity * HISTORY_BLOCK;
+}
+
+/* Memory in use, for the benchmark */
+size_t history_bytes(history_t *history) {
+    if (!history) return 0;
+    return sizeof(history_t) + sizeof(history_block_t*) * history->capacity +
+           sizeof(history_block_t) * history->allocated;
+}
@@ -0,0 +1,25 @@
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include "compat.h"
+#include <stddef.h>
+
+/* Compressed plot history for zoomed out views. Samples are kept in fixed
+ * blocks of 16 bit codes scaled between the lowest and highest value of
+ * the block, about 2 bytes a sample instead of 8, precise to 1/65533 of
+ * the block's range. Errors and gaps keep their own codes. Only the
+ * block being filled is plain doubles. */
+
+#define HISTORY_BLOCK 256
+
+typedef struct history history_t;
+
+history_t *history_create(uint32_t samples);
+void history_destroy(history_t *history);
+void history_push(history_t *history, double value);
+uint32_t history_read_range(history_t *history, uint64_t from, double *values, uint32_t count,
+                            uint64_t *first_out, uint64_t *written_out);
+uint32_t history_size(history_t *history);
+size_t history_bytes(history_t *history);
+
+#endif
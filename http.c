@@ -0,0 +1,764 @@
+#define _GNU_SOURCE
+#include "compat.h"
+#include "http.h"
+#include "png.h"
+#include "net.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+
+#define HTTP_MAX_CLIENTS 64
+#define HTTP_REQUEST_MAX 4096
+#define HTTP_POLL_MS 250
+#define HTTP_WAIT_POLL_MS 20
+#define HTTP_SNAPSHOT_TIMEOUT_MS 5000
+#define HTTP_IDLE_TIMEOUT_MS 30000
+#define HTTP_STREAM_INTERVAL_MS 250
+#define HTTP_STREAM_MAX_SAMPLES 64
+#define HTTP_STREAM_BACKLOG (1024 * 1024)   /* drop stream clients this far behind */
+
+/* Encoded images are shared by every client sending them */
+typedef struct {
+    uint8_t *data;
+    size_t size;
+    uint32_t refs;
+} http_blob_t;
+
+typedef enum {
+    HTTP_CLIENT_FREE,
+    HTTP_CLIENT_READING,
+    HTTP_CLIENT_WAITING,    /* for a framebuffer snapshot */
+    HTTP_CLIENT_WRITING,
+    HTTP_CLIENT_STREAMING
+} http_client_state_t;
+
+typedef struct {
+    int fd;
+    http_client_state_t state;
+    uint32_t last_activity_ms;
+
+    char request[HTTP_REQUEST_MAX];
+    size_t request_size;
+    int keep_alive;
+    int head_only;
+
+    /* Image the client waits for, -1 is the whole dashboard */
+    int32_t wait_plot;
+    uint32_t min_serial;
+    uint32_t wait_start_ms;
+
+    net_buffer_t out;
+    http_blob_t *body;
+    size_t body_sent;
+} http_client_t;
+
+typedef struct {
+    rect_t rect;
+    int on_screen;
+    uint32_t drawn_serial;
+} http_plot_snapshot_t;
+
+typedef struct {
+    http_blob_t *png;
+    uint32_t frame_serial;  /* snapshot it was checked against */
+    uint32_t drawn_serial;  /* plot contents it shows */
+} http_plot_cache_t;
+
+struct http_server {
+    int listen_fd;
+    plot_system_t *system;
+    plot_thread_t *thread;
+    volatile int running;
+    http_client_t clients[HTTP_MAX_CLIENTS];
+
+    /* Shared with the render thread, the snapshot itself is only written
+     * while snapshot_wanted is set and only read while it is not */
+    mutex_t *mutex;
+    int snapshot_wanted;
+    int snapshot_status;    /* 1 ok, 0 none yet, -1 backend cannot read back */
+    uint32_t frame_serial;
+    int frame_stale;        /* window hidden, the last frame is old */
+    uint32_t snapshot_serial;
+    uint32_t *snapshot;
+    size_t snapshot_capacity;
+    int32_t snapshot_width;
+    int32_t snapshot_height;
+    http_plot_snapshot_t *snapshot_plots;
+
+    /* HTTP thread only */
+    http_blob_t *dashboard_png;
+    uint32_t dashboard_serial;
+    http_plot_cache_t *plot_cache;
+    uint64_t *stream_next;      /* per plot, written count streamed up to */
+    uint32_t last_stream_ms;
+};
+
+static int serial_at_least(uint32_t serial, uint32_t min) {
+    return (int32_t)(serial - min) >= 0;
+}
+
+static void http_blob_release(http_blob_t *blob) {
+    if (!blob) return;
+    if (--blob->refs == 0) {
+        free(blob->data);
+        free(blob);
+    }
+}
+
+static http_blob_t *http_blob_encode(const uint32_t *pixels, int32_t width, int32_t height, int32_t stride) {
+    http_blob_t *blob = malloc(sizeof(http_blob_t));
+    if (!blob) return NULL;
+
+    if (!png_encode(pixels, width, height, stride, &blob->data, &blob->size)) {
+        free(blob);
+        return NULL;
+    }
+    blob->refs = 1;
+    return blob;
+}
+
+static void http_client_close(http_client_t *client) {
+    if (client->fd >= 0) {
+        close(client->fd);
+    }
+    http_blob_release(client->body);
+    net_buffer_free(&client->out);
+    memset(client, 0, sizeof(*client));
+    client->fd = -1;
+    client->state = HTTP_CLIENT_FREE;
+}
+
+/* Queue a complete response; body is either text or a shared blob */
+static void http_respond(http_client_t *client, int status, const char *reason, const char *content_type,
+                         const char *text, http_blob_t *blob) {
+    size_t length = blob ? blob->size : (text ? strlen(text) : 0);
+
+    net_buffer_printf(&client->out, "HTTP/1.1 %d %s\r\n"
+                                    "Content-Type: %s\r\n"
+                                    "Content-Length: %zu\r\n"
+                                    "Cache-Control: no-cache\r\n"
+                                    "Connection: %s\r\n\r\n",
+                      status, reason, content_type, length, client->keep_alive ? "keep-alive" : "close");
+
+    if (!client->head_only) {
+        if (blob) {
+            blob->refs++;
+            client->body = blob;
+            client->body_sent = 0;
+        } else if (text) {
+            net_buffer_append(&client->out, text, length);
+        }
+    }
+    client->state = HTTP_CLIENT_WRITING;
+}
+
+static void http_respond_error(http_client_t *client, int status, const char *reason) {
+    char text[128];
+    snprintf(text, sizeof(text), "%d %s\n", status, reason);
+    http_respond(client, status, reason, "text/plain", text, NULL);
+}
+
+static void http_append_escaped(net_buffer_t *out, const char *text, int json) {
+    for (; *text; text++) {
+        char c = *text;
+        if (json && (c == '"' || c == '\\')) {
+            net_buffer_printf(out, "\\%c", c);
+        } else if (json && (unsigned char)c < 0x20) {
+            net_buffer_printf(out, "\\u%04x", c);
+        } else if (!json && c == '&') {
+            net_buffer_append(out, "&amp;", 5);
+        } else if (!json && c == '<') {
+            net_buffer_append(out, "&lt;", 4);
+        } else if (!json && c == '>') {
+            net_buffer_append(out, "&gt;", 4);
+        } else {
+            net_buffer_append(out, &c, 1);
+        }
+    }
+}
+
+static void http_send_index(http_server_t *server, http_client_t *client) {
+    net_buffer_t page;
+    uint32_t i;
+
+    memset(&page, 0, sizeof(page));
+    net_buffer_printf(&page, "<!DOCTYPE html>\n<html><head><title>PlotTool</title></head><body>\n"
+                             "<p><img src=\"/plot.png\" alt=\"dashboard\"></p>\n<ul>\n");
+    for (i = 0; i < server->system->plot_count; i++) {
+        net_buffer_printf(&page, "<li><a href=\"/plot/%u.png\">", i);
+        http_append_escaped(&page, server->system->plots[i].config->name, 0);
+        net_buffer_printf(&page, "</a></li>\n");
+    }
+    net_buffer_printf(&page, "</ul>\n<p><a href=\"/stream\">/stream</a></p>\n</body></html>\n");
+    net_buffer_append(&page, "", 1);
+
+    http_respond(client, 200, "OK", "text/html; charset=utf-8", page.data ? page.data : "", NULL);
+    net_buffer_free(&page);
+}
+
+static void http_start_stream(http_client_t *client) {
+    client->keep_alive = 0;
+    net_buffer_printf(&client->out, "HTTP/1.1 200 OK\r\n"
+                                    "Content-Type: text/event-stream\r\n"
+                                    "Cache-Control: no-cache\r\n"
+                                    "Connection: close\r\n\r\n");
+    client->state = client->head_only ? HTTP_CLIENT_WRITING : HTTP_CLIENT_STREAMING;
+}
+
+/* Value of a request header, the name matched case-insensitively */
+static const char *http_header(const char *request, const char *name) {
+    size_t length = strlen(name);
+    const char *line = strchr(request, '\n');
+
+    while (line) {
+        line++;
+        if (strncasecmp(line, name, length) == 0 && line[length] == ':') {
+            const char *value = line + length + 1;
+            while (*value == ' ' || *value == '\t') value++;
+            return value;
+        }
+        line = strchr(line, '\n');
+    }
+    return NULL;
+}
+
+/* Parse one request out of the buffer, returns 0 until the headers are in */
+static int http_handle_request(http_server_t *server, http_client_t *client) {
+    char method[16], path[256], version[16];
+    char *end = NULL;
+    size_t i, consumed;
+
+    for (i = 3; i < client->request_size; i++) {
+        if (memcmp(client->request + i - 3, "\r\n\r\n", 4) == 0) {
+            end = client->request + i + 1;
+            break;
+        }
+    }
+    if (!end) {
+        if (client->request_size >= HTTP_REQUEST_MAX) {
+            client->keep_alive = 0;
+            http_respond_error(client, 431, "Request Header Fields Too Large");
+            return 1;
+        }
+        return 0;
+    }
+
+    consumed = end - client->request;
+    end[-1] = '\0';
+
+    if (sscanf(client->request, "%15s %255s %15s", method, path, version) != 3) {
+        client->keep_alive = 0;
+        client->request_size = 0;
+        http_respond_error(client, 400, "Bad Request");
+        return 1;
+    }
+
+    const char *connection = http_header(client->request, "Connection");
+    client->keep_alive = strcmp(version, "HTTP/1.1") == 0 &&
+                         !(connection && strncasecmp(connection, "close", 5) == 0) &&
+                         !http_header(client->request, "Content-Length");
+    client->head_only = strcmp(method, "HEAD") == 0;
+
+    memmove(client->request, client->request + consumed, client->request_size - consumed);
+    client->request_size -= consumed;
+
+    char *query = strchr(path, '?');
+    if (query) *query = '\0';
+
+    if (strcmp(method, "GET") != 0 && !client->head_only) {
+        client->keep_alive = 0;
+        http_respond_error(client, 405, "Method Not Allowed");
+        return 1;
+    }
+
+    unsigned int plot_index;
+    char tail[8];
+    if (strcmp(path, "/") == 0 || strcmp(path, "/index.html") == 0) {
+        http_send_index(server, client);
+    } else if (strcmp(path, "/stream") == 0) {
+        http_start_stream(client);
+    } else if (strcmp(path, "/plot.png") == 0) {
+        client->wait_plot = -1;
+        client->state = HTTP_CLIENT_WAITING;
+    } else if (sscanf(path, "/plot/%u%7s", &plot_index, tail) == 2 && strcmp(tail, ".png") == 0 &&
+               plot_index < server->system->plot_count) {
+        client->wait_plot = (int32_t)plot_index;
+        client->state = HTTP_CLIENT_WAITING;
+    } else {
+        http_respond_error(client, 404, "Not Found");
+    }
+
+    if (client->state == HTTP_CLIENT_WAITING) {
+        mutex_lock(server->mutex);
+        client->min_serial = server->frame_serial + (server->frame_stale ? 1 : 0);
+        mutex_unlock(server->mutex);
+        client->wait_start_ms = platform_get_time_ms();
+    }
+    return 1;
+}
+
+/* Try to answer a waiting client from the caches or the current snapshot.
+ * Returns 0 if a newer snapshot is needed. */
+static int http_serve_image(http_server_t *server, http_client_t *client, int snapshot_usable) {
+    int fresh = snapshot_usable && server->snapshot_status != 0 &&
+                serial_at_least(server->snapshot_serial, client->min_serial);
+
+    if (client->wait_plot < 0) {
+        if (server->dashboard_png && serial_at_least(server->dashboard_serial, client->min_serial)) {
+            http_respond(client, 200, "OK", "image/png", NULL, server->dashboard_png);
+            return 1;
+        }
+        if (!fresh) return 0;
+        if (server->snapshot_status < 0) {
+            http_respond_error(client, 503, "Graphics backend cannot read back frames");
+            return 1;
+        }
+
+        http_blob_t *png = http_blob_encode(server->snapshot, server->snapshot_width,
+                                            server->snapshot_height, server->snapshot_width);
+        if (!png) {
+            http_respond_error(client, 500, "Internal Server Error");
+            return 1;
+        }
+        http_blob_release(server->dashboard_png);
+        server->dashboard_png = png;
+        server->dashboard_serial = server->snapshot_serial;
+        http_respond(client, 200, "OK", "image/png", NULL, png);
+        return 1;
+    }
+
+    http_plot_cache_t *cache = &server->plot_cache[client->wait_plot];
+    if (cache->png && serial_at_least(cache->frame_serial, client->min_serial)) {
+        http_respond(client, 200, "OK", "image/png", NULL, cache->png);
+        return 1;
+    }
+    if (!fresh) return 0;
+    if (server->snapshot_status < 0) {
+        http_respond_error(client, 503, "Graphics backend cannot read back frames");
+        return 1;
+    }
+
+    http_plot_snapshot_t *plot = &server->snapshot_plots[client->wait_plot];
+    rect_t rect = plot->rect;
+    if (rect.x < 0) { rect.w += rect.x; rect.x = 0; }
+    if (rect.y < 0) { rect.h += rect.y; rect.y = 0; }
+    if (rect.x + rect.w > server->snapshot_width) rect.w = server->snapshot_width - rect.x;
+    if (rect.y + rect.h > server->snapshot_height) rect.h = server->snapshot_height - rect.y;
+    if (!plot->on_screen || rect.w <= 0 || rect.h <= 0) {
+        http_respond_error(client, 404, "Plot is not on screen");
+        return 1;
+    }
+
+    /* Plots that were not redrawn since keep their encoded image */
+    if (!cache->png || cache->drawn_serial != plot->drawn_serial) {
+        http_blob_t *png = http_blob_encode(server->snapshot + (size_t)rect.y * server->snapshot_width + rect.x,
+                                            rect.w, rect.h, server->snapshot_width);
+        if (!png) {
+            http_respond_error(client, 500, "Internal Server Error");
+            return 1;
+        }
+        http_blob_release(cache->png);
+        cache->png = png;
+        cache->drawn_serial = plot->drawn_serial;
+    }
+    cache->frame_serial = server->snapshot_serial;
+    http_respond(client, 200, "OK", "image/png", NULL, cache->png);
+    return 1;
+}
+
+static void http_serve_waiting(http_server_t *server) {
+    int wanted, need_snapshot = 0, i;
+    uint32_t now = platform_get_time_ms();
+
+    mutex_lock(server->mutex);
+    wanted = server->snapshot_wanted;
+    mutex_unlock(server->mutex);
+
+    for (i = 0; i < HTTP_MAX_CLIENTS; i++) {
+        http_client_t *client = &server->clients[i];
+        if (client->state != HTTP_CLIENT_WAITING) continue;
+
+        if (http_serve_image(server, client, !wanted)) continue;
+
+        if (now - client->wait_start_ms >= HTTP_SNAPSHOT_TIMEOUT_MS) {
+            http_respond_error(client, 503, "No frame rendered");
+        } else {
+            need_snapshot = 1;
+        }
+    }
+
+    if (need_snapshot && !wanted) {
+        mutex_lock(server->mutex);
+        server->snapshot_wanted = 1;
+        mutex_unlock(server->mutex);
+    }
+}
+
+static void http_append_values(net_buffer_t *out, const double *values, uint32_t count) {
+    uint32_t i;
+    net_buffer_append(out, "[", 1);
+    for (i = 0; i < count; i++) {
+        if (values[i] < 0) {
+            net_buffer_printf(out, "%snull", i ? "," : "");
+        } else {
+            net_buffer_printf(out, "%s%.6g", i ? "," : "", values[i]);
+        }
+    }
+    net_buffer_append(out, "]", 1);
+}
+
+/* Send every sample that arrived since the last tick as one event per
+ * plot, the newest HTTP_STREAM_MAX_SAMPLES of them when more did. Read
+ * with ringbuf_peek_range, which never holds up a sampler. */
+static void http_stream_samples(http_server_t *server) {
+    plot_system_t *system = server->system;
+    double values[HTTP_STREAM_MAX_SAMPLES];
+    double secondary[HTTP_STREAM_MAX_SAMPLES];
+    double min[HTTP_STREAM_MAX_SAMPLES], max[HTTP_STREAM_MAX_SAMPLES];
+    uint64_t times[HTTP_STREAM_MAX_SAMPLES];
+    uint64_t written, from, first, first_secondary, written_secondary;
+    uint32_t i, n, n_secondary;
+    int c, streaming = 0;
+
+    for (c = 0; c < HTTP_MAX_CLIENTS; c++) {
+        if (server->clients[c].state == HTTP_CLIENT_STREAMING) streaming = 1;
+    }
+
+    for (i = 0; i < system->plot_count; i++) {
+        plot_t *plot = &system->plots[i];
+        ringbuf_t *ring = plot->data_buffer;
+        if (!ring) continue;
+
+        written = atomic_load(&ring->written);
+        from = server->stream_next[i];
+        if (written == from) continue;
+        if (written < from) from = 0;
+        if (written - from > HTTP_STREAM_MAX_SAMPLES) from = written - HTTP_STREAM_MAX_SAMPLES;
+        if (!streaming) {
+            server->stream_next[i] = written;
+            continue;
+        }
+
+        /* Left for the next tick when a push kept getting in the way */
+        n = ringbuf_peek_range(ring, from, values, min, max, times, HTTP_STREAM_MAX_SAMPLES, &first, &written);
+        if (n == 0) continue;
+        server->stream_next[i] = first + n;
+
+        n_secondary = 0;
+        if (plot->is_dual && plot->data_buffer_secondary) {
+            n_secondary = ringbuf_peek_range(plot->data_buffer_secondary, first, secondary, min, max, times, n,
+                                             &first_secondary, &written_secondary);
+        }
+
+        for (c = 0; c < HTTP_MAX_CLIENTS; c++) {
+            http_client_t *client = &server->clients[c];
+            if (client->state != HTTP_CLIENT_STREAMING) continue;
+
+            net_buffer_printf(&client->out, "event: sample\ndata: {\"plot\":%u,\"name\":\"", i);
+            http_append_escaped(&client->out, plot->config->name, 1);
+            net_buffer_printf(&client->out, "\",\"values\":");
+            http_append_values(&client->out, values, n);
+            if (n_secondary) {
+                net_buffer_printf(&client->out, ",\"secondary\":");
+                http_append_values(&client->out, secondary, n_secondary);
+            }
+            net_buffer_printf(&client->out, "}\n\n");
+        }
+    }
+
+    for (c = 0; c < HTTP_MAX_CLIENTS; c++) {
+        http_client_t *client = &server->clients[c];
+        if (client->state == HTTP_CLIENT_STREAMING && client->out.size - client->out.sent > HTTP_STREAM_BACKLOG) {
+            http_client_close(client);
+        }
+    }
+}
+
+static void http_client_read(http_server_t *server, http_client_t *client) {
+    char discard[512];
+    ssize_t n;
+
+    if (client->state != HTTP_CLIENT_READING) {
+        /* Nothing more is expected, only notice the peer going away */
+        n = recv(client->fd, discard, sizeof(discard), 0);
+        if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+            http_client_close(client);
+        }
+        return;
+    }
+
+    n = recv(client->fd, client->request + client->request_size,
+             HTTP_REQUEST_MAX - client->request_size, 0);
+    if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+        http_client_close(client);
+        return;
+    }
+    if (n > 0) {
+        client->request_size += n;
+        client->last_activity_ms = platform_get_time_ms();
+        http_handle_request(server, client);
+    }
+}
+
+static void http_client_write(http_server_t *server, http_client_t *client) {
+    int result = net_buffer_send(client->fd, &client->out);
+
+    if (result > 0 && client->body) {
+        result = net_send(client->fd, client->body->data, client->body->size, &client->body_sent);
+    }
+    if (result < 0) http_client_close(client);
+    if (result <= 0) return;
+
+    http_blob_release(client->body);
+    client->body = NULL;
+    client->last_activity_ms = platform_get_time_ms();
+
+    if (client->state == HTTP_CLIENT_STREAMING) return;
+
+    if (!client->keep_alive) {
+        http_client_close(client);
+        return;
+    }
+
+    /* Pipelined requests may already be buffered */
+    client->state = HTTP_CLIENT_READING;
+    if (client->request_size > 0) {
+        http_handle_request(server, client);
+    }
+}
+
+static void http_accept(http_server_t *server) {
+    int fd, i;
+
+    while ((fd = net_accept(server->listen_fd)) >= 0) {
+        for (i = 0; i < HTTP_MAX_CLIENTS; i++) {
+            if (server->clients[i].state == HTTP_CLIENT_FREE) break;
+        }
+        if (i == HTTP_MAX_CLIENTS) {
+            close(fd);
+            continue;
+        }
+
+        http_client_t *client = &server->clients[i];
+        memset(client, 0, sizeof(*client));
+        client->fd = fd;
+        client->state = HTTP_CLIENT_READING;
+        client->last_activity_ms = platform_get_time_ms();
+    }
+}
+
+static void http_server_thread(void *arg) {
+    http_server_t *server = (http_server_t*)arg;
+    struct pollfd fds[HTTP_MAX_CLIENTS + 1];
+    int slot[HTTP_MAX_CLIENTS + 1];
+
+    while (server->running) {
+        int nfds = 1, waiting = 0, i;
+
+        fds[0].fd = server->listen_fd;
+        fds[0].events = POLLIN;
+        fds[0].revents = 0;
+
+        for (i = 0; i < HTTP_MAX_CLIENTS; i++) {
+            http_client_t *client = &server->clients[i];
+            if (client->state == HTTP_CLIENT_FREE) continue;
+
+            /* Pipelined requests stay in the socket until this one is done */
+            short events = 0;
+            if (client->state == HTTP_CLIENT_READING || client->state == HTTP_CLIENT_STREAMING) events |= POLLIN;
+            if (client->out.sent < client->out.size || client->body) events |= POLLOUT;
+            if (client->state == HTTP_CLIENT_WAITING) waiting = 1;
+
+            fds[nfds].fd = client->fd;
+            fds[nfds].events = events;
+            fds[nfds].revents = 0;
+            slot[nfds] = i;
+            nfds++;
+        }
+
+        if (poll(fds, nfds, waiting ? HTTP_WAIT_POLL_MS : HTTP_POLL_MS) < 0 && errno != EINTR) {
+            break;
+        }
+
+        if (fds[0].revents & POLLIN) {
+            http_accept(server);
+        }
+
+        for (i = 1; i < nfds; i++) {
+            http_client_t *client = &server->clients[slot[i]];
+            if (client->fd != fds[i].fd) continue;
+
+            if (fds[i].revents & (POLLERR | POLLNVAL)) {
+                http_client_close(client);
+                continue;
+            }
+            if (fds[i].revents & (POLLIN | POLLHUP)) {
+                http_client_read(server, client);
+            }
+            if (client->state != HTTP_CLIENT_FREE && (fds[i].revents & POLLOUT)) {
+                http_client_write(server, client);
+            }
+        }
+
+        http_serve_waiting(server);
+
+        uint32_t now = platform_get_time_ms();
+        if (now - server->last_stream_ms >= HTTP_STREAM_INTERVAL_MS) {
+            server->last_stream_ms = now;
+            http_stream_samples(server);
+        }
+
+        for (i = 0; i < HTTP_MAX_CLIENTS; i++) {
+            http_client_t *client = &server->clients[i];
+            if (client->state == HTTP_CLIENT_READING && now - client->last_activity_ms >= HTTP_IDLE_TIMEOUT_MS) {
+                http_client_close(client);
+            } else if (client->state != HTTP_CLIENT_FREE && (client->out.sent < client->out.size || client->body)) {
+                http_client_write(server, client);
+            }
+        }
+    }
+}
+
+http_server_t *http_server_create(plot_system_t *system, const char *bind_address, int32_t port) {
+    uint32_t count;
+    int i;
+
+    if (!system || port <= 0) return NULL;
+    if (!bind_address || !*bind_address) bind_address = "127.0.0.1";
+
+    http_server_t *server = calloc(1, sizeof(http_server_t));
+    if (!server) return NULL;
+
+    count = system->plot_count ? system->plot_count : 1;
+    server->system = system;
+    server->mutex = mutex_create();
+    server->snapshot_plots = calloc(count, sizeof(http_plot_snapshot_t));
+    server->plot_cache = calloc(count, sizeof(http_plot_cache_t));
+    server->stream_next = calloc(count, sizeof(uint64_t));
+    for (i = 0; i < HTTP_MAX_CLIENTS; i++) {
+        server->clients[i].fd = -1;
+    }
+
+    server->listen_fd = net_listen(bind_address, port);
+    if (server->listen_fd < 0) {
+        fprintf(stderr, "HTTP: cannot listen on %s:%d\n", bind_address, port);
+    }
+
+    if (server->listen_fd < 0 || !server->mutex || !server->snapshot_plots || !server->plot_cache ||
+        !server->stream_next) {
+        if (server->listen_fd >= 0) close(server->listen_fd);
+        mutex_destroy(server->mutex);
+        free(server->snapshot_plots);
+        free(server->plot_cache);
+        free(server->stream_next);
+        free(server);
+        return NULL;
+    }
+
+    net_ignore_sigpipe();
+
+    server->last_stream_ms = platform_get_time_ms();
+    server->running = 1;
+    server->thread = plot_thread_create(http_server_thread, server);
+    if (!server->thread) {
+        server->running = 0;
+        http_server_destroy(server);
+        return NULL;
+    }
+
+    return server;
+}
+
+void http_server_destroy(http_server_t *server) {
+    uint32_t i;
+    if (!server) return;
+
+    if (server->thread) {
+        server->running = 0;
+        plot_thread_join(server->thread);
+        plot_thread_destroy(server->thread);
+    }
+
+    for (i = 0; i < HTTP_MAX_CLIENTS; i++) {
+        if (server->clients[i].state != HTTP_CLIENT_FREE) {
+            http_client_close(&server->clients[i]);
+        }
+    }
+    for (i = 0; i < server->system->plot_count; i++) {
+        http_blob_release(server->plot_cache[i].png);
+    }
+    http_blob_release(server->dashboard_png);
+
+    close(server->listen_fd);
+    mutex_destroy(server->mutex);
+    free(server->snapshot);
+    free(server->snapshot_plots);
+    free(server->plot_cache);
+    free(server->stream_next);
+    free(server);
+}
+
+/* For the render thread, which keeps drawing a hidden window while a
+ * client waits for a snapshot */
+int http_server_wants_frames(http_server_t *server) {
+    int wanted;
+
+    if (!server) return 0;
+
+    mutex_lock(server->mutex);
+    wanted = server->snapshot_wanted;
+    mutex_unlock(server->mutex);
+    return wanted;
+}
+
+/* Called by the render thread after every update */
+void http_server_publish(http_server_t *server, plot_system_t *system) {
+    const uint32_t *pixels;
+    int32_t width, height, stride, y;
+    uint32_t i;
+
+    if (!server || !system) return;
+
+    mutex_lock(server->mutex);
+    server->frame_serial = system->frame_serial;
+    server->frame_stale = system->hidden;
+
+    /* A hidden window skipped this frame; the next update draws it */
+    if (server->snapshot_wanted && !system->hidden) {
+        server->snapshot_status = -1;
+        if (renderer_read_pixels(system->renderer, &pixels, &width, &height, &stride)) {
+            size_t needed = (size_t)width * height;
+            if (needed > server->snapshot_capacity) {
+                uint32_t *grown = realloc(server->snapshot, needed * sizeof(uint32_t));
+                if (grown) {
+                    server->snapshot = grown;
+                    server->snapshot_capacity = needed;
+                }
+            }
+            if (needed <= server->snapshot_capacity) {
+                for (y = 0; y < height; y++) {
+                    memcpy(server->snapshot + (size_t)y * width, pixels + (size_t)y * stride,
+                           sizeof(uint32_t) * width);
+                }
+                for (i = 0; i < system->plot_count; i++) {
+                    server->snapshot_plots[i].rect = system->plots[i].rect;
+                    server->snapshot_plots[i].on_screen = system->plots[i].on_screen;
+                    server->snapshot_plots[i].drawn_serial = system->plots[i].drawn_serial;
+                }
+                server->snapshot_width = width;
+                server->snapshot_height = height;
+                server->snapshot_status = 1;
+            }
+        }
+        server->snapshot_serial = system->frame_serial;
+        server->snapshot_wanted = 0;
+    }
+
+    mutex_unlock(server->mutex);
+}
@@ -0,0 +1,23 @@
+#ifndef HTTP_H
+#define HTTP_H
+
+#include "compat.h"
+#include "plot.h"
+
+/* Built-in HTTP/1.1 server. One thread runs a non-blocking poll loop over
+ * every connection and serves:
+ *   /              index page
+ *   /plot.png      the whole dashboard
+ *   /plot/<n>.png  a single plot
+ *   /stream        new samples as server-sent events
+ * Images come from framebuffer snapshots taken by the render thread in
+ * http_server_publish() when a client asks for one. */
+
+typedef struct http_server http_server_t;
+
+http_server_t *http_server_create(plot_system_t *system, const char *bind_address, int32_t port);
+void http_server_destroy(http_server_t *server);
+void http_server_publish(http_server_t *server, plot_system_t *system);
+int http_server_wants_frames(http_server_t *server);
+
+#endif
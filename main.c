@@ -11,39 +11,344 @@
 #include "plot.h"
 #include "ringbuf.h"
 #include "threading.h"
+#include "datasource.h"
+#include "http.h"
+#include "vnc.h"
+#include "remote.h"
+#include "record.h"
+#include "export.h"
+#include "query.h"
+#include "watch.h"
 
-static int running = 1;
+#define DAEMON_TICK_MS 250
+#define RELOAD_SETTLE_MS 500    /* a save and a SIGHUP make one reload */
+
+static volatile sig_atomic_t running = 1;
+static volatile sig_atomic_t reload_requested = 0;
+static int verbose = 0;
+static uint64_t started_us;
 
 void signal_handler(int sig) {
-    exit(0);
+    if (sig == SIGHUP) {
+        reload_requested = 1;
+    } else {
+        running = 0;
+    }
+}
+
+/* Everything serving the plots, stopped and started again around a
+ * config reload as they hold the config and the plots */
+typedef struct {
+    http_server_t *http;
+    vnc_server_t *vnc;
+    query_server_t *query;
+    remote_agent_t *agent;
+    exporter_t *exporter;
+} servers_t;
+
+static void servers_start_exporter(servers_t *servers, config_t *config, data_collector_t *collector) {
+    if (config->export_format == EXPORT_OFF) return;
+
+    servers->exporter = exporter_create(collector, config);
+    if (!servers->exporter) fprintf(stderr, "Failed to start exporter, continuing without it\n");
+}
+
+/* The HTTP and VNC servers only with a plot system */
+static void servers_start(servers_t *servers, config_t *config, data_collector_t *collector,
+                          plot_system_t *plot_system, int agent_mode) {
+    if (plot_system && config->http_port > 0) {
+        servers->http = http_server_create(plot_system, config->http_bind, config->http_port);
+        if (!servers->http) {
+            fprintf(stderr, "Failed to start HTTP server, continuing without it\n");
+        }
+    }
+
+    if (plot_system && config->vnc_port > 0) {
+        servers->vnc = vnc_server_create(plot_system, config->vnc_bind, config->vnc_port);
+        if (!servers->vnc) {
+            fprintf(stderr, "Failed to start VNC server, continuing without it\n");
+        }
+    }
+
+    if (config->query_socket) {
+        servers->query = query_server_create(collector, config);
+        if (!servers->query) fprintf(stderr, "Failed to start query socket, continuing without it\n");
+    }
+
+    if (agent_mode || config->agent_port > 0) {
+        servers->agent = remote_agent_create(collector, config, config->agent_bind, config->agent_port);
+        if (!servers->agent && !agent_mode) {
+            fprintf(stderr, "Failed to start agent, continuing without it\n");
+        }
+    }
+}
+
+static void servers_stop(servers_t *servers) {
+    http_server_destroy(servers->http);
+    vnc_server_destroy(servers->vnc);
+    query_server_destroy(servers->query);
+    remote_agent_destroy(servers->agent);
+    exporter_destroy(servers->exporter);
+    memset(servers, 0, sizeof(*servers));
+}
+
+/* SIGHUP or a save of the config file: plots that still sample the same
+ * thing the same way carry on with their history, the rest is started
+ * afresh. A config that does not parse leaves the running one, so does
+ * running out of memory halfway, by reloading the running config over
+ * what was done. Returns the config in use. */
+static config_t *reload_config(config_t *config, data_collector_t *collector, plot_system_t *plot_system,
+                               servers_t *servers, int agent_mode) {
+    config_t *new_config = config_reload(config->path);
+    config_t *old_config = config;
+
+    if (!new_config) {
+        fprintf(stderr, "Config %s has errors or no plots, keeping the running one\n", config->path);
+        return config;
+    }
+
+    servers_stop(servers);
+    if (data_collector_reload(collector, new_config) &&
+        (!plot_system || plot_system_reload(plot_system, new_config, collector))) {
+        config_make_current(new_config);
+        config = new_config;
+    } else {
+        fprintf(stderr, "Failed to reload config %s, keeping the running one\n", config->path);
+        config_destroy(new_config);
+        if (!data_collector_reload(collector, config) ||
+            (plot_system && !plot_system_reload(plot_system, config, collector))) {
+            fprintf(stderr, "Failed to restore the running config, exiting\n");
+            running = 0;
+            return config;
+        }
+    }
+
+    servers_start_exporter(servers, config, collector);
+    servers_start(servers, config, collector, plot_system, agent_mode);
+    if (agent_mode && !servers->agent) {
+        fprintf(stderr, "Failed to restart agent\n");
+        running = 0;
+    }
+    if (config == old_config) return config;
+
+    if (plot_system && config->max_fps != old_config->max_fps) {
+        graphics_stop_render_timer();
+        graphics_start_render_timer(config->max_fps);
+    }
+
+    fprintf(stderr, "Reloaded %s, %u plots\n", config->path, config->plot_count);
+    config_destroy(old_config);
+    return config;
+}
+
+/* -v: from start to the first frame on screen, to the first sample of any
+ * plot and to every plot having one, polled from the main loop until all
+ * is reported. Datasources open on their own threads meanwhile. */
+static void report_startup(plot_system_t *plot_system, data_collector_t *collector) {
+    static int frame_reported = 0, first_reported = 0, all_reported = 0;
+    uint64_t first_us, last_us;
+    data_source_t *slowest;
+    uint32_t sampled;
+
+    if (!verbose || ((frame_reported || !plot_system) && all_reported)) return;
+
+    if (plot_system && !frame_reported && plot_system->frame_serial > 0) {
+        fprintf(stderr, "Startup: first frame after %.1f ms\n",
+                (platform_get_monotonic_us() - started_us) / 1000.0);
+        frame_reported = 1;
+    }
+    if (all_reported) return;
+
+    sampled = data_collector_sampled(collector, &first_us, &last_us, &slowest);
+    if (sampled > 0 && !first_reported) {
+        fprintf(stderr, "Startup: first sample after %.1f ms\n", (first_us - started_us) / 1000.0);
+        first_reported = 1;
+    }
+    if (slowest && sampled == collector->source_count) {
+        fprintf(stderr, "Startup: all %u plots sampled after %.1f ms, slowest to open %s=%s in %u ms\n",
+                sampled, (last_us - started_us) / 1000.0, slowest->type, slowest->target, slowest->init_ms);
+        all_reported = 1;
+    }
+}
+
+/* Polled from the main loop, never blocks. A SIGHUP and saves of the
+ * file all set one pending reload, done once none came for
+ * RELOAD_SETTLE_MS, so saving and then sending SIGHUP reloads once. Where
+ * the plots are fixed, by a daemon's shared index or a recording, reloads
+ * are refused. */
+static int reload_wanted(file_watch_t *watch, int reloadable) {
+    static int pending = 0;
+    static uint32_t requested_ms;
+    uint32_t now = platform_get_time_ms();
+
+    if (reload_requested || file_watch_changed(watch)) {
+        reload_requested = 0;
+        pending = 1;
+        requested_ms = now;
+    }
+    if (!pending || now - requested_ms < RELOAD_SETTLE_MS) return 0;
+
+    pending = 0;
+    if (!reloadable) {
+        fprintf(stderr, "Config reload does not work with --daemon, --attach, --record or --replay\n");
+        return 0;
+    }
+    return 1;
+}
+
+/* --daemon: sample only, for any number of --attach viewers. --agent:
+ * sample only, for remote= plots on other hosts. */
+static int run_daemon(const char *config_file, int agent_mode, const char *record_file) {
+    config_t *config;
+    data_collector_t *data_collector;
+    recorder_t *recorder = NULL;
+    file_watch_t *watch = NULL;
+    servers_t servers;
+    int reloadable = agent_mode && !record_file;
+
+    memset(&servers, 0, sizeof(servers));
+
+    config = config_load(config_file);
+    if (!config) {
+        fprintf(stderr, "Failed to load configuration\n");
+        platform_cleanup();
+        return 1;
+    }
+
+    data_collector = data_collector_create(config, agent_mode ? 0 : COLLECTOR_SHARED);
+    if (!data_collector) {
+        fprintf(stderr, "Failed to create data collector\n");
+        config_destroy(config);
+        platform_cleanup();
+        return 1;
+    }
+
+    if (record_file) {
+        recorder = recorder_create(record_file, data_collector);
+        if (!recorder) {
+            fprintf(stderr, "Failed to start recording\n");
+            data_collector_destroy(data_collector);
+            config_destroy(config);
+            platform_cleanup();
+            return 1;
+        }
+    }
+
+    servers_start_exporter(&servers, config, data_collector);
+
+    if (!data_collector_start(data_collector)) {
+        fprintf(stderr, "Failed to start data collector\n");
+        servers_stop(&servers);
+        recorder_destroy(recorder);
+        data_collector_destroy(data_collector);
+        config_destroy(config);
+        platform_cleanup();
+        return 1;
+    }
+
+    servers_start(&servers, config, data_collector, NULL, agent_mode);
+    if (agent_mode && !servers.agent) {
+        fprintf(stderr, "Failed to start agent\n");
+        servers_stop(&servers);
+        recorder_destroy(recorder);
+        data_collector_destroy(data_collector);
+        config_destroy(config);
+        platform_cleanup();
+        return 1;
+    }
+
+    if (reloadable) watch = file_watch_create(config->path);
+
+    while (running) {
+        platform_sleep(DAEMON_TICK_MS);
+        report_startup(NULL, data_collector);
+        if (reload_wanted(watch, reloadable)) {
+            config = reload_config(config, data_collector, NULL, &servers, agent_mode);
+        }
+    }
+
+    file_watch_destroy(watch);
+    servers_stop(&servers);
+    recorder_destroy(recorder);
+    data_collector_destroy(data_collector);
+    config_destroy(config);
+    platform_cleanup();
+    return 0;
 }
 
 
 int main(int argc, char *argv[]) {
     char *config_file = "plottool.ini";
-    int i;
-    uint32_t frame_count = 0;
+    char *record_file = NULL, *replay_file = NULL, *end;
+    int i, daemon_mode = 0, attach_mode = 0, agent_mode = 0, replay_reported = 0;
+    uint32_t frame_count = 0, replay_started_ms = 0;
+    double speed = 1.0;
     config_t *config;
     plot_system_t *plot_system;
     data_collector_t *data_collector;
+    recorder_t *recorder = NULL;
+    replay_t *replay = NULL;
+    file_watch_t *watch = NULL;
+    servers_t servers;
+    int reloadable;
+
+    memset(&servers, 0, sizeof(servers));
+    started_us = platform_get_monotonic_us();
 
     for (i = 1; i < argc; i++) {
         if (strcmp(argv[i], "-f") == 0 && i + 1 < argc) {
             config_file = argv[i + 1];
             i++;
+        } else if (strcmp(argv[i], "-v") == 0) {
+            verbose = 1;
+        } else if (strcmp(argv[i], "--daemon") == 0 && !attach_mode && !agent_mode) {
+            daemon_mode = 1;
+        } else if (strcmp(argv[i], "--attach") == 0 && !daemon_mode && !agent_mode) {
+            attach_mode = 1;
+        } else if (strcmp(argv[i], "--agent") == 0 && !daemon_mode && !attach_mode) {
+            agent_mode = 1;
+        } else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc) {
+            record_file = argv[++i];
+        } else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc) {
+            replay_file = argv[++i];
+        } else if (strcmp(argv[i], "--speed") == 0 && i + 1 < argc) {
+            /* 100, 100x or max */
+            i++;
+            speed = strcmp(argv[i], "max") == 0 ? 0.0 : strtod(argv[i], &end);
+            if (strcmp(argv[i], "max") != 0 && (end == argv[i] || speed <= 0.0 ||
+                                                (*end && strcmp(end, "x") != 0))) {
+                fprintf(stderr, "Invalid speed %s\n", argv[i]);
+                return 1;
+            }
         } else {
-            fprintf(stderr, "Usage: %s [-f config_file]\n", argv[0]);
+            fprintf(stderr, "Usage: %s [-v] [-f config_file] [--daemon | --attach | --agent]\n"
+                            "       [--record file] [--replay file [--speed N[x] | max]]\n", argv[0]);
             return 1;
         }
     }
 
+    if (replay_file && (daemon_mode || attach_mode || agent_mode)) {
+        fprintf(stderr, "--replay only works in the viewer\n");
+        return 1;
+    }
+    if (record_file && attach_mode) {
+        fprintf(stderr, "--record belongs on the --daemon, a viewer samples nothing\n");
+        return 1;
+    }
+
     signal(SIGINT, signal_handler);
     signal(SIGTERM, signal_handler);
+    signal(SIGHUP, signal_handler);
 
     if (!platform_init()) {
         fprintf(stderr, "Failed to initialize platform\n");
         return 1;
     }
+    datasource_setup();
+
+    if (daemon_mode || agent_mode) {
+        return run_daemon(config_file, agent_mode, record_file);
+    }
 
     if (!graphics_init()) {
         fprintf(stderr, "Failed to initialize graphics\n");
@@ -69,7 +374,8 @@ int main(int argc, char *argv[]) {
         return 1;
     }
     
-    data_collector = data_collector_create(config);
+    data_collector = attach_mode ? data_collector_attach(config) :
+                     data_collector_create(config, replay_file ? COLLECTOR_REPLAY : 0);
     if (!data_collector) {
         fprintf(stderr, "Failed to create data collector\n");
         plot_system_destroy(plot_system);
@@ -78,11 +384,38 @@ int main(int argc, char *argv[]) {
         platform_cleanup();
         return 1;
     }
+
+    if (record_file) {
+        recorder = recorder_create(record_file, data_collector);
+        if (!recorder) fprintf(stderr, "Failed to start recording, continuing without it\n");
+    }
+
+    if (!attach_mode) {
+        servers_start_exporter(&servers, config, data_collector);
+    }
+
+    if (replay_file) {
+        replay = replay_create(replay_file, data_collector, speed);
+        if (!replay) {
+            fprintf(stderr, "Failed to open replay\n");
+            servers_stop(&servers);
+            recorder_destroy(recorder);
+            data_collector_destroy(data_collector);
+            plot_system_destroy(plot_system);
+            config_destroy(config);
+            graphics_cleanup();
+            platform_cleanup();
+            return 1;
+        }
+    }
     
     plot_system_connect_data_buffers(plot_system, data_collector);
     
-    if (!data_collector_start(data_collector)) {
+    if (!data_collector_start(data_collector) || (replay && !replay_start(replay))) {
         fprintf(stderr, "Failed to start data collector\n");
+        replay_destroy(replay);
+        servers_stop(&servers);
+        recorder_destroy(recorder);
         data_collector_destroy(data_collector);
         plot_system_destroy(plot_system);
         config_destroy(config);
@@ -92,24 +425,49 @@ int main(int argc, char *argv[]) {
     }
     
 
+    servers_start(&servers, config, data_collector, plot_system, 0);
+
+    reloadable = !attach_mode && !record_file && !replay_file;
+    if (reloadable) watch = file_watch_create(config->path);
+
     graphics_start_render_timer(config->max_fps);
+    replay_started_ms = platform_get_time_ms();
 
     while (running) {
+        plot_system->remote_viewers = http_server_wants_frames(servers.http) ||
+                                      vnc_server_wants_frames(servers.vnc);
         if (!plot_system_update(plot_system)) {
-            exit(0);
+            break;
         }
+        http_server_publish(servers.http, plot_system);
+        vnc_server_publish(servers.vnc, plot_system);
 
         frame_count++;
-        if (frame_count % 60 == 0) {
+        report_startup(plot_system, data_collector);
+        if (replay && !replay_reported && replay_done(replay)) {
+            uint32_t elapsed_ms = platform_get_time_ms() - replay_started_ms;
+            uint32_t frames = plot_system->frame_serial;
+            fprintf(stderr, "Replay: %u frames in %.1f s, %.1f frames/s\n", frames,
+                    elapsed_ms / 1000.0, elapsed_ms ? frames * 1000.0 / elapsed_ms : 0.0);
+            replay_reported = 1;
         }
 
+        if (reload_wanted(watch, reloadable)) {
+            config = reload_config(config, data_collector, plot_system, &servers, 0);
+        }
     }
 
+    /* Everything reading the plots goes before the samplers are joined */
+    file_watch_destroy(watch);
+    servers_stop(&servers);
+    replay_destroy(replay);
+    recorder_destroy(recorder);
+    data_collector_destroy(data_collector);
     graphics_stop_render_timer();
+    plot_system_destroy(plot_system);
+    config_destroy(config);
     graphics_cleanup();
     platform_cleanup();
 
-    exit(0);
-    
     return 0;
 }
@@ -0,0 +1,118 @@
+#include "compat.h"
+#include "net.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+
+#ifdef MSG_NOSIGNAL
+#define NET_SEND_FLAGS MSG_NOSIGNAL
+#else
+#define NET_SEND_FLAGS 0
+#endif
+
+int net_buffer_append(net_buffer_t *buffer, const void *data, size_t size) {
+    if (buffer->size + size > buffer->capacity) {
+        size_t capacity = buffer->capacity ? buffer->capacity : 1024;
+        while (capacity < buffer->size + size) capacity *= 2;
+        char *grown = realloc(buffer->data, capacity);
+        if (!grown) return 0;
+        buffer->data = grown;
+        buffer->capacity = capacity;
+    }
+    memcpy(buffer->data + buffer->size, data, size);
+    buffer->size += size;
+    return 1;
+}
+
+int net_buffer_printf(net_buffer_t *buffer, const char *format, ...) {
+    char text[1024];
+    va_list args;
+    int length;
+
+    va_start(args, format);
+    length = vsnprintf(text, sizeof(text), format, args);
+    va_end(args);
+
+    if (length < 0) return 0;
+    if ((size_t)length >= sizeof(text)) length = sizeof(text) - 1;
+    return net_buffer_append(buffer, text, length);
+}
+
+void net_buffer_free(net_buffer_t *buffer) {
+    free(buffer->data);
+    memset(buffer, 0, sizeof(*buffer));
+}
+
+int net_send(int fd, const void *data, size_t size, size_t *sent) {
+    while (*sent < size) {
+        ssize_t n = send(fd, (const char *)data + *sent, size - *sent, NET_SEND_FLAGS);
+        if (n < 0) {
+            return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR ? 0 : -1;
+        }
+        *sent += n;
+    }
+    return 1;
+}
+
+int net_buffer_send(int fd, net_buffer_t *buffer) {
+    int result = net_send(fd, buffer->data, buffer->size, &buffer->sent);
+
+    if (result > 0) {
+        buffer->size = 0;
+        buffer->sent = 0;
+    }
+    return result;
+}
+
+int net_listen(const char *bind_address, int32_t port) {
+    struct addrinfo hints, *result, *ai;
+    char service[16];
+    int fd = -1, one = 1;
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE;
+    snprintf(service, sizeof(service), "%d", port);
+
+    if (getaddrinfo(bind_address, service, &hints, &result) != 0) return -1;
+
+    for (ai = result; ai; ai = ai->ai_next) {
+        fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (fd < 0) continue;
+
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        if (bind(fd, ai->ai_addr, ai->ai_addrlen) == 0 && listen(fd, 16) == 0) break;
+
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(result);
+
+    if (fd >= 0) {
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+    }
+    return fd;
+}
+
+int net_accept(int listen_fd) {
+    int fd = accept(listen_fd, NULL, NULL);
+
+    if (fd >= 0) {
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+    }
+    return fd;
+}
+
+/* A peer vanishing mid-write must not kill the process */
+void net_ignore_sigpipe(void) {
+    signal(SIGPIPE, SIG_IGN);
+}
@@ -0,0 +1,34 @@
+#ifndef NET_H
+#define NET_H
+
+#include "compat.h"
+#include <stddef.h>
+
+/* Plumbing shared by the HTTP, VNC, query and agent servers: each runs one
+ * thread polling a non-blocking listen socket and its clients. Output is
+ * queued per client and sent right after queueing, so poll only has to
+ * wait for POLLOUT on whatever a full socket left over. */
+
+typedef struct {
+    char *data;
+    size_t size;
+    size_t sent;
+    size_t capacity;
+} net_buffer_t;
+
+int net_buffer_append(net_buffer_t *buffer, const void *data, size_t size);
+int net_buffer_printf(net_buffer_t *buffer, const char *format, ...);
+void net_buffer_free(net_buffer_t *buffer);
+
+/* 1 once everything went out, 0 when the socket is full, -1 when the peer
+ * is gone. A buffer sent in full is emptied. */
+int net_buffer_send(int fd, net_buffer_t *buffer);
+int net_send(int fd, const void *data, size_t size, size_t *sent);
+
+/* Both return non-blocking sockets, or -1 */
+int net_listen(const char *bind_address, int32_t port);
+int net_accept(int listen_fd);
+
+void net_ignore_sigpipe(void);
+
+#endif
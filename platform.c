@@ -66,6 +66,46 @@ uint32_t platform_get_time_ms(void) {
     return (uint32_t)(tv.tv_sec * 1000 + tv.tv_usec / 1000);
 }
 
+void platform_sleep_us(uint64_t microseconds) {
+    struct timespec ts;
+    ts.tv_sec = (time_t)(microseconds / 1000000);
+    ts.tv_nsec = (long)(microseconds % 1000000) * 1000;
+    nanosleep(&ts, NULL);
+}
+
+uint64_t platform_get_time_us(void) {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (uint64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+/* Never steps back with the wall clock. Counts suspended time where the
+ * system can, so a laptop lid closed for an hour shows as an hour. */
+uint64_t platform_get_monotonic_us(void) {
+#if defined(CLOCK_BOOTTIME) || defined(CLOCK_MONOTONIC)
+    struct timespec ts;
+#ifdef CLOCK_BOOTTIME
+    if (clock_gettime(CLOCK_BOOTTIME, &ts) == 0) {
+        return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+    }
+#endif
+#ifdef CLOCK_MONOTONIC
+    if (clock_gettime(CLOCK_MONOTONIC, &ts) == 0) {
+        return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+    }
+#endif
+#endif
+    return platform_get_time_us();
+}
+
+uint32_t platform_cpu_count(void) {
+#ifdef _SC_NPROCESSORS_ONLN
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    if (count > 0) return (uint32_t)count;
+#endif
+    return 1;
+}
+
 mutex_t *mutex_create(void) {
 #if defined(__unix__) || defined(__unix) || defined(unix) || defined(__APPLE__)
     mutex_t *mutex = malloc(sizeof(mutex_t));
@@ -115,6 +155,63 @@ void mutex_unlock(mutex_t *mutex) {
 #endif
 }
 
+cond_t *cond_create(void) {
+#if defined(__unix__) || defined(__unix) || defined(unix) || defined(__APPLE__)
+    cond_t *cond = malloc(sizeof(cond_t));
+    if (!cond) return NULL;
+
+    cond->handle = malloc(sizeof(pthread_cond_t));
+    if (!cond->handle) {
+        free(cond);
+        return NULL;
+    }
+
+    if (pthread_cond_init((pthread_cond_t*)cond->handle, NULL) != 0) {
+        free(cond->handle);
+        free(cond);
+        return NULL;
+    }
+
+    return cond;
+#else
+    return NULL;
+#endif
+}
+
+void cond_destroy(cond_t *cond) {
+    if (!cond) return;
+
+#if defined(__unix__) || defined(__unix) || defined(unix) || defined(__APPLE__)
+    pthread_cond_destroy((pthread_cond_t*)cond->handle);
+    free(cond->handle);
+#endif
+    free(cond);
+}
+
+void cond_wait(cond_t *cond, mutex_t *mutex) {
+    if (!cond || !mutex) return;
+
+#if defined(__unix__) || defined(__unix) || defined(unix) || defined(__APPLE__)
+    pthread_cond_wait((pthread_cond_t*)cond->handle, (pthread_mutex_t*)mutex->handle);
+#endif
+}
+
+void cond_signal(cond_t *cond) {
+    if (!cond) return;
+
+#if defined(__unix__) || defined(__unix) || defined(unix) || defined(__APPLE__)
+    pthread_cond_signal((pthread_cond_t*)cond->handle);
+#endif
+}
+
+void cond_broadcast(cond_t *cond) {
+    if (!cond) return;
+
+#if defined(__unix__) || defined(__unix) || defined(unix) || defined(__APPLE__)
+    pthread_cond_broadcast((pthread_cond_t*)cond->handle);
+#endif
+}
+
 plot_thread_t *plot_thread_create(void (*func)(void *), void *arg) {
 #if defined(__unix__) || defined(__unix) || defined(unix) || defined(__APPLE__)
     plot_thread_t *thread = malloc(sizeof(plot_thread_t));
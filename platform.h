@@ -17,6 +17,10 @@ typedef struct {
     void *handle;
 } mutex_t;
 
+typedef struct {
+    void *handle;
+} cond_t;
+
 typedef struct {
     void *handle;
 } plot_thread_t;
@@ -26,12 +30,22 @@ int platform_init(void);
 void platform_cleanup(void);
 void platform_sleep(uint32_t milliseconds);
 uint32_t platform_get_time_ms(void);
+void platform_sleep_us(uint64_t microseconds);
+uint64_t platform_get_time_us(void);
+uint64_t platform_get_monotonic_us(void);
+uint32_t platform_cpu_count(void);
 
 mutex_t *mutex_create(void);
 void mutex_destroy(mutex_t *mutex);
 void mutex_lock(mutex_t *mutex);
 void mutex_unlock(mutex_t *mutex);
 
+cond_t *cond_create(void);
+void cond_destroy(cond_t *cond);
+void cond_wait(cond_t *cond, mutex_t *mutex);
+void cond_signal(cond_t *cond);
+void cond_broadcast(cond_t *cond);
+
 plot_thread_t *plot_thread_create(void (*func)(void *), void *arg);
 void plot_thread_destroy(plot_thread_t *thread);
 void plot_thread_join(plot_thread_t *thread);
@@ -10,42 +10,202 @@
 #include <math.h>
 #include <unistd.h>
 
-typedef struct {
-    double min_value;
-    double max_value;
-    double avg_value;
-    double last_value;
-    double min_value_secondary;
-    double max_value_secondary;
-    double avg_value_secondary;
-    double last_value_secondary;
-} plot_stats_t;
-
-static plot_stats_t plot_stats_cache[32];
+#define PLOT_SPACING 10
+
 static char system_hostname[256] = "";
 
-static void calculate_stats(plot_t *plot, data_source_t *data_source, uint32_t plot_index) {
+static void calculate_stats(plot_t *plot, data_source_t *data_source) {
+    datasource_stats_t ds_stats;
+    datasource_t *datasource;
+    int ok = 0;
+
     if (!plot) return;
 
-    if (data_source && data_source->datasource && data_source->datasource->handler->get_stats) {
-        datasource_stats_t ds_stats;
-        if (data_source->datasource->handler->get_stats(data_source->datasource->context, &ds_stats) == 1) {
-            plot_stats_cache[plot_index].min_value = ds_stats.min;
-            plot_stats_cache[plot_index].max_value = ds_stats.max;
-            plot_stats_cache[plot_index].avg_value = ds_stats.avg;
-            plot_stats_cache[plot_index].last_value = ds_stats.last;
-            plot_stats_cache[plot_index].min_value_secondary = ds_stats.min_secondary;
-            plot_stats_cache[plot_index].max_value_secondary = ds_stats.max_secondary;
-            plot_stats_cache[plot_index].avg_value_secondary = ds_stats.avg_secondary;
-            plot_stats_cache[plot_index].last_value_secondary = ds_stats.last_secondary;
+    /* Sources that sample nothing themselves get the stats published for
+     * them: by the daemon, the agent of a remote plot or a replay */
+    datasource = data_source_opened(data_source);
+    if (data_source && data_source->shared && !datasource) {
+        ok = shared_read_stats(data_source->shared, &ds_stats);
+    } else if (datasource && datasource->handler->get_stats) {
+        ok = datasource->handler->get_stats(datasource->context, &ds_stats) == 1;
+    }
+
+    if (ok) {
+        plot->stats.min_value = ds_stats.min;
+        plot->stats.max_value = ds_stats.max;
+        plot->stats.avg_value = ds_stats.avg;
+        plot->stats.last_value = ds_stats.last;
+        plot->stats.min_value_secondary = ds_stats.min_secondary;
+        plot->stats.max_value_secondary = ds_stats.max_secondary;
+        plot->stats.avg_value_secondary = ds_stats.avg_secondary;
+        plot->stats.last_value_secondary = ds_stats.last_secondary;
+    }
+}
+
+
+
+static void plot_draw_time_span(plot_t *plot, renderer_t *renderer, font_t *font,
+                                int32_t x, int32_t y, int32_t height, config_t *global_config) {
+    uint32_t buffer_size;
+    int32_t refresh_interval;
+    uint64_t total_time_ms;
+    char time_span_text[64];
+    uint32_t minutes, hours, days;
+
+    buffer_size = plot->data_buffer->size;
+    if (plot->data_source && plot->data_source->history) {
+        buffer_size = history_size(plot->data_source->history);
+    }
+    if (plot->data_source) {
+        refresh_interval = plot->data_source->column_interval_ms;
+    } else {
+        refresh_interval = (plot->config->refresh_interval_ms > 0) ?
+                          plot->config->refresh_interval_ms :
+                          global_config->refresh_interval_ms;
+    }
+    total_time_ms = (uint64_t)buffer_size * refresh_interval;
+    if (total_time_ms < 1000) {
+        snprintf(time_span_text, sizeof(time_span_text), "%ums", (uint32_t)total_time_ms);
+    } else if (total_time_ms < 60000) {
+        snprintf(time_span_text, sizeof(time_span_text), "%us", (uint32_t)(total_time_ms / 1000));
+    } else if (total_time_ms < 86400000) {
+        minutes = (uint32_t)((total_time_ms + 59999) / 60000);
+        if (minutes < 60) {
+            snprintf(time_span_text, sizeof(time_span_text), "%um", minutes);
+        } else {
+            hours = (minutes + 59) / 60;
+            snprintf(time_span_text, sizeof(time_span_text), "%uh", hours);
+        }
+    } else {
+        days = (uint32_t)((total_time_ms + 86399999) / 86400000);
+        snprintf(time_span_text, sizeof(time_span_text), "%ud", days);
+    }
+
+    font_draw_text(renderer, font, global_config->text_color, x, y + height - 15, time_span_text);
+}
+
+/* Halfway to the background, for the min/max envelope behind a column */
+static color_t plot_dim_color(color_t color, color_t background) {
+    color.r = (uint8_t)((color.r + background.r) / 2);
+    color.g = (uint8_t)((color.g + background.g) / 2);
+    color.b = (uint8_t)((color.b + background.b) / 2);
+    return color;
+}
+
+static uint32_t plot_pack_rgb(color_t color) {
+    return ((uint32_t)color.r << 16) | ((uint32_t)color.g << 8) | color.b;
+}
+
+/* Green through yellow to orange for values, the error colour for failed
+ * samples and the background where there is no sample yet. */
+static void plot_build_heatmap_palette(uint32_t *palette, config_t *global_config) {
+    int i;
+
+    palette[HEATMAP_NO_DATA] = plot_pack_rgb(global_config->background_color);
+    for (i = 1; i <= HEATMAP_LEVELS; i++) {
+        double t = (double)(i - 1) / (HEATMAP_LEVELS - 1);
+        color_t color;
+        color.r = (uint8_t)(t < 0.5 ? 510.0 * t : 255.0);
+        color.g = (uint8_t)(t < 0.5 ? 160.0 + 190.0 * t : 255.0 - 250.0 * (t - 0.5));
+        color.b = 0;
+        color.a = 255;
+        palette[i] = plot_pack_rgb(color);
+    }
+    palette[HEATMAP_LOSS] = plot_pack_rgb(global_config->error_line_color);
+}
+
+static void plot_draw_heatmap(plot_t *plot, renderer_t *renderer, font_t *font,
+                              int32_t x, int32_t y, int32_t width, int32_t height, config_t *global_config,
+                              const uint32_t *palette) {
+    int32_t plot_y = y + 20;
+    int32_t plot_height = height - 40;
+    rect_t image_rect;
+    size_t needed;
+    char stats_text[64];
+    int32_t text_width, text_height;
+
+    image_rect.x = x + 1;
+    image_rect.y = plot_y + 2;
+    image_rect.w = width - 2;
+    image_rect.h = plot_height - 4;
+    if (image_rect.w <= 0 || image_rect.h <= 0) return;
+
+    needed = (size_t)image_rect.w * image_rect.h;
+    if (needed > plot->image_capacity) {
+        uint32_t *image = realloc(plot->image, sizeof(uint32_t) * needed);
+        if (!image) return;
+        plot->image = image;
+        plot->image_capacity = needed;
+    }
+
+    if (heatmap_render(plot->heatmap, palette, plot->image,
+                       image_rect.w, image_rect.h, image_rect.w)) {
+        renderer_draw_image(renderer, image_rect, plot->image, image_rect.w);
+    }
+
+    if (plot->data_source && plot->data_source->initializing) {
+        snprintf(stats_text, sizeof(stats_text), "Initializing");
+    } else {
+        snprintf(stats_text, sizeof(stats_text), "%u/%u down",
+                 (unsigned)atomic_load(&plot->heatmap->lost), plot->heatmap->rows);
+    }
+    font_get_text_size(font, stats_text, &text_width, &text_height);
+    font_draw_text(renderer, font, global_config->text_color, x + width - text_width, y + height - 15, stats_text);
+
+    plot_draw_time_span(plot, renderer, font, x, y, height, global_config);
+}
+
+/* Columns back from the right edge for each value. Ring buffer values go
+ * by their push time, so a collector that stalled on a timeout or a
+ * suspended machine leaves a gap instead of squeezing the time axis.
+ * Decimated columns are fixed runs of samples and just go side by side. */
+static void plot_place_columns(const uint64_t *times, uint32_t count, int32_t interval_ms, uint32_t *offsets) {
+    uint64_t interval_us = (uint64_t)(interval_ms > 0 ? interval_ms : 0) * 1000;
+    uint32_t i;
+
+    for (i = 0; i < count; i++) {
+        if (times && interval_us > 0) {
+            uint64_t back = (times[count - 1] - times[i] + interval_us / 2) / interval_us;
+            offsets[i] = back < 2048 ? (uint32_t)back : 2048;
+        } else {
+            offsets[i] = count - 1 - i;
         }
     }
 }
 
+/* One value per pixel column, decimated when the buffer holds more. A
+ * compressed history deeper than the plot is drawn instead of the ring. */
+static int plot_read_columns(ringbuf_t *ringbuf, history_t *history, decimate_t **decimate, decimate_mode_t mode,
+                             uint32_t columns, int32_t interval_ms, double *values, double *min, double *max,
+                             uint32_t *offsets, uint32_t *count) {
+    uint64_t times[2048];
+    uint32_t head, tail;
+
+    if (!history || history_size(history) <= columns) {
+        history = NULL;
+        if (ringbuf->size <= columns) {
+            if (!ringbuf_read_envelope(ringbuf, values, min, max, times, 2048, count, &head, &tail)) return 0;
+            plot_place_columns(times, *count, interval_ms, offsets);
+            return 1;
+        }
+    }
 
+    if (!*decimate) {
+        *decimate = decimate_create(mode);
+        if (!*decimate) return 0;
+    }
+    if (history) {
+        *count = decimate_update_history(*decimate, history, columns, values, min, max);
+    } else {
+        *count = decimate_update(*decimate, ringbuf, columns, values, min, max);
+    }
+    plot_place_columns(NULL, *count, 0, offsets);
+    return 1;
+}
 
 void plot_draw(plot_t *plot, renderer_t *renderer, font_t *font,
-               int32_t x, int32_t y, int32_t width, int32_t height, config_t *global_config, uint32_t plot_index) {
+               int32_t x, int32_t y, int32_t width, int32_t height, config_t *global_config, uint32_t plot_index,
+               const uint32_t *heatmap_palette) {
     color_t border_color;
     char title[256];
     int32_t plot_y, plot_height;
@@ -58,8 +218,12 @@ void plot_draw(plot_t *plot, renderer_t *renderer, font_t *font,
     int32_t scale_x;
     double temp_buffer[2048];
     double temp_buffer_secondary[2048];
-    uint32_t data_count, head_pos, tail_pos;
-    uint32_t data_count_secondary, head_pos_secondary, tail_pos_secondary;
+    double min_buffer[2048], max_buffer[2048];
+    double min_buffer_secondary[2048], max_buffer_secondary[2048];
+    uint32_t offsets[2048], offsets_secondary[2048];
+    int32_t interval_ms;
+    color_t envelope_color, envelope_color_secondary;
+    uint32_t data_count, data_count_secondary, columns;
     int32_t prev_out_x, prev_out_y;
     uint32_t i;
     double in_value, out_value;
@@ -69,15 +233,11 @@ void plot_draw(plot_t *plot, renderer_t *renderer, font_t *font,
     int32_t bar_height;
     int32_t text_width, text_height;
     int32_t text_x;
-    uint32_t buffer_size;
-    int32_t refresh_interval;
-    uint32_t total_time_ms;
-    char time_span_text[64];
-    uint32_t minutes, hours, days;
 
     if (!plot || !renderer || !font) return;
-    
-    calculate_stats(plot, plot->data_source, plot_index);
+    (void)plot_index;
+
+    calculate_stats(plot, plot->data_source);
     
     border_color = global_config->border_color;
     renderer_set_color(renderer, border_color);
@@ -102,9 +262,19 @@ void plot_draw(plot_t *plot, renderer_t *renderer, font_t *font,
     border_rect.w = width;
     border_rect.h = plot_height;
     renderer_draw_rect(renderer, border_rect);
+    plot->graph.x = x + 1;
+    plot->graph.y = plot_y + 1;
+    plot->graph.w = width - 2;
+    plot->graph.h = plot_height - 2;
+
+    if (plot->heatmap && plot->data_buffer) {
+        plot_draw_heatmap(plot, renderer, font, x, y, width, height, global_config, heatmap_palette);
+        return;
+    }
     
     if (!plot->data_buffer || ringbuf_count(plot->data_buffer) == 0) {
-        snprintf(stats_text, sizeof(stats_text), "No data");
+        snprintf(stats_text, sizeof(stats_text), "%s",
+                 plot->data_source && plot->data_source->initializing ? "Initializing" : "No data");
         font_draw_text(renderer, font, global_config->text_color, x, y + height - 15, stats_text);
         return;
     }
@@ -121,12 +291,12 @@ void plot_draw(plot_t *plot, renderer_t *renderer, font_t *font,
         max_val = fixed_max_scale;
     } else {
         if (plot->is_dual) {
-            double max_primary = plot_stats_cache[plot_index].max_value;
-            double max_secondary = plot_stats_cache[plot_index].max_value_secondary;
+            double max_primary = plot->stats.max_value;
+            double max_secondary = plot->stats.max_value_secondary;
             max_val = (max_primary > max_secondary) ? max_primary : max_secondary;
             if (max_val <= 0) max_val = 1.0;
         } else {
-            max_val = plot_stats_cache[plot_index].max_value > 0 ? plot_stats_cache[plot_index].max_value : 1.0;
+            max_val = plot->stats.max_value > 0 ? plot->stats.max_value : 1.0;
         }
     }
 
@@ -146,26 +316,45 @@ void plot_draw(plot_t *plot, renderer_t *renderer, font_t *font,
     scale_x = x + width - scale_text_width;
     font_draw_text(renderer, font, global_config->text_color, scale_x, y + 5, scale_text);
 
-    if (!ringbuf_read_snapshot(plot->data_buffer, temp_buffer, 2048, &data_count, &head_pos, &tail_pos)) {
+    columns = width > 2 ? (uint32_t)(width - 2) : 1;
+    if (columns > 2048) columns = 2048;
+    interval_ms = plot->data_source ? plot->data_source->column_interval_ms : 0;
+    if (!plot_read_columns(plot->data_buffer, plot->data_source ? plot->data_source->history : NULL,
+                           &plot->decimate, plot->config->decimation, columns, interval_ms,
+                           temp_buffer, min_buffer, max_buffer, offsets, &data_count)) {
         return;
     }
+    envelope_color = plot_dim_color(plot->config->line_color, global_config->background_color);
+    envelope_color_secondary = plot_dim_color(plot->config->line_color_secondary, global_config->background_color);
 
     if (plot->is_dual && plot->data_buffer_secondary) {
-        if (!ringbuf_read_snapshot(plot->data_buffer_secondary, temp_buffer_secondary, 2048,
-                                  &data_count_secondary, &head_pos_secondary, &tail_pos_secondary)) {
+        if (!plot_read_columns(plot->data_buffer_secondary,
+                               plot->data_source ? plot->data_source->history_secondary : NULL,
+                               &plot->decimate_secondary, plot->config->decimation, columns, interval_ms,
+                               temp_buffer_secondary, min_buffer_secondary, max_buffer_secondary,
+                               offsets_secondary, &data_count_secondary)) {
             return;
         }
+        /* OUT is pushed right after IN and can be a sample short */
+        if (data_count_secondary < data_count) data_count = data_count_secondary;
         prev_out_x = -1;
         prev_out_y = -1;
 
+        /* Placed by the OUT push times, it covers no more than IN */
         for (i = 0; i < data_count; i++) {
             in_value = temp_buffer[i];
             out_value = temp_buffer_secondary[i];
 
-            plot_x = x + width - 2 - (data_count - 1 - i);
+            if (offsets_secondary[i] >= columns) continue;
+            plot_x = x + width - 2 - offsets_secondary[i];
             plot_bottom = plot_y + plot_height - 2;
+            if (prev_out_x >= 0 && plot_x - prev_out_x > 1) {
+                prev_out_x = prev_out_y = -1;
+            }
 
-            if (in_value < 0 || out_value < 0) {
+            if (in_value == RINGBUF_MISSING || out_value == RINGBUF_MISSING) {
+                prev_out_x = prev_out_y = -1;
+            } else if (in_value < 0 || out_value < 0) {
                 renderer_set_color(renderer, global_config->error_line_color);
                 renderer_draw_line(renderer, plot_x, plot_y + 2, plot_x, plot_bottom);
                 prev_out_x = prev_out_y = -1;
@@ -173,6 +362,18 @@ void plot_draw(plot_t *plot, renderer_t *renderer, font_t *font,
                 in_bar_height = (int32_t)((in_value / max_val) * (plot_height - 4));
                 if (in_bar_height < 1) in_bar_height = 1;
 
+                if (max_buffer[i] > in_value) {
+                    int32_t peak_height = (int32_t)((max_buffer[i] / max_val) * (plot_height - 4));
+                    renderer_set_color(renderer, envelope_color);
+                    renderer_draw_line(renderer, plot_x, plot_bottom - peak_height, plot_x, plot_bottom - in_bar_height);
+                }
+                if (max_buffer_secondary[i] > min_buffer_secondary[i]) {
+                    int32_t low_y = plot_bottom - (int32_t)((min_buffer_secondary[i] / max_val) * (plot_height - 4));
+                    int32_t high_y = plot_bottom - (int32_t)((max_buffer_secondary[i] / max_val) * (plot_height - 4));
+                    renderer_set_color(renderer, envelope_color_secondary);
+                    renderer_draw_line(renderer, plot_x, high_y, plot_x, low_y);
+                }
+
                 renderer_set_color(renderer, plot->config->line_color);
                 renderer_draw_line(renderer, plot_x, plot_bottom - in_bar_height, plot_x, plot_bottom);
 
@@ -196,16 +397,25 @@ void plot_draw(plot_t *plot, renderer_t *renderer, font_t *font,
         for (i = 0; i < data_count; i++) {
             double value = temp_buffer[i];
 
-            int32_t plot_x = x + width - 2 - (data_count - 1 - i);
+            if (offsets[i] >= columns) continue;
+            int32_t plot_x = x + width - 2 - offsets[i];
             int32_t plot_bottom = plot_y + plot_height - 2;
 
-            if (value < 0) {
+            if (value == RINGBUF_MISSING) {
+                continue;
+            } else if (value < 0) {
                 renderer_set_color(renderer, global_config->error_line_color);
                 renderer_draw_line(renderer, plot_x, plot_y + 2, plot_x, plot_bottom);
             } else {
                 int32_t bar_height = (int32_t)((value / max_val) * (plot_height - 4));
                 if (bar_height < 1) bar_height = 1;
 
+                if (max_buffer[i] > value) {
+                    int32_t peak_height = (int32_t)((max_buffer[i] / max_val) * (plot_height - 4));
+                    renderer_set_color(renderer, envelope_color);
+                    renderer_draw_line(renderer, plot_x, plot_bottom - peak_height, plot_x, plot_bottom - bar_height);
+                }
+
                 renderer_set_color(renderer, plot->config->line_color);
                 renderer_draw_line(renderer, plot_x, plot_bottom - bar_height, plot_x, plot_bottom);
             }
@@ -215,8 +425,8 @@ void plot_draw(plot_t *plot, renderer_t *renderer, font_t *font,
     if (plot->data_source && plot->data_source->datasource && plot->data_source->datasource->handler->format_value) {
         char avg_formatted[64];
         char last_formatted[64];
-        plot->data_source->datasource->handler->format_value(plot_stats_cache[plot_index].avg_value, avg_formatted, sizeof(avg_formatted));
-        plot->data_source->datasource->handler->format_value(plot_stats_cache[plot_index].last_value, last_formatted, sizeof(last_formatted));
+        plot->data_source->datasource->handler->format_value(plot->stats.avg_value, avg_formatted, sizeof(avg_formatted));
+        plot->data_source->datasource->handler->format_value(plot->stats.last_value, last_formatted, sizeof(last_formatted));
         snprintf(stats_text, sizeof(stats_text), "%s", last_formatted);
     } else {
         if (plot->data_source && plot->data_source->datasource) {
@@ -226,38 +436,50 @@ void plot_draw(plot_t *plot, renderer_t *renderer, font_t *font,
         }
         if (strlen(unit) > 0) {
             snprintf(stats_text, sizeof(stats_text), "%.1f%s",
-                     plot_stats_cache[plot_index].last_value, unit);
+                     plot->stats.last_value, unit);
         } else {
             snprintf(stats_text, sizeof(stats_text), "%.1f",
-                     plot_stats_cache[plot_index].last_value);
+                     plot->stats.last_value);
         }
     }
 
+    /* History kept in history_dir shows while the datasource opens */
+    if (plot->data_source && plot->data_source->initializing) {
+        snprintf(stats_text, sizeof(stats_text), "Initializing");
+    }
+
     font_get_text_size(font, stats_text, &text_width, &text_height);
     text_x = x + width - text_width;
     font_draw_text(renderer, font, global_config->text_color, text_x, y + height - 15, stats_text);
 
-    buffer_size = plot->data_buffer->size;
-    refresh_interval = (plot->config->refresh_interval_ms > 0) ?
-                      plot->config->refresh_interval_ms :
-                      global_config->refresh_interval_ms;
-    total_time_ms = buffer_size * refresh_interval;
-    if (total_time_ms < 60000) {
-        snprintf(time_span_text, sizeof(time_span_text), "%us", total_time_ms / 1000);
-    } else if (total_time_ms < 86400000) {
-        minutes = (total_time_ms + 59999) / 60000;
-        if (minutes < 60) {
-            snprintf(time_span_text, sizeof(time_span_text), "%um", minutes);
-        } else {
-            hours = (minutes + 59) / 60;
-            snprintf(time_span_text, sizeof(time_span_text), "%uh", hours);
+    plot_draw_time_span(plot, renderer, font, x, y, height, global_config);
+}
+
+/* Tops of the grid rows, rows + 1 entries. Each grid row is as tall as
+ * its tallest plot. */
+static int32_t *plot_system_layout(config_t *config, uint32_t columns, uint32_t rows) {
+    int32_t *row_offsets = calloc(rows + 1, sizeof(int32_t));
+    uint32_t row, column;
+
+    if (!row_offsets) return NULL;
+
+    for (row = 0; row < rows; row++) {
+        int32_t tallest = 0;
+        for (column = 0; column < columns; column++) {
+            uint32_t index = row * columns + column;
+            if (index >= config->plot_count) break;
+            if (config->plots[index].height > tallest) tallest = config->plots[index].height;
         }
-    } else {
-        days = (total_time_ms + 86399999) / 86400000;
-        snprintf(time_span_text, sizeof(time_span_text), "%ud", days);
+        row_offsets[row + 1] = row_offsets[row] + tallest + PLOT_SPACING;
     }
+    return row_offsets;
+}
 
-    font_draw_text(renderer, font, global_config->text_color, x, y + height - 15, time_span_text);
+static void plot_init(plot_t *plot, plot_config_t *config) {
+    memset(plot, 0, sizeof(*plot));
+    plot->config = config;
+    plot->active = 1;
+    plot->stats_dirty = 1;
 }
 
 plot_system_t *plot_system_create(config_t *config) {
@@ -274,8 +496,22 @@ plot_system_t *plot_system_create(config_t *config) {
         return NULL;
     }
     
-    int32_t plot_spacing = 10;
-    int32_t window_height = config->plot_count * (config->default_height + plot_spacing) + config->window_margin * 2;
+    system->columns = config->columns > 0 ? (uint32_t)config->columns : 1;
+    system->rows = (system->plot_count + system->columns - 1) / system->columns;
+    system->scroll_y = 0;
+
+    system->row_offsets = plot_system_layout(config, system->columns, system->rows);
+    if (!system->row_offsets) {
+        free(system->plots);
+        free(system);
+        return NULL;
+    }
+
+    /* Past max_window_height the window scrolls instead of growing */
+    int32_t window_height = system->row_offsets[system->rows] + config->window_margin * 2;
+    if (config->max_window_height > 0 && window_height > config->max_window_height) {
+        window_height = config->max_window_height;
+    }
 
     char window_title[300];
     if (gethostname(system_hostname, sizeof(system_hostname)) == 0) {
@@ -288,9 +524,10 @@ plot_system_t *plot_system_create(config_t *config) {
     }
 
     system->window = window_create(window_title,
-                                  config->default_width,
+                                  config->default_width * system->columns,
                                   window_height);
     if (!system->window) {
+        free(system->row_offsets);
         free(system->plots);
         free(system);
         return NULL;
@@ -306,6 +543,7 @@ plot_system_t *plot_system_create(config_t *config) {
     system->renderer = renderer_create(system->window);
     if (!system->renderer) {
         window_destroy(system->window);
+        free(system->row_offsets);
         free(system->plots);
         free(system);
         return NULL;
@@ -327,11 +565,30 @@ plot_system_t *plot_system_create(config_t *config) {
     if (!system->font) {
         renderer_destroy(system->renderer);
         window_destroy(system->window);
+        free(system->row_offsets);
         free(system->plots);
         free(system);
         return NULL;
     }
     
+    system->draw_queue = malloc(sizeof(uint32_t) * (system->plot_count ? system->plot_count : 1));
+    if (!system->draw_queue) {
+        font_destroy(system->font);
+        renderer_destroy(system->renderer);
+        window_destroy(system->window);
+        free(system->row_offsets);
+        free(system->plots);
+        free(system);
+        return NULL;
+    }
+    system->draw_count = 0;
+
+    uint32_t render_threads = config->render_threads > 0 ?
+                              (uint32_t)config->render_threads : platform_cpu_count();
+    if (render_threads > system->plot_count) render_threads = system->plot_count;
+    system->render_pool = render_pool_create(system->renderer, render_threads);
+    plot_build_heatmap_palette(system->heatmap_palette, config);
+
     system->fullscreen = should_be_fullscreen;
     system->last_plot_width = 0;
 
@@ -340,36 +597,93 @@ plot_system_t *plot_system_create(config_t *config) {
     system->window_size_dirty = 1;
 
     system->needs_redraw = 1;
+    system->hidden = 0;
+    system->frame_serial = 0;
 
     system->last_fullscreen_check_ms = platform_get_time_ms();
 
     uint32_t i;
     for (i = 0; i < system->plot_count; i++) {
-        plot_t *plot = &system->plots[i];
-        plot->config = &config->plots[i];
-        plot->data_buffer = NULL;
-        plot_stats_cache[i].min_value = 0.0;
-        plot_stats_cache[i].max_value = 0.0;
-        plot_stats_cache[i].avg_value = 0.0;
-        plot_stats_cache[i].last_value = 0.0;
-        plot->active = 1;
-
-        plot->cached_data_count = 0;
-        plot->cached_data_count_secondary = 0;
-        plot->cached_head_position = 0;
-        plot->cached_head_position_secondary = 0;
-        plot->stats_dirty = 1;
+        plot_init(&system->plots[i], &config->plots[i]);
     }
     
     return system;
 }
 
+/* Lays out the plots of a reloaded config in the window there is, and
+ * connects them to the reloaded collector. The window keeps its size, a
+ * longer list scrolls. Returns 0 and changes nothing when out of memory. */
+int plot_system_reload(plot_system_t *system, config_t *config, data_collector_t *collector) {
+    uint32_t columns, rows, render_threads, i;
+    int32_t *row_offsets;
+    uint32_t *draw_queue;
+    plot_t *plots;
+
+    if (!system || !config || !collector) return 0;
+
+    columns = config->columns > 0 ? (uint32_t)config->columns : 1;
+    rows = (config->plot_count + columns - 1) / columns;
+    plots = malloc(sizeof(plot_t) * (config->plot_count ? config->plot_count : 1));
+    draw_queue = malloc(sizeof(uint32_t) * (config->plot_count ? config->plot_count : 1));
+    row_offsets = plot_system_layout(config, columns, rows);
+    if (!plots || !draw_queue || !row_offsets) {
+        free(plots);
+        free(draw_queue);
+        free(row_offsets);
+        return 0;
+    }
+
+    for (i = 0; i < system->plot_count; i++) {
+        free(system->plots[i].image);
+        decimate_destroy(system->plots[i].decimate);
+        decimate_destroy(system->plots[i].decimate_secondary);
+    }
+    free(system->plots);
+    free(system->draw_queue);
+    free(system->row_offsets);
+
+    system->config = config;
+    system->plots = plots;
+    system->plot_count = config->plot_count;
+    system->draw_queue = draw_queue;
+    system->draw_count = 0;
+    system->row_offsets = row_offsets;
+    system->columns = columns;
+    system->rows = rows;
+    system->scroll_y = 0;
+    for (i = 0; i < system->plot_count; i++) {
+        plot_init(&system->plots[i], &config->plots[i]);
+    }
+    plot_system_connect_data_buffers(system, collector);
+
+    render_threads = config->render_threads > 0 ? (uint32_t)config->render_threads : platform_cpu_count();
+    if (render_threads > system->plot_count) render_threads = system->plot_count;
+    render_pool_destroy(system->render_pool);
+    system->render_pool = render_pool_create(system->renderer, render_threads);
+    plot_build_heatmap_palette(system->heatmap_palette, config);
+
+    /* Resizes the buffers of new plots to the plot width and repaints */
+    system->last_plot_width = 0;
+    system->window_size_dirty = 1;
+    system->needs_redraw = 1;
+    return 1;
+}
+
 void plot_system_destroy(plot_system_t *system) {
+    uint32_t i;
     if (!system) return;
     
+    render_pool_destroy(system->render_pool);
     font_destroy(system->font);
     renderer_destroy(system->renderer);
     window_destroy(system->window);
+    for (i = 0; i < system->plot_count; i++) {
+        free(system->plots[i].image);
+        decimate_destroy(system->plots[i].decimate);
+        decimate_destroy(system->plots[i].decimate_secondary);
+    }
+    free(system->draw_queue);
+    free(system->row_offsets);
     free(system->plots);
     free(system);
 }
@@ -379,33 +693,185 @@ void plot_system_connect_data_buffers(plot_system_t *system, data_collector_t *c
     if (!system || !collector) return;
 
     for (i = 0; i < system->plot_count && i < collector->source_count; i++) {
-        system->plots[i].data_buffer = collector->sources[i].data_buffer;
-        system->plots[i].data_buffer_secondary = collector->sources[i].data_buffer_secondary;
-        system->plots[i].data_source = &collector->sources[i];
-        system->plots[i].is_dual = collector->sources[i].is_dual;
+        system->plots[i].data_buffer = collector->sources[i]->data_buffer;
+        system->plots[i].data_buffer_secondary = collector->sources[i]->data_buffer_secondary;
+        system->plots[i].data_source = collector->sources[i];
+        system->plots[i].is_dual = collector->sources[i]->is_dual;
+        system->plots[i].heatmap = collector->sources[i]->heatmap;
     }
 }
 
-static int plot_system_needs_redraw(plot_system_t *system) {
-    if (!system) return 0;
+static int plot_has_new_data(plot_t *plot) {
+    if (!plot->data_buffer) return 0;
 
-    if (window_was_resized() || system->window_size_dirty || system->needs_redraw) {
+    if (plot->cached_data_count != plot->data_buffer->count ||
+        plot->cached_head_position != plot->data_buffer->head) {
         return 1;
     }
 
-    uint32_t i;
-    for (i = 0; i < system->plot_count; i++) {
-        plot_t *plot = &system->plots[i];
-        if (!plot->data_buffer) continue;
+    if (plot->is_dual && plot->data_buffer_secondary &&
+        (plot->cached_data_count_secondary != plot->data_buffer_secondary->count ||
+         plot->cached_head_position_secondary != plot->data_buffer_secondary->head)) {
+        return 1;
+    }
 
-        if (plot->cached_data_count != plot->data_buffer->count ||
-            plot->cached_head_position != plot->data_buffer->head) {
-            return 1;
+    return 0;
+}
+
+static void plot_mark_drawn(plot_t *plot) {
+    if (!plot->data_buffer) return;
+
+    plot->cached_data_count = plot->data_buffer->count;
+    plot->cached_head_position = plot->data_buffer->head;
+    if (plot->is_dual && plot->data_buffer_secondary) {
+        plot->cached_data_count_secondary = plot->data_buffer_secondary->count;
+        plot->cached_head_position_secondary = plot->data_buffer_secondary->head;
+    }
+}
+
+static int32_t plot_system_max_scroll(plot_system_t *system) {
+    int32_t content_height = system->row_offsets[system->rows] +
+                             system->config->window_margin * 2;
+    int32_t max_scroll = content_height - system->cached_window_height;
+    return max_scroll > 0 ? max_scroll : 0;
+}
+
+/* Plots [first, last) are at least partially inside the window. Everything
+ * else is neither snapshotted nor drawn. */
+static uint32_t plot_system_row_at(plot_system_t *system, int32_t offset) {
+    uint32_t low = 0, high = system->rows;
+
+    while (low < high) {
+        uint32_t mid = low + (high - low) / 2;
+        if (system->row_offsets[mid + 1] > offset) {
+            high = mid;
+        } else {
+            low = mid + 1;
         }
+    }
+    return low;
+}
+
+/* Height of the row at offset, spacing included. Rows differ when plots
+ * override their height. */
+static int32_t plot_system_row_height(plot_system_t *system, int32_t offset) {
+    uint32_t row = plot_system_row_at(system, offset);
+    if (row >= system->rows) row = system->rows - 1;
+    return system->row_offsets[row + 1] - system->row_offsets[row];
+}
 
-        if (plot->is_dual && plot->data_buffer_secondary &&
-            (plot->cached_data_count_secondary != plot->data_buffer_secondary->count ||
-             plot->cached_head_position_secondary != plot->data_buffer_secondary->head)) {
+/* Scroll offset after moving notches rows down, or up when negative. Each
+ * step lands on a row boundary so a wheel notch moves exactly one row. */
+static int32_t plot_system_scroll_rows(plot_system_t *system, int32_t scroll_y, int32_t notches) {
+    while (notches > 0 && scroll_y < system->row_offsets[system->rows]) {
+        scroll_y = system->row_offsets[plot_system_row_at(system, scroll_y) + 1];
+        notches--;
+    }
+    while (notches < 0 && scroll_y > 0) {
+        scroll_y = system->row_offsets[plot_system_row_at(system, scroll_y - 1)];
+        notches++;
+    }
+    return scroll_y;
+}
+
+static void plot_system_visible_range(plot_system_t *system, uint32_t *first, uint32_t *last) {
+    int32_t margin = system->config->window_margin;
+    int32_t top = system->scroll_y - margin;
+    int32_t bottom = system->scroll_y + system->cached_window_height - margin;
+    uint32_t first_row, last_row;
+
+    first_row = plot_system_row_at(system, top);
+    last_row = plot_system_row_at(system, bottom - 1);
+    if (last_row < system->rows) last_row++;
+    if (first_row > last_row) first_row = last_row;
+
+    *first = first_row * system->columns;
+    *last = last_row * system->columns;
+    if (*last > system->plot_count) *last = system->plot_count;
+    if (*first > *last) *first = *last;
+}
+
+static void plot_system_scroll(plot_system_t *system, graphics_event_t *event) {
+    int32_t row_height = plot_system_row_height(system, system->scroll_y);
+    int32_t page = system->cached_window_height - system->config->window_margin * 2;
+    int32_t max_scroll = plot_system_max_scroll(system);
+    int32_t scroll_y = system->scroll_y;
+
+    if (page < row_height) page = row_height;
+
+    switch (event->key) {
+        case KEY_PAGE_UP:
+            scroll_y -= page;
+            break;
+        case KEY_PAGE_DOWN:
+            scroll_y += page;
+            break;
+        case KEY_HOME:
+            scroll_y = 0;
+            break;
+        case KEY_END:
+            scroll_y = max_scroll;
+            break;
+        default:
+            scroll_y = plot_system_scroll_rows(system, scroll_y, event->scroll);
+            break;
+    }
+
+    if (scroll_y > max_scroll) scroll_y = max_scroll;
+    if (scroll_y < 0) scroll_y = 0;
+
+    if (scroll_y != system->scroll_y) {
+        system->scroll_y = scroll_y;
+        system->needs_redraw = 1;
+    }
+}
+
+static void plot_system_draw_scrollbar(plot_system_t *system) {
+    int32_t max_scroll = plot_system_max_scroll(system);
+    int32_t window_height = system->cached_window_height;
+    int32_t content_height = window_height + max_scroll;
+    rect_t thumb;
+
+    if (max_scroll <= 0 || system->config->window_margin < 4) return;
+
+    thumb.w = 3;
+    thumb.x = system->cached_window_width - thumb.w - 1;
+    thumb.h = (int32_t)((int64_t)window_height * window_height / content_height);
+    if (thumb.h < 10) thumb.h = 10;
+    thumb.y = (int32_t)((int64_t)system->scroll_y * (window_height - thumb.h) / max_scroll);
+
+    renderer_set_color(system->renderer, system->config->border_color);
+    renderer_fill_rect(system->renderer, thumb);
+}
+
+/* Draws one queued plot. Everything it touches belongs to that plot, so
+ * the render pool can run several at once on their own renderers. */
+static void plot_system_draw_job(void *arg, renderer_t *renderer, uint32_t job) {
+    plot_system_t *system = (plot_system_t*)arg;
+    uint32_t index = system->draw_queue[job];
+    plot_t *plot = &system->plots[index];
+    rect_t plot_rect = plot->rect;
+
+    if (renderer_begin_plot(renderer, index, plot_rect, plot->draw_dirty)) {
+        renderer_set_color(renderer, system->config->background_color);
+        renderer_fill_rect(renderer, plot_rect);
+        plot_draw(plot, renderer, system->font, plot_rect.x, plot_rect.y,
+                  plot_rect.w - 1, plot_rect.h, system->config, index, system->heatmap_palette);
+    }
+    renderer_end_plot(renderer, index, plot_rect);
+}
+
+static int plot_system_needs_redraw(plot_system_t *system) {
+    if (!system) return 0;
+
+    if (window_was_resized() || system->window_size_dirty || system->needs_redraw) {
+        return 1;
+    }
+
+    uint32_t i, first, last;
+    plot_system_visible_range(system, &first, &last);
+    for (i = first; i < last; i++) {
+        if (plot_has_new_data(&system->plots[i])) {
             return 1;
         }
     }
@@ -438,6 +904,9 @@ int plot_system_update(plot_system_t *system) {
                 }
                 system->needs_redraw = 1;
                 break;
+            case GRAPHICS_EVENT_SCROLL:
+                plot_system_scroll(system, &event);
+                break;
             case GRAPHICS_EVENT_NONE:
             case GRAPHICS_EVENT_KEY_PRESS:
             default:
@@ -459,6 +928,17 @@ int plot_system_update(plot_system_t *system) {
         }
     }
 
+    /* Collectors keep sampling while nobody can see the window; repaint
+     * everything once it comes back, or once a remote viewer wants it */
+    if (!window_is_visible(system->window) && !system->remote_viewers) {
+        system->hidden = 1;
+        return 1;
+    }
+    if (system->hidden) {
+        system->hidden = 0;
+        system->needs_redraw = 1;
+    }
+
     int window_resized = window_was_resized();
     int needs_full_render = 0;
 
@@ -467,16 +947,35 @@ int plot_system_update(plot_system_t *system) {
         system->window_size_dirty = 0;
         system->needs_redraw = 1;
         needs_full_render = 1;
+
+        if (system->scroll_y > plot_system_max_scroll(system)) {
+            system->scroll_y = plot_system_max_scroll(system);
+        }
     }
 
-    int32_t current_plot_width = system->cached_window_width - (system->config->window_margin * 2);
+    int32_t margin = system->config->window_margin;
+    int32_t columns = (int32_t)system->columns;
+    int32_t current_plot_width = (system->cached_window_width - margin * 2 -
+                                  (columns - 1) * PLOT_SPACING) / columns;
     if (system->last_plot_width != current_plot_width) {
         uint32_t new_buffer_size = current_plot_width - 2;
         if (new_buffer_size > 0) {
             uint32_t i;
             for (i = 0; i < system->plot_count; i++) {
+                /* Deeper history stays, it is decimated to the new width */
+                uint32_t plot_buffer_size = new_buffer_size;
+                if (system->plots[i].config->history > plot_buffer_size &&
+                    !system->plots[i].config->history_compress) {
+                    plot_buffer_size = system->plots[i].config->history;
+                }
                 if (system->plots[i].data_buffer) {
-                    ringbuf_resize(system->plots[i].data_buffer, new_buffer_size);
+                    ringbuf_resize(system->plots[i].data_buffer, plot_buffer_size);
+                }
+                if (system->plots[i].data_buffer_secondary) {
+                    ringbuf_resize(system->plots[i].data_buffer_secondary, plot_buffer_size);
+                }
+                if (system->plots[i].heatmap) {
+                    heatmap_resize(system->plots[i].heatmap, new_buffer_size);
                 }
             }
         }
@@ -489,17 +988,48 @@ int plot_system_update(plot_system_t *system) {
         return 1;
     }
 
-    int32_t plot_height = system->config->default_height;
-    int32_t margin = system->config->window_margin;
-    int32_t plot_spacing = 10;
+    /* Retained backends only repaint plots with new samples; anything that
+     * invalidates the whole window (resize, refresh, fps overlay) or a
+     * backend that swaps buffers needs every plot redrawn. */
+    int full_render = needs_full_render || system->needs_redraw ||
+                      system->config->fps_counter ||
+                      !renderer_has_backing_store(system->renderer);
+
+    uint32_t i, first, last;
+    system->frame_serial++;
+    if (full_render) {
+        system->cleared_serial = system->frame_serial;
+        renderer_clear(system->renderer, system->config->background_color);
+        for (i = 0; i < system->plot_count; i++) {
+            system->plots[i].on_screen = 0;
+        }
+    }
 
-    renderer_clear(system->renderer, system->config->background_color);
+    system->draw_count = 0;
+    plot_system_visible_range(system, &first, &last);
+    for (i = first; i < last; i++) {
+        plot_t *plot = &system->plots[i];
+        int dirty = plot_has_new_data(plot);
 
-    uint32_t i;
-    for (i = 0; i < system->plot_count; i++) {
-        int32_t y = i * (plot_height + plot_spacing) + margin;
-        plot_draw(&system->plots[i], system->renderer, system->font,
-                  margin, y, current_plot_width, plot_height, system->config, i);
+        if (!full_render && !dirty) continue;
+
+        plot->rect.x = margin + (int32_t)(i % system->columns) * (current_plot_width + PLOT_SPACING);
+        plot->rect.y = margin + system->row_offsets[i / system->columns] - system->scroll_y;
+        plot->rect.w = current_plot_width + 1;
+        plot->rect.h = plot->config->height;
+        plot->draw_dirty = dirty;
+        plot->on_screen = 1;
+        plot->drawn_serial = system->frame_serial;
+        plot_mark_drawn(plot);
+
+        system->draw_queue[system->draw_count++] = i;
+    }
+
+    render_pool_run(system->draw_count > 1 ? system->render_pool : NULL, system->renderer,
+                    system->draw_count, plot_system_draw_job, system);
+
+    if (full_render) {
+        plot_system_draw_scrollbar(system);
     }
 
     graphics_draw_fps_counter(system->renderer, system->font, system->config->fps_counter);
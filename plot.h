@@ -4,8 +4,22 @@
 #include "compat.h"
 #include "config.h"
 #include "ringbuf.h"
+#include "heatmap.h"
 #include "graphics.h"
 #include "threading.h"
+#include "render_pool.h"
+#include "decimate.h"
+
+typedef struct {
+    double min_value;
+    double max_value;
+    double avg_value;
+    double last_value;
+    double min_value_secondary;
+    double max_value_secondary;
+    double avg_value_secondary;
+    double last_value_secondary;
+} plot_stats_t;
 
 typedef struct {
     plot_config_t *config;
@@ -21,6 +35,23 @@ typedef struct {
     uint32_t cached_head_position;
     uint32_t cached_head_position_secondary;
     int stats_dirty;
+    plot_stats_t stats;
+
+    /* Column cache for buffers deeper than the plot is wide */
+    decimate_t *decimate;
+    decimate_t *decimate_secondary;
+
+    /* Heatmap plots render their matrix into this scanline buffer */
+    heatmap_t *heatmap;
+    uint32_t *image;
+    size_t image_capacity;
+
+    /* Where the plot was last put on screen, for image export */
+    rect_t rect;
+    rect_t graph;   /* inside the border, where samples scroll left */
+    int on_screen;
+    uint32_t drawn_serial;
+    int draw_dirty; /* had new samples when queued for drawing */
 } plot_t;
 
 typedef struct {
@@ -38,8 +69,24 @@ typedef struct {
     int32_t cached_window_height;
     int window_size_dirty;
 
+    /* Grid layout and vertical scrolling */
+    uint32_t columns;
+    uint32_t rows;
+    int32_t *row_offsets; /* rows + 1 entries, top of each grid row */
+    int32_t scroll_y;
+
     /* Rendering optimization */
     int needs_redraw;
+    int hidden;
+    int remote_viewers;    /* HTTP or VNC clients want frames, drawn even while hidden */
+    uint32_t frame_serial; /* bumped for every presented frame */
+    uint32_t cleared_serial; /* last frame redrawn from an empty window */
+    uint32_t heatmap_palette[256]; /* from the config colours, rebuilt on reload */
+
+    /* Plots to draw this frame, on render_pool when there is one */
+    render_pool_t *render_pool;
+    uint32_t *draw_queue;
+    uint32_t draw_count;
 
     /* Fullscreen recheck timing */
     uint64_t last_fullscreen_check_ms;
@@ -50,8 +97,10 @@ plot_system_t *plot_system_create(config_t *config);
 void plot_system_destroy(plot_system_t *system);
 int plot_system_update(plot_system_t *system);
 void plot_system_connect_data_buffers(plot_system_t *system, data_collector_t *collector);
+int plot_system_reload(plot_system_t *system, config_t *config, data_collector_t *collector);
 
 void plot_draw(plot_t *plot, renderer_t *renderer, font_t *font,
-               int32_t x, int32_t y, int32_t width, int32_t height, config_t *global_config, uint32_t plot_index);
+               int32_t x, int32_t y, int32_t width, int32_t height, config_t *global_config, uint32_t plot_index,
+               const uint32_t *heatmap_palette);
 
 #endif
@@ -0,0 +1,171 @@
+#include "png.h"
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+
+typedef struct {
+    uint8_t *data;
+    size_t size;
+    size_t capacity;
+} png_buffer_t;
+
+static int png_reserve(png_buffer_t *buf, size_t extra) {
+    if (buf->size + extra <= buf->capacity) return 1;
+
+    size_t capacity = buf->capacity ? buf->capacity : 65536;
+    while (capacity < buf->size + extra) capacity *= 2;
+
+    uint8_t *grown = realloc(buf->data, capacity);
+    if (!grown) return 0;
+    buf->data = grown;
+    buf->capacity = capacity;
+    return 1;
+}
+
+static void png_put_u32(uint8_t *p, uint32_t value) {
+    p[0] = (uint8_t)(value >> 24);
+    p[1] = (uint8_t)(value >> 16);
+    p[2] = (uint8_t)(value >> 8);
+    p[3] = (uint8_t)value;
+}
+
+static int png_write_chunk(png_buffer_t *buf, const char *type, const uint8_t *data, uint32_t length) {
+    if (!png_reserve(buf, 12 + length)) return 0;
+
+    uint8_t *p = buf->data + buf->size;
+    png_put_u32(p, length);
+    memcpy(p + 4, type, 4);
+    if (length) memcpy(p + 8, data, length);
+    png_put_u32(p + 8 + length, (uint32_t)crc32(0, p + 4, 4 + length));
+    buf->size += 12 + length;
+    return 1;
+}
+
+/* Filter one scanline with whichever of None, Sub and Up leaves the
+ * smallest residuals; flat plot backgrounds turn into runs of zeros. */
+static const uint8_t *png_filter_row(const uint8_t *raw, const uint8_t *prev, size_t length,
+                                     uint8_t *candidates[3]) {
+    uint32_t cost[3] = {0, 0, 0};
+    uint8_t *none = candidates[0] + 1;
+    uint8_t *sub = candidates[1] + 1;
+    uint8_t *up = candidates[2] + 1;
+    size_t i;
+    int best = 0, f;
+
+    for (i = 0; i < length; i++) {
+        uint8_t left = i >= 3 ? raw[i - 3] : 0;
+        uint8_t above = prev ? prev[i] : 0;
+        none[i] = raw[i];
+        sub[i] = (uint8_t)(raw[i] - left);
+        up[i] = (uint8_t)(raw[i] - above);
+        cost[0] += (uint32_t)abs((int8_t)none[i]);
+        cost[1] += (uint32_t)abs((int8_t)sub[i]);
+        cost[2] += (uint32_t)abs((int8_t)up[i]);
+    }
+
+    for (f = 0; f < 3; f++) {
+        candidates[f][0] = (uint8_t)f;
+        if (cost[f] < cost[best]) best = f;
+    }
+
+    return candidates[best];
+}
+
+int png_encode(const uint32_t *pixels, int32_t width, int32_t height, int32_t stride,
+               uint8_t **out, size_t *out_size) {
+    static const uint8_t signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+    png_buffer_t buf = {NULL, 0, 0};
+    uint8_t header[13];
+    uint8_t *rows = NULL;
+    uint8_t *candidates[3] = {NULL, NULL, NULL};
+    size_t row_bytes = (size_t)width * 3;
+    size_t idat_start;
+    z_stream stream;
+    int32_t x, y;
+    int f, ok = 0;
+
+    if (!pixels || width <= 0 || height <= 0 || !out || !out_size) return 0;
+
+    memset(&stream, 0, sizeof(stream));
+    if (deflateInit2(&stream, 6, Z_DEFLATED, 15, 8, Z_RLE) != Z_OK) return 0;
+
+    rows = malloc(row_bytes * 2);
+    for (f = 0; f < 3; f++) {
+        candidates[f] = malloc(row_bytes + 1);
+    }
+    if (!rows || !candidates[0] || !candidates[1] || !candidates[2]) goto done;
+
+    if (!png_reserve(&buf, sizeof(signature))) goto done;
+    memcpy(buf.data, signature, sizeof(signature));
+    buf.size = sizeof(signature);
+
+    png_put_u32(header, (uint32_t)width);
+    png_put_u32(header + 4, (uint32_t)height);
+    header[8] = 8;      /* bit depth */
+    header[9] = 2;      /* truecolor */
+    header[10] = 0;
+    header[11] = 0;
+    header[12] = 0;
+    if (!png_write_chunk(&buf, "IHDR", header, sizeof(header))) goto done;
+
+    /* One IDAT chunk, its length is patched in once deflate is done */
+    if (!png_reserve(&buf, 8)) goto done;
+    idat_start = buf.size;
+    memcpy(buf.data + idat_start + 4, "IDAT", 4);
+    buf.size += 8;
+
+    for (y = 0; y <= height; y++) {
+        int flush = Z_NO_FLUSH;
+
+        if (y < height) {
+            const uint32_t *src = pixels + (size_t)y * stride;
+            uint8_t *raw = rows + (y & 1) * row_bytes;
+            const uint8_t *prev = y > 0 ? rows + ((y - 1) & 1) * row_bytes : NULL;
+
+            for (x = 0; x < width; x++) {
+                raw[x * 3] = (uint8_t)(src[x] >> 16);
+                raw[x * 3 + 1] = (uint8_t)(src[x] >> 8);
+                raw[x * 3 + 2] = (uint8_t)src[x];
+            }
+            stream.next_in = (Bytef*)png_filter_row(raw, prev, row_bytes, candidates);
+            stream.avail_in = (uInt)(row_bytes + 1);
+        } else {
+            stream.next_in = NULL;
+            stream.avail_in = 0;
+            flush = Z_FINISH;
+        }
+
+        for (;;) {
+            if (!png_reserve(&buf, 65536)) goto done;
+            stream.next_out = buf.data + buf.size;
+            stream.avail_out = (uInt)(buf.capacity - buf.size);
+
+            int status = deflate(&stream, flush);
+            buf.size = buf.capacity - stream.avail_out;
+            if (status == Z_STREAM_ERROR) goto done;
+            if (flush == Z_FINISH ? status == Z_STREAM_END : stream.avail_in == 0) break;
+        }
+    }
+
+    uint32_t idat_length = (uint32_t)(buf.size - idat_start - 8);
+    png_put_u32(buf.data + idat_start, idat_length);
+    if (!png_reserve(&buf, 4)) goto done;
+    png_put_u32(buf.data + buf.size, (uint32_t)crc32(0, buf.data + idat_start + 4, idat_length + 4));
+    buf.size += 4;
+
+    if (!png_write_chunk(&buf, "IEND", NULL, 0)) goto done;
+
+    *out = buf.data;
+    *out_size = buf.size;
+    buf.data = NULL;
+    ok = 1;
+
+done:
+    deflateEnd(&stream);
+    free(rows);
+    for (f = 0; f < 3; f++) {
+        free(candidates[f]);
+    }
+    free(buf.data);
+    return ok;
+}
@@ -0,0 +1,12 @@
+#ifndef PNG_H
+#define PNG_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* Encode 0x00RRGGBB scanlines as an 8 bit RGB PNG. The returned buffer is
+ * malloced, the caller frees it. */
+int png_encode(const uint32_t *pixels, int32_t width, int32_t height, int32_t stride,
+               uint8_t **out, size_t *out_size);
+
+#endif
@@ -0,0 +1,521 @@
+#include "compat.h"
+#include "query.h"
+#include "net.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#define QUERY_MAX_CLIENTS 32
+#define QUERY_LINE_MAX 512
+#define QUERY_TICK_MS 100
+#define QUERY_CHUNK 1024                /* samples per ring read */
+#define QUERY_HISTORY_MAX 100000        /* samples per history answer */
+#define QUERY_BACKLOG (1024 * 1024)     /* drop subscribers this far behind */
+
+typedef struct {
+    double value[QUERY_CHUNK];
+    double min[QUERY_CHUNK];
+    double max[QUERY_CHUNK];
+    uint64_t time[QUERY_CHUNK];
+} query_chunk_t;
+
+typedef struct {
+    int fd;
+    char in[QUERY_LINE_MAX];
+    size_t in_size;
+    int discarding;             /* rest of a line already refused */
+
+    net_buffer_t out;
+
+    /* Subscribers get every sample after the one numbered next */
+    int subscribed;
+    int32_t subscribe_plot;     /* -1 is every plot */
+    uint64_t *next;
+} query_client_t;
+
+struct query_server {
+    int listen_fd;
+    char *path;
+    data_collector_t *collector;
+    config_t *config;
+    uint32_t plot_count;
+    plot_thread_t *thread;
+    volatile int running;
+    query_client_t clients[QUERY_MAX_CLIENTS];
+    query_chunk_t *chunk;       /* primary and secondary */
+    uint32_t last_tick_ms;
+};
+
+static void query_client_close(query_client_t *client) {
+    if (client->fd >= 0) close(client->fd);
+    net_buffer_free(&client->out);
+    free(client->next);
+    memset(client, 0, sizeof(*client));
+    client->fd = -1;
+}
+
+static void query_value(query_client_t *client, double value) {
+    if (value < 0) {
+        net_buffer_append(&client->out, " nan", 4);
+    } else {
+        net_buffer_printf(&client->out, " %.10g", value);
+    }
+}
+
+/* Monotonic push times to Unix seconds */
+static void query_time(query_client_t *client, uint64_t time_us) {
+    int64_t wall_us = (int64_t)time_us + (int64_t)platform_get_time_us() - (int64_t)platform_get_monotonic_us();
+    net_buffer_printf(&client->out, "%lld.%03lld", (long long)(wall_us / 1000000),
+                      (long long)(wall_us % 1000000 / 1000));
+}
+
+/* By index, title, then the first plot of that type */
+static int32_t query_find(query_server_t *server, const char *name) {
+    char *end;
+    long index;
+    uint32_t i;
+
+    index = strtol(name, &end, 10);
+    if (*name && !*end) return index >= 0 && (uint32_t)index < server->plot_count ? (int32_t)index : -1;
+
+    for (i = 0; i < server->plot_count; i++) {
+        if (strcmp(server->config->plots[i].name, name) == 0) return (int32_t)i;
+    }
+    for (i = 0; i < server->plot_count; i++) {
+        if (strcmp(server->collector->sources[i]->type, name) == 0) return (int32_t)i;
+    }
+    return -1;
+}
+
+/* Heatmap rings hold row colors, not values */
+static data_source_t *query_source(query_server_t *server, int32_t plot) {
+    data_source_t *source;
+
+    if (plot < 0) return NULL;
+    source = server->collector->sources[plot];
+    if (!source->data_buffer || source->heatmap || strcmp(source->type, "heatmap") == 0) return NULL;
+    return source;
+}
+
+/* Samples numbered from onwards, with the secondary series when it lines
+ * up. Returns how many, first and written tell where they are. */
+static uint32_t query_read(query_server_t *server, data_source_t *source, uint64_t from,
+                           uint64_t *first, uint64_t *written, int *dual) {
+    uint64_t first_secondary, written_secondary;
+    uint32_t count, count_secondary;
+    query_chunk_t *chunk = server->chunk;
+
+    count = ringbuf_peek_range(source->data_buffer, from, chunk[0].value, chunk[0].min, chunk[0].max,
+                               chunk[0].time, QUERY_CHUNK, first, written);
+    *dual = 0;
+    if (count && source->data_buffer_secondary) {
+        count_secondary = ringbuf_peek_range(source->data_buffer_secondary, *first, chunk[1].value, chunk[1].min,
+                                             chunk[1].max, chunk[1].time, count, &first_secondary, &written_secondary);
+        *dual = count_secondary == count && first_secondary == *first;
+    }
+    return count;
+}
+
+/* Where the newest samples start, pushes after this only make it older */
+static uint64_t query_newest(ringbuf_t *ring, uint64_t samples) {
+    uint64_t written = atomic_load(&ring->written);
+    return written > samples ? written - samples : 0;
+}
+
+static void query_list(query_server_t *server, query_client_t *client) {
+    uint32_t i;
+
+    for (i = 0; i < server->plot_count; i++) {
+        net_buffer_printf(&client->out, "%u\t%s\t%s\t%s\n", i, server->collector->sources[i]->type,
+                          server->collector->sources[i]->target, server->config->plots[i].name);
+    }
+}
+
+static void query_last(query_server_t *server, query_client_t *client, data_source_t *source) {
+    uint64_t first, written;
+    uint32_t count;
+    int dual;
+
+    count = query_read(server, source, query_newest(source->data_buffer, 1), &first, &written, &dual);
+    if (count == 0) {
+        net_buffer_printf(&client->out, query_newest(source->data_buffer, 0) ? "error busy, try again\n" :
+                                                                               "error no samples yet\n");
+        return;
+    }
+    query_time(client, server->chunk[0].time[count - 1]);
+    query_value(client, server->chunk[0].value[count - 1]);
+    if (dual) query_value(client, server->chunk[1].value[count - 1]);
+    net_buffer_append(&client->out, "\n", 1);
+}
+
+static void query_stats(query_client_t *client, data_source_t *source) {
+    datasource_stats_t stats;
+    datasource_t *datasource = data_source_opened(source);
+    int ok = 0;
+
+    /* Like the plots: sources that sample nothing get stats published */
+    if (source->shared && !datasource) {
+        ok = shared_read_stats(source->shared, &stats);
+    } else if (datasource && datasource->handler->get_stats) {
+        ok = datasource->handler->get_stats(datasource->context, &stats) == 1;
+    }
+    if (!ok) {
+        net_buffer_printf(&client->out, "error no stats\n");
+        return;
+    }
+    net_buffer_printf(&client->out, "%.10g %.10g %.10g %.10g", stats.min, stats.max, stats.avg, stats.last);
+    if (source->is_dual) {
+        net_buffer_printf(&client->out, " %.10g %.10g %.10g %.10g", stats.min_secondary, stats.max_secondary,
+                          stats.avg_secondary, stats.last_secondary);
+    }
+    net_buffer_append(&client->out, "\n", 1);
+}
+
+static void query_history(query_server_t *server, query_client_t *client, data_source_t *source, double seconds) {
+    uint64_t now = platform_get_monotonic_us(), cutoff, samples, from, first, written;
+    int32_t interval_ms = source->column_interval_ms > 0 ? source->column_interval_ms : 1;
+    uint32_t count, i;
+    int dual;
+
+    cutoff = seconds * 1e6 < (double)now ? now - (uint64_t)(seconds * 1e6) : 0;
+
+    /* Columns are at least an interval apart, so this reaches far enough */
+    samples = seconds * 1000.0 / interval_ms + 2 < QUERY_HISTORY_MAX ?
+              (uint64_t)(seconds * 1000.0 / interval_ms) + 2 : QUERY_HISTORY_MAX;
+    from = query_newest(source->data_buffer, samples);
+
+    do {
+        count = query_read(server, source, from, &first, &written, &dual);
+        if (count == 0 && query_newest(source->data_buffer, 0) > from) {
+            /* Pushes kept getting in the way of the read */
+            net_buffer_printf(&client->out, "error busy, try again\n");
+            return;
+        }
+        for (i = 0; i < count; i++) {
+            if (server->chunk[0].time[i] < cutoff) continue;
+            query_time(client, server->chunk[0].time[i]);
+            query_value(client, server->chunk[0].value[i]);
+            query_value(client, server->chunk[0].min[i]);
+            query_value(client, server->chunk[0].max[i]);
+            if (dual) {
+                query_value(client, server->chunk[1].value[i]);
+                query_value(client, server->chunk[1].min[i]);
+                query_value(client, server->chunk[1].max[i]);
+            }
+            net_buffer_append(&client->out, "\n", 1);
+        }
+        from = first + count;
+    } while (count == QUERY_CHUNK && from < written);
+}
+
+static void query_subscribe(query_server_t *server, query_client_t *client, int32_t plot) {
+    uint32_t i;
+
+    client->next = calloc(server->plot_count + 1, sizeof(uint64_t));
+    if (!client->next) {
+        net_buffer_printf(&client->out, "error out of memory\n\n");
+        return;
+    }
+    for (i = 0; i < server->plot_count; i++) {
+        data_source_t *source = query_source(server, (int32_t)i);
+        if (source) client->next[i] = query_newest(source->data_buffer, 0);
+    }
+    client->subscribed = 1;
+    client->subscribe_plot = plot;
+}
+
+static void query_command(query_server_t *server, query_client_t *client, char *line) {
+    char *command = line, *argument, *end;
+    data_source_t *source = NULL;
+    double seconds = 0.0;
+    int32_t plot = -1;
+
+    argument = strchr(line, ' ');
+    if (argument) {
+        *argument++ = '\0';
+        while (*argument == ' ') argument++;
+    } else {
+        argument = line + strlen(line);
+    }
+
+    if (strcmp(command, "history") == 0) {
+        seconds = strtod(argument, &end);
+        argument = end;
+        while (*argument == ' ') argument++;
+    }
+    if (*argument) {
+        plot = query_find(server, argument);
+        source = query_source(server, plot);
+    }
+
+    if (strcmp(command, "list") == 0) {
+        query_list(server, client);
+    } else if (strcmp(command, "history") == 0 && seconds <= 0.0) {
+        net_buffer_printf(&client->out, "error history wants seconds, then the plot\n");
+    } else if (strcmp(command, "subscribe") == 0 && (!*argument || source)) {
+        query_subscribe(server, client, *argument ? plot : -1);
+        return;
+    } else if (strcmp(command, "last") != 0 && strcmp(command, "stats") != 0 &&
+               strcmp(command, "history") != 0) {
+        net_buffer_printf(&client->out, "error unknown command, try list, last, stats, history or subscribe\n");
+    } else if (!source) {
+        net_buffer_printf(&client->out, "error no plot %s\n", argument);
+    } else if (strcmp(command, "last") == 0) {
+        query_last(server, client, source);
+    } else if (strcmp(command, "stats") == 0) {
+        query_stats(client, source);
+    } else {
+        query_history(server, client, source, seconds);
+    }
+    net_buffer_append(&client->out, "\n", 1);
+}
+
+/* Every sample since the last tick, a line each */
+static void query_publish(query_server_t *server) {
+    uint64_t first, written;
+    uint32_t i, count, n;
+    int c, dual;
+
+    for (i = 0; i < server->plot_count; i++) {
+        data_source_t *source = query_source(server, (int32_t)i);
+        if (!source) continue;
+
+        for (c = 0; c < QUERY_MAX_CLIENTS; c++) {
+            query_client_t *client = &server->clients[c];
+            if (!client->subscribed) continue;
+            if (client->subscribe_plot >= 0 && client->subscribe_plot != (int32_t)i) continue;
+
+            do {
+                count = query_read(server, source, client->next[i], &first, &written, &dual);
+                for (n = 0; n < count; n++) {
+                    net_buffer_printf(&client->out, "%u ", i);
+                    query_time(client, server->chunk[0].time[n]);
+                    query_value(client, server->chunk[0].value[n]);
+                    if (dual) query_value(client, server->chunk[1].value[n]);
+                    net_buffer_append(&client->out, "\n", 1);
+                }
+                if (count) client->next[i] = first + count;
+            } while (count == QUERY_CHUNK);
+        }
+    }
+
+    for (c = 0; c < QUERY_MAX_CLIENTS; c++) {
+        query_client_t *client = &server->clients[c];
+        if (client->subscribed && client->out.size - client->out.sent > QUERY_BACKLOG) {
+            query_client_close(client);
+        }
+    }
+}
+
+static void query_client_read(query_server_t *server, query_client_t *client) {
+    ssize_t n;
+    char *newline;
+
+    n = recv(client->fd, client->in + client->in_size, QUERY_LINE_MAX - client->in_size, 0);
+    if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+        query_client_close(client);
+        return;
+    }
+    if (n < 0 || client->subscribed) return;
+    client->in_size += n;
+
+    if (client->discarding) {
+        newline = memchr(client->in, '\n', client->in_size);
+        if (!newline) {
+            client->in_size = 0;
+            return;
+        }
+        client->in_size -= newline + 1 - client->in;
+        memmove(client->in, newline + 1, client->in_size);
+        client->discarding = 0;
+    }
+
+    while ((newline = memchr(client->in, '\n', client->in_size))) {
+        size_t length = newline - client->in;
+        *newline = '\0';
+        if (length > 0 && client->in[length - 1] == '\r') client->in[length - 1] = '\0';
+        query_command(server, client, client->in);
+        memmove(client->in, newline + 1, client->in_size - length - 1);
+        client->in_size -= length + 1;
+        if (client->subscribed) {
+            client->in_size = 0;
+            return;
+        }
+    }
+    if (client->in_size == QUERY_LINE_MAX) {
+        net_buffer_printf(&client->out, "error line too long\n\n");
+        client->in_size = 0;
+        client->discarding = 1;
+    }
+}
+
+static void query_client_write(query_client_t *client) {
+    if (net_buffer_send(client->fd, &client->out) < 0) query_client_close(client);
+}
+
+static void query_accept(query_server_t *server) {
+    int fd, i;
+
+    while ((fd = net_accept(server->listen_fd)) >= 0) {
+        for (i = 0; i < QUERY_MAX_CLIENTS; i++) {
+            if (server->clients[i].fd < 0) break;
+        }
+        if (i == QUERY_MAX_CLIENTS) {
+            close(fd);
+            continue;
+        }
+
+        memset(&server->clients[i], 0, sizeof(query_client_t));
+        server->clients[i].fd = fd;
+    }
+}
+
+static void query_server_thread(void *arg) {
+    query_server_t *server = (query_server_t *)arg;
+    struct pollfd fds[QUERY_MAX_CLIENTS + 1];
+    int slot[QUERY_MAX_CLIENTS + 1];
+
+    while (server->running) {
+        int nfds = 1, i;
+        uint32_t now;
+
+        fds[0].fd = server->listen_fd;
+        fds[0].events = POLLIN;
+        fds[0].revents = 0;
+
+        for (i = 0; i < QUERY_MAX_CLIENTS; i++) {
+            query_client_t *client = &server->clients[i];
+            if (client->fd < 0) continue;
+
+            fds[nfds].fd = client->fd;
+            fds[nfds].events = POLLIN | (client->out.sent < client->out.size ? POLLOUT : 0);
+            fds[nfds].revents = 0;
+            slot[nfds] = i;
+            nfds++;
+        }
+
+        if (poll(fds, nfds, QUERY_TICK_MS) < 0 && errno != EINTR) break;
+
+        if (fds[0].revents & POLLIN) query_accept(server);
+
+        for (i = 1; i < nfds; i++) {
+            query_client_t *client = &server->clients[slot[i]];
+            if (client->fd != fds[i].fd) continue;
+
+            if (fds[i].revents & (POLLERR | POLLNVAL)) {
+                query_client_close(client);
+                continue;
+            }
+            if (fds[i].revents & (POLLIN | POLLHUP)) query_client_read(server, client);
+        }
+
+        now = platform_get_time_ms();
+        if (now - server->last_tick_ms >= QUERY_TICK_MS) {
+            server->last_tick_ms = now;
+            query_publish(server);
+        }
+
+        for (i = 0; i < QUERY_MAX_CLIENTS; i++) {
+            query_client_t *client = &server->clients[i];
+            if (client->fd >= 0 && client->out.sent < client->out.size) query_client_write(client);
+        }
+    }
+}
+
+static int query_listen(const char *path) {
+    struct sockaddr_un address;
+    int fd;
+
+    if (strlen(path) >= sizeof(address.sun_path)) return -1;
+
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+
+    /* A socket left over from a crash is in the way */
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, path);
+    unlink(path);
+    if (bind(fd, (struct sockaddr *)&address, sizeof(address)) < 0 || listen(fd, 16) < 0) {
+        close(fd);
+        return -1;
+    }
+
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+    return fd;
+}
+
+query_server_t *query_server_create(data_collector_t *collector, config_t *config) {
+    query_server_t *server;
+    int i;
+
+    if (!collector || !config || !config->query_socket) return NULL;
+
+    server = calloc(1, sizeof(query_server_t));
+    if (!server) return NULL;
+
+    server->collector = collector;
+    server->config = config;
+    server->plot_count = collector->source_count < config->plot_count ? collector->source_count : config->plot_count;
+    for (i = 0; i < QUERY_MAX_CLIENTS; i++) {
+        server->clients[i].fd = -1;
+    }
+
+    server->path = malloc(strlen(config->query_socket) + 1);
+    server->chunk = calloc(2, sizeof(query_chunk_t));
+    server->listen_fd = server->path ? query_listen(config->query_socket) : -1;
+    if (server->listen_fd < 0) {
+        fprintf(stderr, "Query: cannot listen on %s: %s\n", config->query_socket, strerror(errno));
+    }
+
+    if (server->listen_fd < 0 || !server->chunk) {
+        if (server->listen_fd >= 0) close(server->listen_fd);
+        free(server->path);
+        free(server->chunk);
+        free(server);
+        return NULL;
+    }
+    strcpy(server->path, config->query_socket);
+
+    net_ignore_sigpipe();
+
+    server->last_tick_ms = platform_get_time_ms();
+    server->running = 1;
+    server->thread = plot_thread_create(query_server_thread, server);
+    if (!server->thread) {
+        server->running = 0;
+        query_server_destroy(server);
+        return NULL;
+    }
+
+    return server;
+}
+
+void query_server_destroy(query_server_t *server) {
+    int i;
+
+    if (!server) return;
+
+    if (server->thread) {
+        server->running = 0;
+        plot_thread_join(server->thread);
+        plot_thread_destroy(server->thread);
+    }
+
+    for (i = 0; i < QUERY_MAX_CLIENTS; i++) {
+        if (server->clients[i].fd >= 0) query_client_close(&server->clients[i]);
+    }
+
+    close(server->listen_fd);
+    unlink(server->path);
+    free(server->path);
+    free(server->chunk);
+    free(server);
+}
@@ -0,0 +1,24 @@
+#ifndef QUERY_H
+#define QUERY_H
+
+#include "compat.h"
+#include "config.h"
+#include "threading.h"
+
+/* Local queries over a UNIX socket (query_socket= in [global]), eg. from
+ * scripts with socat. One command per line, every answer ends with an
+ * empty line, PLOT is an index, a title or a type:
+ *   list                    index, type, target and title of every plot
+ *   last PLOT               time value [secondary]
+ *   stats PLOT              min max avg last [of the secondary too]
+ *   history SECONDS PLOT    time value min max [secondary ...], oldest first
+ *   subscribe [PLOT]        then index time value [secondary] per new sample
+ * Times are Unix seconds, failed samples are nan. One thread polls every
+ * connection and reads the ring buffers without their write lock. */
+
+typedef struct query_server query_server_t;
+
+query_server_t *query_server_create(data_collector_t *collector, config_t *config);
+void query_server_destroy(query_server_t *server);
+
+#endif
@@ -0,0 +1,487 @@
+#include "compat.h"
+#include "record.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#define RECORD_MAGIC "PLOTREC"
+#define RECORD_VERSION 1
+#define RECORD_SCALE 1000.0         /* values kept in 1/1000 */
+#define RECORD_FLUSH_MS 1000
+#define RECORD_STRING_MAX 4096
+#define RECORD_SLEEP_MAX_US 100000  /* stay responsive to replay_destroy */
+
+#define RECORD_VALUE 0
+#define RECORD_ERROR 1
+#define RECORD_GAP 2
+#define RECORD_ENVELOPE 3
+
+struct recorder {
+    FILE *file;
+    mutex_t *mutex;
+    uint32_t stream_count;
+    ringbuf_t **rings;
+    int32_t *interval_ms;
+    int64_t *time_ms;       /* last sample of each stream */
+    int64_t *value;
+    uint32_t flushed_ms;
+};
+
+typedef struct {
+    datasource_stats_t stats;
+    double sum[2];
+    uint64_t count[2];
+} replay_totals_t;
+
+struct replay {
+    FILE *file;
+    data_collector_t *collector;
+    double speed;           /* 0 replays as fast as it decodes */
+    plot_thread_t *thread;
+    volatile int running;
+    volatile int done;
+
+    uint32_t stream_count;
+    data_source_t **sources;    /* NULL for streams the config lacks */
+    uint32_t *plot;
+    uint8_t *series;
+    int32_t *interval_ms;
+    int64_t *time_ms;
+    int64_t *value;
+
+    /* Stats as the datasources would have kept them, per plot */
+    shared_plot_t *shared;
+    replay_totals_t *totals;
+};
+
+static void record_put_varint(FILE *file, uint64_t value) {
+    while (value >= 0x80) {
+        putc((int)(value & 0x7f) | 0x80, file);
+        value >>= 7;
+    }
+    putc((int)value, file);
+}
+
+static int record_get_varint(FILE *file, uint64_t *value) {
+    int shift, c;
+
+    *value = 0;
+    for (shift = 0; shift < 64; shift += 7) {
+        c = getc(file);
+        if (c == EOF) return 0;
+        *value |= (uint64_t)(c & 0x7f) << shift;
+        if (!(c & 0x80)) return 1;
+    }
+    return 0;
+}
+
+static void record_put_string(FILE *file, const char *string) {
+    size_t length = strlen(string);
+    record_put_varint(file, length);
+    fwrite(string, 1, length, file);
+}
+
+static char *record_get_string(FILE *file) {
+    uint64_t length;
+    char *string;
+
+    if (!record_get_varint(file, &length) || length > RECORD_STRING_MAX) return NULL;
+    string = malloc(length + 1);
+    if (!string) return NULL;
+    if (fread(string, 1, length, file) != length) {
+        free(string);
+        return NULL;
+    }
+    string[length] = '\0';
+    return string;
+}
+
+static uint64_t record_zigzag(int64_t value) {
+    return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+}
+
+static int64_t record_unzigzag(uint64_t value) {
+    return (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+}
+
+static int64_t record_quantize(double value) {
+    if (value > 9e15) value = 9e15;
+    if (value < -9e15) value = -9e15;
+    return value < 0.0 ? -(int64_t)(-value * RECORD_SCALE + 0.5) :
+                         (int64_t)(value * RECORD_SCALE + 0.5);
+}
+
+/* Heatmap rows are not a stream of values, their footer ring is skipped */
+static int record_source_streams(data_source_t *source) {
+    if (!source->data_buffer || source->heatmap || strcmp(source->type, "heatmap") == 0) return 0;
+    return source->data_buffer_secondary ? 2 : 1;
+}
+
+static void recorder_tap(void *arg, uint32_t stream, uint64_t time, double value, double min, double max) {
+    recorder_t *recorder = (recorder_t *)arg;
+    int64_t time_ms = (int64_t)(time / 1000);
+    int64_t quantized;
+    uint32_t kind, now;
+    FILE *file = recorder->file;
+
+    if (value == RINGBUF_MISSING) {
+        kind = RECORD_GAP;
+    } else if (!(value >= 0.0)) {
+        kind = RECORD_ERROR;
+    } else if (min != value || max != value) {
+        kind = RECORD_ENVELOPE;
+    } else {
+        kind = RECORD_VALUE;
+    }
+
+    mutex_lock(recorder->mutex);
+
+    record_put_varint(file, (uint64_t)stream << 2 | kind);
+    record_put_varint(file, record_zigzag(time_ms - recorder->time_ms[stream] - recorder->interval_ms[stream]));
+    recorder->time_ms[stream] = time_ms;
+
+    if (kind == RECORD_VALUE || kind == RECORD_ENVELOPE) {
+        quantized = record_quantize(value);
+        record_put_varint(file, record_zigzag(quantized - recorder->value[stream]));
+        recorder->value[stream] = quantized;
+        if (kind == RECORD_ENVELOPE) {
+            record_put_varint(file, record_zigzag(quantized - record_quantize(min)));
+            record_put_varint(file, record_zigzag(record_quantize(max) - quantized));
+        }
+    }
+
+    now = platform_get_time_ms();
+    if (now - recorder->flushed_ms >= RECORD_FLUSH_MS) {
+        fflush(file);
+        recorder->flushed_ms = now;
+    }
+
+    mutex_unlock(recorder->mutex);
+}
+
+static void recorder_free(recorder_t *recorder) {
+    if (recorder->file) fclose(recorder->file);
+    if (recorder->mutex) mutex_destroy(recorder->mutex);
+    free(recorder->rings);
+    free(recorder->interval_ms);
+    free(recorder->time_ms);
+    free(recorder->value);
+    free(recorder);
+}
+
+/* Taps the rings before the collector starts, samples restored from
+ * history files are not part of the recording */
+recorder_t *recorder_create(const char *path, data_collector_t *collector) {
+    recorder_t *recorder;
+    data_source_t *source;
+    uint32_t i, series, stream = 0;
+
+    if (!path || !collector) return NULL;
+
+    recorder = calloc(1, sizeof(recorder_t));
+    if (!recorder) return NULL;
+
+    for (i = 0; i < collector->source_count; i++) {
+        recorder->stream_count += record_source_streams(collector->sources[i]);
+    }
+
+    recorder->rings = calloc(recorder->stream_count + 1, sizeof(ringbuf_t *));
+    recorder->interval_ms = calloc(recorder->stream_count + 1, sizeof(int32_t));
+    recorder->time_ms = calloc(recorder->stream_count + 1, sizeof(int64_t));
+    recorder->value = calloc(recorder->stream_count + 1, sizeof(int64_t));
+    recorder->mutex = mutex_create();
+    if (!recorder->rings || !recorder->interval_ms || !recorder->time_ms ||
+        !recorder->value || !recorder->mutex) {
+        recorder_free(recorder);
+        return NULL;
+    }
+
+    recorder->file = fopen(path, "wb");
+    if (!recorder->file) {
+        fprintf(stderr, "Cannot create recording %s: %s\n", path, strerror(errno));
+        recorder_free(recorder);
+        return NULL;
+    }
+
+    fwrite(RECORD_MAGIC, 1, sizeof(RECORD_MAGIC), recorder->file);
+    record_put_varint(recorder->file, RECORD_VERSION);
+    record_put_varint(recorder->file, recorder->stream_count);
+
+    for (i = 0; i < collector->source_count; i++) {
+        source = collector->sources[i];
+        for (series = 0; series < (uint32_t)record_source_streams(source); series++) {
+            recorder->rings[stream] = series ? source->data_buffer_secondary : source->data_buffer;
+            recorder->interval_ms[stream] = source->column_interval_ms;
+            record_put_varint(recorder->file, i);
+            record_put_varint(recorder->file, series);
+            record_put_varint(recorder->file, (uint64_t)source->column_interval_ms);
+            record_put_string(recorder->file, source->type);
+            record_put_string(recorder->file, source->target);
+            stream++;
+        }
+    }
+    fflush(recorder->file);
+    recorder->flushed_ms = platform_get_time_ms();
+
+    for (stream = 0; stream < recorder->stream_count; stream++) {
+        ringbuf_add_tap(recorder->rings[stream], recorder_tap, recorder, stream);
+    }
+
+    return recorder;
+}
+
+void recorder_destroy(recorder_t *recorder) {
+    uint32_t stream;
+
+    if (!recorder) return;
+
+    for (stream = 0; stream < recorder->stream_count; stream++) {
+        ringbuf_remove_tap(recorder->rings[stream], recorder_tap, recorder);
+    }
+    mutex_lock(recorder->mutex);
+    fflush(recorder->file);
+    mutex_unlock(recorder->mutex);
+    recorder_free(recorder);
+}
+
+static void replay_free(replay_t *replay) {
+    if (replay->file) fclose(replay->file);
+    free(replay->sources);
+    free(replay->plot);
+    free(replay->series);
+    free(replay->interval_ms);
+    free(replay->time_ms);
+    free(replay->value);
+    free(replay->shared);
+    free(replay->totals);
+    free(replay);
+}
+
+/* Streams are matched to the config by plot, series, type and target, a
+ * config edited since the recording just loses the plots that moved */
+static int replay_read_streams(replay_t *replay, const char *path) {
+    data_collector_t *collector = replay->collector;
+    data_source_t *source;
+    uint64_t plot, series, interval_ms;
+    char *type, *target;
+    uint32_t stream;
+
+    for (stream = 0; stream < replay->stream_count; stream++) {
+        if (!record_get_varint(replay->file, &plot) ||
+            !record_get_varint(replay->file, &series) ||
+            !record_get_varint(replay->file, &interval_ms)) {
+            return 0;
+        }
+        type = record_get_string(replay->file);
+        target = record_get_string(replay->file);
+        if (!type || !target) {
+            free(type);
+            free(target);
+            return 0;
+        }
+
+        replay->interval_ms[stream] = (int32_t)interval_ms;
+        replay->series[stream] = series ? 1 : 0;
+
+        source = plot < collector->source_count ? collector->sources[plot] : NULL;
+        if (source && strcmp(source->type, type) == 0 && strcmp(source->target, target) == 0 &&
+            (series ? source->data_buffer_secondary : source->data_buffer)) {
+            replay->sources[stream] = source;
+            replay->plot[stream] = (uint32_t)plot;
+            if (!series) source->column_interval_ms = (int32_t)interval_ms;
+            if (!source->shared) source->shared = &replay->shared[plot];
+        } else {
+            fprintf(stderr, "%s: no plot %s:%s at %llu in the config, skipping it\n",
+                    path, type, target, (unsigned long long)plot);
+        }
+
+        free(type);
+        free(target);
+    }
+    return 1;
+}
+
+replay_t *replay_create(const char *path, data_collector_t *collector, double speed) {
+    replay_t *replay;
+    char magic[sizeof(RECORD_MAGIC)];
+    uint64_t version, stream_count;
+
+    if (!path || !collector) return NULL;
+
+    replay = calloc(1, sizeof(replay_t));
+    if (!replay) return NULL;
+    replay->collector = collector;
+    replay->speed = speed;
+
+    replay->file = fopen(path, "rb");
+    if (!replay->file) {
+        fprintf(stderr, "Cannot open recording %s: %s\n", path, strerror(errno));
+        replay_free(replay);
+        return NULL;
+    }
+
+    if (fread(magic, 1, sizeof(magic), replay->file) != sizeof(magic) ||
+        memcmp(magic, RECORD_MAGIC, sizeof(magic)) != 0 ||
+        !record_get_varint(replay->file, &version) || version != RECORD_VERSION ||
+        !record_get_varint(replay->file, &stream_count) || stream_count > 65536) {
+        fprintf(stderr, "%s is not a plottool recording\n", path);
+        replay_free(replay);
+        return NULL;
+    }
+    replay->stream_count = (uint32_t)stream_count;
+
+    replay->sources = calloc(stream_count + 1, sizeof(data_source_t *));
+    replay->plot = calloc(stream_count + 1, sizeof(uint32_t));
+    replay->series = calloc(stream_count + 1, sizeof(uint8_t));
+    replay->interval_ms = calloc(stream_count + 1, sizeof(int32_t));
+    replay->time_ms = calloc(stream_count + 1, sizeof(int64_t));
+    replay->value = calloc(stream_count + 1, sizeof(int64_t));
+    replay->shared = calloc(collector->source_count + 1, sizeof(shared_plot_t));
+    replay->totals = calloc(collector->source_count + 1, sizeof(replay_totals_t));
+    if (!replay->sources || !replay->plot || !replay->series || !replay->interval_ms ||
+        !replay->time_ms || !replay->value || !replay->shared || !replay->totals) {
+        replay_free(replay);
+        return NULL;
+    }
+
+    if (!replay_read_streams(replay, path)) {
+        fprintf(stderr, "%s: damaged stream table\n", path);
+        replay_free(replay);
+        return NULL;
+    }
+
+    return replay;
+}
+
+static void replay_stats_add(replay_t *replay, uint32_t stream, double value) {
+    replay_totals_t *totals = &replay->totals[replay->plot[stream]];
+    datasource_stats_t *stats = &totals->stats;
+    int series = replay->series[stream];
+
+    if (value < 0.0) return;
+
+    totals->sum[series] += value;
+    totals->count[series]++;
+    if (series) {
+        if (totals->count[1] == 1 || value < stats->min_secondary) stats->min_secondary = value;
+        if (totals->count[1] == 1 || value > stats->max_secondary) stats->max_secondary = value;
+        stats->avg_secondary = totals->sum[1] / totals->count[1];
+        stats->last_secondary = value;
+    } else {
+        if (totals->count[0] == 1 || value < stats->min) stats->min = value;
+        if (totals->count[0] == 1 || value > stats->max) stats->max = value;
+        stats->avg = totals->sum[0] / totals->count[0];
+        stats->last = value;
+    }
+    shared_publish_stats(replay->sources[stream]->shared, stats);
+}
+
+static void replay_push(replay_t *replay, uint32_t stream, uint64_t time_us,
+                        double value, double min, double max) {
+    data_source_t *source = replay->sources[stream];
+
+    if (!source) return;
+
+    if (replay->series[stream]) {
+        ringbuf_push_at(source->data_buffer_secondary, time_us, value, min, max);
+        history_push(source->history_secondary, value);
+    } else {
+        ringbuf_push_at(source->data_buffer, time_us, value, min, max);
+        history_push(source->history, value);
+    }
+    replay_stats_add(replay, stream, value);
+}
+
+/* Keeps the recorded spacing divided by speed, against the clock rather
+ * than per sample so rounding does not add up */
+static void replay_pace(replay_t *replay, uint64_t start_us, int64_t elapsed_ms) {
+    uint64_t due, now;
+
+    if (replay->speed <= 0.0 || elapsed_ms <= 0) return;
+
+    due = start_us + (uint64_t)(elapsed_ms * 1000.0 / replay->speed);
+    now = platform_get_monotonic_us();
+    while (replay->running && due > now + 1000) {
+        platform_sleep_us(due - now < RECORD_SLEEP_MAX_US ? due - now : RECORD_SLEEP_MAX_US);
+        now = platform_get_monotonic_us();
+    }
+}
+
+static void replay_thread(void *arg) {
+    replay_t *replay = (replay_t *)arg;
+    uint64_t start_us = platform_get_monotonic_us();
+    uint64_t head, delta, below, above, samples = 0;
+    int64_t first_ms = 0, time_ms, quantized;
+    uint32_t stream, kind;
+    double value, min, max;
+    int started = 0;
+
+    while (replay->running && record_get_varint(replay->file, &head)) {
+        stream = (uint32_t)(head >> 2);
+        kind = (uint32_t)(head & 3);
+        if (stream >= replay->stream_count || !record_get_varint(replay->file, &delta)) break;
+
+        time_ms = replay->time_ms[stream] + record_unzigzag(delta) + replay->interval_ms[stream];
+        replay->time_ms[stream] = time_ms;
+
+        if (kind == RECORD_VALUE || kind == RECORD_ENVELOPE) {
+            if (!record_get_varint(replay->file, &delta)) break;
+            quantized = replay->value[stream] + record_unzigzag(delta);
+            replay->value[stream] = quantized;
+            value = min = max = quantized / RECORD_SCALE;
+            if (kind == RECORD_ENVELOPE) {
+                if (!record_get_varint(replay->file, &below) ||
+                    !record_get_varint(replay->file, &above)) break;
+                min = (quantized - record_unzigzag(below)) / RECORD_SCALE;
+                max = (quantized + record_unzigzag(above)) / RECORD_SCALE;
+            }
+        } else {
+            value = min = max = kind == RECORD_GAP ? RINGBUF_MISSING : -1.0;
+        }
+
+        /* The recording's first sample lands at the start of the replay */
+        if (!started) {
+            first_ms = time_ms;
+            started = 1;
+        }
+        replay_pace(replay, start_us, time_ms - first_ms);
+        if (time_ms < first_ms) time_ms = first_ms;
+
+        /* Recorded spacing is kept, the plots scroll speed times faster */
+        replay_push(replay, stream, start_us + (uint64_t)(time_ms - first_ms) * 1000,
+                    value, min, max);
+        samples++;
+    }
+
+    fprintf(stderr, "Replay: %llu samples in %.1f s\n", (unsigned long long)samples,
+            (platform_get_monotonic_us() - start_us) / 1000000.0);
+    replay->done = 1;
+}
+
+int replay_start(replay_t *replay) {
+    if (!replay) return 0;
+
+    replay->running = 1;
+    replay->thread = plot_thread_create(replay_thread, replay);
+    if (!replay->thread) {
+        replay->running = 0;
+        return 0;
+    }
+    return 1;
+}
+
+int replay_done(replay_t *replay) {
+    return replay && replay->done;
+}
+
+void replay_destroy(replay_t *replay) {
+    if (!replay) return;
+
+    if (replay->thread) {
+        replay->running = 0;
+        plot_thread_join(replay->thread);
+        plot_thread_destroy(replay->thread);
+    }
+    replay_free(replay);
+}
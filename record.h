@@ -0,0 +1,31 @@
+#ifndef RECORD_H
+#define RECORD_H
+
+#include "compat.h"
+#include "threading.h"
+
+/* --record logs every sample pushed into the plots' ring buffers, --replay
+ * feeds a log back into the same buffers instead of live datasources, as
+ * fast as --speed asks, while the dashboard renders as usual.
+ *
+ *   "PLOTREC" version stream_count
+ *   per stream  plot series interval_ms type_length type target_length target
+ *   per sample  stream << 2 | kind, zigzag(dt_ms - interval_ms), then for
+ *               a value the zigzag delta in 1/1000, for a value with an
+ *               envelope also zigzag(value - min) and zigzag(max - value)
+ *
+ * Kinds are value, error, gap and value with envelope. Numbers are LEB128
+ * varints, times and deltas carry over between samples of a stream. */
+
+typedef struct recorder recorder_t;
+typedef struct replay replay_t;
+
+recorder_t *recorder_create(const char *path, data_collector_t *collector);
+void recorder_destroy(recorder_t *recorder);
+
+replay_t *replay_create(const char *path, data_collector_t *collector, double speed);
+int replay_start(replay_t *replay);
+int replay_done(replay_t *replay);
+void replay_destroy(replay_t *replay);
+
+#endif
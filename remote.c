@@ -0,0 +1,951 @@
+#define _GNU_SOURCE
+#include "compat.h"
+#include "remote.h"
+#include "net.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <poll.h>
+#include <netdb.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+
+#define REMOTE_VERSION 1
+#define REMOTE_MAX_PEERS 64
+#define REMOTE_BATCH 1024               /* samples per frame at most */
+#define REMOTE_BACKLOG (256 * 1024)     /* stop reading a ring this far ahead of the socket */
+#define REMOTE_HELLO_MAX 512
+#define REMOTE_IN_MAX (64 * 1024)
+#define REMOTE_KEEPALIVE_MS 5000
+#define REMOTE_TIMEOUT_MS 15000
+#define REMOTE_CONNECT_TIMEOUT_MS 5000
+#define REMOTE_RETRY_MS 1000
+#define REMOTE_RETRY_MAX_MS 30000
+#define REMOTE_SCALE 1000.0             /* values travel in 1/1000 */
+
+#define REMOTE_FRAME_SAMPLES 1
+#define REMOTE_FRAME_STATS 2
+
+#define REMOTE_STATUS_OK 0
+#define REMOTE_STATUS_UNKNOWN 1
+
+typedef struct {
+    uint8_t *data;
+    size_t size;
+    size_t capacity;
+} remote_buffer_t;
+
+/* Reads past the end clear ok, the message is then incomplete */
+typedef struct {
+    const uint8_t *at;
+    const uint8_t *end;
+    int ok;
+} remote_reader_t;
+
+struct remote_client {
+    data_source_t *source;
+    char host[256];
+    char port[16];
+    char plot[256];
+    shared_plot_t stats;    /* unless a --daemon publishes them for viewers */
+    uint8_t *in;
+
+    /* Where to pick up after a reconnect */
+    uint64_t session;       /* of the agent, a new one means it restarted */
+    uint64_t next;          /* agent sample number to ask for */
+    uint64_t last_time_us;  /* newest sample pushed, local clock */
+    int reported;
+};
+
+/* Decoder state of one connection */
+typedef struct {
+    int hello;
+    int is_dual;
+    int32_t interval_ms;
+    int64_t offset_us;
+    int64_t time_ms;
+    int64_t value[2];
+} remote_stream_t;
+
+typedef struct {
+    int fd;                 /* -1 when free */
+    data_source_t *source;  /* NULL until the hello is answered */
+    int closing;            /* once the output is sent */
+    uint32_t last_activity_ms;
+    uint8_t in[REMOTE_HELLO_MAX];
+    size_t in_size;
+    remote_buffer_t out;
+    size_t out_sent;
+
+    /* Encoder state */
+    uint64_t next;
+    int64_t time_ms;
+    int64_t value[2];
+    uint32_t last_stats_ms;
+} remote_peer_t;
+
+struct remote_agent {
+    int listen_fd;
+    data_collector_t *collector;
+    config_t *config;
+    plot_thread_t *thread;
+    volatile int running;
+    uint64_t session;
+    uint32_t last_tick_ms;
+    remote_peer_t peers[REMOTE_MAX_PEERS];
+
+    /* Agent thread only */
+    remote_buffer_t frame;
+    double values[2][REMOTE_BATCH];
+    double min[REMOTE_BATCH];
+    double max[REMOTE_BATCH];
+    uint64_t times[REMOTE_BATCH];
+};
+
+static int remote_put(remote_buffer_t *buffer, const void *data, size_t size) {
+    if (buffer->size + size > buffer->capacity) {
+        size_t capacity = buffer->capacity ? buffer->capacity : 1024;
+        uint8_t *grown;
+        while (capacity < buffer->size + size) capacity *= 2;
+        grown = realloc(buffer->data, capacity);
+        if (!grown) return 0;
+        buffer->data = grown;
+        buffer->capacity = capacity;
+    }
+    memcpy(buffer->data + buffer->size, data, size);
+    buffer->size += size;
+    return 1;
+}
+
+static int remote_put_byte(remote_buffer_t *buffer, uint8_t value) {
+    return remote_put(buffer, &value, 1);
+}
+
+static int remote_put_varint(remote_buffer_t *buffer, uint64_t value) {
+    uint8_t bytes[10];
+    size_t n = 0;
+
+    while (value >= 0x80) {
+        bytes[n++] = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    bytes[n++] = (uint8_t)value;
+    return remote_put(buffer, bytes, n);
+}
+
+static int remote_put_u64(remote_buffer_t *buffer, uint64_t value) {
+    uint8_t bytes[8];
+    int i;
+
+    for (i = 0; i < 8; i++) {
+        bytes[i] = (uint8_t)(value >> (8 * i));
+    }
+    return remote_put(buffer, bytes, 8);
+}
+
+static int remote_put_double(remote_buffer_t *buffer, double value) {
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return remote_put_u64(buffer, bits);
+}
+
+static uint8_t remote_get_byte(remote_reader_t *reader) {
+    if (reader->at >= reader->end) {
+        reader->ok = 0;
+        return 0;
+    }
+    return *reader->at++;
+}
+
+static void remote_get_bytes(remote_reader_t *reader, void *out, size_t size) {
+    if ((size_t)(reader->end - reader->at) < size) {
+        reader->ok = 0;
+        reader->at = reader->end;
+        return;
+    }
+    memcpy(out, reader->at, size);
+    reader->at += size;
+}
+
+static uint64_t remote_get_varint(remote_reader_t *reader) {
+    uint64_t value = 0;
+    int shift;
+
+    for (shift = 0; shift < 64; shift += 7) {
+        uint8_t byte = remote_get_byte(reader);
+        value |= (uint64_t)(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) return value;
+    }
+    reader->ok = 0;
+    return value;
+}
+
+static uint64_t remote_get_u64(remote_reader_t *reader) {
+    uint64_t value = 0;
+    int i;
+
+    for (i = 0; i < 8; i++) {
+        value |= (uint64_t)remote_get_byte(reader) << (8 * i);
+    }
+    return value;
+}
+
+static double remote_get_double(remote_reader_t *reader) {
+    uint64_t bits = remote_get_u64(reader);
+    double value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+static uint64_t remote_zigzag(int64_t value) {
+    return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+}
+
+static int64_t remote_unzigzag(uint64_t value) {
+    return (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+}
+
+static int64_t remote_quantize(double value) {
+    if (value > 9e15) value = 9e15;
+    return (int64_t)(value * REMOTE_SCALE + 0.5);
+}
+
+/* host[:port]:plot, host may be a [v6 address]. The plot is all the rest,
+ * titles like "BW - router:eth0" hold colons themselves. */
+static int remote_parse_target(const char *target, char *host, size_t host_size,
+                               char *port, size_t port_size, const char **plot) {
+    const char *end, *rest;
+    size_t length;
+
+    if (!target) return 0;
+
+    if (target[0] == '[') {
+        target++;
+        end = strchr(target, ']');
+        if (!end || end[1] != ':') return 0;
+        rest = end + 2;
+    } else {
+        end = strchr(target, ':');
+        if (!end) return 0;
+        rest = end + 1;
+    }
+    length = end - target;
+    if (length == 0 || length >= host_size) return 0;
+    memcpy(host, target, length);
+    host[length] = '\0';
+
+    snprintf(port, port_size, "%d", REMOTE_DEFAULT_PORT);
+    length = strspn(rest, "0123456789");
+    if (length > 0 && length < port_size && rest[length] == ':') {
+        memcpy(port, rest, length);
+        port[length] = '\0';
+        rest += length + 1;
+    }
+
+    if (!*rest) return 0;
+    *plot = rest;
+    return 1;
+}
+
+/* A plot named by type rather than title, bw is if_thr like in [targets] */
+static const char *remote_plot_type(const char *plot) {
+    return strcmp(plot, "bw") == 0 ? "if_thr" : plot;
+}
+
+/* Unit, scale and formatting of a remote plot come from its type when it
+ * is named by one, eg. remote=web1:cpu. A title gives plain numbers. */
+datasource_t *remote_describe(const char *target) {
+    char host[256], port[16];
+    const char *plot;
+    datasource_t *ds = NULL;
+
+    if (remote_parse_target(target, host, sizeof(host), port, sizeof(port), &plot)) {
+        ds = datasource_describe(remote_plot_type(plot), target);
+    }
+    return ds ? ds : datasource_describe("remote", target);
+}
+
+remote_client_t *remote_client_create(data_source_t *source) {
+    remote_client_t *client;
+    const char *plot;
+
+    if (!source) return NULL;
+
+    client = calloc(1, sizeof(remote_client_t));
+    if (!client) return NULL;
+
+    if (!remote_parse_target(source->target, client->host, sizeof(client->host),
+                             client->port, sizeof(client->port), &plot) ||
+        strlen(plot) >= sizeof(client->plot)) {
+        fprintf(stderr, "Bad remote target %s, expected host[:port]:plot\n", source->target);
+        free(client);
+        return NULL;
+    }
+    strcpy(client->plot, plot);
+
+    client->in = malloc(REMOTE_IN_MAX);
+    if (!client->in) {
+        free(client);
+        return NULL;
+    }
+
+    client->source = source;
+    if (!source->shared) source->shared = &client->stats;
+
+    net_ignore_sigpipe();
+    return client;
+}
+
+void remote_client_destroy(remote_client_t *client) {
+    if (!client) return;
+
+    if (client->source->shared == &client->stats) client->source->shared = NULL;
+    free(client->in);
+    free(client);
+}
+
+static int remote_connect(remote_client_t *client) {
+    struct addrinfo hints, *result, *ai;
+    int fd = -1;
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+
+    if (getaddrinfo(client->host, client->port, &hints, &result) != 0) return -1;
+
+    for (ai = result; ai; ai = ai->ai_next) {
+        struct pollfd pfd;
+        socklen_t length = sizeof(int);
+        int error = 0;
+
+        fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (fd < 0) continue;
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+
+        /* A host that is down must not hold the plot for minutes */
+        if (connect(fd, ai->ai_addr, ai->ai_addrlen) == 0) break;
+        if (errno == EINPROGRESS) {
+            pfd.fd = fd;
+            pfd.events = POLLOUT;
+            pfd.revents = 0;
+            if (poll(&pfd, 1, REMOTE_CONNECT_TIMEOUT_MS) == 1 &&
+                getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &length) == 0 && error == 0) {
+                break;
+            }
+        }
+
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(result);
+    return fd;
+}
+
+/* 1 once the agent took the hello, 0 to wait for more, -1 to hang up */
+static int remote_client_hello(remote_client_t *client, remote_stream_t *stream, remote_reader_t *reader) {
+    char magic[4];
+    uint8_t version, status;
+    uint64_t session, now_ms;
+
+    remote_get_bytes(reader, magic, sizeof(magic));
+    version = remote_get_byte(reader);
+    status = remote_get_byte(reader);
+    stream->is_dual = remote_get_byte(reader);
+    stream->interval_ms = (int32_t)remote_get_varint(reader);
+    session = remote_get_u64(reader);
+    now_ms = remote_get_varint(reader);
+    if (!reader->ok) return 0;
+
+    if (memcmp(magic, "PLTA", 4) != 0 || version != REMOTE_VERSION) return -1;
+    if (status != REMOTE_STATUS_OK) {
+        if (!client->reported) {
+            fprintf(stderr, "Remote %s:%s has no plot %s\n", client->host, client->port, client->plot);
+            client->reported = 1;
+        }
+        return -1;
+    }
+
+    client->session = session;
+    stream->offset_us = (int64_t)platform_get_monotonic_us() - (int64_t)now_ms * 1000;
+    stream->hello = 1;
+
+    /* Columns are placed by the agent's interval */
+    if (stream->interval_ms > 0) {
+        client->source->column_interval_ms = stream->interval_ms;
+        client->source->refresh_interval_ms = stream->interval_ms;
+    }
+    return 1;
+}
+
+static void remote_client_samples(remote_client_t *client, remote_stream_t *stream, remote_reader_t *reader) {
+    data_source_t *source = client->source;
+    uint64_t next = remote_get_varint(reader);
+    uint64_t count = remote_get_varint(reader), i;
+    int series = stream->is_dual ? 2 : 1, s;
+
+    for (i = 0; i < count && reader->ok; i++) {
+        uint64_t head = remote_get_varint(reader);
+        double value[2] = { -1.0, -1.0 };
+        int64_t time_us;
+
+        stream->time_ms += remote_unzigzag(head >> 2) + stream->interval_ms;
+        for (s = 0; s < series; s++) {
+            if (head & (1u << s)) continue;
+            stream->value[s] += remote_unzigzag(remote_get_varint(reader));
+            value[s] = stream->value[s] / REMOTE_SCALE;
+        }
+        if (!reader->ok) break;
+
+        /* Samples it already has, after a restart of the agent */
+        time_us = stream->time_ms * 1000 + stream->offset_us;
+        if (time_us <= (int64_t)client->last_time_us) continue;
+        client->last_time_us = (uint64_t)time_us;
+
+        ringbuf_push_at(source->data_buffer, (uint64_t)time_us, value[0], value[0], value[0]);
+        history_push(source->history, value[0]);
+        if (source->data_buffer_secondary && stream->is_dual) {
+            ringbuf_push_at(source->data_buffer_secondary, (uint64_t)time_us, value[1], value[1], value[1]);
+            history_push(source->history_secondary, value[1]);
+        }
+    }
+
+    if (reader->ok) client->next = next;
+}
+
+static void remote_client_stats(remote_client_t *client, remote_reader_t *reader) {
+    datasource_stats_t stats;
+
+    stats.min = remote_get_double(reader);
+    stats.max = remote_get_double(reader);
+    stats.avg = remote_get_double(reader);
+    stats.last = remote_get_double(reader);
+    stats.min_secondary = remote_get_double(reader);
+    stats.max_secondary = remote_get_double(reader);
+    stats.avg_secondary = remote_get_double(reader);
+    stats.last_secondary = remote_get_double(reader);
+
+    if (reader->ok) shared_publish_stats(client->source->shared, &stats);
+}
+
+/* Handles every complete message in data, returns the bytes used or -1 to
+ * hang up */
+static long remote_client_parse(remote_client_t *client, remote_stream_t *stream, const uint8_t *data, size_t size) {
+    remote_reader_t reader, frame;
+    size_t used = 0;
+
+    while (used < size) {
+        reader.at = data + used;
+        reader.end = data + size;
+        reader.ok = 1;
+
+        if (!stream->hello) {
+            int status = remote_client_hello(client, stream, &reader);
+            if (status < 0) return -1;
+            if (status == 0) break;
+        } else {
+            uint8_t kind = remote_get_byte(&reader);
+            uint64_t length = remote_get_varint(&reader);
+
+            if (!reader.ok) break;
+            if (length > REMOTE_IN_MAX - 16) return -1;
+            if ((uint64_t)(reader.end - reader.at) < length) break;
+
+            frame.at = reader.at;
+            frame.end = reader.at + length;
+            frame.ok = 1;
+            if (kind == REMOTE_FRAME_SAMPLES) {
+                remote_client_samples(client, stream, &frame);
+            } else if (kind == REMOTE_FRAME_STATS) {
+                remote_client_stats(client, &frame);
+            }
+            if (!frame.ok) return -1;
+            reader.at += length;
+        }
+        used = reader.at - data;
+    }
+
+    return (long)used;
+}
+
+static int remote_send_all(int fd, const uint8_t *data, size_t size) {
+    while (size > 0) {
+        struct pollfd pfd;
+        ssize_t n = send(fd, data, size, 0);
+
+        if (n > 0) {
+            data += n;
+            size -= n;
+            continue;
+        }
+        if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) return 0;
+
+        pfd.fd = fd;
+        pfd.events = POLLOUT;
+        pfd.revents = 0;
+        if (poll(&pfd, 1, REMOTE_TIMEOUT_MS) <= 0) return 0;
+    }
+    return 1;
+}
+
+/* One connection, until it drops or the agent goes quiet. Returns 1 if
+ * the agent took the hello. */
+static int remote_client_session(remote_client_t *client, int fd) {
+    remote_buffer_t hello;
+    remote_stream_t stream;
+    size_t size = 0;
+    uint32_t heard_ms;
+    int sent;
+
+    memset(&hello, 0, sizeof(hello));
+    memset(&stream, 0, sizeof(stream));
+
+    remote_put(&hello, "PLTR", 4);
+    remote_put_byte(&hello, REMOTE_VERSION);
+    remote_put_byte(&hello, (uint8_t)strlen(client->plot));
+    remote_put(&hello, client->plot, strlen(client->plot));
+    remote_put_u64(&hello, client->session);
+    remote_put_varint(&hello, client->next);
+    sent = hello.data && remote_send_all(fd, hello.data, hello.size);
+    free(hello.data);
+    if (!sent) return 0;
+
+    heard_ms = platform_get_time_ms();
+    while (client->source->running) {
+        struct pollfd pfd;
+        ssize_t n;
+        long used;
+
+        pfd.fd = fd;
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+        n = poll(&pfd, 1, REMOTE_TICK_MS);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) break;
+        if (n == 0) {
+            if (platform_get_time_ms() - heard_ms >= REMOTE_TIMEOUT_MS) break;
+            continue;
+        }
+
+        n = recv(fd, client->in + size, REMOTE_IN_MAX - size, 0);
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) continue;
+        if (n <= 0) break;
+        size += n;
+        heard_ms = platform_get_time_ms();
+
+        used = remote_client_parse(client, &stream, client->in, size);
+        if (used < 0) break;
+        memmove(client->in, client->in + used, size - used);
+        size -= used;
+    }
+
+    return stream.hello;
+}
+
+/* Thread of a remote plot. While the agent cannot be reached the plot
+ * stands still, the samples missed are backfilled when it is back. */
+void remote_client_run(remote_client_t *client) {
+    uint32_t backoff = REMOTE_RETRY_MS;
+
+    if (!client) return;
+
+    while (client->source->running) {
+        int fd = remote_connect(client);
+        uint32_t waited;
+
+        if (fd >= 0) {
+            if (remote_client_session(client, fd)) backoff = REMOTE_RETRY_MS;
+            close(fd);
+        }
+
+        for (waited = 0; waited < backoff && client->source->running; waited += REMOTE_TICK_MS) {
+            platform_sleep(REMOTE_TICK_MS);
+        }
+        backoff = backoff * 2 < REMOTE_RETRY_MAX_MS ? backoff * 2 : REMOTE_RETRY_MAX_MS;
+    }
+}
+
+static void remote_peer_close(remote_peer_t *peer) {
+    if (peer->fd >= 0) {
+        close(peer->fd);
+    }
+    free(peer->out.data);
+    memset(peer, 0, sizeof(*peer));
+    peer->fd = -1;
+}
+
+static void remote_peer_frame(remote_peer_t *peer, uint8_t kind, const remote_buffer_t *frame) {
+    remote_put_byte(&peer->out, kind);
+    remote_put_varint(&peer->out, frame->size);
+    remote_put(&peer->out, frame->data, frame->size);
+}
+
+/* By title first, then the first plot of that type */
+static data_source_t *remote_agent_find(remote_agent_t *agent, const char *name) {
+    uint32_t count = agent->collector->source_count, i;
+    const char *type = remote_plot_type(name);
+
+    if (agent->config->plot_count < count) count = agent->config->plot_count;
+
+    for (i = 0; i < count; i++) {
+        data_source_t *source = agent->collector->sources[i];
+        if (source->data_buffer && !source->heatmap && strcmp(agent->config->plots[i].name, name) == 0) {
+            return source;
+        }
+    }
+    for (i = 0; i < count; i++) {
+        data_source_t *source = agent->collector->sources[i];
+        if (source->data_buffer && !source->heatmap && strcmp(source->type, type) == 0) {
+            return source;
+        }
+    }
+    return NULL;
+}
+
+static void remote_peer_hello(remote_agent_t *agent, remote_peer_t *peer) {
+    remote_reader_t reader;
+    char magic[4], name[256];
+    uint8_t version, length;
+    uint64_t session, next;
+    data_source_t *source;
+
+    reader.at = peer->in;
+    reader.end = peer->in + peer->in_size;
+    reader.ok = 1;
+
+    remote_get_bytes(&reader, magic, sizeof(magic));
+    version = remote_get_byte(&reader);
+    length = remote_get_byte(&reader);
+    remote_get_bytes(&reader, name, length);
+    name[reader.ok ? length : 0] = '\0';
+    session = remote_get_u64(&reader);
+    next = remote_get_varint(&reader);
+
+    if (!reader.ok) {
+        if (peer->in_size == sizeof(peer->in)) remote_peer_close(peer);
+        return;
+    }
+    if (memcmp(magic, "PLTR", 4) != 0 || version != REMOTE_VERSION) {
+        remote_peer_close(peer);
+        return;
+    }
+
+    source = remote_agent_find(agent, name);
+
+    remote_put(&peer->out, "PLTA", 4);
+    remote_put_byte(&peer->out, REMOTE_VERSION);
+    remote_put_byte(&peer->out, source ? REMOTE_STATUS_OK : REMOTE_STATUS_UNKNOWN);
+    remote_put_byte(&peer->out, source && source->data_buffer_secondary ? 1 : 0);
+    remote_put_varint(&peer->out, source ? (uint64_t)source->column_interval_ms : 0);
+    remote_put_u64(&peer->out, agent->session);
+    remote_put_varint(&peer->out, platform_get_monotonic_us() / 1000);
+
+    if (!source) {
+        peer->closing = 1;
+        return;
+    }
+
+    /* A client of an earlier run of this agent gets all there is */
+    peer->source = source;
+    peer->next = session == agent->session ? next : 0;
+}
+
+static void remote_peer_read(remote_agent_t *agent, remote_peer_t *peer) {
+    uint8_t discard[512];
+    ssize_t n;
+
+    /* Nothing more is expected once streaming */
+    if (peer->source || peer->closing) {
+        n = recv(peer->fd, discard, sizeof(discard), 0);
+    } else {
+        n = recv(peer->fd, peer->in + peer->in_size, sizeof(peer->in) - peer->in_size, 0);
+    }
+
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) return;
+    if (n <= 0) {
+        remote_peer_close(peer);
+        return;
+    }
+
+    peer->last_activity_ms = platform_get_time_ms();
+    if (!peer->source && !peer->closing) {
+        peer->in_size += n;
+        remote_peer_hello(agent, peer);
+    }
+}
+
+static void remote_peer_write(remote_peer_t *peer) {
+    if (net_send(peer->fd, peer->out.data, peer->out.size, &peer->out_sent) < 0) {
+        remote_peer_close(peer);
+        return;
+    }
+
+    if (peer->out_sent == peer->out.size) {
+        peer->out.size = 0;
+        peer->out_sent = 0;
+        if (peer->closing) remote_peer_close(peer);
+    } else if (peer->out_sent >= REMOTE_BACKLOG) {
+        memmove(peer->out.data, peer->out.data + peer->out_sent, peer->out.size - peer->out_sent);
+        peer->out.size -= peer->out_sent;
+        peer->out_sent = 0;
+    }
+}
+
+/* Gaps left by a restart are not sent, the client sees the time jump */
+static void remote_peer_samples(remote_agent_t *agent, remote_peer_t *peer, uint64_t next, uint32_t count, int series) {
+    remote_buffer_t *frame = &agent->frame;
+    int64_t interval_ms = peer->source->column_interval_ms;
+    uint32_t records = 0, i;
+    int s;
+
+    for (i = 0; i < count; i++) {
+        if (agent->values[0][i] != RINGBUF_MISSING) records++;
+    }
+
+    frame->size = 0;
+    remote_put_varint(frame, next);
+    remote_put_varint(frame, records);
+
+    for (i = 0; i < count; i++) {
+        int64_t time_ms = (int64_t)(agent->times[i] / 1000);
+        uint64_t errors = 0;
+
+        if (agent->values[0][i] == RINGBUF_MISSING) continue;
+
+        for (s = 0; s < series; s++) {
+            if (!(agent->values[s][i] >= 0.0)) errors |= 1u << s;
+        }
+        remote_put_varint(frame, remote_zigzag(time_ms - peer->time_ms - interval_ms) << 2 | errors);
+        peer->time_ms = time_ms;
+
+        for (s = 0; s < series; s++) {
+            int64_t value;
+            if (errors & (1u << s)) continue;
+            value = remote_quantize(agent->values[s][i]);
+            remote_put_varint(frame, remote_zigzag(value - peer->value[s]));
+            peer->value[s] = value;
+        }
+    }
+
+    remote_peer_frame(peer, REMOTE_FRAME_SAMPLES, frame);
+}
+
+/* Stats double as the keepalive, an empty batch where there are none */
+static void remote_peer_stats(remote_agent_t *agent, remote_peer_t *peer) {
+    data_source_t *source = peer->source;
+    remote_buffer_t *frame = &agent->frame;
+    datasource_stats_t stats;
+    datasource_t *datasource = data_source_opened(source);
+    int ok = 0;
+
+    if (source->shared && !datasource) {
+        ok = shared_read_stats(source->shared, &stats);
+    } else if (datasource && datasource->handler->get_stats) {
+        ok = datasource->handler->get_stats(datasource->context, &stats) == 1;
+    }
+
+    frame->size = 0;
+    if (!ok) {
+        remote_put_varint(frame, peer->next);
+        remote_put_varint(frame, 0);
+        remote_peer_frame(peer, REMOTE_FRAME_SAMPLES, frame);
+        return;
+    }
+
+    remote_put_double(frame, stats.min);
+    remote_put_double(frame, stats.max);
+    remote_put_double(frame, stats.avg);
+    remote_put_double(frame, stats.last);
+    remote_put_double(frame, stats.min_secondary);
+    remote_put_double(frame, stats.max_secondary);
+    remote_put_double(frame, stats.avg_secondary);
+    remote_put_double(frame, stats.last_secondary);
+    remote_peer_frame(peer, REMOTE_FRAME_STATS, frame);
+}
+
+/* New samples since the last tick, in batches while the client keeps up.
+ * A client that falls behind further than the ring holds skips ahead. */
+static void remote_peer_stream(remote_agent_t *agent, remote_peer_t *peer, uint32_t now) {
+    data_source_t *source = peer->source;
+    int series = source->data_buffer_secondary ? 2 : 1;
+    uint64_t first, first_secondary, written;
+    uint32_t count, count_secondary, generation;
+    int sent = 0;
+
+    while (peer->out.size - peer->out_sent < REMOTE_BACKLOG) {
+        count = ringbuf_read_range(source->data_buffer, peer->next, agent->values[0], agent->min, agent->max,
+                                   agent->times, REMOTE_BATCH, &first, &written, &generation);
+        if (count == 0) break;
+
+        /* Both series are pushed together, the second may be one ahead */
+        if (series == 2) {
+            count_secondary = ringbuf_read_range(source->data_buffer_secondary, first, agent->values[1],
+                                                 agent->min, agent->max, NULL, count,
+                                                 &first_secondary, &written, &generation);
+            if (first_secondary != first || count_secondary == 0) break;
+            if (count_secondary < count) count = count_secondary;
+        }
+
+        remote_peer_samples(agent, peer, first + count, count, series);
+        peer->next = first + count;
+        sent = 1;
+    }
+
+    if (sent || now - peer->last_stats_ms >= REMOTE_KEEPALIVE_MS) {
+        remote_peer_stats(agent, peer);
+        peer->last_stats_ms = now;
+    }
+}
+
+static void remote_agent_accept(remote_agent_t *agent) {
+    int fd, i;
+
+    while ((fd = net_accept(agent->listen_fd)) >= 0) {
+        for (i = 0; i < REMOTE_MAX_PEERS; i++) {
+            if (agent->peers[i].fd < 0) break;
+        }
+        if (i == REMOTE_MAX_PEERS) {
+            close(fd);
+            continue;
+        }
+
+        agent->peers[i].fd = fd;
+        agent->peers[i].last_activity_ms = platform_get_time_ms();
+    }
+}
+
+static void remote_agent_thread(void *arg) {
+    remote_agent_t *agent = (remote_agent_t*)arg;
+    struct pollfd fds[REMOTE_MAX_PEERS + 1];
+    int slot[REMOTE_MAX_PEERS + 1];
+
+    while (agent->running) {
+        int nfds = 1, i;
+        uint32_t now;
+
+        fds[0].fd = agent->listen_fd;
+        fds[0].events = POLLIN;
+        fds[0].revents = 0;
+
+        for (i = 0; i < REMOTE_MAX_PEERS; i++) {
+            remote_peer_t *peer = &agent->peers[i];
+            if (peer->fd < 0) continue;
+
+            fds[nfds].fd = peer->fd;
+            fds[nfds].events = POLLIN | (peer->out_sent < peer->out.size ? POLLOUT : 0);
+            fds[nfds].revents = 0;
+            slot[nfds] = i;
+            nfds++;
+        }
+
+        if (poll(fds, nfds, REMOTE_TICK_MS) < 0 && errno != EINTR) {
+            break;
+        }
+
+        if (fds[0].revents & POLLIN) {
+            remote_agent_accept(agent);
+        }
+
+        for (i = 1; i < nfds; i++) {
+            remote_peer_t *peer = &agent->peers[slot[i]];
+            if (peer->fd != fds[i].fd) continue;
+
+            if (fds[i].revents & (POLLERR | POLLNVAL)) {
+                remote_peer_close(peer);
+                continue;
+            }
+            if (fds[i].revents & (POLLIN | POLLHUP)) {
+                remote_peer_read(agent, peer);
+            }
+        }
+
+        now = platform_get_time_ms();
+        if (now - agent->last_tick_ms >= REMOTE_TICK_MS) {
+            agent->last_tick_ms = now;
+            for (i = 0; i < REMOTE_MAX_PEERS; i++) {
+                remote_peer_t *peer = &agent->peers[i];
+                if (peer->fd >= 0 && peer->source) {
+                    remote_peer_stream(agent, peer, now);
+                }
+            }
+        }
+
+        for (i = 0; i < REMOTE_MAX_PEERS; i++) {
+            remote_peer_t *peer = &agent->peers[i];
+            if (peer->fd < 0) continue;
+
+            if (!peer->source && !peer->closing && now - peer->last_activity_ms >= REMOTE_TIMEOUT_MS) {
+                remote_peer_close(peer);
+            } else if (peer->out_sent < peer->out.size) {
+                remote_peer_write(peer);
+            }
+        }
+    }
+}
+
+remote_agent_t *remote_agent_create(data_collector_t *collector, config_t *config,
+                                    const char *bind_address, int32_t port) {
+    remote_agent_t *agent;
+    int i;
+
+    if (!collector || !config) return NULL;
+    if (port <= 0) port = REMOTE_DEFAULT_PORT;
+    if (!bind_address || !*bind_address) bind_address = "127.0.0.1";
+
+    agent = calloc(1, sizeof(remote_agent_t));
+    if (!agent) return NULL;
+
+    agent->collector = collector;
+    agent->config = config;
+    for (i = 0; i < REMOTE_MAX_PEERS; i++) {
+        agent->peers[i].fd = -1;
+    }
+
+    /* Tells clients whether their place in the stream is still valid */
+    agent->session = platform_get_time_us() ^ ((uint64_t)getpid() << 40);
+    if (agent->session == 0) agent->session = 1;
+
+    agent->listen_fd = net_listen(bind_address, port);
+    if (agent->listen_fd < 0) {
+        fprintf(stderr, "Agent: cannot listen on %s:%d\n", bind_address, port);
+        free(agent);
+        return NULL;
+    }
+
+    net_ignore_sigpipe();
+
+    agent->last_tick_ms = platform_get_time_ms();
+    agent->running = 1;
+    agent->thread = plot_thread_create(remote_agent_thread, agent);
+    if (!agent->thread) {
+        agent->running = 0;
+        remote_agent_destroy(agent);
+        return NULL;
+    }
+
+    return agent;
+}
+
+void remote_agent_destroy(remote_agent_t *agent) {
+    int i;
+    if (!agent) return;
+
+    if (agent->thread) {
+        agent->running = 0;
+        plot_thread_join(agent->thread);
+        plot_thread_destroy(agent->thread);
+    }
+
+    for (i = 0; i < REMOTE_MAX_PEERS; i++) {
+        if (agent->peers[i].fd >= 0) {
+            remote_peer_close(&agent->peers[i]);
+        }
+    }
+
+    close(agent->listen_fd);
+    free(agent->frame.data);
+    free(agent);
+}
@@ -0,0 +1,41 @@
+#ifndef REMOTE_H
+#define REMOTE_H
+
+#include "compat.h"
+#include "config.h"
+#include "threading.h"
+
+/* Plots streamed between hosts. An agent (--agent, or agent_port in any
+ * mode) serves its plots over TCP. A remote=host[:port]:plot plot
+ * connects, asks for everything after the last sample it got and then
+ * keeps receiving batches every REMOTE_TICK_MS. After a reconnect the
+ * agent backfills from its ring buffer, as far back as it still has.
+ *
+ *   client  "PLTR" version name_length name session[8] next
+ *   agent   "PLTA" version status is_dual interval_ms session[8] now_ms
+ *   then frames of kind, length and payload:
+ *     samples  next count, per sample zigzag(dt_ms - interval_ms) << 2
+ *              with one error bit per series, then for each series
+ *              without error the zigzag delta of its value in 1/1000
+ *     stats    the 8 datasource_stats_t doubles
+ *
+ * Numbers are LEB128 varints, session and doubles 8 bytes little endian.
+ * Deltas carry over between frames of a connection. Times are the agent's
+ * monotonic clock, moved to the client's by the difference at the hello. */
+
+#define REMOTE_DEFAULT_PORT 7300
+#define REMOTE_TICK_MS 250
+
+typedef struct remote_client remote_client_t;
+typedef struct remote_agent remote_agent_t;
+
+datasource_t *remote_describe(const char *target);
+remote_client_t *remote_client_create(data_source_t *source);
+void remote_client_run(remote_client_t *client);
+void remote_client_destroy(remote_client_t *client);
+
+remote_agent_t *remote_agent_create(data_collector_t *collector, config_t *config,
+                                    const char *bind_address, int32_t port);
+void remote_agent_destroy(remote_agent_t *agent);
+
+#endif
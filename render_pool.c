@@ -0,0 +1,152 @@
+#include "compat.h"
+#include "render_pool.h"
+#include "platform.h"
+#include <stdlib.h>
+
+typedef struct {
+    struct render_pool *pool;
+    renderer_t *renderer;
+    plot_thread_t *thread;
+} render_worker_t;
+
+struct render_pool {
+    render_worker_t *workers;
+    uint32_t worker_count;
+
+    mutex_t *mutex;
+    cond_t *work_ready;
+    cond_t *work_done;
+
+    /* Current batch, guarded by mutex */
+    render_job_t job;
+    void *arg;
+    uint32_t job_count;
+    uint32_t next_job;
+    uint32_t running;
+    int quit;
+};
+
+/* Called with the mutex held, drops it around every job */
+static void render_pool_take_jobs(render_pool_t *pool, renderer_t *renderer) {
+    while (pool->next_job < pool->job_count) {
+        uint32_t n = pool->next_job++;
+        pool->running++;
+
+        mutex_unlock(pool->mutex);
+        pool->job(pool->arg, renderer, n);
+        mutex_lock(pool->mutex);
+
+        pool->running--;
+    }
+    if (pool->running == 0) {
+        cond_signal(pool->work_done);
+    }
+}
+
+static void render_worker_thread(void *arg) {
+    render_worker_t *worker = (render_worker_t*)arg;
+    render_pool_t *pool = worker->pool;
+
+    mutex_lock(pool->mutex);
+    while (!pool->quit) {
+        if (pool->next_job < pool->job_count) {
+            render_pool_take_jobs(pool, worker->renderer);
+        } else {
+            cond_wait(pool->work_ready, pool->mutex);
+        }
+    }
+    mutex_unlock(pool->mutex);
+}
+
+render_pool_t *render_pool_create(renderer_t *renderer, uint32_t threads) {
+    uint32_t i;
+
+    if (!renderer || threads < 2) return NULL;
+
+    render_pool_t *pool = calloc(1, sizeof(render_pool_t));
+    if (!pool) return NULL;
+
+    pool->mutex = mutex_create();
+    pool->work_ready = cond_create();
+    pool->work_done = cond_create();
+    pool->workers = calloc(threads - 1, sizeof(render_worker_t));
+    if (!pool->mutex || !pool->work_ready || !pool->work_done || !pool->workers) {
+        render_pool_destroy(pool);
+        return NULL;
+    }
+
+    for (i = 0; i < threads - 1; i++) {
+        render_worker_t *worker = &pool->workers[i];
+        worker->pool = pool;
+        worker->renderer = renderer_create_worker(renderer);
+        if (!worker->renderer) break;
+
+        worker->thread = plot_thread_create(render_worker_thread, worker);
+        if (!worker->thread) {
+            renderer_destroy(worker->renderer);
+            worker->renderer = NULL;
+            break;
+        }
+        pool->worker_count++;
+    }
+
+    if (pool->worker_count == 0) {
+        render_pool_destroy(pool);
+        return NULL;
+    }
+
+    return pool;
+}
+
+void render_pool_destroy(render_pool_t *pool) {
+    uint32_t i;
+    if (!pool) return;
+
+    if (pool->worker_count > 0) {
+        mutex_lock(pool->mutex);
+        pool->quit = 1;
+        cond_broadcast(pool->work_ready);
+        mutex_unlock(pool->mutex);
+
+        for (i = 0; i < pool->worker_count; i++) {
+            plot_thread_join(pool->workers[i].thread);
+            plot_thread_destroy(pool->workers[i].thread);
+            renderer_destroy(pool->workers[i].renderer);
+        }
+    }
+
+    free(pool->workers);
+    cond_destroy(pool->work_done);
+    cond_destroy(pool->work_ready);
+    mutex_destroy(pool->mutex);
+    free(pool);
+}
+
+void render_pool_run(render_pool_t *pool, renderer_t *renderer, uint32_t count,
+                     render_job_t job, void *arg) {
+    uint32_t i;
+    if (!job) return;
+
+    if (!pool) {
+        for (i = 0; i < count; i++) {
+            job(arg, renderer, i);
+        }
+        return;
+    }
+
+    mutex_lock(pool->mutex);
+    pool->job = job;
+    pool->arg = arg;
+    pool->job_count = count;
+    pool->next_job = 0;
+    cond_broadcast(pool->work_ready);
+
+    render_pool_take_jobs(pool, renderer);
+    while (pool->running > 0) {
+        cond_wait(pool->work_done, pool->mutex);
+    }
+
+    pool->job_count = 0;
+    pool->next_job = 0;
+    mutex_unlock(pool->mutex);
+}
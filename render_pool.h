@@ -0,0 +1,22 @@
+#ifndef RENDER_POOL_H
+#define RENDER_POOL_H
+
+#include "compat.h"
+#include "graphics.h"
+
+/* Worker threads drawing plots in parallel, each with its own worker
+ * renderer on the shared target. The calling thread takes jobs too. */
+
+typedef struct render_pool render_pool_t;
+
+typedef void (*render_job_t)(void *arg, renderer_t *renderer, uint32_t job);
+
+/* NULL if the backend has no worker renderers or threads is below 2 */
+render_pool_t *render_pool_create(renderer_t *renderer, uint32_t threads);
+void render_pool_destroy(render_pool_t *pool);
+
+/* Runs job 0..count-1 and returns once all of them are done */
+void render_pool_run(render_pool_t *pool, renderer_t *renderer, uint32_t count,
+                     render_job_t job, void *arg);
+
+#endif
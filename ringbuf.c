@@ -1,7 +1,48 @@
 #include "compat.h"
 #include "ringbuf.h"
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+
+#define RINGBUF_FILE_MAGIC "PLOTRING"
+#define RINGBUF_FILE_VERSION 2
+
+/* Start of a history file, followed by size values, with an envelope size
+ * mins and size maxes, then size push times (not in version 1). Native
+ * byte order, the file is only meant to be read back by the same machine.
+ * Viewers attached to a daemon map it read-only while it is written, the
+ * sequence is odd while a push is under way. */
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t size;
+    uint32_t head;
+    uint32_t count;
+    uint64_t written;
+    uint64_t last_time_ms;  /* wall clock of the newest value */
+    int32_t interval_ms;
+    uint32_t envelope;
+    volatile uint32_t sequence;
+    uint32_t generation;    /* changed once a writer replaced the object */
+    uint8_t reserved[8];
+} ringbuf_file_t;
+
+/* Orders the sequence against the stores and loads around it */
+#if defined(__GNUC__)
+#define ringbuf_barrier() __sync_synchronize()
+#else
+#define ringbuf_barrier()
+#endif
+
+#define RINGBUF_PEEK_ATTEMPTS 100
+#define RINGBUF_PEEK_SPINS 4       /* retries before yielding to the writer */
 
 ringbuf_t *ringbuf_create(uint32_t size) {
     if (size == 0) return NULL;
@@ -10,11 +51,29 @@ ringbuf_t *ringbuf_create(uint32_t size) {
     if (!ringbuf) return NULL;
     
     ringbuf->data = malloc(sizeof(double) * size);
-    if (!ringbuf->data) {
+    ringbuf->time = calloc(size, sizeof(uint64_t));
+    if (!ringbuf->data || !ringbuf->time) {
+        free(ringbuf->data);
+        free(ringbuf->time);
         free(ringbuf);
         return NULL;
     }
     
+    ringbuf->min = NULL;
+    ringbuf->max = NULL;
+    ringbuf->written = 0;
+    ringbuf->generation = 0;
+    ringbuf->sequence = 0;
+    ringbuf->first_push_us = 0;
+    ringbuf->fd = -1;
+    ringbuf->map = NULL;
+    ringbuf->map_length = 0;
+    ringbuf->path = NULL;
+    ringbuf->shm = 0;
+    ringbuf->map_generation = 0;
+    ringbuf->interval_ms = 0;
+    ringbuf->attached = 0;
+    memset(ringbuf->taps, 0, sizeof(ringbuf->taps));
     ringbuf->size = size;
     atomic_store(&ringbuf->head, 0);
     atomic_store(&ringbuf->tail, 0);
@@ -23,6 +82,7 @@ ringbuf_t *ringbuf_create(uint32_t size) {
     ringbuf->write_mutex = mutex_create();
     if (!ringbuf->write_mutex) {
         free(ringbuf->data);
+        free(ringbuf->time);
         free(ringbuf);
         return NULL;
     }
@@ -31,6 +91,7 @@ ringbuf_t *ringbuf_create(uint32_t size) {
     if (!ringbuf->resize_mutex) {
         mutex_destroy(ringbuf->write_mutex);
         free(ringbuf->data);
+        free(ringbuf->time);
         free(ringbuf);
         return NULL;
     }
@@ -40,17 +101,522 @@ ringbuf_t *ringbuf_create(uint32_t size) {
     return ringbuf;
 }
 
+static uint64_t ringbuf_wall_time_ms(void) {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (uint64_t)tv.tv_sec * 1000 + tv.tv_usec / 1000;
+}
+
+static size_t ringbuf_file_length(uint32_t size, int envelope, uint32_t version) {
+    return sizeof(ringbuf_file_t) + sizeof(double) * size * (envelope ? 3 : 1) +
+           (version >= 2 ? sizeof(uint64_t) * size : 0);
+}
+
+/* Plain stores, the kernel writes them back whenever it likes and
+ * ringbuf_sync forces it. begin goes before the slot is overwritten. */
+static void ringbuf_file_begin(ringbuf_t *ringbuf) {
+    ringbuf_file_t *file = (ringbuf_file_t *)ringbuf->map;
+
+    file->sequence++;
+    ringbuf_barrier();
+}
+
+static void ringbuf_file_commit(ringbuf_t *ringbuf) {
+    ringbuf_file_t *file = (ringbuf_file_t *)ringbuf->map;
+
+    file->head = atomic_load(&ringbuf->head);
+    file->count = atomic_load(&ringbuf->count);
+    file->written = ringbuf->written;
+    file->last_time_ms = ringbuf_wall_time_ms();
+    ringbuf_barrier();
+    file->sequence++;
+}
+
+/* Viewers may have the object mapped, and truncating it under them makes
+ * them fault past its end or read at stale offsets. One that changes size
+ * is unlinked and made anew under the same name instead. old_out gets the
+ * old header, NULL when the object is kept, for ringbuf_retire. */
+static int ringbuf_replace(ringbuf_t *ringbuf, size_t length, ringbuf_file_t **old_out) {
+    ringbuf_file_t *old;
+    struct flock lock;
+    struct stat st;
+    int fd;
+
+    *old_out = NULL;
+    if (!ringbuf->path || fstat(ringbuf->fd, &st) != 0 ||
+        (size_t)st.st_size < sizeof(ringbuf_file_t) || (size_t)st.st_size == length) {
+        return 1;
+    }
+
+    old = mmap(NULL, sizeof(ringbuf_file_t), PROT_READ | PROT_WRITE, MAP_SHARED, ringbuf->fd, 0);
+    if (old == MAP_FAILED) return 0;
+    *old_out = old;
+
+    if (ringbuf->shm) {
+        shm_unlink(ringbuf->path);
+        fd = shm_open(ringbuf->path, O_RDWR | O_CREAT | O_EXCL, 0644);
+    } else {
+        unlink(ringbuf->path);
+        fd = open(ringbuf->path, O_RDWR | O_CREAT | O_EXCL, 0644);
+    }
+    if (fd < 0) {
+        close(ringbuf->fd);
+        ringbuf->fd = -1;
+        return 0;
+    }
+
+    memset(&lock, 0, sizeof(lock));
+    lock.l_type = F_WRLCK;
+    lock.l_whence = SEEK_SET;
+    fcntl(fd, F_SETLK, &lock);
+
+    close(ringbuf->fd);
+    ringbuf->fd = fd;
+    return 1;
+}
+
+/* Tell viewers of a replaced object to map the new one, once it is
+ * complete */
+static void ringbuf_retire(ringbuf_file_t *old, uint32_t generation) {
+    if (!old) return;
+
+    old->generation = generation;
+    munmap(old, sizeof(ringbuf_file_t));
+}
+
+/* Move the arrays from the heap into the file, sized to fit them. On
+ * failure they stay on the heap and nothing more is saved. */
+static int ringbuf_map(ringbuf_t *ringbuf) {
+    int envelope = ringbuf->min != NULL;
+    size_t length = ringbuf_file_length(ringbuf->size, envelope, RINGBUF_FILE_VERSION);
+    size_t bytes = sizeof(double) * ringbuf->size;
+    ringbuf_file_t *file, *old;
+    uint32_t generation;
+    double *data;
+    uint64_t *time;
+
+    if (!ringbuf_replace(ringbuf, length, &old)) {
+        ringbuf_retire(old, old ? old->generation + 1 : 0);
+        return 0;
+    }
+    file = ftruncate(ringbuf->fd, (off_t)length) == 0 ?
+           mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_SHARED, ringbuf->fd, 0) : MAP_FAILED;
+    if (file == MAP_FAILED) {
+        ringbuf_retire(old, old ? old->generation + 1 : 0);
+        return 0;
+    }
+    /* A restart at the same size keeps the viewers it has */
+    generation = old ? old->generation + 1 : file->generation;
+
+    data = (double *)(file + 1);
+    memcpy(data, ringbuf->data, bytes);
+    free(ringbuf->data);
+    ringbuf->data = data;
+    if (envelope) {
+        memcpy(data + ringbuf->size, ringbuf->min, bytes);
+        memcpy(data + ringbuf->size * 2, ringbuf->max, bytes);
+        free(ringbuf->min);
+        free(ringbuf->max);
+        ringbuf->min = data + ringbuf->size;
+        ringbuf->max = data + ringbuf->size * 2;
+    }
+    time = (uint64_t *)(data + ringbuf->size * (envelope ? 3 : 1));
+    memcpy(time, ringbuf->time, sizeof(uint64_t) * ringbuf->size);
+    free(ringbuf->time);
+    ringbuf->time = time;
+
+    memset(file, 0, sizeof(ringbuf_file_t));
+    memcpy(file->magic, RINGBUF_FILE_MAGIC, sizeof(file->magic));
+    file->version = RINGBUF_FILE_VERSION;
+    file->size = ringbuf->size;
+    file->interval_ms = ringbuf->interval_ms;
+    file->envelope = envelope;
+    file->generation = generation;
+    ringbuf->map = file;
+    ringbuf->map_length = length;
+    ringbuf_file_commit(ringbuf);
+    ringbuf_retire(old, generation);
+    return 1;
+}
+
+/* Back to heap arrays, before they change size */
+static int ringbuf_unmap(ringbuf_t *ringbuf) {
+    size_t bytes = sizeof(double) * ringbuf->size;
+    double *data = malloc(bytes);
+    double *min = ringbuf->min ? malloc(bytes) : NULL;
+    double *max = ringbuf->min ? malloc(bytes) : NULL;
+    uint64_t *time = malloc(sizeof(uint64_t) * ringbuf->size);
+
+    if (!data || !time || (ringbuf->min && (!min || !max))) {
+        free(data);
+        free(min);
+        free(max);
+        free(time);
+        return 0;
+    }
+
+    memcpy(data, ringbuf->data, bytes);
+    if (min) {
+        memcpy(min, ringbuf->min, bytes);
+        memcpy(max, ringbuf->max, bytes);
+    }
+    memcpy(time, ringbuf->time, sizeof(uint64_t) * ringbuf->size);
+    munmap(ringbuf->map, ringbuf->map_length);
+    ringbuf->map = NULL;
+    ringbuf->data = data;
+    ringbuf->min = min;
+    ringbuf->max = max;
+    ringbuf->time = time;
+    return 1;
+}
+
+/* Push what an earlier run left in the file, then a gap for the time it
+ * was not running. Push times are not saved, the monotonic clock starts
+ * over on reboot, so restored values are stamped one interval apart
+ * back from now. */
+static void ringbuf_restore(ringbuf_t *ringbuf, size_t length) {
+    ringbuf_file_t *file = mmap(NULL, length, PROT_READ, MAP_SHARED, ringbuf->fd, 0);
+    uint64_t now = ringbuf_wall_time_ms(), missed = 0, time, step;
+    uint32_t i;
+
+    if (file == MAP_FAILED) return;
+
+    if (memcmp(file->magic, RINGBUF_FILE_MAGIC, sizeof(file->magic)) == 0 &&
+        file->version >= 1 && file->version <= RINGBUF_FILE_VERSION && file->size > 0 &&
+        file->head < file->size && file->count <= file->size && file->written >= file->count &&
+        length >= ringbuf_file_length(file->size, file->envelope, file->version)) {
+        const double *data = (const double *)(file + 1);
+        const double *min = file->envelope ? data + file->size : data;
+        const double *max = file->envelope ? data + file->size * 2 : data;
+
+        if (file->count > 0 && ringbuf->interval_ms > 0 && now > file->last_time_ms) {
+            missed = (now - file->last_time_ms) / (uint64_t)ringbuf->interval_ms;
+        }
+        if (missed > ringbuf->size) missed = ringbuf->size;
+
+        step = (uint64_t)(ringbuf->interval_ms > 0 ? ringbuf->interval_ms : 0) * 1000;
+        time = platform_get_monotonic_us();
+        time = time > step * (file->count + missed) ? time - step * (file->count + missed) : 0;
+
+        for (i = 0; i < file->count; i++, time += step) {
+            uint32_t idx = (file->head + file->size - file->count + i) % file->size;
+            ringbuf_push_at(ringbuf, time, data[idx], min[idx], max[idx]);
+        }
+        ringbuf->written = file->written;
+
+        for (; missed > 0; missed--, time += step) {
+            ringbuf_push_at(ringbuf, time, RINGBUF_MISSING, RINGBUF_MISSING, RINGBUF_MISSING);
+        }
+        ringbuf->first_push_us = 0;
+    }
+
+    munmap(file, length);
+}
+
+static ringbuf_t *ringbuf_create_envelope(uint32_t size, int envelope) {
+    ringbuf_t *ringbuf = ringbuf_create(size);
+    if (ringbuf && envelope) ringbuf_enable_envelope(ringbuf);
+    return ringbuf;
+}
+
+/* Take over an open file or shared memory object for ringbuf_create_mapped
+ * and ringbuf_create_shared */
+static ringbuf_t *ringbuf_map_fd(int fd, const char *path, int shm, uint32_t size, int envelope, int32_t interval_ms) {
+    ringbuf_t *ringbuf = ringbuf_create(size);
+    struct flock lock;
+    struct stat st;
+
+    if (!ringbuf) {
+        close(fd);
+        return NULL;
+    }
+    if (envelope) ringbuf_enable_envelope(ringbuf);
+    ringbuf->interval_ms = interval_ms;
+    ringbuf->fd = fd;
+    ringbuf->path = strdup(path);
+    ringbuf->shm = shm;
+
+    memset(&lock, 0, sizeof(lock));
+    lock.l_type = F_WRLCK;
+    lock.l_whence = SEEK_SET;
+    if (fcntl(ringbuf->fd, F_SETLK, &lock) != 0) {
+        fprintf(stderr, "History file %s is in use, not saving this plot\n", path);
+        close(ringbuf->fd);
+        ringbuf->fd = -1;
+        return ringbuf;
+    }
+
+    if (fstat(ringbuf->fd, &st) == 0 && (size_t)st.st_size >= sizeof(ringbuf_file_t)) {
+        ringbuf_restore(ringbuf, (size_t)st.st_size);
+    }
+    if (!ringbuf_map(ringbuf)) {
+        fprintf(stderr, "Cannot map history file %s: %s\n", path, strerror(errno));
+    }
+
+    return ringbuf;
+}
+
+/* Like ringbuf_create, but kept in a file mapped into memory so the
+ * history outlives the process. Falls back to memory only when the file
+ * cannot be used, eg. another plottool has it open. */
+ringbuf_t *ringbuf_create_mapped(const char *path, uint32_t size, int envelope, int32_t interval_ms) {
+    int fd = open(path, O_RDWR | O_CREAT, 0644);
+
+    if (fd < 0) {
+        fprintf(stderr, "Cannot open history file %s: %s\n", path, strerror(errno));
+        return ringbuf_create_envelope(size, envelope);
+    }
+    return ringbuf_map_fd(fd, path, 0, size, envelope, interval_ms);
+}
+
+/* The same in a POSIX shared memory object, for viewers of a daemon. It
+ * lasts until reboot or until a daemon finds its plot gone, so a
+ * restarted daemon carries on. */
+ringbuf_t *ringbuf_create_shared(const char *name, uint32_t size, int envelope, int32_t interval_ms) {
+    int fd = shm_open(name, O_RDWR | O_CREAT, 0644);
+
+    if (fd < 0) {
+        fprintf(stderr, "Cannot open shared memory %s: %s\n", name, strerror(errno));
+        return ringbuf_create_envelope(size, envelope);
+    }
+    return ringbuf_map_fd(fd, name, 1, size, envelope, interval_ms);
+}
+
+/* Map and check what a daemon writes, read-only */
+static ringbuf_file_t *ringbuf_open_attached(const char *name, int shared, int *fd_out, size_t *length_out) {
+    int fd = shared ? shm_open(name, O_RDONLY, 0) : open(name, O_RDONLY);
+    ringbuf_file_t *file;
+    struct stat st;
+
+    if (fd < 0) return NULL;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(ringbuf_file_t)) {
+        close(fd);
+        return NULL;
+    }
+
+    file = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (file == MAP_FAILED) {
+        close(fd);
+        return NULL;
+    }
+    if (memcmp(file->magic, RINGBUF_FILE_MAGIC, sizeof(file->magic)) != 0 ||
+        file->version != RINGBUF_FILE_VERSION || file->size == 0 ||
+        (size_t)st.st_size < ringbuf_file_length(file->size, file->envelope, file->version)) {
+        munmap(file, (size_t)st.st_size);
+        close(fd);
+        return NULL;
+    }
+
+    *fd_out = fd;
+    *length_out = (size_t)st.st_size;
+    return file;
+}
+
+static void ringbuf_use_mapping(ringbuf_t *ringbuf, ringbuf_file_t *file, int fd, size_t length) {
+    double *data = (double *)(file + 1);
+
+    ringbuf->size = file->size;
+    ringbuf->data = data;
+    ringbuf->min = file->envelope ? data + file->size : NULL;
+    ringbuf->max = file->envelope ? data + file->size * 2 : NULL;
+    ringbuf->time = (uint64_t *)(data + file->size * (file->envelope ? 3 : 1));
+    ringbuf->interval_ms = file->interval_ms;
+    ringbuf->map_generation = file->generation;
+    ringbuf->fd = fd;
+    ringbuf->map = file;
+    ringbuf->map_length = length;
+}
+
+/* Map what a daemon writes read-only, from a history file or a shared
+ * memory object. ringbuf_follow picks up new pushes. */
+ringbuf_t *ringbuf_attach(const char *name, int shared) {
+    ringbuf_file_t *file;
+    ringbuf_t *ringbuf;
+    size_t length;
+    int fd;
+
+    file = ringbuf_open_attached(name, shared, &fd, &length);
+    if (!file) return NULL;
+
+    ringbuf = calloc(1, sizeof(ringbuf_t));
+    if (ringbuf) {
+        ringbuf->write_mutex = mutex_create();
+        ringbuf->resize_mutex = mutex_create();
+        ringbuf->path = strdup(name);
+    }
+    if (!ringbuf || !ringbuf->write_mutex || !ringbuf->resize_mutex || !ringbuf->path) {
+        if (ringbuf && ringbuf->write_mutex) mutex_destroy(ringbuf->write_mutex);
+        if (ringbuf && ringbuf->resize_mutex) mutex_destroy(ringbuf->resize_mutex);
+        if (ringbuf) free(ringbuf->path);
+        free(ringbuf);
+        munmap(file, length);
+        close(fd);
+        return NULL;
+    }
+
+    ringbuf_use_mapping(ringbuf, file, fd, length);
+    ringbuf->shm = shared;
+    ringbuf->attached = 1;
+    ringbuf_follow(ringbuf);
+    return ringbuf;
+}
+
+/* The daemon made the object anew, restarted at another size or with the
+ * envelope toggled. Everything reading an attached ring holds the write
+ * mutex, so the arrays can be swapped under it. Until the new object can
+ * be mapped the old one is kept, it is only no longer written. */
+static void ringbuf_reattach(ringbuf_t *ringbuf) {
+    void *old_map = ringbuf->map;
+    size_t old_length = ringbuf->map_length, length;
+    int old_fd = ringbuf->fd, fd;
+    ringbuf_file_t *file;
+
+    file = ringbuf_open_attached(ringbuf->path, ringbuf->shm, &fd, &length);
+    if (!file) return;
+
+    mutex_lock(ringbuf->resize_mutex);
+    mutex_lock(ringbuf->write_mutex);
+    ringbuf_use_mapping(ringbuf, file, fd, length);
+    ringbuf->generation++;
+    mutex_unlock(ringbuf->write_mutex);
+    mutex_unlock(ringbuf->resize_mutex);
+
+    munmap(old_map, old_length);
+    close(old_fd);
+}
+
+/* Consistent copy of the writer's position, retried while it pushes */
+static void ringbuf_file_position(ringbuf_t *ringbuf, uint32_t *head, uint32_t *count, uint64_t *written) {
+    const ringbuf_file_t *file = (const ringbuf_file_t *)ringbuf->map;
+    uint32_t sequence, attempts;
+
+    for (attempts = 0; attempts < 1000; attempts++) {
+        sequence = file->sequence;
+        ringbuf_barrier();
+        *head = file->head;
+        *count = file->count;
+        *written = file->written;
+        ringbuf_barrier();
+        if (!(sequence & 1) && sequence == file->sequence) break;
+    }
+    if (*head >= ringbuf->size || *count > ringbuf->size) {
+        *head = 0;
+        *count = 0;
+    }
+}
+
+/* Attached rings: take over what the daemon pushed since the last call */
+void ringbuf_follow(ringbuf_t *ringbuf) {
+    const ringbuf_file_t *file;
+    uint32_t head, count;
+    uint64_t written;
+
+    if (!ringbuf || !ringbuf->attached) return;
+
+    file = (const ringbuf_file_t *)ringbuf->map;
+    if (file->generation != ringbuf->map_generation || file->size != ringbuf->size) {
+        ringbuf_reattach(ringbuf);
+    }
+
+    ringbuf_file_position(ringbuf, &head, &count, &written);
+
+    mutex_lock(ringbuf->write_mutex);
+    atomic_store(&ringbuf->head, head);
+    atomic_store(&ringbuf->count, count);
+    atomic_store(&ringbuf->tail, (head + ringbuf->size - count) % ringbuf->size);
+    ringbuf->written = written;
+    mutex_unlock(ringbuf->write_mutex);
+}
+
+/* Attached rings: how many of count values copied from the oldest visible
+ * one the daemon may have overwritten meanwhile. Counts the slot it might
+ * be filling right now too. */
+static uint32_t ringbuf_overwritten(ringbuf_t *ringbuf, uint64_t first, uint32_t count) {
+    uint32_t head, available;
+    uint64_t written;
+
+    if (!ringbuf->attached) return 0;
+
+    ringbuf_barrier();
+    ringbuf_file_position(ringbuf, &head, &available, &written);
+    if (written + 1 <= ringbuf->size || written + 1 - ringbuf->size <= first) return 0;
+    return written + 1 - ringbuf->size - first < count ? (uint32_t)(written + 1 - ringbuf->size - first) : count;
+}
+
+/* Drop the first n of count from each buffer given */
+static void ringbuf_drop_front(uint32_t n, uint32_t count, double *a, double *b, double *c, uint64_t *t) {
+    if (n == 0) return;
+    if (a) memmove(a, a + n, sizeof(double) * (count - n));
+    if (b) memmove(b, b + n, sizeof(double) * (count - n));
+    if (c) memmove(c, c + n, sizeof(double) * (count - n));
+    if (t) memmove(t, t + n, sizeof(uint64_t) * (count - n));
+}
+
+/* Force the mapping out to storage. Called on a slow cadence, writes in
+ * between only touch the page cache. */
+void ringbuf_sync(ringbuf_t *ringbuf) {
+    if (!ringbuf || ringbuf->attached) return;
+
+    mutex_lock(ringbuf->resize_mutex);
+    if (ringbuf->map) {
+        msync(ringbuf->map, ringbuf->map_length, MS_SYNC);
+    }
+    mutex_unlock(ringbuf->resize_mutex);
+}
+
 void ringbuf_destroy(ringbuf_t *ringbuf) {
     if (!ringbuf) return;
 
     mutex_destroy(ringbuf->write_mutex);
     mutex_destroy(ringbuf->resize_mutex);
-    free(ringbuf->data);
+    if (ringbuf->map) {
+        if (!ringbuf->attached) msync(ringbuf->map, ringbuf->map_length, MS_SYNC);
+        munmap(ringbuf->map, ringbuf->map_length);
+    } else {
+        free(ringbuf->data);
+        free(ringbuf->min);
+        free(ringbuf->max);
+        free(ringbuf->time);
+    }
+    if (ringbuf->fd >= 0) close(ringbuf->fd);
+    free(ringbuf->path);
     free(ringbuf);
 }
 
+/* Keep a min and max next to every value, for sources that push one
+ * aggregated column per several samples. Existing values get a flat
+ * envelope. */
+int ringbuf_enable_envelope(ringbuf_t *ringbuf) {
+    if (!ringbuf || ringbuf->attached) return 0;
+
+    mutex_lock(ringbuf->resize_mutex);
+    mutex_lock(ringbuf->write_mutex);
+
+    if (!ringbuf->min) {
+        double *min = malloc(sizeof(double) * ringbuf->size);
+        double *max = malloc(sizeof(double) * ringbuf->size);
+        if (!min || !max || (ringbuf->map && !ringbuf_unmap(ringbuf))) {
+            free(min);
+            free(max);
+            mutex_unlock(ringbuf->write_mutex);
+            mutex_unlock(ringbuf->resize_mutex);
+            return 0;
+        }
+        memcpy(min, ringbuf->data, sizeof(double) * ringbuf->size);
+        memcpy(max, ringbuf->data, sizeof(double) * ringbuf->size);
+        ringbuf->min = min;
+        ringbuf->max = max;
+        if (ringbuf->fd >= 0) ringbuf_map(ringbuf);
+    }
+
+    mutex_unlock(ringbuf->write_mutex);
+    mutex_unlock(ringbuf->resize_mutex);
+    return 1;
+}
+
+/* Attached rings keep the daemon's size */
 int ringbuf_resize(ringbuf_t *ringbuf, uint32_t new_size) {
-    if (!ringbuf || new_size == 0) return 0;
+    if (!ringbuf || new_size == 0 || ringbuf->attached) return 0;
 
     mutex_lock(ringbuf->resize_mutex);
     mutex_lock(ringbuf->write_mutex);
@@ -62,7 +628,18 @@ int ringbuf_resize(ringbuf_t *ringbuf, uint32_t new_size) {
     }
 
     double *new_data = malloc(sizeof(double) * new_size);
-    if (!new_data) {
+    uint64_t *new_time = calloc(new_size, sizeof(uint64_t));
+    double *new_min = NULL, *new_max = NULL;
+    if (ringbuf->min) {
+        new_min = malloc(sizeof(double) * new_size);
+        new_max = malloc(sizeof(double) * new_size);
+    }
+    if (!new_data || !new_time || (ringbuf->min && (!new_min || !new_max)) ||
+        (ringbuf->map && !ringbuf_unmap(ringbuf))) {
+        free(new_data);
+        free(new_time);
+        free(new_min);
+        free(new_max);
         mutex_unlock(ringbuf->write_mutex);
         mutex_unlock(ringbuf->resize_mutex);
         return 0;
@@ -83,17 +660,34 @@ int ringbuf_resize(ringbuf_t *ringbuf, uint32_t new_size) {
                 src_index = (current_tail + i) % ringbuf->size;
             }
             new_data[i] = ringbuf->data[src_index];
+            new_time[i] = ringbuf->time[src_index];
+            if (new_min) {
+                new_min[i] = ringbuf->min[src_index];
+                new_max[i] = ringbuf->max[src_index];
+            }
         }
     }
 
     free(ringbuf->data);
+    free(ringbuf->min);
+    free(ringbuf->max);
+    free(ringbuf->time);
     ringbuf->data = new_data;
+    ringbuf->time = new_time;
+    ringbuf->min = new_min;
+    ringbuf->max = new_max;
     ringbuf->size = new_size;
+    ringbuf->generation++;
     atomic_store(&ringbuf->head, copy_count % new_size);
     atomic_store(&ringbuf->tail, 0);
     atomic_store(&ringbuf->count, copy_count);
 
     memset(&ringbuf->data[copy_count], 0, sizeof(double) * (new_size - copy_count));
+    if (new_min) {
+        memset(&new_min[copy_count], 0, sizeof(double) * (new_size - copy_count));
+        memset(&new_max[copy_count], 0, sizeof(double) * (new_size - copy_count));
+    }
+    if (ringbuf->fd >= 0) ringbuf_map(ringbuf);
 
     mutex_unlock(ringbuf->write_mutex);
     mutex_unlock(ringbuf->resize_mutex);
@@ -101,16 +695,40 @@ int ringbuf_resize(ringbuf_t *ringbuf, uint32_t new_size) {
 }
 
 int ringbuf_push(ringbuf_t *ringbuf, double value) {
-    if (!ringbuf) return 0;
+    return ringbuf_push_column(ringbuf, value, value, value);
+}
+
+/* min and max are dropped when the envelope is not enabled */
+int ringbuf_push_column(ringbuf_t *ringbuf, double value, double min, double max) {
+    return ringbuf_push_at(ringbuf, platform_get_monotonic_us(), value, min, max);
+}
+
+/* Push stamped with a given time rather than now, for restored values and
+ * samples received from an agent */
+int ringbuf_push_at(ringbuf_t *ringbuf, uint64_t time, double value, double min, double max) {
+    uint32_t i;
+
+    if (!ringbuf || ringbuf->attached) return 0;
 
     mutex_lock(ringbuf->write_mutex);
 
     uint32_t current_head = atomic_load(&ringbuf->head);
     uint32_t current_count = atomic_load(&ringbuf->count);
 
+    ringbuf->sequence++;
+    ringbuf_barrier();
+    if (ringbuf->map) ringbuf_file_begin(ringbuf);
+
     ringbuf->data[current_head] = value;
+    ringbuf->time[current_head] = time;
+    if (ringbuf->min) {
+        ringbuf->min[current_head] = min;
+        ringbuf->max[current_head] = max;
+    }
     uint32_t new_head = (current_head + 1) % ringbuf->size;
     atomic_store(&ringbuf->head, new_head);
+    ringbuf->written++;
+    if (!ringbuf->first_push_us) ringbuf->first_push_us = platform_get_monotonic_us();
 
     if (current_count < ringbuf->size) {
         atomic_store(&ringbuf->count, current_count + 1);
@@ -118,13 +736,59 @@ int ringbuf_push(ringbuf_t *ringbuf, double value) {
         uint32_t current_tail = atomic_load(&ringbuf->tail);
         atomic_store(&ringbuf->tail, (current_tail + 1) % ringbuf->size);
     }
+    if (ringbuf->map) ringbuf_file_commit(ringbuf);
+    ringbuf_barrier();
+    ringbuf->sequence++;
+
+    /* Under the mutex, so once ringbuf_remove_tap returns no call is left
+     * running and the tap's argument can be freed */
+    for (i = 0; i < RINGBUF_MAX_TAPS && ringbuf->taps[i].fn; i++) {
+        ringbuf->taps[i].fn(ringbuf->taps[i].arg, ringbuf->taps[i].stream, time, value, min, max);
+    }
 
     mutex_unlock(ringbuf->write_mutex);
     return 1;
 }
 
+int ringbuf_add_tap(ringbuf_t *ringbuf, ringbuf_tap_fn fn, void *arg, uint32_t stream) {
+    uint32_t i;
+
+    if (!ringbuf || !fn) return 0;
+
+    mutex_lock(ringbuf->write_mutex);
+    for (i = 0; i < RINGBUF_MAX_TAPS; i++) {
+        if (!ringbuf->taps[i].fn) {
+            ringbuf->taps[i].arg = arg;
+            ringbuf->taps[i].stream = stream;
+            ringbuf->taps[i].fn = fn;
+            mutex_unlock(ringbuf->write_mutex);
+            return 1;
+        }
+    }
+    mutex_unlock(ringbuf->write_mutex);
+    return 0;
+}
+
+void ringbuf_remove_tap(ringbuf_t *ringbuf, ringbuf_tap_fn fn, void *arg) {
+    uint32_t i, j;
+
+    if (!ringbuf) return;
+
+    mutex_lock(ringbuf->write_mutex);
+    for (i = 0; i < RINGBUF_MAX_TAPS; i++) {
+        if (ringbuf->taps[i].fn == fn && ringbuf->taps[i].arg == arg) {
+            for (j = i; j + 1 < RINGBUF_MAX_TAPS; j++) {
+                ringbuf->taps[j] = ringbuf->taps[j + 1];
+            }
+            memset(&ringbuf->taps[RINGBUF_MAX_TAPS - 1], 0, sizeof(ringbuf_tap_t));
+            break;
+        }
+    }
+    mutex_unlock(ringbuf->write_mutex);
+}
+
 int ringbuf_pop(ringbuf_t *ringbuf, double *value) {
-    if (!ringbuf || !value) return 0;
+    if (!ringbuf || !value || ringbuf->attached) return 0;
 
     mutex_lock(ringbuf->write_mutex);
 
@@ -136,8 +800,10 @@ int ringbuf_pop(ringbuf_t *ringbuf, double *value) {
 
     uint32_t current_tail = atomic_load(&ringbuf->tail);
     *value = ringbuf->data[current_tail];
+    if (ringbuf->map) ringbuf_file_begin(ringbuf);
     atomic_store(&ringbuf->tail, (current_tail + 1) % ringbuf->size);
     atomic_store(&ringbuf->count, current_count - 1);
+    if (ringbuf->map) ringbuf_file_commit(ringbuf);
 
     mutex_unlock(ringbuf->write_mutex);
     return 1;
@@ -161,10 +827,137 @@ int ringbuf_is_empty(ringbuf_t *ringbuf) {
     return (atomic_load(&ringbuf->count) == 0);
 }
 
+/* Copy up to count of the newest values, oldest first */
+uint32_t ringbuf_read_last(ringbuf_t *ringbuf, double *buffer, uint32_t count) {
+    if (!ringbuf || !buffer) return 0;
+
+    mutex_lock(ringbuf->write_mutex);
+
+    uint32_t available = atomic_load(&ringbuf->count);
+    uint32_t head = atomic_load(&ringbuf->head);
+    uint32_t i;
+
+    if (count > available) count = available;
+    for (i = 0; i < count; i++) {
+        buffer[i] = ringbuf->data[(head + ringbuf->size - count + i) % ringbuf->size];
+    }
+    i = ringbuf_overwritten(ringbuf, ringbuf->written - count, count);
+    ringbuf_drop_front(i, count, buffer, NULL, NULL, NULL);
+    count -= i;
+
+    mutex_unlock(ringbuf->write_mutex);
+    return count;
+}
+
+/* Copy the values numbered from onwards, counting every push since
+ * creation, oldest first. Values already overwritten are skipped and at
+ * most buffer_size are copied, so a deep buffer can be read in chunks;
+ * first_out tells where the copy starts. Without an envelope min_buffer
+ * and max_buffer get the values, time_buffer gets push times if given. */
+uint32_t ringbuf_read_range(ringbuf_t *ringbuf, uint64_t from, double *buffer, double *min_buffer, double *max_buffer,
+                            uint64_t *time_buffer, uint32_t buffer_size, uint64_t *first_out, uint64_t *written_out, uint32_t *generation_out) {
+    if (!ringbuf || !buffer || !min_buffer || !max_buffer || !first_out || !written_out || !generation_out) return 0;
+
+    mutex_lock(ringbuf->write_mutex);
+
+    uint32_t available = atomic_load(&ringbuf->count);
+    uint32_t head = atomic_load(&ringbuf->head);
+    uint64_t written = ringbuf->written;
+    uint64_t first = written - available;
+    double *min = ringbuf->min ? ringbuf->min : ringbuf->data;
+    double *max = ringbuf->max ? ringbuf->max : ringbuf->data;
+    uint32_t count, behind, i;
+
+    if (from > first) first = from < written ? from : written;
+    behind = (uint32_t)(written - first);
+    count = behind < buffer_size ? behind : buffer_size;
+
+    for (i = 0; i < count; i++) {
+        uint32_t idx = (head + ringbuf->size - behind + i) % ringbuf->size;
+        buffer[i] = ringbuf->data[idx];
+        min_buffer[i] = min[idx];
+        max_buffer[i] = max[idx];
+        if (time_buffer) time_buffer[i] = ringbuf->time[idx];
+    }
+    i = ringbuf_overwritten(ringbuf, first, count);
+    ringbuf_drop_front(i, count, buffer, min_buffer, max_buffer, time_buffer);
+    first += i;
+    count -= i;
+
+    *first_out = first;
+    *written_out = written;
+    *generation_out = ringbuf->generation;
+
+    mutex_unlock(ringbuf->write_mutex);
+    return count;
+}
+
+/* ringbuf_read_range for readers that must never hold up a push, eg. the
+ * query socket. Takes only the resize mutex and retries a copy that a push
+ * overlapped. Returns 0 with first_out at from when pushes kept winning. */
+uint32_t ringbuf_peek_range(ringbuf_t *ringbuf, uint64_t from, double *buffer, double *min_buffer, double *max_buffer,
+                            uint64_t *time_buffer, uint32_t buffer_size, uint64_t *first_out, uint64_t *written_out) {
+    uint32_t sequence, attempts, available, head, behind, count, idx, i, generation;
+    uint64_t written, first;
+    double *min, *max;
+
+    if (!ringbuf || !buffer || !min_buffer || !max_buffer || !time_buffer || !first_out || !written_out) return 0;
+
+    /* Nothing in this process pushes into those */
+    if (ringbuf->attached) {
+        return ringbuf_read_range(ringbuf, from, buffer, min_buffer, max_buffer, time_buffer, buffer_size,
+                                  first_out, written_out, &generation);
+    }
+
+    *first_out = from;
+    *written_out = from;
+
+    mutex_lock(ringbuf->resize_mutex);
+    for (attempts = 0; attempts < RINGBUF_PEEK_ATTEMPTS; attempts++) {
+        /* A push is short, but its sampler may be waiting for this CPU */
+        if (attempts >= RINGBUF_PEEK_SPINS) sched_yield();
+        sequence = ringbuf->sequence;
+        ringbuf_barrier();
+        if (sequence & 1) continue;
+
+        available = atomic_load(&ringbuf->count);
+        head = atomic_load(&ringbuf->head);
+        written = ringbuf->written;
+        min = ringbuf->min ? ringbuf->min : ringbuf->data;
+        max = ringbuf->max ? ringbuf->max : ringbuf->data;
+
+        first = written - available;
+        if (from > first) first = from < written ? from : written;
+        behind = (uint32_t)(written - first);
+        count = behind < buffer_size ? behind : buffer_size;
+
+        for (i = 0; i < count; i++) {
+            idx = (head + ringbuf->size - behind + i) % ringbuf->size;
+            buffer[i] = ringbuf->data[idx];
+            min_buffer[i] = min[idx];
+            max_buffer[i] = max[idx];
+            time_buffer[i] = ringbuf->time[idx];
+        }
+
+        ringbuf_barrier();
+        if (sequence == ringbuf->sequence) {
+            mutex_unlock(ringbuf->resize_mutex);
+            *first_out = first;
+            *written_out = written;
+            return count;
+        }
+    }
+    mutex_unlock(ringbuf->resize_mutex);
+    return 0;
+}
+
 int ringbuf_read_snapshot(ringbuf_t *ringbuf, double *buffer, uint32_t buffer_size, uint32_t *count_out, uint32_t *head_out, uint32_t *tail_out) {
-    if (!ringbuf || !buffer || !count_out || !head_out || !tail_out) return 0;
+    return ringbuf_read_envelope(ringbuf, buffer, NULL, NULL, NULL, buffer_size, count_out, head_out, tail_out);
+}
 
-    uint32_t count, head, tail;
+static int ringbuf_copy_envelope(ringbuf_t *ringbuf, double *buffer, double *min_buffer, double *max_buffer, uint64_t *time_buffer, uint32_t buffer_size, uint32_t *count_out, uint32_t *head_out, uint32_t *tail_out) {
+    uint32_t count, head, tail, lost;
+    uint64_t written;
     uint32_t attempts = 0;
     const uint32_t max_attempts = 10;
 
@@ -172,6 +965,7 @@ int ringbuf_read_snapshot(ringbuf_t *ringbuf, double *buffer, uint32_t buffer_si
         count = atomic_load(&ringbuf->count);
         head = atomic_load(&ringbuf->head);
         tail = atomic_load(&ringbuf->tail);
+        written = ringbuf->written;
 
         if (count == 0) {
             *count_out = 0;
@@ -185,13 +979,29 @@ int ringbuf_read_snapshot(ringbuf_t *ringbuf, double *buffer, uint32_t buffer_si
             uint32_t idx = (tail + i) % ringbuf->size;
             buffer[i] = ringbuf->data[idx];
         }
+        if (min_buffer && max_buffer) {
+            double *min = ringbuf->min ? ringbuf->min : ringbuf->data;
+            double *max = ringbuf->max ? ringbuf->max : ringbuf->data;
+            for (i = 0; i < copy_count; i++) {
+                uint32_t idx = (tail + i) % ringbuf->size;
+                min_buffer[i] = min[idx];
+                max_buffer[i] = max[idx];
+            }
+        }
+        if (time_buffer) {
+            for (i = 0; i < copy_count; i++) {
+                time_buffer[i] = ringbuf->time[(tail + i) % ringbuf->size];
+            }
+        }
 
         uint32_t verify_count = atomic_load(&ringbuf->count);
         uint32_t verify_head = atomic_load(&ringbuf->head);
         uint32_t verify_tail = atomic_load(&ringbuf->tail);
 
         if (count == verify_count && head == verify_head && tail == verify_tail) {
-            *count_out = copy_count;
+            lost = ringbuf_overwritten(ringbuf, written - count, copy_count);
+            ringbuf_drop_front(lost, copy_count, buffer, min_buffer, max_buffer, time_buffer);
+            *count_out = copy_count - lost;
             *head_out = head;
             *tail_out = tail;
             return 1;
@@ -202,3 +1012,22 @@ int ringbuf_read_snapshot(ringbuf_t *ringbuf, double *buffer, uint32_t buffer_si
 
     return 0;
 }
+
+/* Like ringbuf_read_snapshot, also copying the envelope into min_buffer and
+ * max_buffer when both are given. Without an envelope they get the values. */
+int ringbuf_read_envelope(ringbuf_t *ringbuf, double *buffer, double *min_buffer, double *max_buffer, uint64_t *time_buffer, uint32_t buffer_size, uint32_t *count_out, uint32_t *head_out, uint32_t *tail_out) {
+    int ok;
+
+    if (!ringbuf || !buffer || !count_out || !head_out || !tail_out) return 0;
+    if (!ringbuf->attached) {
+        return ringbuf_copy_envelope(ringbuf, buffer, min_buffer, max_buffer, time_buffer, buffer_size,
+                                     count_out, head_out, tail_out);
+    }
+
+    /* Attached rings may be mapped again, see ringbuf_reattach */
+    mutex_lock(ringbuf->write_mutex);
+    ok = ringbuf_copy_envelope(ringbuf, buffer, min_buffer, max_buffer, time_buffer, buffer_size,
+                               count_out, head_out, tail_out);
+    mutex_unlock(ringbuf->write_mutex);
+    return ok;
+}
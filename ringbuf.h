@@ -3,25 +3,77 @@
 
 #include "compat.h"
 #include "platform.h"
+#include <stddef.h>
+
+/* Stored for every interval plottool was not running, drawn as a gap */
+#define RINGBUF_MISSING -2.0
+
+#define RINGBUF_MAX_TAPS 2
+
+typedef void (*ringbuf_tap_fn)(void *arg, uint32_t stream, uint64_t time, double value, double min, double max);
+
+typedef struct {
+    ringbuf_tap_fn fn;
+    void *arg;
+    uint32_t stream;
+} ringbuf_tap_t;
 
 typedef struct {
     double *data;
+    double *min;    /* per slot envelope, NULL unless enabled */
+    double *max;
+    uint64_t *time; /* monotonic push time of each slot, us */
     uint32_t size;
     atomic_uint_fast32_t head;
     atomic_uint_fast32_t tail;
     atomic_uint_fast32_t count;
+    uint64_t written;       /* values pushed since creation, under write_mutex */
+    uint32_t generation;    /* bumped by every resize */
+    volatile uint32_t sequence; /* odd while a push is under way */
+    volatile uint64_t first_push_us; /* monotonic, 0 until this process pushes */
     mutex_t *write_mutex;
     mutex_t *resize_mutex;
+
+    /* File backing, the arrays above then point into the mapping */
+    int fd;
+    void *map;
+    size_t map_length;
+    char *path;     /* of the file or shared memory object, to replace it */
+    int shm;
+    uint32_t map_generation; /* attached rings map again when the header's differs */
+    int32_t interval_ms;
+    int attached;   /* read-only view of a daemon's buffer */
+
+    /* See every push, for --record and the exporter. Added, removed and
+     * called under the write mutex, so taps must be quick and must not
+     * touch this ring. */
+    ringbuf_tap_t taps[RINGBUF_MAX_TAPS];
 } ringbuf_t;
 
 ringbuf_t *ringbuf_create(uint32_t size);
+ringbuf_t *ringbuf_create_mapped(const char *path, uint32_t size, int envelope, int32_t interval_ms);
+ringbuf_t *ringbuf_create_shared(const char *name, uint32_t size, int envelope, int32_t interval_ms);
+ringbuf_t *ringbuf_attach(const char *name, int shared);
+void ringbuf_follow(ringbuf_t *ringbuf);
+void ringbuf_sync(ringbuf_t *ringbuf);
 void ringbuf_destroy(ringbuf_t *ringbuf);
 int ringbuf_resize(ringbuf_t *ringbuf, uint32_t new_size);
+int ringbuf_enable_envelope(ringbuf_t *ringbuf);
 int ringbuf_push(ringbuf_t *ringbuf, double value);
+int ringbuf_push_column(ringbuf_t *ringbuf, double value, double min, double max);
+int ringbuf_push_at(ringbuf_t *ringbuf, uint64_t time, double value, double min, double max);
+int ringbuf_add_tap(ringbuf_t *ringbuf, ringbuf_tap_fn fn, void *arg, uint32_t stream);
+void ringbuf_remove_tap(ringbuf_t *ringbuf, ringbuf_tap_fn fn, void *arg);
 int ringbuf_pop(ringbuf_t *ringbuf, double *value);
 uint32_t ringbuf_count(ringbuf_t *ringbuf);
 int ringbuf_is_full(ringbuf_t *ringbuf);
 int ringbuf_is_empty(ringbuf_t *ringbuf);
+uint32_t ringbuf_read_last(ringbuf_t *ringbuf, double *buffer, uint32_t count);
 int ringbuf_read_snapshot(ringbuf_t *ringbuf, double *buffer, uint32_t buffer_size, uint32_t *count_out, uint32_t *head_out, uint32_t *tail_out);
+uint32_t ringbuf_read_range(ringbuf_t *ringbuf, uint64_t from, double *buffer, double *min_buffer, double *max_buffer,
+                            uint64_t *time_buffer, uint32_t buffer_size, uint64_t *first_out, uint64_t *written_out, uint32_t *generation_out);
+uint32_t ringbuf_peek_range(ringbuf_t *ringbuf, uint64_t from, double *buffer, double *min_buffer, double *max_buffer,
+                            uint64_t *time_buffer, uint32_t buffer_size, uint64_t *first_out, uint64_t *written_out);
+int ringbuf_read_envelope(ringbuf_t *ringbuf, double *buffer, double *min_buffer, double *max_buffer, uint64_t *time_buffer, uint32_t buffer_size, uint32_t *count_out, uint32_t *head_out, uint32_t *tail_out);
 
 #endif
@@ -0,0 +1,225 @@
+#include "compat.h"
+#include "shared.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define SHARED_MAGIC "PLOTSHM"
+#define SHARED_VERSION 2
+
+#if defined(__GNUC__)
+#define shared_barrier() __sync_synchronize()
+#else
+#define shared_barrier()
+#endif
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t plot_count;
+    int32_t pid;
+    uint8_t reserved[44];
+} shared_header_t;
+
+struct shared_index {
+    shared_header_t *header;
+    shared_plot_t *plots;
+    size_t length;
+    char (*stale)[SHARED_BUFFER_LENGTH];   /* rings of the previous daemon */
+    uint32_t stale_count;
+};
+
+static shared_index_t *shared_index_map(int fd, size_t length, int writable) {
+    shared_index_t *index = malloc(sizeof(shared_index_t));
+    void *map;
+
+    if (!index) return NULL;
+
+    map = mmap(NULL, length, writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) {
+        free(index);
+        return NULL;
+    }
+
+    index->header = map;
+    index->plots = (shared_plot_t *)(index->header + 1);
+    index->length = length;
+    index->stale = NULL;
+    index->stale_count = 0;
+    return index;
+}
+
+static int shared_index_valid(shared_index_t *index) {
+    return memcmp(index->header->magic, SHARED_MAGIC, sizeof(SHARED_MAGIC)) == 0 &&
+           index->header->version == SHARED_VERSION &&
+           index->length >= sizeof(shared_header_t) + sizeof(shared_plot_t) * index->header->plot_count;
+}
+
+/* The rings the index of an earlier daemon lists, for
+ * shared_index_unlink_stale */
+static void shared_index_previous(shared_index_t *index, int fd, size_t length) {
+    shared_index_t *previous = shared_index_map(fd, length, 0);
+    uint32_t i;
+
+    if (!previous) return;
+    if (shared_index_valid(previous) && previous->header->plot_count > 0) {
+        index->stale = calloc(previous->header->plot_count, SHARED_BUFFER_LENGTH);
+        for (i = 0; index->stale && i < previous->header->plot_count; i++) {
+            if (!previous->plots[i].buffer[0]) continue;
+            memcpy(index->stale[index->stale_count++], previous->plots[i].buffer, SHARED_BUFFER_LENGTH - 1);
+        }
+    }
+    shared_index_destroy(previous);
+}
+
+/* Daemon side, started over on every run. Viewers of the last daemon may
+ * still have the index mapped, so one of another size is unlinked and
+ * made anew rather than truncated under them. */
+shared_index_t *shared_index_create(const char *name, uint32_t plot_count) {
+    size_t length = sizeof(shared_header_t) + sizeof(shared_plot_t) * plot_count;
+    shared_index_t *index, previous;
+    struct stat st;
+    int fd;
+
+    fd = shm_open(name, O_RDWR | O_CREAT, 0644);
+    if (fd < 0) {
+        fprintf(stderr, "Cannot open shared memory %s: %s\n", name, strerror(errno));
+        return NULL;
+    }
+
+    memset(&previous, 0, sizeof(previous));
+    if (fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(shared_header_t)) {
+        shared_index_previous(&previous, fd, (size_t)st.st_size);
+    }
+    if (fstat(fd, &st) == 0 && st.st_size > 0 && (size_t)st.st_size != length) {
+        close(fd);
+        shm_unlink(name);
+        fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0644);
+    }
+    if (fd < 0 || fstat(fd, &st) != 0 ||
+        ((size_t)st.st_size != length && ftruncate(fd, (off_t)length) != 0)) {
+        fprintf(stderr, "Cannot size shared memory %s: %s\n", name, strerror(errno));
+        if (fd >= 0) close(fd);
+        free(previous.stale);
+        return NULL;
+    }
+
+    index = shared_index_map(fd, length, 1);
+    close(fd);
+    if (!index) {
+        free(previous.stale);
+        return NULL;
+    }
+
+    index->stale = previous.stale;
+    index->stale_count = previous.stale_count;
+    memset(index->header, 0, length);
+    memcpy(index->header->magic, SHARED_MAGIC, sizeof(SHARED_MAGIC));
+    index->header->version = SHARED_VERSION;
+    index->header->plot_count = plot_count;
+    index->header->pid = (int32_t)getpid();
+    return index;
+}
+
+/* Viewer side */
+shared_index_t *shared_index_attach(const char *name) {
+    shared_index_t *index;
+    struct stat st;
+    int fd;
+
+    fd = shm_open(name, O_RDONLY, 0);
+    if (fd < 0) return NULL;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(shared_header_t)) {
+        close(fd);
+        return NULL;
+    }
+
+    index = shared_index_map(fd, (size_t)st.st_size, 0);
+    close(fd);
+    if (!index) return NULL;
+
+    if (!shared_index_valid(index)) {
+        shared_index_destroy(index);
+        return NULL;
+    }
+    return index;
+}
+
+static int shared_index_uses(shared_index_t *index, const char *name) {
+    char out[SHARED_BUFFER_LENGTH + 4];
+    uint32_t i;
+
+    for (i = 0; i < index->header->plot_count; i++) {
+        if (!index->plots[i].buffer[0]) continue;
+        snprintf(out, sizeof(out), "%s-out", index->plots[i].buffer);
+        if (strcmp(index->plots[i].buffer, name) == 0 || strcmp(out, name) == 0) return 1;
+    }
+    return 0;
+}
+
+/* Daemon side, once every plot has its ring: shared memory lasts until
+ * reboot, so the rings of plots the last daemon had and this one has not,
+ * renamed or removed, are unlinked here */
+void shared_index_unlink_stale(shared_index_t *index) {
+    char name[SHARED_BUFFER_LENGTH + 4];
+    uint32_t i;
+
+    if (!index) return;
+
+    for (i = 0; i < index->stale_count; i++) {
+        if (!shared_index_uses(index, index->stale[i])) shm_unlink(index->stale[i]);
+        snprintf(name, sizeof(name), "%s-out", index->stale[i]);
+        if (!shared_index_uses(index, name)) shm_unlink(name);
+    }
+    free(index->stale);
+    index->stale = NULL;
+    index->stale_count = 0;
+}
+
+void shared_index_destroy(shared_index_t *index) {
+    if (!index) return;
+
+    munmap(index->header, index->length);
+    free(index->stale);
+    free(index);
+}
+
+shared_plot_t *shared_index_plot(shared_index_t *index, uint32_t plot) {
+    if (!index || plot >= index->header->plot_count) return NULL;
+    return &index->plots[plot];
+}
+
+uint32_t shared_index_plot_count(shared_index_t *index) {
+    return index ? index->header->plot_count : 0;
+}
+
+void shared_publish_stats(shared_plot_t *plot, const datasource_stats_t *stats) {
+    if (!plot || !stats) return;
+
+    plot->sequence++;
+    shared_barrier();
+    plot->stats = *stats;
+    shared_barrier();
+    plot->sequence++;
+}
+
+/* 0 until the daemon published some, or while it keeps writing */
+int shared_read_stats(const shared_plot_t *plot, datasource_stats_t *stats) {
+    uint32_t sequence, attempts;
+
+    if (!plot || !stats) return 0;
+
+    for (attempts = 0; attempts < 100; attempts++) {
+        sequence = plot->sequence;
+        shared_barrier();
+        *stats = plot->stats;
+        shared_barrier();
+        if (!(sequence & 1) && sequence == plot->sequence) return sequence > 0;
+    }
+    return 0;
+}
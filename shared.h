@@ -0,0 +1,38 @@
+#ifndef SHARED_H
+#define SHARED_H
+
+#include "compat.h"
+#include "datasource.h"
+
+/* Index a collector daemon publishes in POSIX shared memory next to its
+ * ring buffers: which plots it samples and their latest statistics.
+ * Viewers map it read-only, check their plots against it and find each
+ * ring buffer by the same name the daemon gave it. */
+
+#define SHARED_TYPE_LENGTH 32
+#define SHARED_TARGET_LENGTH 224
+#define SHARED_BUFFER_LENGTH 256
+
+typedef struct {
+    volatile uint32_t sequence;     /* odd while stats are written */
+    int32_t column_interval_ms;
+    uint32_t is_dual;
+    uint32_t reserved;
+    char type[SHARED_TYPE_LENGTH];
+    char target[SHARED_TARGET_LENGTH];
+    char buffer[SHARED_BUFFER_LENGTH];  /* shared memory ring, empty for a file */
+    datasource_stats_t stats;
+} shared_plot_t;
+
+typedef struct shared_index shared_index_t;
+
+shared_index_t *shared_index_create(const char *name, uint32_t plot_count);
+shared_index_t *shared_index_attach(const char *name);
+void shared_index_unlink_stale(shared_index_t *index);
+void shared_index_destroy(shared_index_t *index);
+shared_plot_t *shared_index_plot(shared_index_t *index, uint32_t plot);
+uint32_t shared_index_plot_count(shared_index_t *index);
+void shared_publish_stats(shared_plot_t *plot, const datasource_stats_t *stats);
+int shared_read_stats(const shared_plot_t *plot, datasource_stats_t *stats);
+
+#endif
@@ -1,157 +1,761 @@
 #include "compat.h"
 #include "threading.h"
+#include "remote.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <ctype.h>
+#include <sys/stat.h>
+
+#define HEATMAP_MAX_WORKERS 32
+#define HEATMAP_DEFAULT_MAX 1000.0
+#define DATA_SOURCE_STOP_STEP_US 100000
+#define DATA_SOURCE_JOIN_MS 10000           /* wait for a sampler stuck in a probe */
+
+typedef struct {
+    data_source_t *source;
+    uint32_t first_row;
+    uint32_t row_step;
+} heatmap_worker_t;
+
+/* Sleeps in short steps so a stopped source can be joined soon */
+static void data_source_sleep_us(data_source_t *source, uint64_t microseconds) {
+    while (microseconds > 0 && source->running) {
+        uint64_t step = microseconds < DATA_SOURCE_STOP_STEP_US ? microseconds : DATA_SOURCE_STOP_STEP_US;
+        platform_sleep_us(step);
+        microseconds -= step;
+    }
+}
+
+/* Each worker walks its share of the rows once per interval so a few slow
+ * or dead targets only delay their neighbours, not the whole map. */
+static void heatmap_worker_thread(void *arg) {
+    heatmap_worker_t *worker = (heatmap_worker_t*)arg;
+    data_source_t *source = worker->source;
+    uint32_t started = platform_get_time_ms(), row;
+
+    /* Rows are opened by the workers sampling them, a few at a time */
+    for (row = worker->first_row; row < source->row_count && source->running; row += worker->row_step) {
+        if (source->row_sources[row] && datasource_init(source->row_sources[row])) {
+            datasource_set_refresh_interval(source->row_sources[row], source->refresh_interval_ms);
+        }
+    }
+    if (__sync_sub_and_fetch(&source->initializing, 1) == 0) {
+        source->init_ms = platform_get_time_ms() - started;
+    }
+
+    while (source->running) {
+        uint32_t start = platform_get_time_ms();
+        uint32_t row, elapsed;
+
+        for (row = worker->first_row; row < source->row_count && source->running; row += worker->row_step) {
+            double value = -1.0;
+            if (!source->row_sources[row] || !datasource_collect(source->row_sources[row], &value)) {
+                value = -1.0;
+            }
+            heatmap_set(source->heatmap, row, value);
+        }
+
+        elapsed = platform_get_time_ms() - start;
+        if (elapsed < (uint32_t)source->refresh_interval_ms) {
+            data_source_sleep_us(source, (uint64_t)(source->refresh_interval_ms - elapsed) * 1000);
+        }
+    }
+}
+
+static void heatmap_source_run(data_source_t *source) {
+    uint32_t worker_count = source->row_count < HEATMAP_MAX_WORKERS ? source->row_count : HEATMAP_MAX_WORKERS;
+    heatmap_worker_t *workers = malloc(sizeof(heatmap_worker_t) * worker_count);
+    plot_thread_t **threads = calloc(worker_count + 1, sizeof(plot_thread_t *));
+    uint32_t i;
+
+    if (!workers || !threads) {
+        free(workers);
+        free(threads);
+        source->initializing = 0;
+        return;
+    }
+
+    source->initializing = (int)worker_count;
+    for (i = 0; i < worker_count; i++) {
+        workers[i].source = source;
+        workers[i].first_row = i;
+        workers[i].row_step = worker_count;
+        threads[i] = plot_thread_create(heatmap_worker_thread, &workers[i]);
+        if (!threads[i]) __sync_sub_and_fetch(&source->initializing, 1);
+    }
+
+    /* The ring buffer carries the number of failed rows per column, which
+     * is what the footer shows and what tells the renderer to repaint. */
+    while (source->running) {
+        data_source_sleep_us(source, (uint64_t)source->refresh_interval_ms * 1000);
+        if (source->running) ringbuf_push(source->data_buffer, (double)heatmap_commit(source->heatmap));
+    }
+
+    for (i = 0; i < worker_count; i++) {
+        if (threads[i]) {
+            plot_thread_join(threads[i]);
+            plot_thread_destroy(threads[i]);
+        }
+    }
+    free(threads);
+    free(workers);
+}
+
+static int heatmap_source_create(data_source_t *source, const char *spec, uint32_t columns) {
+    char row_type[64];
+    char **targets;
+    uint32_t i;
+    double max_value = HEATMAP_DEFAULT_MAX;
+
+    if (!heatmap_expand_targets(heatmap_split_spec(spec, row_type, sizeof(row_type)),
+                                &targets, &source->row_count)) {
+        return 0;
+    }
+
+    source->row_sources = calloc(source->row_count, sizeof(datasource_t*));
+    if (!source->row_sources) {
+        heatmap_free_targets(targets, source->row_count);
+        return 0;
+    }
+
+    for (i = 0; i < source->row_count; i++) {
+        source->row_sources[i] = datasource_describe(row_type, targets[i]);
+        if (source->row_sources[i] && source->row_sources[i]->handler->is_dual) {
+            datasource_destroy(source->row_sources[i]);
+            source->row_sources[i] = NULL;
+        }
+        if (source->row_sources[i]) {
+            if (source->row_sources[i]->handler->max_scale > 0.0) {
+                max_value = source->row_sources[i]->handler->max_scale;
+            }
+        }
+    }
+    heatmap_free_targets(targets, source->row_count);
+
+    source->heatmap = heatmap_create(source->row_count, columns, max_value);
+    return source->heatmap != NULL;
+}
+
+static void heatmap_source_destroy(data_source_t *source) {
+    uint32_t i;
+
+    if (source->row_sources) {
+        for (i = 0; i < source->row_count; i++) {
+            datasource_destroy(source->row_sources[i]);
+        }
+        free(source->row_sources);
+    }
+    heatmap_destroy(source->heatmap);
+}
+
+typedef struct {
+    double sum;
+    double min;
+    double max;
+    uint32_t count;
+} column_t;
+
+static void column_add(column_t *column, double value) {
+    if (column->count == 0 || value < column->min) column->min = value;
+    if (column->count == 0 || value > column->max) column->max = value;
+    column->sum += value;
+    column->count++;
+}
+
+/* A column where every sample failed is an error column */
+static void column_push(column_t *column, ringbuf_t *ringbuf, history_t *history) {
+    if (column->count == 0) {
+        ringbuf_push(ringbuf, -1.0);
+        history_push(history, -1.0);
+    } else {
+        ringbuf_push_column(ringbuf, column->sum / column->count, column->min, column->max);
+        history_push(history, column->sum / column->count);
+    }
+    memset(column, 0, sizeof(column_t));
+}
 
 static void data_source_thread(void *arg) {
     data_source_t *source = (data_source_t*)arg;
     if (!source) return;
 
+    if (source->heatmap) {
+        heatmap_source_run(source);
+        return;
+    }
+
+    if (source->remote) {
+        remote_client_run(source->remote);
+        return;
+    }
+
+    /* Viewers only pick up what the daemon pushed */
+    if (source->attached) {
+        while (source->running) {
+            ringbuf_follow(source->data_buffer);
+            ringbuf_follow(source->data_buffer_secondary);
+            data_source_sleep_us(source, (uint64_t)source->column_interval_ms * 1000);
+        }
+        return;
+    }
 
-    if (!source->datasource) {
-        while (1) {
+
+    /* Opening the datasource may block on DNS, an SNMP session or a
+     * command, so it is done here and every plot starts on its own */
+    if (source->initializing) {
+        uint32_t started = platform_get_time_ms();
+        if (datasource_init(source->datasource)) {
+            datasource_set_refresh_interval(source->datasource, source->refresh_interval_ms);
+        }
+        source->init_ms = platform_get_time_ms() - started;
+        __atomic_store_n(&source->initializing, 0, __ATOMIC_RELEASE);
+    }
+
+    if (!source->datasource || !source->datasource->context) {
+        while (source->running) {
             ringbuf_push(source->data_buffer, -1.0);
-            platform_sleep(source->refresh_interval_ms);
+            history_push(source->history, -1.0);
+            data_source_sleep_us(source, (uint64_t)source->column_interval_ms * 1000);
         }
         return;
     }
 
-    uint32_t sample_count = 0;
-    while (1) {
+    /* Samples run on a fixed schedule rather than sleeping a full interval
+     * after each one, so fast sources keep their rate. Everything sampled
+     * within one column interval is pushed as a single mean with its min
+     * and max. A sampler that overruns its slot starts again from now. */
+    uint64_t sample_us = source->refresh_interval_us > 0 ? (uint64_t)source->refresh_interval_us :
+                         (uint64_t)source->refresh_interval_ms * 1000;
+    uint64_t column_us = (uint64_t)source->column_interval_ms * 1000;
+    uint64_t next_sample = platform_get_time_us();
+    uint64_t next_column = next_sample + column_us;
+    uint64_t next_sync = next_sample + (uint64_t)source->history_sync_ms * 1000;
+    column_t column, column_secondary;
+
+    memset(&column, 0, sizeof(column));
+    memset(&column_secondary, 0, sizeof(column_secondary));
+
+    while (source->running) {
+        uint64_t now;
 
         if (source->is_dual && source->datasource->handler->collect_dual) {
             double in_value = 0.0, out_value = 0.0;
-            int success = source->datasource->handler->collect_dual(source->datasource->context, &in_value, &out_value);
-
-            if (success) {
-                ringbuf_push(source->data_buffer, in_value);
-                ringbuf_push(source->data_buffer_secondary, out_value);
-            } else {
-                ringbuf_push(source->data_buffer, -1.0);
-                ringbuf_push(source->data_buffer_secondary, -1.0);
-            }
 
-            sample_count++;
-            if (sample_count % 10 == 0) {
+            if (source->datasource->handler->collect_dual(source->datasource->context, &in_value, &out_value)) {
+                column_add(&column, in_value);
+                column_add(&column_secondary, out_value);
             }
         } else {
             double value = 0.0;
-            int success = datasource_collect(source->datasource, &value);
 
-            if (success) {
-                ringbuf_push(source->data_buffer, value);
-            } else {
-                ringbuf_push(source->data_buffer, -1.0);
+            if (datasource_collect(source->datasource, &value)) {
+                column_add(&column, value);
+            }
+        }
+
+        next_sample += sample_us;
+        now = platform_get_time_us();
+        if (now > next_sample + sample_us) {
+            next_sample = now;
+        }
+
+        if (next_sample >= next_column) {
+            column_push(&column, source->data_buffer, source->history);
+            if (source->data_buffer_secondary) {
+                column_push(&column_secondary, source->data_buffer_secondary, source->history_secondary);
+            }
+            next_column += column_us;
+            if (next_column <= next_sample) {
+                next_column = next_sample + column_us;
+            }
+
+            if (source->shared && source->datasource->handler->get_stats) {
+                datasource_stats_t stats;
+                if (source->datasource->handler->get_stats(source->datasource->context, &stats) == 1) {
+                    shared_publish_stats(source->shared, &stats);
+                }
             }
 
-            sample_count++;
-            if (sample_count % 10 == 0) {
+            /* File backed buffers are flushed out rarely, to spare SD cards */
+            if (source->history_sync_ms > 0 && now >= next_sync) {
+                ringbuf_sync(source->data_buffer);
+                ringbuf_sync(source->data_buffer_secondary);
+                next_sync = now + (uint64_t)source->history_sync_ms * 1000;
             }
         }
 
-        platform_sleep(source->refresh_interval_ms);
+        if (next_sample > now) {
+            data_source_sleep_us(source, next_sample - now);
+        }
+    }
+
+}
+
+/* Where a plot's buffer lives outside the process: a file in history_dir,
+ * else for a daemon a shared memory object. Returns 1 for a file. */
+static int data_source_buffer_name(config_t *config, uint32_t index, const char *suffix,
+                                   char *path, size_t length) {
+    const char *plot_name = config->plots[index].name;
+    const char *shm_name = config->shm_name ? config->shm_name : "/plottool";
+    char name[256];
+    uint32_t i, j;
+
+    for (i = 0, j = 0; plot_name[i] && j < sizeof(name) - 1; i++) {
+        char c = plot_name[i];
+        name[j++] = (isalnum((unsigned char)c) || c == '-' || c == '.') ? c : '_';
+    }
+    name[j] = '\0';
+
+    /* Plots sharing a name each get their own file */
+    for (i = 0; i < index; i++) {
+        if (strcmp(config->plots[i].name, plot_name) == 0) break;
+    }
+    if (config->history_dir) {
+        if (i < index) {
+            snprintf(path, length, "%s/%s-%u%s.ring", config->history_dir, name, index, suffix);
+        } else {
+            snprintf(path, length, "%s/%s%s.ring", config->history_dir, name, suffix);
+        }
+        return 1;
+    }
+    if (i < index) {
+        snprintf(path, length, "%s-%s-%u%s", shm_name, name, index, suffix);
+    } else {
+        snprintf(path, length, "%s-%s%s", shm_name, name, suffix);
+    }
+    return 0;
+}
+
+/* With history_dir set plot buffers live in files named after the plot
+ * and survive a restart, a daemon keeps them in shared memory otherwise.
+ * Heatmaps keep only their footer in the ring buffer, they are not saved
+ * or shared, and a replay never touches the saved history. */
+static ringbuf_t *data_source_buffer(config_t *config, uint32_t index, const char *suffix,
+                                     uint32_t size, int envelope, int32_t interval_ms, int flags) {
+    char path[1024];
+    ringbuf_t *ringbuf;
+
+    if ((!config->history_dir && !(flags & COLLECTOR_SHARED)) || (flags & COLLECTOR_REPLAY) ||
+        strcmp(config->plots[index].type, "heatmap") == 0) {
+        ringbuf = ringbuf_create(size);
+        if (ringbuf && envelope) ringbuf_enable_envelope(ringbuf);
+        return ringbuf;
+    }
+
+    if (data_source_buffer_name(config, index, suffix, path, sizeof(path))) {
+        return ringbuf_create_mapped(path, size, envelope, interval_ms);
+    }
+    return ringbuf_create_shared(path, size, envelope, interval_ms);
+}
+
+/* Sampling interval and column width of plot index, as the sampler uses
+ * them and as a reload compares them */
+static void data_source_intervals(config_t *config, uint32_t index, int32_t *refresh_ms, int32_t *refresh_us,
+                                  int32_t *column_ms) {
+    plot_config_t *plot = &config->plots[index];
+
+    *refresh_ms = plot->refresh_interval_ms > 0 ? plot->refresh_interval_ms : config->refresh_interval_ms;
+    *refresh_us = plot->refresh_interval_ms > 0 ? plot->refresh_interval_us : config->refresh_interval_us;
+
+    /* Sampling faster than the display can scroll folds several samples
+     * into each column */
+    *column_ms = plot->column_interval_ms > 0 ? plot->column_interval_ms : config->column_interval_ms;
+    if (*column_ms <= 0 && config->max_fps > 0) {
+        *column_ms = (1000 + config->max_fps - 1) / config->max_fps;
+    }
+    if (*column_ms < *refresh_ms || strcmp(plot->type, "heatmap") == 0) {
+        *column_ms = *refresh_ms;
+    }
+}
+
+static void data_source_destroy(data_source_t *source) {
+    if (!source) return;
+
+    remote_client_destroy(source->remote);
+    free(source->type);
+    free(source->target);
+    datasource_destroy(source->datasource);
+    heatmap_source_destroy(source);
+    ringbuf_destroy(source->data_buffer);
+    ringbuf_destroy(source->data_buffer_secondary);
+    history_destroy(source->history);
+    history_destroy(source->history_secondary);
+    free(source);
+}
+
+/* The source of plot index with its buffers, not started yet */
+static data_source_t *data_source_create(config_t *config, uint32_t index, shared_index_t *shared_index,
+                                         int flags) {
+    int shared = flags & COLLECTOR_SHARED, replay = flags & COLLECTOR_REPLAY;
+    plot_config_t *plot = &config->plots[index];
+    uint32_t buffer_size = config->default_width - 2;
+    int compress = plot->history_compress && plot->history > 0 && strcmp(plot->type, "heatmap") != 0 && !shared;
+    int envelope, remote;
+    data_source_t *source;
+
+    source = calloc(1, sizeof(data_source_t));
+    if (!source) return NULL;
+
+    if (plot->history > buffer_size && !compress) buffer_size = plot->history;
+    source->type = malloc(strlen(plot->type) + 1);
+    source->target = malloc(strlen(plot->target) + 1);
+    if (!source->type || !source->target) {
+        data_source_destroy(source);
+        return NULL;
+    }
+
+    strcpy(source->type, plot->type);
+    strcpy(source->target, plot->target);
+    /* Only described here, the sampler thread opens it */
+    remote = strcmp(plot->type, "remote") == 0;
+    source->datasource = remote ? remote_describe(plot->target) : datasource_describe(plot->type, plot->target);
+    source->initializing = source->datasource && !remote && !replay;
+    source->shared = shared_index_plot(shared_index, index);
+    source->is_dual = (source->datasource && source->datasource->handler->is_dual);
+    data_source_intervals(config, index, &source->refresh_interval_ms, &source->refresh_interval_us,
+                          &source->column_interval_ms);
+
+    if (strcmp(source->type, "heatmap") == 0 && !replay) {
+        source->initializing = heatmap_source_create(source, source->target, config->default_width - 2);
+    }
+
+    envelope = source->column_interval_ms > source->refresh_interval_ms || source->refresh_interval_us > 0;
+    source->data_buffer = data_source_buffer(config, index, "", buffer_size, envelope,
+                                             source->column_interval_ms, flags);
+    if (source->is_dual) {
+        source->data_buffer_secondary = data_source_buffer(config, index, "-out", buffer_size, envelope,
+                                                           source->column_interval_ms, flags);
+    }
+
+    /* The ring then only covers the plot width, the deep history is kept
+     * compressed next to it */
+    source->history = compress ? history_create(plot->history) : NULL;
+    source->history_secondary = compress && source->is_dual ? history_create(plot->history) : NULL;
+    source->history_sync_ms = config->history_dir && !replay ? config->history_sync_ms : 0;
+    source->history_depth = plot->history;
+
+    if (source->shared) {
+        strncpy(source->shared->type, source->type, SHARED_TYPE_LENGTH - 1);
+        strncpy(source->shared->target, source->target, SHARED_TARGET_LENGTH - 1);
+        source->shared->column_interval_ms = source->column_interval_ms;
+        source->shared->is_dual = source->is_dual;
+        if (source->data_buffer && source->data_buffer->shm) {
+            strncpy(source->shared->buffer, source->data_buffer->path, SHARED_BUFFER_LENGTH - 1);
+        }
+    }
+
+    /* A remote plot that cannot be set up shows errors like a dead
+     * datasource */
+    if (remote && source->data_buffer && !replay) {
+        source->remote = remote_client_create(source);
+        if (!source->remote) {
+            datasource_destroy(source->datasource);
+            source->datasource = NULL;
+        }
+    }
+
+    if (!source->data_buffer) {
+        data_source_destroy(source);
+        return NULL;
+    }
+    return source;
+}
+
+/* A plot sampling the same thing the same way, whose buffers a reload can
+ * keep */
+static int data_source_matches(data_source_t *source, config_t *config, uint32_t index) {
+    plot_config_t *plot = &config->plots[index];
+    int32_t refresh_ms, refresh_us, column_ms;
+    int compress = plot->history_compress && plot->history > 0 && strcmp(plot->type, "heatmap") != 0;
+
+    if (!source || strcmp(source->type, plot->type) != 0 || strcmp(source->target, plot->target) != 0) return 0;
+    data_source_intervals(config, index, &refresh_ms, &refresh_us, &column_ms);
+    if (source->refresh_interval_ms != refresh_ms || source->refresh_interval_us != refresh_us ||
+        source->column_interval_ms != column_ms) return 0;
+
+    return source->history_depth == plot->history && (source->history != NULL) == compress;
+}
+
+static int data_source_start(data_source_t *source) {
+    source->running = 1;
+    source->thread = plot_thread_create(data_source_thread, source);
+    if (!source->thread) {
+        source->running = 0;
+        return 0;
     }
+    return 1;
+}
+
+/* Returns 0 when the sampler is stuck in a probe and has to be left
+ * running, with its source */
+static int data_source_stop(data_source_t *source) {
+    source->running = 0;
+    if (!source->thread) return 1;
 
+    if (!plot_thread_join_timeout(source->thread, DATA_SOURCE_JOIN_MS)) {
+        fprintf(stderr, "Plot %s=%s does not stop, leaving it behind\n", source->type, source->target);
+        return 0;
+    }
+    plot_thread_destroy(source->thread);
+    source->thread = NULL;
+    return 1;
 }
 
-data_collector_t *data_collector_create(config_t *config) {
+/* COLLECTOR_SHARED is set for --daemon, which publishes its buffers for
+ * viewers. COLLECTOR_REPLAY describes the datasources without starting
+ * them, the buffers are fed from a --record log. */
+data_collector_t *data_collector_create(config_t *config, int flags) {
+    data_collector_t *collector;
+    uint32_t i;
+
     if (!config) return NULL;
-    
-    data_collector_t *collector = malloc(sizeof(data_collector_t));
+
+    collector = calloc(1, sizeof(data_collector_t));
     if (!collector) return NULL;
-    
+
     collector->source_count = config->plot_count;
-    collector->sources = malloc(sizeof(data_source_t) * collector->source_count);
+    collector->sources = calloc(collector->source_count + 1, sizeof(data_source_t *));
+    collector->replay = flags & COLLECTOR_REPLAY;
     if (!collector->sources) {
         free(collector);
         return NULL;
     }
-    
-    uint32_t i, j;
+
+    if (flags & COLLECTOR_SHARED) {
+        collector->index = shared_index_create(config->shm_name ? config->shm_name : "/plottool",
+                                               collector->source_count);
+        if (!collector->index) {
+            data_collector_destroy(collector);
+            return NULL;
+        }
+    }
+
+    if (config->history_dir && !collector->replay) {
+        mkdir(config->history_dir, 0755);
+    }
+
+    for (i = 0; i < collector->source_count; i++) {
+        collector->sources[i] = data_source_create(config, i, collector->index, flags);
+        if (!collector->sources[i]) {
+            data_collector_destroy(collector);
+            return NULL;
+        }
+    }
+    shared_index_unlink_stale(collector->index);
+
+    return collector;
+}
+
+/* A viewer of a --daemon: the same plots, with buffers mapped read-only
+ * from the daemon and no datasource of its own. Plots the daemon does not
+ * sample the same way, and heatmaps, show no data. */
+data_collector_t *data_collector_attach(config_t *config) {
+    const char *shm_name;
+    data_collector_t *collector;
+    char path[1024];
+    uint32_t i;
+
+    if (!config) return NULL;
+    shm_name = config->shm_name ? config->shm_name : "/plottool";
+
+    collector = calloc(1, sizeof(data_collector_t));
+    if (!collector) return NULL;
+
+    collector->index = shared_index_attach(shm_name);
+    if (!collector->index) {
+        fprintf(stderr, "No plottool --daemon found at %s\n", shm_name);
+        free(collector);
+        return NULL;
+    }
+
+    collector->source_count = config->plot_count;
+    collector->sources = calloc(collector->source_count + 1, sizeof(data_source_t *));
+    if (!collector->sources) {
+        data_collector_destroy(collector);
+        return NULL;
+    }
+
     for (i = 0; i < collector->source_count; i++) {
-        data_source_t *source = &collector->sources[i];
-        source->type = malloc(strlen(config->plots[i].type) + 1);
-        source->target = malloc(strlen(config->plots[i].target) + 1);
-        
+        data_source_t *source = calloc(1, sizeof(data_source_t));
+        shared_plot_t *plot = shared_index_plot(collector->index, i);
+        int file;
+
+        if (!source) {
+            data_collector_destroy(collector);
+            return NULL;
+        }
+        collector->sources[i] = source;
+        source->type = strdup(config->plots[i].type);
+        source->target = strdup(config->plots[i].target);
+        source->attached = 1;
         if (!source->type || !source->target) {
-            for (j = 0; j < i; j++) {
-                free(collector->sources[j].type);
-                free(collector->sources[j].target);
-            }
-            free(collector->sources);
-            free(collector);
+            data_collector_destroy(collector);
             return NULL;
         }
-        
-        strcpy(source->type, config->plots[i].type);
-        strcpy(source->target, config->plots[i].target);
-        source->datasource = datasource_create(config->plots[i].type, config->plots[i].target);
-        source->data_buffer = ringbuf_create(config->default_width - 2);
-        source->thread = NULL;
 
-        source->is_dual = (source->datasource && source->datasource->handler->is_dual);
-        if (source->is_dual) {
-            source->data_buffer_secondary = ringbuf_create(config->default_width - 2);
-        } else {
-            source->data_buffer_secondary = NULL;
+        if (!plot || strncmp(plot->type, source->type, SHARED_TYPE_LENGTH - 1) != 0 ||
+            strncmp(plot->target, source->target, SHARED_TARGET_LENGTH - 1) != 0) {
+            fprintf(stderr, "Daemon does not sample %s=%s, config differs\n", source->type, source->target);
+            continue;
         }
+        if (strcmp(source->type, "heatmap") == 0) continue;
 
-        source->refresh_interval_ms = (config->plots[i].refresh_interval_ms > 0) ?
-                                     config->plots[i].refresh_interval_ms :
-                                     config->refresh_interval_ms;
+        source->shared = plot;
+        source->datasource = strcmp(source->type, "remote") == 0 ? remote_describe(source->target) :
+                             datasource_describe(source->type, source->target);
+        source->is_dual = plot->is_dual;
+        source->column_interval_ms = plot->column_interval_ms;
+        source->refresh_interval_ms = plot->column_interval_ms;
 
-        if (source->datasource) {
-            datasource_set_refresh_interval(source->datasource, source->refresh_interval_ms);
+        file = data_source_buffer_name(config, i, "", path, sizeof(path));
+        source->data_buffer = ringbuf_attach(path, !file);
+        if (source->is_dual) {
+            data_source_buffer_name(config, i, "-out", path, sizeof(path));
+            source->data_buffer_secondary = ringbuf_attach(path, !file);
         }
-
         if (!source->data_buffer) {
-            for (j = 0; j < i; j++) {
-                free(collector->sources[j].type);
-                free(collector->sources[j].target);
-                ringbuf_destroy(collector->sources[j].data_buffer);
-            }
-            free(collector->sources);
-            free(collector);
-            return NULL;
+            fprintf(stderr, "Cannot attach to %s\n", path);
         }
     }
 
-
     return collector;
 }
 
 void data_collector_destroy(data_collector_t *collector) {
-    uint32_t i;
+    uint32_t i, stuck = 0;
     if (!collector) return;
-    
-    for (i = 0; i < collector->source_count; i++) {
-        free(collector->sources[i].type);
-        free(collector->sources[i].target);
-        datasource_destroy(collector->sources[i].datasource);
-        ringbuf_destroy(collector->sources[i].data_buffer);
-        if (collector->sources[i].data_buffer_secondary) {
-            ringbuf_destroy(collector->sources[i].data_buffer_secondary);
+
+    /* All told first, so stuck probes do not add up their timeouts */
+    for (i = 0; collector->sources && i < collector->source_count; i++) {
+        if (collector->sources[i]) collector->sources[i]->running = 0;
+    }
+    for (i = 0; collector->sources && i < collector->source_count; i++) {
+        if (!collector->sources[i]) continue;
+        if (data_source_stop(collector->sources[i])) {
+            data_source_destroy(collector->sources[i]);
+        } else {
+            stuck++;
         }
     }
-    
+
+    /* A source left behind still publishes its stats into the index */
     free(collector->sources);
+    if (!stuck) shared_index_destroy(collector->index);
     free(collector);
 }
 
 int data_collector_start(data_collector_t *collector) {
     uint32_t i;
     if (!collector) return 0;
-    
-    for (i = 0; i < collector->source_count; i++) {
-        data_source_t *source = &collector->sources[i];
-        source->thread = plot_thread_create(data_source_thread, source);
 
-        if (!source->thread) {
+    /* The replay thread does all the pushing */
+    if (collector->replay) return 1;
+
+    for (i = 0; i < collector->source_count; i++) {
+        data_source_t *source = collector->sources[i];
+        if (source->thread || (source->attached && !source->data_buffer)) continue;
+        if (!data_source_start(source)) {
             return 0;
         }
     }
-    
+
     return 1;
 }
 
+/* Takes the plots of a reloaded config. Plots still sampling the same
+ * thing the same way keep their source, thread and history, the sources
+ * of plots gone are stopped before new ones are set up and started, so a
+ * history file is never open twice. Plots of a daemon, a viewer or a
+ * replay are fixed, those return 0 and keep everything as it was. */
+int data_collector_reload(data_collector_t *collector, config_t *config) {
+    data_source_t **sources;
+    uint32_t i, j;
+
+    if (!collector || !config || collector->index || collector->replay) return 0;
+    for (i = 0; i < collector->source_count; i++) {
+        if (collector->sources[i]->attached) return 0;
+    }
+
+    sources = calloc(config->plot_count + 1, sizeof(data_source_t *));
+    if (!sources) return 0;
+
+    for (i = 0; i < config->plot_count; i++) {
+        for (j = 0; j < collector->source_count; j++) {
+            if (data_source_matches(collector->sources[j], config, i)) {
+                sources[i] = collector->sources[j];
+                collector->sources[j] = NULL;
+                break;
+            }
+        }
+    }
+
+    for (j = 0; j < collector->source_count; j++) {
+        if (collector->sources[j]) collector->sources[j]->running = 0;
+    }
+    for (j = 0; j < collector->source_count; j++) {
+        if (collector->sources[j] && data_source_stop(collector->sources[j])) {
+            data_source_destroy(collector->sources[j]);
+        }
+    }
+    free(collector->sources);
+    collector->sources = sources;
+    collector->source_count = config->plot_count;
+
+    if (config->history_dir) {
+        mkdir(config->history_dir, 0755);
+    }
+
+    /* Only running out of memory fails here. The collector then keeps the
+     * sources it has, packed, for the caller to reload the running config
+     * over. */
+    for (i = 0; i < collector->source_count; i++) {
+        if (sources[i]) continue;
+        sources[i] = data_source_create(config, i, NULL, 0);
+        if (!sources[i]) {
+            for (i = 0, j = 0; i < config->plot_count; i++) {
+                if (sources[i]) sources[j++] = sources[i];
+            }
+            collector->source_count = j;
+            return 0;
+        }
+    }
+
+    return data_collector_start(collector);
+}
+
+/* For -v: plots that pushed a sample since start, of those sampled in this
+ * process, when the first and the last of them did, and the slowest to
+ * open its datasource */
+uint32_t data_collector_sampled(data_collector_t *collector, uint64_t *first_us, uint64_t *last_us,
+                                data_source_t **slowest) {
+    uint32_t i, sampled = 0;
+
+    *first_us = 0;
+    *last_us = 0;
+    *slowest = NULL;
+    if (!collector) return 0;
+
+    for (i = 0; i < collector->source_count; i++) {
+        data_source_t *source = collector->sources[i];
+        uint64_t pushed;
+
+        if (!source->data_buffer || source->attached) continue;
+        if (!*slowest || source->init_ms > (*slowest)->init_ms) *slowest = source;
+
+        pushed = source->data_buffer->first_push_us;
+        if (!pushed) continue;
+        if (!*first_us || pushed < *first_us) *first_us = pushed;
+        if (pushed > *last_us) *last_us = pushed;
+        sampled++;
+    }
+    return sampled;
+}
+
+/* The datasource once its sampler has opened it, NULL before that or when
+ * opening failed. The context is written on the sampling thread, so other
+ * threads go through here before calling into the handler. */
+datasource_t *data_source_opened(data_source_t *source) {
+    if (!source || !source->datasource) return NULL;
+    if (__atomic_load_n(&source->initializing, __ATOMIC_ACQUIRE)) return NULL;
+    return source->datasource->context ? source->datasource : NULL;
+}
@@ -4,8 +4,11 @@
 #include "compat.h"
 #include "platform.h"
 #include "ringbuf.h"
+#include "history.h"
 #include "config.h"
 #include "datasource.h"
+#include "heatmap.h"
+#include "shared.h"
 
 typedef struct {
     char *type;
@@ -13,18 +16,49 @@ typedef struct {
     datasource_t *datasource;
     ringbuf_t *data_buffer;
     ringbuf_t *data_buffer_secondary;
+    history_t *history;          /* compressed deep history, NULL unless enabled */
+    history_t *history_secondary;
+    uint32_t history_depth;      /* history= of the plot, for a reload to compare */
     plot_thread_t *thread;
+    volatile int running;        /* cleared to stop the thread */
+    volatile int initializing;   /* datasource not opened yet, for heatmaps workers left */
+    uint32_t init_ms;            /* how long opening the datasource took */
     int32_t refresh_interval_ms;
+    int32_t refresh_interval_us; /* 0 unless sampling faster than once a millisecond */
+    int32_t column_interval_ms;  /* one ring buffer slot, >= refresh_interval_ms */
+    int32_t history_sync_ms;     /* 0 when the buffers are not file backed */
     int is_dual;
+
+    /* --daemon publishes stats here, --attach reads them and the buffers */
+    shared_plot_t *shared;
+    int attached;
+
+    /* remote=host:plot sources, fed by an agent instead of a datasource */
+    struct remote_client *remote;
+
+    /* heatmap sources sample one datasource per row */
+    heatmap_t *heatmap;
+    datasource_t **row_sources;
+    uint32_t row_count;
 } data_source_t;
 
 typedef struct {
-    data_source_t *sources;
+    data_source_t **sources;     /* each allocated apart, kept across a reload */
     uint32_t source_count;
+    shared_index_t *index;  /* NULL unless shared with viewers */
+    int replay;             /* buffers fed from a --record log */
 } data_collector_t;
 
-data_collector_t *data_collector_create(config_t *config);
+#define COLLECTOR_SHARED 1  /* buffers in shared memory for --attach viewers */
+#define COLLECTOR_REPLAY 2  /* datasources only described, nothing sampled */
+
+data_collector_t *data_collector_create(config_t *config, int flags);
+data_collector_t *data_collector_attach(config_t *config);
 void data_collector_destroy(data_collector_t *collector);
 int data_collector_start(data_collector_t *collector);
+int data_collector_reload(data_collector_t *collector, config_t *config);
+uint32_t data_collector_sampled(data_collector_t *collector, uint64_t *first_us, uint64_t *last_us,
+                                data_source_t **slowest);
+datasource_t *data_source_opened(data_source_t *source);
 
 #endif
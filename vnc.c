@@ -0,0 +1,1481 @@
+#define _GNU_SOURCE
+#include "compat.h"
+#include "vnc.h"
+#include "net.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <poll.h>
+#include <zlib.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+
+#define VNC_MAX_CLIENTS 32
+#define VNC_IN_MAX 4096
+#define VNC_POLL_MS 250
+#define VNC_HANDSHAKE_TIMEOUT_MS 10000
+#define VNC_QUEUE_MAX 256
+#define VNC_BACKLOG (64 * 1024 * 1024)  /* drop viewers this far behind */
+#define VNC_ZLIB_LEVEL 6
+
+/* Damage is found in tiles of this size, ZRLE always uses 64x64 */
+#define VNC_TILE_W 64
+#define VNC_TILE_H 16
+#define VNC_ZRLE_TILE 64
+#define VNC_PALETTE_MAX 127
+
+#define VNC_ENC_RAW 0
+#define VNC_ENC_COPYRECT 1
+#define VNC_ENC_ZRLE 16
+#define VNC_ENC_DESKTOP_SIZE -223
+
+#define VNC_CAN_COPYRECT 1
+#define VNC_CAN_ZRLE 2
+#define VNC_CAN_DESKTOP_SIZE 4
+
+typedef struct {
+    uint8_t bpp;
+    uint8_t depth;
+    uint8_t big_endian;
+    uint8_t true_colour;
+    uint16_t max[3];
+    uint8_t shift[3];
+} vnc_format_t;
+
+typedef struct {
+    uint8_t *data;
+    size_t size;
+    size_t capacity;
+} vnc_buffer_t;
+
+/* One encoded FramebufferUpdate, shared by every viewer it is queued for */
+typedef struct {
+    uint8_t *data;
+    size_t size;
+    uint32_t refs;
+} vnc_blob_t;
+
+/* Viewers with the same pixel format and encodings share an encoder and
+ * its zlib stream. The stream is raw deflate: every viewer starts with a
+ * full frame from a private stream and the shared one is reset after that,
+ * so its next blocks never refer back to data the newcomer did not see. */
+typedef struct vnc_encoder {
+    vnc_format_t format;
+    int caps;
+    uint32_t bytes;         /* per pixel */
+    uint32_t cpixel_size;   /* ZRLE drops the unused byte of 32 bpp */
+    uint32_t cpixel_offset;
+    int native;             /* format is our own 0x00RRGGBB */
+    z_stream zs;
+    int zs_ready;
+    int reset_stream;
+    uint32_t clients;
+    struct vnc_encoder *next;
+} vnc_encoder_t;
+
+typedef struct {
+    rect_t rect;
+    int32_t src_x;
+    int32_t src_y;
+    int copy;
+} vnc_op_t;
+
+typedef enum {
+    VNC_CLIENT_FREE,
+    VNC_CLIENT_VERSION,
+    VNC_CLIENT_SECURITY,
+    VNC_CLIENT_INIT,
+    VNC_CLIENT_READY
+} vnc_client_state_t;
+
+typedef struct {
+    /* Guarded by the server mutex */
+    vnc_client_state_t state;
+    vnc_format_t format;
+    int caps;
+    int32_t width;          /* framebuffer size the viewer knows about */
+    int32_t height;
+    vnc_encoder_t *encoder;
+    int join;               /* wants a first full frame */
+    int refresh;            /* asked for a full frame again */
+    int zlib_started;       /* viewer has seen a zlib header */
+    int dropped;
+    vnc_blob_t *queue[VNC_QUEUE_MAX];
+    uint32_t queue_head;
+    uint32_t queue_count;
+    size_t queue_bytes;
+
+    /* VNC thread only */
+    int fd;
+    int minor_version;
+    uint32_t last_activity_ms;
+    uint8_t in[VNC_IN_MAX];
+    size_t in_size;
+    size_t skip;            /* cut text bytes still to be ignored */
+    vnc_buffer_t out;
+    size_t out_sent;
+    size_t blob_sent;
+    int requested;
+    int wants_updates;
+} vnc_client_t;
+
+struct vnc_server {
+    int listen_fd;
+    int wake_fd[2];
+    plot_thread_t *thread;
+    volatile int running;
+
+    mutex_t *mutex;
+    vnc_client_t clients[VNC_MAX_CLIENTS];
+    vnc_encoder_t *encoders;
+    int32_t width;          /* for ServerInit */
+    int32_t height;
+    int readback_failed;
+
+    /* Render thread only: the picture every attached viewer has */
+    uint32_t *shadow;
+    size_t shadow_capacity;
+    int32_t shadow_width;
+    int32_t shadow_height;
+    int shadow_valid;
+    uint32_t last_serial;
+    int32_t last_scroll_y;
+
+    vnc_op_t *ops;
+    uint32_t op_count;
+    uint32_t op_capacity;
+    uint8_t *tiles;
+    size_t tile_capacity;
+    uint32_t tile[VNC_ZRLE_TILE * VNC_ZRLE_TILE];
+    vnc_buffer_t zrle;
+    vnc_buffer_t message;
+};
+
+static const vnc_format_t vnc_native_format = { 32, 24, 0, 1, { 255, 255, 255 }, { 16, 8, 0 } };
+
+static int vnc_buffer_reserve(vnc_buffer_t *buffer, size_t size) {
+    if (buffer->size + size <= buffer->capacity) return 1;
+
+    size_t capacity = buffer->capacity ? buffer->capacity * 2 : 4096;
+    while (capacity < buffer->size + size) capacity *= 2;
+
+    uint8_t *grown = realloc(buffer->data, capacity);
+    if (!grown) return 0;
+    buffer->data = grown;
+    buffer->capacity = capacity;
+    return 1;
+}
+
+static int vnc_put(vnc_buffer_t *buffer, const void *data, size_t size) {
+    if (!vnc_buffer_reserve(buffer, size)) return 0;
+    memcpy(buffer->data + buffer->size, data, size);
+    buffer->size += size;
+    return 1;
+}
+
+static int vnc_put8(vnc_buffer_t *buffer, uint8_t value) {
+    return vnc_put(buffer, &value, 1);
+}
+
+static int vnc_put16(vnc_buffer_t *buffer, uint16_t value) {
+    uint8_t bytes[2] = { value >> 8, value };
+    return vnc_put(buffer, bytes, 2);
+}
+
+static int vnc_put32(vnc_buffer_t *buffer, uint32_t value) {
+    uint8_t bytes[4] = { value >> 24, value >> 16, value >> 8, value };
+    return vnc_put(buffer, bytes, 4);
+}
+
+static void vnc_patch32(vnc_buffer_t *buffer, size_t at, uint32_t value) {
+    buffer->data[at] = value >> 24;
+    buffer->data[at + 1] = value >> 16;
+    buffer->data[at + 2] = value >> 8;
+    buffer->data[at + 3] = value;
+}
+
+static void vnc_blob_release(vnc_blob_t *blob) {
+    if (!blob) return;
+    if (--blob->refs == 0) {
+        free(blob->data);
+        free(blob);
+    }
+}
+
+/* Pixel formats */
+
+static void vnc_format_parse(vnc_format_t *format, const uint8_t *data) {
+    format->bpp = data[0];
+    format->depth = data[1];
+    format->big_endian = data[2] != 0;
+    format->true_colour = data[3] != 0;
+    format->max[0] = (data[4] << 8) | data[5];
+    format->max[1] = (data[6] << 8) | data[7];
+    format->max[2] = (data[8] << 8) | data[9];
+    format->shift[0] = data[10];
+    format->shift[1] = data[11];
+    format->shift[2] = data[12];
+}
+
+static void vnc_format_put(vnc_buffer_t *buffer, const vnc_format_t *format) {
+    uint8_t pad[3] = { 0, 0, 0 };
+    vnc_put8(buffer, format->bpp);
+    vnc_put8(buffer, format->depth);
+    vnc_put8(buffer, format->big_endian);
+    vnc_put8(buffer, format->true_colour);
+    vnc_put16(buffer, format->max[0]);
+    vnc_put16(buffer, format->max[1]);
+    vnc_put16(buffer, format->max[2]);
+    vnc_put8(buffer, format->shift[0]);
+    vnc_put8(buffer, format->shift[1]);
+    vnc_put8(buffer, format->shift[2]);
+    vnc_put(buffer, pad, 3);
+}
+
+static int vnc_format_usable(const vnc_format_t *format) {
+    int i;
+    if (!format->true_colour) return 0;
+    if (format->bpp != 8 && format->bpp != 16 && format->bpp != 32) return 0;
+    for (i = 0; i < 3; i++) {
+        if (format->max[i] == 0 || format->shift[i] >= format->bpp) return 0;
+    }
+    return 1;
+}
+
+static int vnc_format_equal(const vnc_format_t *a, const vnc_format_t *b) {
+    int i;
+    if (a->bpp != b->bpp || a->depth != b->depth || a->big_endian != b->big_endian) return 0;
+    for (i = 0; i < 3; i++) {
+        if (a->max[i] != b->max[i] || a->shift[i] != b->shift[i]) return 0;
+    }
+    return 1;
+}
+
+static uint32_t vnc_convert(const vnc_format_t *format, uint32_t rgb) {
+    uint32_t r = (rgb >> 16) & 0xff, g = (rgb >> 8) & 0xff, b = rgb & 0xff;
+    return ((r * format->max[0] + 127) / 255) << format->shift[0] |
+           ((g * format->max[1] + 127) / 255) << format->shift[1] |
+           ((b * format->max[2] + 127) / 255) << format->shift[2];
+}
+
+static void vnc_pixel_bytes(const vnc_encoder_t *encoder, uint32_t value, uint8_t *bytes) {
+    uint32_t i, n = encoder->bytes;
+    for (i = 0; i < n; i++) {
+        uint32_t byte_shift = encoder->format.big_endian ? (n - 1 - i) * 8 : i * 8;
+        bytes[i] = value >> byte_shift;
+    }
+}
+
+static void vnc_put_cpixel(vnc_buffer_t *buffer, const vnc_encoder_t *encoder, uint32_t value) {
+    uint8_t bytes[4];
+    vnc_pixel_bytes(encoder, value, bytes);
+    vnc_put(buffer, bytes + encoder->cpixel_offset, encoder->cpixel_size);
+}
+
+/* Encoders */
+
+static vnc_encoder_t *vnc_encoder_get(vnc_server_t *server, const vnc_format_t *format, int caps) {
+    vnc_encoder_t *encoder;
+    uint32_t mask, one = 1;
+
+    for (encoder = server->encoders; encoder; encoder = encoder->next) {
+        if (encoder->caps == caps && vnc_format_equal(&encoder->format, format)) return encoder;
+    }
+
+    encoder = calloc(1, sizeof(vnc_encoder_t));
+    if (!encoder) return NULL;
+
+    encoder->format = *format;
+    encoder->caps = caps;
+    encoder->bytes = format->bpp / 8;
+    encoder->cpixel_size = encoder->bytes;
+    if (format->bpp == 32 && format->depth <= 24) {
+        mask = ((uint32_t)format->max[0] << format->shift[0]) |
+               ((uint32_t)format->max[1] << format->shift[1]) |
+               ((uint32_t)format->max[2] << format->shift[2]);
+        if (!(mask & 0xff000000)) {
+            encoder->cpixel_size = 3;
+            encoder->cpixel_offset = format->big_endian ? 1 : 0;
+        } else if (!(mask & 0xff)) {
+            encoder->cpixel_size = 3;
+            encoder->cpixel_offset = format->big_endian ? 0 : 1;
+        }
+    }
+    encoder->native = vnc_format_equal(format, &vnc_native_format) && *(uint8_t*)&one == 1;
+
+    if (caps & VNC_CAN_ZRLE) {
+        if (deflateInit2(&encoder->zs, VNC_ZLIB_LEVEL, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+            free(encoder);
+            return NULL;
+        }
+        encoder->zs_ready = 1;
+    }
+
+    encoder->next = server->encoders;
+    server->encoders = encoder;
+    return encoder;
+}
+
+static void vnc_encoder_release(vnc_server_t *server, vnc_encoder_t *encoder) {
+    vnc_encoder_t **link;
+
+    if (!encoder || --encoder->clients > 0) return;
+
+    for (link = &server->encoders; *link; link = &(*link)->next) {
+        if (*link == encoder) {
+            *link = encoder->next;
+            break;
+        }
+    }
+    if (encoder->zs_ready) deflateEnd(&encoder->zs);
+    free(encoder);
+}
+
+/* Called with the mutex held. A blob partly on the wire stays queued so
+ * the viewer never sees half a message. */
+static void vnc_client_detach(vnc_server_t *server, vnc_client_t *client, int keep_partial) {
+    uint32_t keep = (keep_partial && client->blob_sent > 0 && client->queue_count > 0) ? 1 : 0;
+
+    while (client->queue_count > keep) {
+        uint32_t last = (client->queue_head + client->queue_count - 1) % VNC_QUEUE_MAX;
+        client->queue_bytes -= client->queue[last]->size;
+        vnc_blob_release(client->queue[last]);
+        client->queue_count--;
+    }
+
+    vnc_encoder_release(server, client->encoder);
+    client->encoder = NULL;
+    client->join = 0;
+    client->refresh = 0;
+}
+
+static void vnc_client_queue(vnc_client_t *client, vnc_blob_t *blob) {
+    if (client->dropped) return;
+    if (client->queue_count == VNC_QUEUE_MAX || client->queue_bytes + blob->size > VNC_BACKLOG) {
+        client->dropped = 1;
+        return;
+    }
+    blob->refs++;
+    client->queue[(client->queue_head + client->queue_count) % VNC_QUEUE_MAX] = blob;
+    client->queue_count++;
+    client->queue_bytes += blob->size;
+}
+
+static vnc_blob_t *vnc_blob_create(const vnc_buffer_t *message) {
+    vnc_blob_t *blob = malloc(sizeof(vnc_blob_t));
+    if (!blob) return NULL;
+
+    blob->data = malloc(message->size);
+    if (!blob->data) {
+        free(blob);
+        return NULL;
+    }
+    memcpy(blob->data, message->data, message->size);
+    blob->size = message->size;
+    blob->refs = 1;
+    return blob;
+}
+
+/* Damage: tiles that differ from the shadow. With a move, pixels inside
+ * moved are checked against the shadow dx,dy away instead, which is what
+ * the viewer would have after a CopyRect. */
+
+static int vnc_row_differs(vnc_server_t *server, const uint32_t *pixels, int32_t stride,
+                           int32_t y, int32_t x0, int32_t x1, int32_t dx, int32_t dy) {
+    return memcmp(pixels + (size_t)y * stride + x0,
+                  server->shadow + (size_t)(y + dy) * server->shadow_width + x0 + dx,
+                  sizeof(uint32_t) * (x1 - x0)) != 0;
+}
+
+static uint32_t vnc_mark_tiles(vnc_server_t *server, const uint32_t *pixels, int32_t stride,
+                               rect_t r, const rect_t *moved, int32_t dx, int32_t dy) {
+    int32_t tiles_x = (r.w + VNC_TILE_W - 1) / VNC_TILE_W;
+    int32_t tiles_y = (r.h + VNC_TILE_H - 1) / VNC_TILE_H;
+    int32_t tx, ty, y;
+    uint32_t count = 0;
+
+    for (ty = 0; ty < tiles_y; ty++) {
+        int32_t y0 = r.y + ty * VNC_TILE_H;
+        int32_t y1 = y0 + VNC_TILE_H < r.y + r.h ? y0 + VNC_TILE_H : r.y + r.h;
+
+        for (tx = 0; tx < tiles_x; tx++) {
+            int32_t x0 = r.x + tx * VNC_TILE_W;
+            int32_t x1 = x0 + VNC_TILE_W < r.x + r.w ? x0 + VNC_TILE_W : r.x + r.w;
+            uint8_t dirty = 0;
+
+            for (y = y0; y < y1 && !dirty; y++) {
+                int32_t a = x0, b = x0;
+                if (moved && y >= moved->y && y < moved->y + moved->h) {
+                    a = x0 > moved->x ? x0 : moved->x;
+                    b = x1 < moved->x + moved->w ? x1 : moved->x + moved->w;
+                    if (a >= b) a = b = x0;
+                }
+                dirty = (a < b && vnc_row_differs(server, pixels, stride, y, a, b, dx, dy)) ||
+                        (x0 < a && vnc_row_differs(server, pixels, stride, y, x0, a, 0, 0)) ||
+                        (b < x1 && vnc_row_differs(server, pixels, stride, y, b, x1, 0, 0));
+            }
+            server->tiles[ty * tiles_x + tx] = dirty;
+            count += dirty;
+        }
+    }
+    return count;
+}
+
+static vnc_op_t *vnc_op_add(vnc_server_t *server) {
+    if (server->op_count == server->op_capacity) {
+        uint32_t capacity = server->op_capacity ? server->op_capacity * 2 : 64;
+        vnc_op_t *grown = realloc(server->ops, capacity * sizeof(vnc_op_t));
+        if (!grown) return NULL;
+        server->ops = grown;
+        server->op_capacity = capacity;
+    }
+    vnc_op_t *op = &server->ops[server->op_count++];
+    memset(op, 0, sizeof(*op));
+    return op;
+}
+
+/* Moves the viewer's copy of area by dx,dy with a CopyRect when that
+ * leaves fewer tiles of r to send. Returns the tiles left, server->tiles
+ * holds them. */
+static uint32_t vnc_try_move(vnc_server_t *server, const uint32_t *pixels, int32_t stride, rect_t r,
+                             rect_t area, int32_t dx, int32_t dy, uint32_t changed) {
+    int32_t ax = dx < 0 ? -dx : dx, ay = dy < 0 ? -dy : dy, y;
+    uint32_t left;
+    rect_t dst;
+
+    if (area.x < r.x) { area.w -= r.x - area.x; area.x = r.x; }
+    if (area.y < r.y) { area.h -= r.y - area.y; area.y = r.y; }
+    if (area.x + area.w > r.x + r.w) area.w = r.x + r.w - area.x;
+    if (area.y + area.h > r.y + r.h) area.h = r.y + r.h - area.y;
+    if (ax >= area.w || ay >= area.h) return changed;
+
+    dst.x = area.x + (dx < 0 ? ax : 0);
+    dst.y = area.y + (dy < 0 ? ay : 0);
+    dst.w = area.w - ax;
+    dst.h = area.h - ay;
+
+    left = vnc_mark_tiles(server, pixels, stride, r, &dst, dx, dy);
+    if (left >= changed) {
+        return vnc_mark_tiles(server, pixels, stride, r, NULL, 0, 0);
+    }
+
+    vnc_op_t *op = vnc_op_add(server);
+    if (!op) return vnc_mark_tiles(server, pixels, stride, r, NULL, 0, 0);
+    op->rect = dst;
+    op->src_x = dst.x + dx;
+    op->src_y = dst.y + dy;
+    op->copy = 1;
+
+    for (y = 0; y < dst.h; y++) {
+        int32_t row = dy > 0 ? dst.y + y : dst.y + dst.h - 1 - y;
+        memmove(server->shadow + (size_t)row * server->shadow_width + dst.x,
+                server->shadow + (size_t)(row + dy) * server->shadow_width + dst.x + dx,
+                sizeof(uint32_t) * dst.w);
+    }
+    return left;
+}
+
+static void vnc_diff_rect(vnc_server_t *server, const uint32_t *pixels, int32_t stride, rect_t r,
+                          rect_t area, int32_t dx, int32_t dy) {
+    int32_t tiles_x, tiles_y, tx, ty, y;
+    uint32_t changed, first_op, i;
+
+    if (r.x < 0) { r.w += r.x; r.x = 0; }
+    if (r.y < 0) { r.h += r.y; r.y = 0; }
+    if (r.x + r.w > server->shadow_width) r.w = server->shadow_width - r.x;
+    if (r.y + r.h > server->shadow_height) r.h = server->shadow_height - r.y;
+    if (r.w <= 0 || r.h <= 0) return;
+
+    tiles_x = (r.w + VNC_TILE_W - 1) / VNC_TILE_W;
+    tiles_y = (r.h + VNC_TILE_H - 1) / VNC_TILE_H;
+    if ((size_t)(tiles_x * tiles_y) > server->tile_capacity) {
+        uint8_t *grown = realloc(server->tiles, tiles_x * tiles_y);
+        if (!grown) return;
+        server->tiles = grown;
+        server->tile_capacity = tiles_x * tiles_y;
+    }
+
+    changed = vnc_mark_tiles(server, pixels, stride, r, NULL, 0, 0);
+    if (changed > 1 && (dx || dy)) {
+        changed = vnc_try_move(server, pixels, stride, r, area, dx, dy, changed);
+    }
+    if (changed == 0) return;
+
+    /* Runs of dirty tiles in a row become one rectangle, and grow down
+     * while the row below has the same run */
+    first_op = server->op_count;
+    for (ty = 0; ty < tiles_y; ty++) {
+        int32_t y0 = r.y + ty * VNC_TILE_H;
+        int32_t y1 = y0 + VNC_TILE_H < r.y + r.h ? y0 + VNC_TILE_H : r.y + r.h;
+
+        tx = 0;
+        while (tx < tiles_x) {
+            int32_t start, x0, x1;
+
+            if (!server->tiles[ty * tiles_x + tx]) {
+                tx++;
+                continue;
+            }
+            start = tx;
+            while (tx < tiles_x && server->tiles[ty * tiles_x + tx]) tx++;
+            x0 = r.x + start * VNC_TILE_W;
+            x1 = r.x + tx * VNC_TILE_W < r.x + r.w ? r.x + tx * VNC_TILE_W : r.x + r.w;
+
+            for (i = first_op; i < server->op_count; i++) {
+                rect_t *prev = &server->ops[i].rect;
+                if (prev->x == x0 && prev->w == x1 - x0 && prev->y + prev->h == y0) {
+                    prev->h += y1 - y0;
+                    break;
+                }
+            }
+            if (i == server->op_count) {
+                vnc_op_t *op = vnc_op_add(server);
+                if (!op) return;
+                op->rect.x = x0;
+                op->rect.y = y0;
+                op->rect.w = x1 - x0;
+                op->rect.h = y1 - y0;
+            }
+        }
+    }
+
+    for (i = first_op; i < server->op_count; i++) {
+        rect_t *o = &server->ops[i].rect;
+        for (y = o->y; y < o->y + o->h; y++) {
+            memcpy(server->shadow + (size_t)y * server->shadow_width + o->x,
+                   pixels + (size_t)y * stride + o->x, sizeof(uint32_t) * o->w);
+        }
+    }
+}
+
+static void vnc_find_damage(vnc_server_t *server, plot_system_t *system, const uint32_t *pixels, int32_t stride) {
+    int cleared = system->cleared_serial == system->frame_serial;
+    rect_t all = { 0, 0, server->shadow_width, server->shadow_height };
+    uint32_t i;
+
+    server->op_count = 0;
+
+    /* Scrolling the grid moves everything up or down at once */
+    if (cleared && system->scroll_y != server->last_scroll_y) {
+        vnc_diff_rect(server, pixels, stride, all, all, 0, system->scroll_y - server->last_scroll_y);
+    }
+
+    /* Samples are drawn right aligned, a new one moves the graph left a column */
+    for (i = 0; i < system->plot_count; i++) {
+        plot_t *plot = &system->plots[i];
+        if (!plot->on_screen || plot->drawn_serial != system->frame_serial) continue;
+        vnc_diff_rect(server, pixels, stride, plot->rect, plot->graph, 1, 0);
+    }
+
+    /* Margins, scrollbar and overlays only change when everything is redrawn */
+    if (cleared) {
+        vnc_diff_rect(server, pixels, stride, all, all, 0, 0);
+    }
+}
+
+/* ZRLE */
+
+typedef struct {
+    uint32_t colors[VNC_PALETTE_MAX];
+    uint32_t count;
+    int overflow;
+    uint8_t slot[256];      /* palette index + 1, 0 is empty */
+} vnc_palette_t;
+
+static uint32_t vnc_palette_hash(uint32_t value) {
+    return (value * 2654435761u) >> 24;
+}
+
+static int vnc_palette_find(const vnc_palette_t *palette, uint32_t value) {
+    uint32_t h = vnc_palette_hash(value);
+    while (palette->slot[h]) {
+        if (palette->colors[palette->slot[h] - 1] == value) return palette->slot[h] - 1;
+        h = (h + 1) & 255;
+    }
+    return -1;
+}
+
+static void vnc_palette_add(vnc_palette_t *palette, uint32_t value) {
+    uint32_t h = vnc_palette_hash(value);
+
+    if (palette->overflow) return;
+    while (palette->slot[h]) {
+        if (palette->colors[palette->slot[h] - 1] == value) return;
+        h = (h + 1) & 255;
+    }
+    if (palette->count == VNC_PALETTE_MAX) {
+        palette->overflow = 1;
+        return;
+    }
+    palette->colors[palette->count++] = value;
+    palette->slot[h] = palette->count;
+}
+
+static void vnc_put_run_length(vnc_buffer_t *buffer, uint32_t length) {
+    length--;
+    while (length >= 255) {
+        vnc_put8(buffer, 255);
+        length -= 255;
+    }
+    vnc_put8(buffer, length);
+}
+
+static void vnc_zrle_tile(vnc_server_t *server, const vnc_encoder_t *encoder, const uint32_t *pixels,
+                          int32_t stride, int32_t x, int32_t y, int32_t w, int32_t h) {
+    vnc_buffer_t *out = &server->zrle;
+    uint32_t *tile = server->tile;
+    uint32_t cp = encoder->cpixel_size;
+    uint32_t n = (uint32_t)(w * h), i, run, last_rgb = 0, last_value = 0;
+    size_t raw_cost, plain_cost = 0, palette_rle_cost = 0, packed_cost = (size_t)-1;
+    vnc_palette_t palette;
+    int32_t row, col;
+    int subencoding = 0;
+
+    palette.count = 0;
+    palette.overflow = 0;
+    memset(palette.slot, 0, sizeof(palette.slot));
+
+    for (row = 0; row < h; row++) {
+        const uint32_t *src = pixels + (size_t)(y + row) * stride + x;
+        uint32_t *dst = tile + row * w;
+        for (col = 0; col < w; col++) {
+            uint32_t rgb = src[col] & 0xffffff;
+            if (encoder->native) {
+                dst[col] = rgb;
+            } else {
+                if (rgb != last_rgb || (row == 0 && col == 0)) {
+                    last_rgb = rgb;
+                    last_value = vnc_convert(&encoder->format, rgb);
+                }
+                dst[col] = last_value;
+            }
+        }
+    }
+
+    /* Runs may wrap from one row to the next */
+    for (i = 0; i < n; i += run) {
+        uint32_t length_bytes;
+        for (run = 1; i + run < n && tile[i + run] == tile[i]; run++);
+        length_bytes = (run - 1) / 255 + 1;
+        plain_cost += cp + length_bytes;
+        palette_rle_cost += 1 + (run > 1 ? length_bytes : 0);
+        vnc_palette_add(&palette, tile[i]);
+    }
+
+    if (!palette.overflow && palette.count == 1) {
+        vnc_put8(out, 1);
+        vnc_put_cpixel(out, encoder, tile[0]);
+        return;
+    }
+
+    raw_cost = (size_t)n * cp;
+    if (plain_cost < raw_cost) {
+        subencoding = 128;
+        raw_cost = plain_cost;
+    }
+    if (!palette.overflow) {
+        palette_rle_cost += palette.count * cp;
+        if (palette_rle_cost < raw_cost) {
+            subencoding = 128 + palette.count;
+            raw_cost = palette_rle_cost;
+        }
+        if (palette.count <= 16) {
+            uint32_t bits = palette.count == 2 ? 1 : palette.count <= 4 ? 2 : 4;
+            packed_cost = palette.count * cp + (size_t)h * ((w * bits + 7) / 8);
+            if (packed_cost < raw_cost) {
+                subencoding = palette.count;
+            }
+        }
+    }
+
+    vnc_put8(out, subencoding);
+
+    if (subencoding == 0) {
+        for (i = 0; i < n; i++) {
+            vnc_put_cpixel(out, encoder, tile[i]);
+        }
+    } else if (subencoding == 128) {
+        for (i = 0; i < n; i += run) {
+            for (run = 1; i + run < n && tile[i + run] == tile[i]; run++);
+            vnc_put_cpixel(out, encoder, tile[i]);
+            vnc_put_run_length(out, run);
+        }
+    } else if (subencoding > 128) {
+        for (i = 0; i < palette.count; i++) {
+            vnc_put_cpixel(out, encoder, palette.colors[i]);
+        }
+        for (i = 0; i < n; i += run) {
+            int index;
+            for (run = 1; i + run < n && tile[i + run] == tile[i]; run++);
+            index = vnc_palette_find(&palette, tile[i]);
+            if (run == 1) {
+                vnc_put8(out, index);
+            } else {
+                vnc_put8(out, index | 128);
+                vnc_put_run_length(out, run);
+            }
+        }
+    } else {
+        uint32_t bits = palette.count == 2 ? 1 : palette.count <= 4 ? 2 : 4;
+        for (i = 0; i < palette.count; i++) {
+            vnc_put_cpixel(out, encoder, palette.colors[i]);
+        }
+        for (row = 0; row < h; row++) {
+            uint32_t byte = 0, used = 0;
+            for (col = 0; col < w; col++) {
+                byte = (byte << bits) | (uint32_t)vnc_palette_find(&palette, tile[row * w + col]);
+                used += bits;
+                if (used == 8) {
+                    vnc_put8(out, byte);
+                    byte = 0;
+                    used = 0;
+                }
+            }
+            if (used > 0) {
+                vnc_put8(out, byte << (8 - used));
+            }
+        }
+    }
+}
+
+static int vnc_deflate(z_stream *zs, const vnc_buffer_t *in, vnc_buffer_t *out) {
+    zs->next_in = in->data;
+    zs->avail_in = in->size;
+    do {
+        if (!vnc_buffer_reserve(out, in->size / 4 + 1024)) return 0;
+        zs->next_out = out->data + out->size;
+        zs->avail_out = out->capacity - out->size;
+        if (deflate(zs, Z_SYNC_FLUSH) == Z_STREAM_ERROR) return 0;
+        out->size = out->capacity - zs->avail_out;
+    } while (zs->avail_out == 0);
+    return 1;
+}
+
+static int vnc_put_zrle(vnc_server_t *server, const vnc_encoder_t *encoder, z_stream *zs,
+                        const uint32_t *pixels, int32_t stride, rect_t r) {
+    vnc_buffer_t *out = &server->message;
+    int32_t tx, ty;
+    size_t length_at;
+
+    server->zrle.size = 0;
+    for (ty = r.y; ty < r.y + r.h; ty += VNC_ZRLE_TILE) {
+        int32_t th = r.y + r.h - ty < VNC_ZRLE_TILE ? r.y + r.h - ty : VNC_ZRLE_TILE;
+        for (tx = r.x; tx < r.x + r.w; tx += VNC_ZRLE_TILE) {
+            int32_t tw = r.x + r.w - tx < VNC_ZRLE_TILE ? r.x + r.w - tx : VNC_ZRLE_TILE;
+            vnc_zrle_tile(server, encoder, pixels, stride, tx, ty, tw, th);
+        }
+    }
+
+    length_at = out->size;
+    if (!vnc_put32(out, 0)) return 0;
+    if (!vnc_deflate(zs, &server->zrle, out)) return 0;
+    vnc_patch32(out, length_at, out->size - length_at - 4);
+    return 1;
+}
+
+static int vnc_put_raw(vnc_buffer_t *out, const vnc_encoder_t *encoder, const uint32_t *pixels,
+                       int32_t stride, rect_t r) {
+    int32_t x, y;
+    uint8_t bytes[4];
+
+    if (!vnc_buffer_reserve(out, (size_t)r.w * r.h * encoder->bytes)) return 0;
+    for (y = r.y; y < r.y + r.h; y++) {
+        const uint32_t *row = pixels + (size_t)y * stride;
+        if (encoder->native) {
+            vnc_put(out, row + r.x, sizeof(uint32_t) * r.w);
+            continue;
+        }
+        for (x = r.x; x < r.x + r.w; x++) {
+            vnc_pixel_bytes(encoder, vnc_convert(&encoder->format, row[x]), bytes);
+            vnc_put(out, bytes, encoder->bytes);
+        }
+    }
+    return 1;
+}
+
+static void vnc_put_rect_header(vnc_buffer_t *out, rect_t r, int32_t encoding) {
+    vnc_put16(out, r.x);
+    vnc_put16(out, r.y);
+    vnc_put16(out, r.w);
+    vnc_put16(out, r.h);
+    vnc_put32(out, (uint32_t)encoding);
+}
+
+/* Builds a FramebufferUpdate for the ops in server->message */
+static int vnc_encode_update(vnc_server_t *server, const vnc_encoder_t *encoder, z_stream *zs,
+                             const uint32_t *pixels, int32_t stride, const vnc_op_t *ops,
+                             uint32_t op_count, int desktop_size) {
+    vnc_buffer_t *out = &server->message;
+    uint32_t i;
+
+    out->size = 0;
+    vnc_put8(out, 0);
+    vnc_put8(out, 0);
+    vnc_put16(out, op_count + (desktop_size ? 1 : 0));
+
+    if (desktop_size) {
+        rect_t size = { 0, 0, server->shadow_width, server->shadow_height };
+        vnc_put_rect_header(out, size, VNC_ENC_DESKTOP_SIZE);
+    }
+
+    for (i = 0; i < op_count; i++) {
+        const vnc_op_t *op = &ops[i];
+
+        if (op->copy && (encoder->caps & VNC_CAN_COPYRECT)) {
+            vnc_put_rect_header(out, op->rect, VNC_ENC_COPYRECT);
+            vnc_put16(out, op->src_x);
+            vnc_put16(out, op->src_y);
+        } else if (encoder->caps & VNC_CAN_ZRLE) {
+            vnc_put_rect_header(out, op->rect, VNC_ENC_ZRLE);
+            if (!vnc_put_zrle(server, encoder, zs, pixels, stride, op->rect)) return 0;
+        } else {
+            vnc_put_rect_header(out, op->rect, VNC_ENC_RAW);
+            if (!vnc_put_raw(out, encoder, pixels, stride, op->rect)) return 0;
+        }
+    }
+
+    /* The puts above only fail when memory runs out */
+    return out->size >= 4;
+}
+
+/* Sends the ops to every viewer attached to an encoder */
+static int vnc_publish_shared(vnc_server_t *server, const uint32_t *pixels, int32_t stride,
+                              const vnc_op_t *ops, uint32_t op_count, int resized) {
+    vnc_encoder_t *encoder;
+    uint32_t i, c;
+    int queued = 0;
+
+    for (encoder = server->encoders; encoder; encoder = encoder->next) {
+        int desktop_size = resized && (encoder->caps & VNC_CAN_DESKTOP_SIZE);
+
+        if (resized && !desktop_size) {
+            /* Nothing to tell the viewer about the new size with */
+            for (c = 0; c < VNC_MAX_CLIENTS; c++) {
+                if (server->clients[c].encoder == encoder) server->clients[c].dropped = 1;
+            }
+            continue;
+        }
+
+        if (encoder->zs_ready && encoder->reset_stream) {
+            for (i = 0; i < op_count; i++) {
+                if (!ops[i].copy || !(encoder->caps & VNC_CAN_COPYRECT)) break;
+            }
+            if (i < op_count) {
+                deflateReset(&encoder->zs);
+                encoder->reset_stream = 0;
+            }
+        }
+
+        if (!vnc_encode_update(server, encoder, &encoder->zs, pixels, stride, ops, op_count, desktop_size)) continue;
+        vnc_blob_t *blob = vnc_blob_create(&server->message);
+        if (!blob) continue;
+
+        for (c = 0; c < VNC_MAX_CLIENTS; c++) {
+            vnc_client_t *client = &server->clients[c];
+            if (client->encoder != encoder) continue;
+            vnc_client_queue(client, blob);
+            if (desktop_size) {
+                client->width = server->shadow_width;
+                client->height = server->shadow_height;
+            }
+            queued = 1;
+        }
+        vnc_blob_release(blob);
+    }
+    return queued;
+}
+
+/* A full frame on a zlib stream of the viewer's own, then it shares the encoder */
+static int vnc_publish_private(vnc_server_t *server, vnc_client_t *client, const uint32_t *pixels, int32_t stride) {
+    vnc_encoder_t *encoder = client->encoder;
+    vnc_op_t all;
+    z_stream zs;
+    int desktop_size = 0, ok;
+
+    if (!encoder) {
+        encoder = vnc_encoder_get(server, &client->format, client->caps);
+        if (!encoder) return 0;
+        encoder->clients++;
+        client->encoder = encoder;
+    }
+
+    if (client->width != server->shadow_width || client->height != server->shadow_height) {
+        if (!(encoder->caps & VNC_CAN_DESKTOP_SIZE)) {
+            client->dropped = 1;
+            return 0;
+        }
+        desktop_size = 1;
+    }
+
+    memset(&all, 0, sizeof(all));
+    all.rect.w = server->shadow_width;
+    all.rect.h = server->shadow_height;
+
+    memset(&zs, 0, sizeof(zs));
+    if (encoder->zs_ready) {
+        /* A viewer that already inflated something only takes more deflate blocks */
+        if (deflateInit2(&zs, VNC_ZLIB_LEVEL, Z_DEFLATED, client->zlib_started ? -15 : 15,
+                         8, Z_DEFAULT_STRATEGY) != Z_OK) {
+            return 0;
+        }
+    }
+    ok = vnc_encode_update(server, encoder, &zs, pixels, stride, &all, 1, desktop_size);
+    if (encoder->zs_ready) {
+        deflateEnd(&zs);
+        encoder->reset_stream = 1;
+        client->zlib_started = 1;
+    }
+    if (!ok) return 0;
+
+    vnc_blob_t *blob = vnc_blob_create(&server->message);
+    if (!blob) return 0;
+    vnc_client_queue(client, blob);
+    vnc_blob_release(blob);
+
+    client->width = server->shadow_width;
+    client->height = server->shadow_height;
+    return 1;
+}
+
+/* Viewers waiting for frames, under the mutex */
+static int vnc_frames_wanted(vnc_server_t *server) {
+    uint32_t c;
+
+    for (c = 0; c < VNC_MAX_CLIENTS; c++) {
+        vnc_client_t *client = &server->clients[c];
+        if (client->state == VNC_CLIENT_READY && !client->dropped && (client->encoder || client->join)) return 1;
+    }
+    return 0;
+}
+
+/* For the render thread, which keeps drawing a hidden window for them */
+int vnc_server_wants_frames(vnc_server_t *server) {
+    int wanted;
+
+    if (!server) return 0;
+
+    mutex_lock(server->mutex);
+    wanted = vnc_frames_wanted(server);
+    mutex_unlock(server->mutex);
+    return wanted;
+}
+
+/* Called by the render thread after every update */
+void vnc_server_publish(vnc_server_t *server, plot_system_t *system) {
+    const uint32_t *pixels;
+    int32_t width, height, stride, y;
+    uint32_t c;
+    int wanted, queued = 0;
+
+    if (!server || !system) return;
+
+    mutex_lock(server->mutex);
+    server->width = system->cached_window_width;
+    server->height = system->cached_window_height;
+
+    wanted = vnc_frames_wanted(server);
+    if (!wanted) {
+        server->shadow_valid = 0;
+        mutex_unlock(server->mutex);
+        return;
+    }
+    /* A hidden window skipped this frame; joins wait for the next one */
+    if (system->hidden) {
+        mutex_unlock(server->mutex);
+        return;
+    }
+
+    if (!renderer_read_pixels(system->renderer, &pixels, &width, &height, &stride)) {
+        if (!server->readback_failed) {
+            fprintf(stderr, "VNC: this graphics backend cannot read the window back\n");
+        }
+        server->readback_failed = 1;
+        for (c = 0; c < VNC_MAX_CLIENTS; c++) {
+            if (server->clients[c].state == VNC_CLIENT_READY) server->clients[c].dropped = 1;
+        }
+        queued = 1;
+        goto done;
+    }
+
+    if (!server->shadow_valid || width != server->shadow_width || height != server->shadow_height) {
+        size_t needed = (size_t)width * height;
+        int resized = server->shadow_valid;
+
+        if (needed > server->shadow_capacity) {
+            uint32_t *grown = realloc(server->shadow, needed * sizeof(uint32_t));
+            if (!grown) goto done;
+            server->shadow = grown;
+            server->shadow_capacity = needed;
+        }
+        server->shadow_width = width;
+        server->shadow_height = height;
+        for (y = 0; y < height; y++) {
+            memcpy(server->shadow + (size_t)y * width, pixels + (size_t)y * stride, sizeof(uint32_t) * width);
+        }
+        server->shadow_valid = 1;
+
+        if (resized) {
+            vnc_op_t all;
+            memset(&all, 0, sizeof(all));
+            all.rect.w = width;
+            all.rect.h = height;
+            queued |= vnc_publish_shared(server, pixels, stride, &all, 1, 1);
+        }
+    } else if (system->frame_serial != server->last_serial) {
+        vnc_find_damage(server, system, pixels, stride);
+        if (server->op_count > 0) {
+            queued |= vnc_publish_shared(server, pixels, stride, server->ops, server->op_count, 0);
+        }
+    }
+    server->last_serial = system->frame_serial;
+    server->last_scroll_y = system->scroll_y;
+
+    for (c = 0; c < VNC_MAX_CLIENTS; c++) {
+        vnc_client_t *client = &server->clients[c];
+        if (client->state != VNC_CLIENT_READY || client->dropped) continue;
+        if (client->join || client->refresh) {
+            queued |= vnc_publish_private(server, client, pixels, stride);
+            client->join = 0;
+            client->refresh = 0;
+        }
+    }
+
+done:
+    mutex_unlock(server->mutex);
+    if (queued) {
+        char wake = 1;
+        if (write(server->wake_fd[1], &wake, 1) < 0) {
+            /* Pipe full, the thread is awake anyway */
+        }
+    }
+}
+
+/* VNC thread */
+
+static void vnc_client_close(vnc_server_t *server, vnc_client_t *client) {
+    mutex_lock(server->mutex);
+    vnc_client_detach(server, client, 0);
+    client->state = VNC_CLIENT_FREE;
+    client->dropped = 0;
+    mutex_unlock(server->mutex);
+
+    if (client->fd >= 0) {
+        close(client->fd);
+    }
+    client->fd = -1;
+    free(client->out.data);
+    memset(&client->out, 0, sizeof(client->out));
+}
+
+static void vnc_client_set_state(vnc_server_t *server, vnc_client_t *client, vnc_client_state_t state) {
+    mutex_lock(server->mutex);
+    client->state = state;
+    mutex_unlock(server->mutex);
+}
+
+static void vnc_send_server_init(vnc_server_t *server, vnc_client_t *client, int32_t width, int32_t height) {
+    static const char name[] = "plottool";
+
+    vnc_put16(&client->out, width);
+    vnc_put16(&client->out, height);
+    vnc_format_put(&client->out, &vnc_native_format);
+    vnc_put32(&client->out, sizeof(name) - 1);
+    vnc_put(&client->out, name, sizeof(name) - 1);
+
+    mutex_lock(server->mutex);
+    client->format = vnc_native_format;
+    client->caps = 0;
+    client->width = width;
+    client->height = height;
+    client->state = VNC_CLIENT_READY;
+    mutex_unlock(server->mutex);
+}
+
+/* Pixel format or encodings changed, start over with a full frame */
+static void vnc_client_reattach(vnc_server_t *server, vnc_client_t *client, const vnc_format_t *format, int caps) {
+    mutex_lock(server->mutex);
+    vnc_client_detach(server, client, 1);
+    client->format = *format;
+    client->caps = caps;
+    client->join = client->wants_updates;
+    mutex_unlock(server->mutex);
+}
+
+/* Returns bytes consumed, 0 when a message is incomplete, -1 to close */
+static int vnc_client_message(vnc_server_t *server, vnc_client_t *client, const uint8_t *data, size_t size) {
+    vnc_format_t format;
+    uint32_t count, i;
+    int caps = 0;
+
+    switch (data[0]) {
+        case 0: /* SetPixelFormat */
+            if (size < 20) return 0;
+            vnc_format_parse(&format, data + 4);
+            if (!vnc_format_usable(&format)) return -1;
+            mutex_lock(server->mutex);
+            caps = client->caps;
+            mutex_unlock(server->mutex);
+            vnc_client_reattach(server, client, &format, caps);
+            return 20;
+
+        case 2: /* SetEncodings */
+            if (size < 4) return 0;
+            count = (data[2] << 8) | data[3];
+            if (4 + count * 4 > VNC_IN_MAX) return -1;
+            if (size < 4 + count * 4) return 0;
+            for (i = 0; i < count; i++) {
+                const uint8_t *e = data + 4 + i * 4;
+                int32_t encoding = (int32_t)(((uint32_t)e[0] << 24) | (e[1] << 16) | (e[2] << 8) | e[3]);
+                if (encoding == VNC_ENC_COPYRECT) caps |= VNC_CAN_COPYRECT;
+                if (encoding == VNC_ENC_ZRLE) caps |= VNC_CAN_ZRLE;
+                if (encoding == VNC_ENC_DESKTOP_SIZE) caps |= VNC_CAN_DESKTOP_SIZE;
+            }
+            mutex_lock(server->mutex);
+            format = client->format;
+            mutex_unlock(server->mutex);
+            vnc_client_reattach(server, client, &format, caps);
+            return 4 + count * 4;
+
+        case 3: /* FramebufferUpdateRequest, always for the whole screen */
+            if (size < 10) return 0;
+            mutex_lock(server->mutex);
+            if (!client->encoder) {
+                client->join = 1;
+            } else if (!data[1]) {
+                client->refresh = 1;
+            }
+            mutex_unlock(server->mutex);
+            client->wants_updates = 1;
+            client->requested = 1;
+            return 10;
+
+        case 4: /* KeyEvent, view only */
+            return size < 8 ? 0 : 8;
+
+        case 5: /* PointerEvent */
+            return size < 6 ? 0 : 6;
+
+        case 6: /* ClientCutText */
+            if (size < 8) return 0;
+            client->skip = ((uint32_t)data[4] << 24) | (data[5] << 16) | (data[6] << 8) | data[7];
+            return 8;
+
+        default:
+            return -1;
+    }
+}
+
+static void vnc_client_process(vnc_server_t *server, vnc_client_t *client) {
+    size_t used = 0;
+
+    while (client->fd >= 0 && used < client->in_size) {
+        const uint8_t *data = client->in + used;
+        size_t size = client->in_size - used;
+        int n = 0;
+
+        if (client->skip > 0) {
+            size_t skipped = client->skip < size ? client->skip : size;
+            client->skip -= skipped;
+            used += skipped;
+            continue;
+        }
+
+        if (client->state == VNC_CLIENT_VERSION) {
+            int major, minor;
+            if (size < 12) break;
+            if (memcmp(data, "RFB ", 4) != 0 || sscanf((const char*)data + 4, "%3d.%3d", &major, &minor) != 2 ||
+                major != 3) {
+                n = -1;
+            } else {
+                client->minor_version = minor >= 8 ? 8 : minor == 7 ? 7 : 3;
+                if (client->minor_version == 3) {
+                    vnc_put32(&client->out, 1);
+                    vnc_client_set_state(server, client, VNC_CLIENT_INIT);
+                } else {
+                    vnc_put8(&client->out, 1);
+                    vnc_put8(&client->out, 1);
+                    vnc_client_set_state(server, client, VNC_CLIENT_SECURITY);
+                }
+                n = 12;
+            }
+        } else if (client->state == VNC_CLIENT_SECURITY) {
+            if (data[0] != 1) {
+                n = -1;
+            } else {
+                if (client->minor_version == 8) vnc_put32(&client->out, 0);
+                vnc_client_set_state(server, client, VNC_CLIENT_INIT);
+                n = 1;
+            }
+        } else if (client->state == VNC_CLIENT_INIT) {
+            int32_t width, height;
+            mutex_lock(server->mutex);
+            width = server->width;
+            height = server->height;
+            if (server->readback_failed) width = -1;
+            mutex_unlock(server->mutex);
+
+            if (width < 0) {
+                n = -1;
+            } else if (width == 0 || height == 0) {
+                break;  /* nothing rendered yet, try again later */
+            } else {
+                vnc_send_server_init(server, client, width, height);
+                n = 1;
+            }
+        } else {
+            n = vnc_client_message(server, client, data, size);
+        }
+
+        if (n < 0) {
+            vnc_client_close(server, client);
+            return;
+        }
+        if (n == 0) break;
+        used += n;
+    }
+
+    if (used > 0 && client->fd >= 0) {
+        memmove(client->in, client->in + used, client->in_size - used);
+        client->in_size -= used;
+    }
+}
+
+static void vnc_client_read(vnc_server_t *server, vnc_client_t *client) {
+    ssize_t n = recv(client->fd, client->in + client->in_size, VNC_IN_MAX - client->in_size, 0);
+
+    if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+        vnc_client_close(server, client);
+        return;
+    }
+    if (n > 0) {
+        client->in_size += n;
+        client->last_activity_ms = platform_get_time_ms();
+        vnc_client_process(server, client);
+    }
+}
+
+/* Queued updates go out one per request; a viewer asks for the next one as
+ * soon as it has drawn the last, which paces slow links on their own. */
+static void vnc_client_write(vnc_server_t *server, vnc_client_t *client) {
+    int result = net_send(client->fd, client->out.data, client->out.size, &client->out_sent);
+
+    if (result < 0) vnc_client_close(server, client);
+    if (result <= 0) return;
+    client->out.size = 0;
+    client->out_sent = 0;
+
+    for (;;) {
+        vnc_blob_t *blob = NULL;
+
+        mutex_lock(server->mutex);
+        if (client->queue_count > 0 && (client->blob_sent > 0 || client->requested)) {
+            blob = client->queue[client->queue_head];
+        }
+        mutex_unlock(server->mutex);
+        if (!blob) return;
+
+        result = net_send(client->fd, blob->data, blob->size, &client->blob_sent);
+        if (client->blob_sent > 0) client->requested = 0;
+        if (result < 0) vnc_client_close(server, client);
+        if (result <= 0) return;
+
+        mutex_lock(server->mutex);
+        client->queue_head = (client->queue_head + 1) % VNC_QUEUE_MAX;
+        client->queue_count--;
+        client->queue_bytes -= blob->size;
+        vnc_blob_release(blob);
+        mutex_unlock(server->mutex);
+        client->blob_sent = 0;
+    }
+}
+
+static int vnc_client_has_output(vnc_server_t *server, vnc_client_t *client) {
+    int pending;
+
+    if (client->out_sent < client->out.size) return 1;
+    mutex_lock(server->mutex);
+    pending = client->queue_count > 0 && (client->blob_sent > 0 || client->requested);
+    mutex_unlock(server->mutex);
+    return pending;
+}
+
+static void vnc_accept(vnc_server_t *server) {
+    static const char version[] = "RFB 003.008\n";
+
+    int fd, i;
+
+    while ((fd = net_accept(server->listen_fd)) >= 0) {
+        for (i = 0; i < VNC_MAX_CLIENTS; i++) {
+            if (server->clients[i].state == VNC_CLIENT_FREE && server->clients[i].fd < 0) break;
+        }
+        if (i == VNC_MAX_CLIENTS) {
+            close(fd);
+            continue;
+        }
+
+        vnc_client_t *client = &server->clients[i];
+        mutex_lock(server->mutex);
+        memset(client, 0, sizeof(*client));
+        client->fd = fd;
+        client->state = VNC_CLIENT_VERSION;
+        mutex_unlock(server->mutex);
+
+        client->last_activity_ms = platform_get_time_ms();
+        vnc_put(&client->out, version, sizeof(version) - 1);
+    }
+}
+
+static void vnc_server_thread(void *arg) {
+    vnc_server_t *server = (vnc_server_t*)arg;
+    struct pollfd fds[VNC_MAX_CLIENTS + 2];
+    int slot[VNC_MAX_CLIENTS + 2];
+
+    while (server->running) {
+        int nfds = 2, i;
+        uint32_t now;
+
+        fds[0].fd = server->listen_fd;
+        fds[0].events = POLLIN;
+        fds[0].revents = 0;
+        fds[1].fd = server->wake_fd[0];
+        fds[1].events = POLLIN;
+        fds[1].revents = 0;
+
+        for (i = 0; i < VNC_MAX_CLIENTS; i++) {
+            vnc_client_t *client = &server->clients[i];
+            if (client->fd < 0) continue;
+
+            fds[nfds].fd = client->fd;
+            fds[nfds].events = POLLIN | (vnc_client_has_output(server, client) ? POLLOUT : 0);
+            fds[nfds].revents = 0;
+            slot[nfds] = i;
+            nfds++;
+        }
+
+        if (poll(fds, nfds, VNC_POLL_MS) < 0 && errno != EINTR) {
+            break;
+        }
+
+        if (fds[0].revents & POLLIN) {
+            vnc_accept(server);
+        }
+        if (fds[1].revents & POLLIN) {
+            char drain[64];
+            while (read(server->wake_fd[0], drain, sizeof(drain)) > 0);
+        }
+
+        for (i = 2; i < nfds; i++) {
+            vnc_client_t *client = &server->clients[slot[i]];
+            if (client->fd != fds[i].fd) continue;
+
+            if (fds[i].revents & (POLLERR | POLLNVAL)) {
+                vnc_client_close(server, client);
+                continue;
+            }
+            if (fds[i].revents & (POLLIN | POLLHUP)) {
+                vnc_client_read(server, client);
+            }
+        }
+
+        now = platform_get_time_ms();
+        for (i = 0; i < VNC_MAX_CLIENTS; i++) {
+            vnc_client_t *client = &server->clients[i];
+            int dropped;
+
+            if (client->fd < 0) continue;
+
+            mutex_lock(server->mutex);
+            dropped = client->dropped;
+            mutex_unlock(server->mutex);
+
+            if (dropped) {
+                vnc_client_close(server, client);
+            } else if (client->state != VNC_CLIENT_READY &&
+                       now - client->last_activity_ms >= VNC_HANDSHAKE_TIMEOUT_MS) {
+                vnc_client_close(server, client);
+            } else {
+                if (client->state == VNC_CLIENT_INIT && client->in_size > 0) {
+                    vnc_client_process(server, client);
+                }
+                if (client->fd >= 0 && vnc_client_has_output(server, client)) {
+                    vnc_client_write(server, client);
+                }
+            }
+        }
+    }
+}
+
+vnc_server_t *vnc_server_create(plot_system_t *system, const char *bind_address, int32_t port) {
+    int i;
+
+    if (!system || port <= 0) return NULL;
+    if (!bind_address || !*bind_address) bind_address = "127.0.0.1";
+
+    vnc_server_t *server = calloc(1, sizeof(vnc_server_t));
+    if (!server) return NULL;
+
+    server->wake_fd[0] = server->wake_fd[1] = -1;
+    for (i = 0; i < VNC_MAX_CLIENTS; i++) {
+        server->clients[i].fd = -1;
+    }
+
+    server->mutex = mutex_create();
+    server->listen_fd = net_listen(bind_address, port);
+    if (server->listen_fd < 0) {
+        fprintf(stderr, "VNC: cannot listen on %s:%d\n", bind_address, port);
+    }
+
+    if (server->listen_fd < 0 || !server->mutex || pipe(server->wake_fd) != 0) {
+        if (server->listen_fd >= 0) close(server->listen_fd);
+        if (server->wake_fd[0] >= 0) close(server->wake_fd[0]);
+        if (server->wake_fd[1] >= 0) close(server->wake_fd[1]);
+        mutex_destroy(server->mutex);
+        free(server);
+        return NULL;
+    }
+    fcntl(server->wake_fd[0], F_SETFL, fcntl(server->wake_fd[0], F_GETFL, 0) | O_NONBLOCK);
+    fcntl(server->wake_fd[1], F_SETFL, fcntl(server->wake_fd[1], F_GETFL, 0) | O_NONBLOCK);
+
+    net_ignore_sigpipe();
+
+    server->running = 1;
+    server->thread = plot_thread_create(vnc_server_thread, server);
+    if (!server->thread) {
+        server->running = 0;
+        vnc_server_destroy(server);
+        return NULL;
+    }
+
+    return server;
+}
+
+void vnc_server_destroy(vnc_server_t *server) {
+    uint32_t i;
+    if (!server) return;
+
+    if (server->thread) {
+        server->running = 0;
+        plot_thread_join(server->thread);
+        plot_thread_destroy(server->thread);
+    }
+
+    for (i = 0; i < VNC_MAX_CLIENTS; i++) {
+        if (server->clients[i].fd >= 0) {
+            vnc_client_close(server, &server->clients[i]);
+        }
+    }
+
+    close(server->listen_fd);
+    close(server->wake_fd[0]);
+    close(server->wake_fd[1]);
+    mutex_destroy(server->mutex);
+    free(server->shadow);
+    free(server->ops);
+    free(server->tiles);
+    free(server->zrle.data);
+    free(server->message.data);
+    free(server);
+}
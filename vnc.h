@@ -0,0 +1,21 @@
+#ifndef VNC_H
+#define VNC_H
+
+#include "compat.h"
+#include "plot.h"
+
+/* Built-in RFB (VNC) server, view only and without authentication.
+ * After every frame the render thread compares the plots that were redrawn
+ * with what the viewers already have and encodes the difference once per
+ * pixel format: CopyRect for plots that scrolled by one column, then ZRLE
+ * or Raw for the tiles that still differ. Every viewer using that format
+ * is sent the same bytes. One thread does the socket I/O. */
+
+typedef struct vnc_server vnc_server_t;
+
+vnc_server_t *vnc_server_create(plot_system_t *system, const char *bind_address, int32_t port);
+void vnc_server_destroy(vnc_server_t *server);
+void vnc_server_publish(vnc_server_t *server, plot_system_t *system);
+int vnc_server_wants_frames(vnc_server_t *server);
+
+#endif
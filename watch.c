@@ -0,0 +1,120 @@
+#include "compat.h"
+#include "watch.h"
+#include "platform.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#ifdef __linux__
+#include <fcntl.h>
+#include <sys/inotify.h>
+#endif
+
+#define WATCH_POLL_MS 1000  /* stat interval without inotify */
+
+struct file_watch {
+    char *path;
+    const char *name;   /* the file name within path */
+    int fd;             /* inotify, -1 when polling */
+    time_t mtime;
+    off_t size;
+    uint32_t checked_ms;
+};
+
+static void file_watch_stat(file_watch_t *watch) {
+    struct stat st;
+
+    if (stat(watch->path, &st) != 0) return;
+    watch->mtime = st.st_mtime;
+    watch->size = st.st_size;
+}
+
+file_watch_t *file_watch_create(const char *path) {
+    file_watch_t *watch;
+    char *slash;
+
+    if (!path) return NULL;
+
+    watch = calloc(1, sizeof(file_watch_t));
+    if (!watch) return NULL;
+
+    watch->path = malloc(strlen(path) + 1);
+    if (!watch->path) {
+        free(watch);
+        return NULL;
+    }
+    strcpy(watch->path, path);
+    slash = strrchr(watch->path, '/');
+    watch->name = slash ? slash + 1 : watch->path;
+    watch->fd = -1;
+    file_watch_stat(watch);
+    watch->checked_ms = platform_get_time_ms();
+
+#ifdef __linux__
+    watch->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (watch->fd >= 0) {
+        char *dir = slash ? watch->path : ".";
+        int added;
+
+        /* The directory, as a rename over the file replaces its inode */
+        if (slash) *slash = '\0';
+        added = inotify_add_watch(watch->fd, slash == watch->path ? "/" : dir,
+                                  IN_CLOSE_WRITE | IN_MOVED_TO);
+        if (slash) *slash = '/';
+        if (added < 0) {
+            close(watch->fd);
+            watch->fd = -1;
+        }
+    }
+#endif
+
+    return watch;
+}
+
+void file_watch_destroy(file_watch_t *watch) {
+    if (!watch) return;
+
+    if (watch->fd >= 0) close(watch->fd);
+    free(watch->path);
+    free(watch);
+}
+
+/* 1 once per write or replace of the file, a save of several writes may
+ * give more than one */
+int file_watch_changed(file_watch_t *watch) {
+    time_t mtime;
+    off_t size;
+    uint32_t now;
+
+    if (!watch) return 0;
+
+#ifdef __linux__
+    if (watch->fd >= 0) {
+        char buffer[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+        int changed = 0;
+        ssize_t n;
+
+        while ((n = read(watch->fd, buffer, sizeof(buffer))) > 0) {
+            char *at = buffer;
+
+            while (at < buffer + n) {
+                struct inotify_event *event = (struct inotify_event*)at;
+                if (event->len > 0 && strcmp(event->name, watch->name) == 0) changed = 1;
+                at += sizeof(struct inotify_event) + event->len;
+            }
+        }
+        return changed;
+    }
+#endif
+
+    now = platform_get_time_ms();
+    if (now - watch->checked_ms < WATCH_POLL_MS) return 0;
+    watch->checked_ms = now;
+
+    mtime = watch->mtime;
+    size = watch->size;
+    file_watch_stat(watch);
+    return watch->mtime != mtime || watch->size != size;
+}
@@ -0,0 +1,17 @@
+#ifndef WATCH_H
+#define WATCH_H
+
+#include "compat.h"
+
+/* Tells when a file was written or replaced, for the config reload. On
+ * Linux inotify on its directory, so editors that save by renaming a new
+ * file over the old one are caught, elsewhere its mtime and size are
+ * compared. Checks never block. */
+
+typedef struct file_watch file_watch_t;
+
+file_watch_t *file_watch_create(const char *path);
+void file_watch_destroy(file_watch_t *watch);
+int file_watch_changed(file_watch_t *watch);
+
+#endif